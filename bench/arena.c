@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netconfd/arena.h"
+
+#include "microbench.h"
+
+/*
+ * Scratch allocations of one <get-config> RPC ending in an rpc-error: node
+ * names and contents, the error body and the reply chunk header. The malloc
+ * variant mirrors the old code path where roxml tracked every string in its
+ * release pool (one cell plus one string each) and netconf_rpc_error() used
+ * two asprintf() calls.
+ */
+static const char *rpc_strings[] =
+{
+	"rpc", "urn:ietf:params:xml:ns:netconf:base:1.0", "message-id", "101",
+	"get-config", "source", "running", "filter", "type", "subtree",
+	"xmlns", "urn:ietf:params:xml:ns:netconf:base:1.0", "interfaces",
+	"interface", "name", "eth0",
+};
+
+#define RPC_STRING_COUNT (sizeof(rpc_strings) / sizeof(*rpc_strings))
+
+#define RPC_ERROR_BODY \
+	"<error-type>%s</error-type><error-tag>%s</error-tag>" \
+	"<error-severity>%s</error-severity><error-message xml:lang=\"en\">%s</error-message>%s"
+
+struct pool_cell
+{
+	void *ptr;
+	struct pool_cell *next;
+};
+
+static void *setup_malloc(size_t size)
+{
+	/* nothing to keep between runs, any non-NULL fixture will do */
+	return (void *) rpc_strings;
+}
+
+static void run_malloc(void *fixture)
+{
+	struct pool_cell *pool = NULL, *cell;
+	char *app_tag = NULL, *error = NULL, *header = NULL;
+	int i;
+
+	for (i = 0; i < RPC_STRING_COUNT; i++)
+	{
+		cell = malloc(sizeof(*cell));
+		cell->ptr = strdup(rpc_strings[i]);
+		cell->next = pool;
+		pool = cell;
+	}
+
+	if (asprintf(&app_tag, "<error-app-tag>%s</error-app-tag>", "bench") < 0)
+		app_tag = NULL;
+
+	if (asprintf(&error, RPC_ERROR_BODY, "rpc", "operation-failed", "error", "method not supported", app_tag ? app_tag : "") < 0)
+		error = NULL;
+
+	if (asprintf(&header, "\n#%zu\n", error ? strlen(error) : 0) < 0)
+		header = NULL;
+
+	bench_use(error);
+	bench_use(header);
+
+	free(app_tag);
+	free(error);
+	free(header);
+
+	while (pool)
+	{
+		cell = pool->next;
+		free(pool->ptr);
+		free(pool);
+		pool = cell;
+	}
+}
+
+static void *setup_arena(size_t size)
+{
+	struct arena *a = malloc(sizeof(*a));
+
+	if (a)
+		arena_init(a, 0);
+
+	return a;
+}
+
+static void run_arena(void *fixture)
+{
+	struct arena *a = fixture;
+	char *error, *header;
+	int i;
+
+	for (i = 0; i < RPC_STRING_COUNT; i++)
+		bench_use(arena_strdup(a, rpc_strings[i]));
+
+	error = arena_printf(a, RPC_ERROR_BODY "%s%s", "rpc", "operation-failed", "error", "method not supported",
+			"<error-app-tag>", "bench", "</error-app-tag>");
+	header = arena_printf(a, "\n#%zu\n", strlen(error));
+
+	bench_use(header);
+
+	arena_reset(a);
+}
+
+static void teardown_arena(void *fixture)
+{
+	arena_free(fixture);
+	free(fixture);
+}
+
+static const struct bench_case cases[] =
+{
+	{ "rpc-scratch/malloc", setup_malloc, run_malloc, NULL, 0 },
+	{ "rpc-scratch/arena", setup_arena, run_arena, teardown_arena, 0 },
+};
+
+const struct bench_suite bench_arena = BENCH_SUITE("arena", cases);
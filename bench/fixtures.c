@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixtures.h"
+#include "../src/messages.h"
+
+/*
+ * Messages of a given size modelled on what a device exchanges: a list of
+ * ietf-interfaces entries, with counters in replies and without in
+ * edit-config. Entries repeat until the message has at least the requested
+ * size, so the element and text node ratio stays the same at every size.
+ */
+#define FIXTURE_NS_INTERFACES "urn:ietf:params:xml:ns:yang:ietf-interfaces"
+
+#define FIXTURE_ENTRY_MAX 512
+
+static char *fixture_build(const char *head, const char *tail, size_t size, int counters)
+{
+	size_t head_len = strlen(head), tail_len = strlen(tail), len = head_len, n;
+	char entry[FIXTURE_ENTRY_MAX];
+	char *buf;
+	unsigned int i = 0;
+
+	if (!(buf = malloc(size + head_len + tail_len + FIXTURE_ENTRY_MAX + 1)))
+		return NULL;
+
+	memcpy(buf, head, head_len);
+
+	while (len + tail_len < size)
+	{
+		if (counters)
+			n = snprintf(entry, sizeof(entry),
+					"<interface><name>eth%u</name>"
+					"<type xmlns:ianaift=\"urn:ietf:params:xml:ns:yang:iana-if-type\">ianaift:ethernetCsmacd</type>"
+					"<enabled>true</enabled><statistics><in-octets>%u</in-octets>"
+					"<out-octets>%u</out-octets></statistics></interface>",
+					i, i * 1500 + 64, i * 1200 + 64);
+		else
+			n = snprintf(entry, sizeof(entry),
+					"<interface><name>eth%u</name><description>uplink %u</description>"
+					"<enabled>true</enabled></interface>",
+					i, i);
+
+		memcpy(buf + len, entry, n);
+		len += n;
+		i++;
+	}
+
+	memcpy(buf + len, tail, tail_len + 1);
+
+	return buf;
+}
+
+/* get reply of at least size bytes */
+char *fixture_reply(size_t size)
+{
+	return fixture_build(
+			"<rpc-reply xmlns=\"" FIXTURE_NS_BASE "\" message-id=\"101\"><data>"
+			"<interfaces xmlns=\"" FIXTURE_NS_INTERFACES "\">",
+			"</interfaces></data></rpc-reply>",
+			size, 1);
+}
+
+/* edit-config request of at least size bytes */
+char *fixture_edit_config(size_t size)
+{
+	return fixture_build(
+			"<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+			"<rpc message-id=\"101\" xmlns=\"" FIXTURE_NS_BASE "\"><edit-config>"
+			"<target><running/></target><config>"
+			"<interfaces xmlns=\"" FIXTURE_NS_INTERFACES "\">",
+			"</interfaces></config></edit-config></rpc>",
+			size, 0);
+}
+
+/*
+ * fixture_frame() - message as it comes off the wire
+ *
+ * @int:		0 for end-of-message framing, 1 for one chunk
+ * @const char*:	message
+ * @size_t*:		set to the length of the framed message
+ */
+char *fixture_frame(int base, const char *msg, size_t *len)
+{
+	size_t msg_len = strlen(msg);
+	char header[32] = "";
+	const char *trailer = base ? XML_NETCONF_BASE_1_1_END : XML_NETCONF_BASE_1_0_END;
+	char *buf;
+
+	if (base)
+		snprintf(header, sizeof(header), "\n#%zu\n", msg_len);
+
+	*len = strlen(header) + msg_len + strlen(trailer);
+
+	if (!(buf = malloc(*len + 1)))
+		return NULL;
+
+	snprintf(buf, *len + 1, "%s%s%s", header, msg, trailer);
+
+	return buf;
+}
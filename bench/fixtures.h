@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_BENCH_FIXTURES_H__
+#define __FREENETCONFD_BENCH_FIXTURES_H__
+
+#include <stddef.h>
+
+#define FIXTURE_NS_BASE "urn:ietf:params:xml:ns:netconf:base:1.0"
+
+/* what clients send first, base:1.1 capable */
+#define FIXTURE_HELLO \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<hello xmlns=\"" FIXTURE_NS_BASE "\"><capabilities>" \
+	"<capability>urn:ietf:params:netconf:base:1.0</capability>" \
+	"<capability>urn:ietf:params:netconf:base:1.1</capability>" \
+	"<capability>urn:ietf:params:netconf:capability:writable-running:1.0</capability>" \
+	"<capability>urn:ietf:params:netconf:capability:notification:1.0</capability>" \
+	"</capabilities></hello>"
+
+/* smallest request there is, about 200 bytes once framed */
+#define FIXTURE_CLOSE_SESSION \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<rpc message-id=\"101\" xmlns=\"" FIXTURE_NS_BASE "\"><close-session/></rpc>"
+
+/* state read spliced in as text */
+#define FIXTURE_GET_MONITORING \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<rpc message-id=\"101\" xmlns=\"" FIXTURE_NS_BASE "\"><get><filter type=\"subtree\">" \
+	"<netconf-state xmlns=\"urn:ietf:params:xml:ns:yang:ietf-netconf-monitoring\"><capabilities/></netconf-state>" \
+	"</filter></get></rpc>"
+
+/* configuration poll as controllers send it */
+#define FIXTURE_GET_CONFIG \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<rpc message-id=\"101\" xmlns=\"" FIXTURE_NS_BASE "\"><get-config>" \
+	"<source><running/></source></get-config></rpc>"
+
+#define FIXTURE_UNSUPPORTED \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<rpc message-id=\"101\" xmlns=\"" FIXTURE_NS_BASE "\"><commit/></rpc>"
+
+char *fixture_reply(size_t size);
+char *fixture_edit_config(size_t size);
+char *fixture_frame(int base, const char *msg, size_t *len);
+
+#endif /* __FREENETCONFD_BENCH_FIXTURES_H__ */
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "microbench.h"
+#include "fixtures.h"
+#include "../src/framing.h"
+
+/*
+ * Decoding of received data as connection_run() does it, from a 200 byte
+ * close-session to a 50 MB reply. "whole" hands over the message in one
+ * piece, the in place path. "reads" hands it over in pieces of
+ * FRAMING_READ_SIZE as when it trickles in from the socket, the assembly
+ * path.
+ */
+#define FRAMING_READ_SIZE 4096
+
+struct framing_fixture
+{
+	struct framing f;
+	char *wire;
+	size_t len;
+	size_t read_size;
+	/* byte the in place path overwrites with the terminating NUL */
+	size_t restore_at;
+	char restore;
+};
+
+static void *setup_decode(int base, size_t size, size_t read_size)
+{
+	struct framing_fixture *ff = calloc(1, sizeof(*ff));
+	char *msg = size <= strlen(FIXTURE_CLOSE_SESSION) ? strdup(FIXTURE_CLOSE_SESSION) : fixture_reply(size);
+
+	if (!ff || !msg || !(ff->wire = fixture_frame(base, msg, &ff->len)))
+	{
+		free(msg);
+		free(ff);
+		return NULL;
+	}
+
+	framing_init(&ff->f, base);
+	ff->f.max_size = ff->len;
+	ff->read_size = read_size ? read_size : ff->len;
+	ff->restore_at = ff->len - (base ? strlen("\n##\n") : strlen("]]>]]>"));
+	ff->restore = ff->wire[ff->restore_at];
+
+	free(msg);
+
+	return ff;
+}
+
+static void *setup_decode_1_0(size_t size)
+{
+	return setup_decode(0, size, 0);
+}
+
+static void *setup_decode_1_0_reads(size_t size)
+{
+	return setup_decode(0, size, FRAMING_READ_SIZE);
+}
+
+static void *setup_decode_1_1(size_t size)
+{
+	return setup_decode(1, size, 0);
+}
+
+static void *setup_decode_1_1_reads(size_t size)
+{
+	return setup_decode(1, size, FRAMING_READ_SIZE);
+}
+
+static void run_decode(void *fixture)
+{
+	struct framing_fixture *ff = fixture;
+	size_t off = 0, n;
+	char *msg = NULL;
+	size_t msg_len;
+	int len;
+
+	while (off < ff->len)
+	{
+		n = ff->len - off < ff->read_size ? ff->len - off : ff->read_size;
+		len = framing_decode(&ff->f, ff->wire + off, n, &msg, &msg_len);
+
+		if (len <= 0)
+			abort();
+
+		off += len;
+	}
+
+	if (!msg)
+		abort();
+
+	bench_use(msg);
+
+	ff->wire[ff->restore_at] = ff->restore;
+}
+
+static void teardown_decode(void *fixture)
+{
+	struct framing_fixture *ff = fixture;
+
+	framing_free(&ff->f);
+	free(ff->wire);
+	free(ff);
+}
+
+/* chunk header and trailer around every reply sent */
+static void run_header(void *fixture)
+{
+	char header[32];
+
+	bench_use(framing_trailer(1));
+
+	if (framing_header(1, (size_t) fixture, header, sizeof(header)) <= 0)
+		abort();
+
+	bench_use(header);
+}
+
+static void *setup_header(size_t size)
+{
+	return (void *) size;
+}
+
+#define DECODE_CASES(_name, _setup) \
+	{ _name, _setup, run_decode, teardown_decode, 200 }, \
+	{ _name, _setup, run_decode, teardown_decode, 4096 }, \
+	{ _name, _setup, run_decode, teardown_decode, 65536 }, \
+	{ _name, _setup, run_decode, teardown_decode, 1048576 }, \
+	{ _name, _setup, run_decode, teardown_decode, 52428800 }
+
+static const struct bench_case cases[] =
+{
+	DECODE_CASES("decode/1.0/whole", setup_decode_1_0),
+	DECODE_CASES("decode/1.0/reads", setup_decode_1_0_reads),
+	DECODE_CASES("decode/1.1/whole", setup_decode_1_1),
+	DECODE_CASES("decode/1.1/reads", setup_decode_1_1_reads),
+	{ "header/1.1", setup_header, run_header, NULL, 52428800 },
+};
+
+const struct bench_suite bench_framing = BENCH_SUITE("framing", cases);
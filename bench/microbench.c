@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "microbench.h"
+
+extern const struct bench_suite bench_arena;
+extern const struct bench_suite bench_framing;
+extern const struct bench_suite bench_rpc;
+
+static const struct bench_suite *suites[] =
+{
+	&bench_arena,
+	&bench_framing,
+	&bench_rpc,
+};
+
+/*
+ * glibc lets programs replace malloc, calls from shared libraries included,
+ * so counting here covers roxml and libc internals as well.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+static bool counting = false;
+static uint64_t alloc_count = 0;
+static uint64_t alloc_bytes = 0;
+
+void *malloc(size_t size)
+{
+	if (counting)
+	{
+		alloc_count++;
+		alloc_bytes += size;
+	}
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	if (counting)
+	{
+		alloc_count++;
+		alloc_bytes += n * size;
+	}
+
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	if (counting)
+	{
+		alloc_count++;
+		alloc_bytes += size;
+	}
+
+	return __libc_realloc(p, size);
+}
+
+void free(void *p)
+{
+	__libc_free(p);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_run_case(const struct bench_suite *suite, const struct bench_case *bc, uint64_t min_ns)
+{
+	uint64_t iterations = 1, i, start, elapsed;
+	void *fixture = NULL;
+
+	if (bc->setup && !(fixture = bc->setup(bc->size)))
+	{
+		fprintf(stderr, "%s/%s: setup failed\n", suite->name, bc->name);
+		return;
+	}
+
+	/* warm up and find an iteration count that runs for at least min_ns */
+	while (1)
+	{
+		start = now_ns();
+
+		for (i = 0; i < iterations; i++)
+			bc->run(fixture);
+
+		elapsed = now_ns() - start;
+
+		if (elapsed >= min_ns || iterations >= (1ULL << 40))
+			break;
+
+		if (elapsed < min_ns / 100)
+			iterations *= 100;
+		else
+			iterations = iterations * min_ns / elapsed + 1;
+	}
+
+	alloc_count = 0;
+	alloc_bytes = 0;
+	counting = true;
+
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++)
+		bc->run(fixture);
+
+	elapsed = now_ns() - start;
+
+	counting = false;
+
+	printf("%-12s %-36s %10zu %12llu %14.1f %12.1f %10.2f\n",
+			suite->name, bc->name, bc->size,
+			(unsigned long long) iterations,
+			(double) elapsed / iterations,
+			(double) alloc_bytes / iterations,
+			(double) alloc_count / iterations);
+
+	if (bc->teardown)
+		bc->teardown(fixture);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t min_ms] [filter]\n", name);
+}
+
+/*
+ * netconfd-microbench [-t min_ms] [filter]
+ *
+ * Runs every case whose "suite/case" name contains filter and prints one
+ * line per case with iterations, ns/op, bytes/op and allocs/op.
+ */
+int main(int argc, char **argv)
+{
+	uint64_t min_ns = 500ULL * 1000000ULL;
+	const char *filter = NULL;
+	char full[256];
+	int i, j;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			min_ns = strtoull(argv[++i], NULL, 10) * 1000000ULL;
+		else if (argv[i][0] == '-')
+		{
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		else
+			filter = argv[i];
+	}
+
+	printf("%-12s %-36s %10s %12s %14s %12s %10s\n",
+			"suite", "case", "size", "iterations", "ns/op", "bytes/op", "allocs/op");
+
+	for (i = 0; i < sizeof(suites) / sizeof(*suites); i++)
+	{
+		for (j = 0; j < suites[i]->n_cases; j++)
+		{
+			const struct bench_case *bc = &suites[i]->cases[j];
+
+			snprintf(full, sizeof(full), "%s/%s", suites[i]->name, bc->name);
+
+			if (filter && !strstr(full, filter))
+				continue;
+
+			bench_run_case(suites[i], bc, min_ns);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_MICROBENCH_H__
+#define __FREENETCONFD_MICROBENCH_H__
+
+#include <stddef.h>
+
+struct bench_case
+{
+	const char *name;
+	/* prepare fixture of given size, NULL on failure */
+	void *(*setup)(size_t size);
+	/* one operation, must leave fixture reusable */
+	void (*run)(void *fixture);
+	void (*teardown)(void *fixture);
+	size_t size;
+};
+
+struct bench_suite
+{
+	const char *name;
+	const struct bench_case *cases;
+	int n_cases;
+};
+
+#define BENCH_SUITE(_name, _cases) \
+	{ .name = _name, .cases = _cases, .n_cases = sizeof(_cases) / sizeof(*(_cases)) }
+
+/* keeps the compiler from dropping results of benchmarked code */
+static inline void bench_use(const void *p)
+{
+	__asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+#endif /* __FREENETCONFD_MICROBENCH_H__ */
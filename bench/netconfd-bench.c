@@ -0,0 +1,964 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "../src/framing.h"
+#include "../src/histogram.h"
+#include "../src/compress.h"
+
+/*
+ * netconfd-bench - closed loop load generator
+ *
+ * Every session keeps up to pipeline requests in flight and sends the next
+ * one as soon as a reply comes in. Replies arrive in request order, so the
+ * send times of a session are a plain ring. Latency is measured from
+ * queueing a request to having decoded its reply, on the monotonic clock.
+ * Results are written as one JSON object to stdout.
+ *
+ * With -z sessions offer compression in their hello, sessions the server
+ * agrees with compress what they send and inflate what they receive. The
+ * report then also holds the compression ratio each way and the time spent
+ * in zlib.
+ */
+#define BENCH_PIPELINE_MAX 64
+#define BENCH_READ_SIZE (64 * 1024)
+/* how long replies still in flight are waited for at the end, ms */
+#define BENCH_DRAIN_WAIT 5000
+
+#define NS_BASE "urn:ietf:params:xml:ns:netconf:base:1.0"
+#define NS_NOTIFICATION "urn:ietf:params:xml:ns:netconf:notification:1.0"
+
+#define BENCH_HELLO \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<hello xmlns=\"" NS_BASE "\"><capabilities>" \
+	"<capability>urn:ietf:params:netconf:base:1.0</capability>%s%s" \
+	"</capabilities></hello>]]>]]>"
+
+#define BENCH_RPC \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<rpc message-id=\"%llu\" xmlns=\"" NS_BASE "\">%s%s%s</rpc>"
+
+enum bench_op
+{
+	OP_GET,
+	OP_GET_CONFIG,
+	OP_EDIT_CONFIG,
+	OP_LOCK,
+	OP_UNLOCK,
+	OP_CREATE_SUBSCRIPTION,
+	__OP_MAX
+};
+
+static const char *op_names[__OP_MAX] =
+{
+	[OP_GET] = "get",
+	[OP_GET_CONFIG] = "get-config",
+	[OP_EDIT_CONFIG] = "edit-config",
+	[OP_LOCK] = "lock",
+	[OP_UNLOCK] = "unlock",
+	[OP_CREATE_SUBSCRIPTION] = "create-subscription",
+};
+
+enum session_state
+{
+	SESSION_HELLO,
+	SESSION_READY,
+	SESSION_DONE,
+};
+
+struct bench_session
+{
+	int fd;
+	int state;
+	struct framing framing;
+	uint64_t connected;
+	/* requests in flight, oldest first */
+	uint64_t sent[BENCH_PIPELINE_MAX];
+	int ops[BENCH_PIPELINE_MAX];
+	int first;
+	int inflight;
+	uint64_t requests;
+	bool locked;
+	bool subscribed;
+	/* unsent output */
+	char *out;
+	size_t out_len;
+	size_t out_off;
+	size_t out_size;
+	bool want_write;
+	/* set once both hellos offered compression */
+	struct compress *zlib;
+};
+
+struct bench_op_stats
+{
+	struct histogram latency;
+	uint64_t errors;
+};
+
+static struct
+{
+	const char *host;
+	const char *port;
+	const char *unix_path;
+	int sessions;
+	int base;
+	int pipeline;
+	int duration;
+	int warmup;
+	uint64_t requests;
+	int mix[__OP_MAX];
+	int mix_total;
+	char *filter;
+	char *config;
+	const char *stream;
+	/* zlib level, 0 for uncompressed sessions */
+	int compress;
+} opt =
+{
+	.host = "127.0.0.1",
+	.port = "1831",
+	.sessions = 10,
+	.base = 1,
+	.pipeline = 1,
+	.duration = 10,
+	.stream = "netconf",
+};
+
+static struct bench_session *sessions;
+static struct bench_op_stats op_stats[__OP_MAX];
+static struct histogram all_latency;
+static struct histogram hello_latency;
+static uint64_t bytes_in, bytes_out, notifications, disconnects, msg_id;
+/* compressed sessions only, message bytes before and after zlib and its time */
+static uint64_t raw_in, wire_in, raw_out, wire_out, inflate_ns, deflate_ns;
+static int compressed;
+static uint64_t measure_start;
+static bool measuring = false;
+static bool stopping = false;
+static int epfd;
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift64, the mix needs speed rather than quality */
+static uint32_t bench_random(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+
+	return rng >> 32;
+}
+
+static char *bench_read_file(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char *buf = NULL;
+	long len;
+
+	if (!f)
+		return NULL;
+
+	if (!fseek(f, 0, SEEK_END) && (len = ftell(f)) >= 0 && !fseek(f, 0, SEEK_SET) &&
+	    (buf = calloc(1, len + 1)) && fread(buf, 1, len, f) != (size_t) len)
+	{
+		free(buf);
+		buf = NULL;
+	}
+
+	fclose(f);
+
+	return buf;
+}
+
+/* "get=70,edit-config=20,lock=10", lock stands for a lock/unlock pair */
+static int bench_parse_mix(char *spec)
+{
+	char *tok, *save = NULL, *eq;
+	int i;
+
+	memset(opt.mix, 0, sizeof(opt.mix));
+
+	for (tok = strtok_r(spec, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+	{
+		if (!(eq = strchr(tok, '=')))
+			return -1;
+
+		*eq++ = '\0';
+
+		for (i = 0; i < __OP_MAX; i++)
+		{
+			if (i != OP_UNLOCK && !strcmp(tok, op_names[i]))
+				break;
+		}
+
+		if (i == __OP_MAX)
+			return -1;
+
+		opt.mix[i] = atoi(eq);
+	}
+
+	opt.mix_total = 0;
+
+	for (i = 0; i < __OP_MAX; i++)
+		opt.mix_total += opt.mix[i];
+
+	return opt.mix_total > 0 ? 0 : -1;
+}
+
+static int bench_out_reserve(struct bench_session *s, size_t len)
+{
+	size_t size;
+	char *out;
+
+	/* drop what has been written already */
+	if (s->out_off)
+	{
+		memmove(s->out, s->out + s->out_off, s->out_len - s->out_off);
+		s->out_len -= s->out_off;
+		s->out_off = 0;
+	}
+
+	if (s->out_len + len <= s->out_size)
+		return 0;
+
+	for (size = s->out_size ? s->out_size : 4096; size < s->out_len + len; size *= 2);
+
+	if (!(out = realloc(s->out, size)))
+		return -1;
+
+	s->out = out;
+	s->out_size = size;
+
+	return 0;
+}
+
+static void bench_watch(struct bench_session *s, bool write)
+{
+	struct epoll_event ev = { .events = EPOLLIN | (write ? EPOLLOUT : 0), .data.ptr = s };
+
+	if (write == s->want_write)
+		return;
+
+	s->want_write = write;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+static void bench_close(struct bench_session *s)
+{
+	if (s->state == SESSION_DONE)
+		return;
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+	close(s->fd);
+	framing_free(&s->framing);
+	compress_free(s->zlib);
+	s->zlib = NULL;
+	s->state = SESSION_DONE;
+	s->inflight = 0;
+}
+
+static void bench_flush(struct bench_session *s)
+{
+	ssize_t n;
+
+	while (s->out_off < s->out_len)
+	{
+		n = write(s->fd, s->out + s->out_off, s->out_len - s->out_off);
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				disconnects++;
+				bench_close(s);
+				return;
+			}
+
+			break;
+		}
+
+		s->out_off += n;
+		bytes_out += n;
+	}
+
+	bench_watch(s, s->out_off < s->out_len);
+}
+
+/* frame message for the session's base and queue it */
+static int bench_queue(struct bench_session *s, const char *msg, size_t len, int base)
+{
+	char header[32], *packed = NULL;
+	const char *trailer = framing_trailer(base);
+	struct iovec part = { (char *) msg, len };
+	size_t tlen = strlen(trailer);
+	uint64_t start;
+	int hlen;
+
+	if (s->zlib)
+	{
+		start = now_ns();
+
+		if (compress_deflate(s->zlib, &part, 1, &packed, &len))
+			return -1;
+
+		deflate_ns += now_ns() - start;
+		raw_out += part.iov_len;
+		wire_out += len;
+		msg = packed;
+	}
+
+	hlen = framing_header(base, len, header, sizeof(header));
+
+	if (bench_out_reserve(s, hlen + len + tlen))
+	{
+		free(packed);
+		return -1;
+	}
+
+	memcpy(s->out + s->out_len, header, hlen);
+	memcpy(s->out + s->out_len + hlen, msg, len);
+	memcpy(s->out + s->out_len + hlen + len, trailer, tlen);
+	s->out_len += hlen + len + tlen;
+	free(packed);
+
+	return 0;
+}
+
+static int bench_pick_op(struct bench_session *s)
+{
+	int i, r;
+
+	/* a lock is always followed by its unlock */
+	if (s->locked)
+		return OP_UNLOCK;
+
+	r = bench_random() % opt.mix_total;
+
+	for (i = 0; i < __OP_MAX; i++)
+	{
+		if (r < opt.mix[i])
+			break;
+
+		r -= opt.mix[i];
+	}
+
+	/* a session subscribes once, later picks fall back to get */
+	if (i == OP_CREATE_SUBSCRIPTION && s->subscribed)
+		i = OP_GET;
+
+	return i;
+}
+
+static int bench_send(struct bench_session *s)
+{
+	static char *msg = NULL, stream[128];
+	static size_t msg_size = 0;
+	const char *head = "", *payload = "", *tail = "";
+	int op = bench_pick_op(s), slot, len;
+	size_t need;
+
+	switch (op)
+	{
+		case OP_GET:
+			head = "<get>";
+			payload = opt.filter ? opt.filter : "";
+			tail = "</get>";
+			break;
+
+		case OP_GET_CONFIG:
+			head = "<get-config><source><running/></source>";
+			payload = opt.filter ? opt.filter : "";
+			tail = "</get-config>";
+			break;
+
+		case OP_EDIT_CONFIG:
+			head = "<edit-config><target><running/></target><config>";
+			payload = opt.config ? opt.config : "";
+			tail = "</config></edit-config>";
+			break;
+
+		case OP_LOCK:
+			head = "<lock><target><running/></target></lock>";
+			s->locked = true;
+			break;
+
+		case OP_UNLOCK:
+			head = "<unlock><target><running/></target></unlock>";
+			s->locked = false;
+			break;
+
+		case OP_CREATE_SUBSCRIPTION:
+			snprintf(stream, sizeof(stream), "<stream><%s/></stream>", opt.stream);
+			head = "<create-subscription xmlns=\"" NS_NOTIFICATION "\">";
+			payload = stream;
+			tail = "</create-subscription>";
+			s->subscribed = true;
+			break;
+	}
+
+	need = sizeof(BENCH_RPC) + 32 + strlen(head) + strlen(payload) + strlen(tail);
+
+	if (need > msg_size)
+	{
+		free(msg);
+
+		if (!(msg = malloc(need)))
+		{
+			msg_size = 0;
+			return -1;
+		}
+
+		msg_size = need;
+	}
+
+	len = snprintf(msg, msg_size, BENCH_RPC, (unsigned long long) ++msg_id, head, payload, tail);
+
+	if (bench_queue(s, msg, len, opt.base))
+		return -1;
+
+	slot = (s->first + s->inflight) % BENCH_PIPELINE_MAX;
+	s->sent[slot] = now_ns();
+	s->ops[slot] = op;
+	s->inflight++;
+	s->requests++;
+
+	return 0;
+}
+
+static bool bench_session_done(struct bench_session *s)
+{
+	return stopping || (opt.requests && s->requests >= opt.requests);
+}
+
+static void bench_fill(struct bench_session *s)
+{
+	while (s->state == SESSION_READY && s->inflight < opt.pipeline && !bench_session_done(s))
+	{
+		if (bench_send(s))
+		{
+			bench_close(s);
+			return;
+		}
+	}
+
+	bench_flush(s);
+}
+
+static void bench_reply(struct bench_session *s, char *msg, uint64_t now)
+{
+	uint64_t latency;
+	int op;
+
+	if (!s->inflight)
+		return;
+
+	op = s->ops[s->first];
+	latency = now - s->sent[s->first];
+	s->first = (s->first + 1) % BENCH_PIPELINE_MAX;
+	s->inflight--;
+
+	if (!measuring)
+		return;
+
+	histogram_record(&op_stats[op].latency, latency);
+	histogram_record(&all_latency, latency);
+
+	if (strstr(msg, "<rpc-error"))
+		op_stats[op].errors++;
+}
+
+static void bench_message(struct bench_session *s, char *msg, uint64_t now)
+{
+	char *p = msg;
+
+	if (s->state == SESSION_HELLO)
+	{
+		histogram_record(&hello_latency, now - s->connected);
+
+		/* everything after the hello uses the agreed framing */
+		framing_init(&s->framing, opt.base);
+		s->framing.max_size = SIZE_MAX;
+		s->state = SESSION_READY;
+
+		if (opt.compress && opt.base && strstr(msg, COMPRESS_CAPABILITY))
+		{
+			if (!(s->zlib = compress_new(opt.compress)))
+			{
+				fprintf(stderr, "unable to start compression\n");
+				disconnects++;
+				bench_close(s);
+				return;
+			}
+
+			compressed++;
+		}
+
+		return;
+	}
+
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+
+	if (!strncmp(p, "<?xml", 5) && (p = strstr(p, "?>")))
+		p += 2;
+
+	if (p && !strncmp(p, "<notification", 13))
+	{
+		if (measuring)
+			notifications++;
+
+		return;
+	}
+
+	bench_reply(s, msg, now);
+}
+
+static void bench_read(struct bench_session *s)
+{
+	static char buf[BENCH_READ_SIZE];
+	char *msg;
+	size_t msg_len;
+	ssize_t n;
+	int off, rc;
+
+	while ((n = read(s->fd, buf, sizeof(buf))) != 0)
+	{
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			n = 0;
+			break;
+		}
+
+		bytes_in += n;
+
+		for (off = 0; off < n && s->state != SESSION_DONE; off += rc)
+		{
+			if ((rc = framing_decode(&s->framing, buf + off, n - off, &msg, &msg_len)) < 0)
+			{
+				fprintf(stderr, "invalid framing from server\n");
+				disconnects++;
+				bench_close(s);
+				return;
+			}
+
+			if (msg && s->zlib)
+			{
+				uint64_t start = now_ns();
+
+				wire_in += msg_len;
+
+				if (compress_inflate(s->zlib, msg, msg_len, SIZE_MAX, &msg, &msg_len))
+				{
+					fprintf(stderr, "invalid compressed message from server\n");
+					disconnects++;
+					bench_close(s);
+					return;
+				}
+
+				inflate_ns += now_ns() - start;
+				raw_in += msg_len;
+			}
+
+			if (msg)
+				bench_message(s, msg, now_ns());
+		}
+	}
+
+	if (!n)
+	{
+		if (!bench_session_done(s) || s->inflight)
+			disconnects++;
+
+		bench_close(s);
+		return;
+	}
+
+	bench_fill(s);
+}
+
+static int bench_connect(void)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *res, *ai;
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	int fd = -1, one = 1;
+
+	if (opt.unix_path)
+	{
+		strncpy(sun.sun_path, opt.unix_path, sizeof(sun.sun_path) - 1);
+
+		if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+			return -1;
+
+		if (connect(fd, (struct sockaddr *) &sun, sizeof(sun)))
+		{
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	if (getaddrinfo(opt.host, opt.port, &hints, &res))
+		return -1;
+
+	for (ai = res; ai; ai = ai->ai_next)
+	{
+		if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol)) < 0)
+			continue;
+
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd >= 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+}
+
+static int bench_open(struct bench_session *s)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+	char hello[512];
+	int len;
+
+	if ((s->fd = bench_connect()) < 0)
+		return -1;
+
+	fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) | O_NONBLOCK);
+
+	/* the capability listed last decides the base */
+	len = snprintf(hello, sizeof(hello), BENCH_HELLO,
+		       opt.base ? "<capability>urn:ietf:params:netconf:base:1.1</capability>" : "",
+		       opt.compress ? "<capability>" COMPRESS_CAPABILITY "</capability>" : "");
+
+	framing_init(&s->framing, 0);
+	s->state = SESSION_HELLO;
+	s->connected = now_ns();
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) || bench_out_reserve(s, len))
+		return -1;
+
+	memcpy(s->out, hello, len);
+	s->out_len = len;
+	bench_flush(s);
+
+	return 0;
+}
+
+/* errors below 0 are left out */
+static void bench_latency_json(const char *name, const struct histogram *h, int64_t errors)
+{
+	printf("\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"min_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+	       "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f",
+	       name, (unsigned long long) h->count,
+	       h->count ? (double) h->sum / h->count / 1000 : 0,
+	       h->min / 1000.0,
+	       histogram_percentile(h, 50) / 1000.0,
+	       histogram_percentile(h, 90) / 1000.0,
+	       histogram_percentile(h, 99) / 1000.0,
+	       histogram_percentile(h, 99.9) / 1000.0,
+	       h->max / 1000.0);
+
+	if (errors >= 0)
+		printf(",\"errors\":%lld", (long long) errors);
+
+	printf("}");
+}
+
+static void bench_report(uint64_t elapsed)
+{
+	double seconds = elapsed / 1e9;
+	uint64_t errors = 0;
+	int i, n = 0;
+
+	for (i = 0; i < __OP_MAX; i++)
+		errors += op_stats[i].errors;
+
+	printf("{\"sessions\":%d,\"base\":\"%s\",\"pipeline\":%d,\"seconds\":%.3f,",
+	       opt.sessions, opt.base ? "1.1" : "1.0", opt.pipeline, seconds);
+	printf("\"requests\":%llu,\"errors\":%llu,\"notifications\":%llu,\"disconnects\":%llu,",
+	       (unsigned long long) all_latency.count, (unsigned long long) errors,
+	       (unsigned long long) notifications, (unsigned long long) disconnects);
+	printf("\"requests_per_second\":%.1f,\"bytes_in\":%llu,\"bytes_out\":%llu,",
+	       seconds > 0 ? all_latency.count / seconds : 0,
+	       (unsigned long long) bytes_in, (unsigned long long) bytes_out);
+
+	if (opt.compress)
+	{
+		printf("\"compression\":{\"sessions\":%d,\"raw_in\":%llu,\"wire_in\":%llu,\"ratio_in\":%.2f,"
+		       "\"raw_out\":%llu,\"wire_out\":%llu,\"ratio_out\":%.2f,\"inflate_mb_per_second\":%.1f,"
+		       "\"deflate_mb_per_second\":%.1f},",
+		       compressed,
+		       (unsigned long long) raw_in, (unsigned long long) wire_in,
+		       wire_in ? (double) raw_in / wire_in : 0,
+		       (unsigned long long) raw_out, (unsigned long long) wire_out,
+		       wire_out ? (double) raw_out / wire_out : 0,
+		       inflate_ns ? raw_in * 1e3 / inflate_ns : 0,
+		       deflate_ns ? raw_out * 1e3 / deflate_ns : 0);
+	}
+
+	bench_latency_json("hello", &hello_latency, -1);
+	printf(",");
+	bench_latency_json("latency", &all_latency, -1);
+	printf(",\"operations\":{");
+
+	for (i = 0; i < __OP_MAX; i++)
+	{
+		if (!op_stats[i].latency.count)
+			continue;
+
+		if (n++)
+			printf(",");
+
+		bench_latency_json(op_names[i], &op_stats[i].latency, op_stats[i].errors);
+	}
+
+	printf("}}\n");
+
+	fprintf(stderr, "%llu requests in %.2fs, %.0f/s, p50 %.1fus p99 %.1fus p99.9 %.1fus, %llu errors\n",
+		(unsigned long long) all_latency.count, seconds,
+		seconds > 0 ? all_latency.count / seconds : 0,
+		histogram_percentile(&all_latency, 50) / 1000.0,
+		histogram_percentile(&all_latency, 99) / 1000.0,
+		histogram_percentile(&all_latency, 99.9) / 1000.0,
+		(unsigned long long) errors);
+
+	if (opt.compress)
+		fprintf(stderr, "%d compressed sessions, replies %.2fx smaller, %.1f MB/s inflated\n",
+			compressed, wire_in ? (double) raw_in / wire_in : 0,
+			inflate_ns ? raw_in * 1e3 / inflate_ns : 0);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -H host        server address (127.0.0.1)\n"
+		"  -p port        server port (1831)\n"
+		"  -u path        connect to a unix socket instead\n"
+		"  -c sessions    concurrent sessions (10)\n"
+		"  -b 0|1         base:1.0 or base:1.1 framing (1)\n"
+		"  -P depth       requests in flight per session (1)\n"
+		"  -d seconds     measured duration (10)\n"
+		"  -w seconds     warm up before measuring (0)\n"
+		"  -n requests    stop after this many requests per session\n"
+		"  -m mix         weights, e.g. get=70,get-config=10,edit-config=10,lock=10\n"
+		"                 ops: get get-config edit-config lock create-subscription\n"
+		"  -f file        subtree filter for get and get-config\n"
+		"  -e file        content of <config> for edit-config\n"
+		"  -s stream      stream for create-subscription (netconf)\n"
+		"  -z level       offer zlib compression, 1 fastest to 9 smallest\n",
+		name);
+}
+
+/*
+ * netconfd-bench [options]
+ *
+ * Opens the sessions, runs the mix for the warm up and measured duration
+ * and prints throughput and latency percentiles as JSON.
+ */
+int main(int argc, char **argv)
+{
+	struct epoll_event events[64];
+	uint64_t start, end, deadline, now;
+	char mix[] = "get=100";
+	int i, n, c, busy;
+
+	if (bench_parse_mix(mix))
+		return EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "H:p:u:c:b:P:d:w:n:m:f:e:s:z:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'H': opt.host = optarg; break;
+			case 'p': opt.port = optarg; break;
+			case 'u': opt.unix_path = optarg; break;
+			case 'c': opt.sessions = atoi(optarg); break;
+			case 'b': opt.base = atoi(optarg) ? 1 : 0; break;
+			case 'P': opt.pipeline = atoi(optarg); break;
+			case 'd': opt.duration = atoi(optarg); break;
+			case 'w': opt.warmup = atoi(optarg); break;
+			case 'n': opt.requests = strtoull(optarg, NULL, 10); break;
+			case 's': opt.stream = optarg; break;
+
+			case 'z':
+#ifdef ENABLE_ZLIB
+				opt.compress = atoi(optarg);
+
+				if (opt.compress < 1 || opt.compress > 9)
+				{
+					fprintf(stderr, "compression level must be between 1 and 9\n");
+					return EXIT_FAILURE;
+				}
+#else
+				fprintf(stderr, "built without zlib\n");
+				return EXIT_FAILURE;
+#endif
+				break;
+
+			case 'm':
+				if (bench_parse_mix(optarg))
+				{
+					fprintf(stderr, "invalid mix '%s'\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'f':
+			case 'e':
+				if (!(c == 'f' ? (opt.filter = bench_read_file(optarg)) : (opt.config = bench_read_file(optarg))))
+				{
+					fprintf(stderr, "unable to read '%s'\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (opt.sessions <= 0 || opt.pipeline <= 0 || opt.pipeline > BENCH_PIPELINE_MAX)
+	{
+		fprintf(stderr, "sessions must be positive and pipeline between 1 and %d\n", BENCH_PIPELINE_MAX);
+		return EXIT_FAILURE;
+	}
+
+	if (opt.filter)
+	{
+		char *f = malloc(strlen(opt.filter) + 64);
+
+		if (!f)
+			return EXIT_FAILURE;
+
+		sprintf(f, "<filter type=\"subtree\">%s</filter>", opt.filter);
+		free(opt.filter);
+		opt.filter = f;
+	}
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 || !(sessions = calloc(opt.sessions, sizeof(*sessions))))
+		return EXIT_FAILURE;
+
+	for (i = 0; i < opt.sessions; i++)
+	{
+		if (bench_open(&sessions[i]))
+		{
+			fprintf(stderr, "unable to open session %d: %s\n", i, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = now_ns();
+	measure_start = start + opt.warmup * 1000000000ULL;
+	deadline = opt.requests ? UINT64_MAX : measure_start + opt.duration * 1000000000ULL;
+	measuring = !opt.warmup;
+	end = 0;
+
+	while (1)
+	{
+		now = now_ns();
+
+		if (!measuring && now >= measure_start)
+			measuring = true;
+
+		/* replies to requests still in flight are not counted */
+		if (!stopping && now >= deadline)
+		{
+			stopping = true;
+			measuring = false;
+			end = now;
+		}
+
+		for (i = 0, busy = 0; i < opt.sessions; i++)
+		{
+			if (sessions[i].state == SESSION_DONE)
+				continue;
+
+			if (sessions[i].state == SESSION_HELLO || sessions[i].inflight || !bench_session_done(&sessions[i]))
+				busy++;
+		}
+
+		if (!busy || (stopping && now >= end + BENCH_DRAIN_WAIT * 1000000ULL))
+			break;
+
+		n = epoll_wait(epfd, events, 64, 100);
+
+		for (i = 0; i < n; i++)
+		{
+			struct bench_session *s = events[i].data.ptr;
+
+			if (s->state == SESSION_DONE)
+				continue;
+
+			if (events[i].events & EPOLLOUT)
+				bench_flush(s);
+
+			if (s->state != SESSION_DONE && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				bench_read(s);
+		}
+	}
+
+	if (!end)
+		end = now_ns();
+
+	bench_report(end - (measure_start > start ? measure_start : start));
+
+	for (i = 0; i < opt.sessions; i++)
+		bench_close(&sessions[i]);
+
+	return disconnects ? EXIT_FAILURE : EXIT_SUCCESS;
+}
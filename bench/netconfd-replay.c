@@ -0,0 +1,794 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "../src/framing.h"
+#include "../src/histogram.h"
+#include "../src/trace.h"
+
+/*
+ * netconfd-replay - play trace files back against a server
+ *
+ * Every session recorded in the traces becomes a script: its hello and
+ * rpcs with their offsets from the start of the capture. Each script is
+ * run by copies synthetic sessions. A message is sent once its offset
+ * divided by speed has passed; with speed 0 (max) a session sends its next
+ * message as soon as the previous one is answered. Replies are decoded and
+ * timed like in netconfd-bench, lag is how late messages went out compared
+ * to the recording.
+ */
+#define REPLAY_INFLIGHT_MAX 256
+#define REPLAY_READ_SIZE (64 * 1024)
+/* how long replies still in flight are waited for at the end, ms */
+#define REPLAY_DRAIN_WAIT 5000
+
+#define NS_BASE "urn:ietf:params:xml:ns:netconf:base:1.0"
+
+/* for sessions whose hello was sent before tracing started */
+#define REPLAY_HELLO \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+	"<hello xmlns=\"" NS_BASE "\"><capabilities>" \
+	"<capability>urn:ietf:params:netconf:base:1.0</capability>%s" \
+	"</capabilities></hello>"
+
+struct replay_message
+{
+	uint64_t at;
+	const char *data;
+	size_t len;
+};
+
+struct replay_script
+{
+	uint32_t session;
+	int file;
+	int base;
+	/* time of the first record since the start of the capture */
+	uint64_t start;
+	const char *hello;
+	size_t hello_len;
+	struct replay_message *msgs;
+	int n_msgs;
+	int size;
+};
+
+enum session_state
+{
+	SESSION_WAIT,
+	SESSION_HELLO,
+	SESSION_READY,
+	SESSION_DONE,
+};
+
+struct replay_session
+{
+	struct replay_script *script;
+	int fd;
+	int state;
+	struct framing framing;
+	uint64_t start;
+	int next;
+	/* requests in flight, oldest first */
+	uint64_t sent[REPLAY_INFLIGHT_MAX];
+	int first;
+	int inflight;
+	/* unsent output */
+	char *out;
+	size_t out_len;
+	size_t out_off;
+	size_t out_size;
+	bool want_write;
+};
+
+static struct
+{
+	const char *host;
+	const char *port;
+	const char *unix_path;
+	int copies;
+	double speed;
+} opt =
+{
+	.host = "127.0.0.1",
+	.port = "1831",
+	.copies = 1,
+	.speed = 1,
+};
+
+static struct replay_script *scripts;
+static int n_scripts;
+static struct replay_session *sessions;
+static int n_sessions;
+static struct histogram latency, lag;
+static uint64_t bytes_in, bytes_out, sent, errors, notifications, disconnects, skipped;
+static int epfd;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct replay_script *replay_script_get(int file, uint32_t session)
+{
+	struct replay_script *s;
+	int i;
+
+	/* most records belong to one of the last few sessions */
+	for (i = n_scripts - 1; i >= 0; i--)
+	{
+		if (scripts[i].file == file && scripts[i].session == session)
+			return &scripts[i];
+	}
+
+	if (!(s = realloc(scripts, (n_scripts + 1) * sizeof(*s))))
+		return NULL;
+
+	scripts = s;
+	s = &scripts[n_scripts++];
+	memset(s, 0, sizeof(*s));
+	s->file = file;
+	s->session = session;
+	s->start = UINT64_MAX;
+
+	return s;
+}
+
+static int replay_script_add(struct replay_script *s, uint64_t at, const char *data, size_t len)
+{
+	struct replay_message *m;
+	int size;
+
+	if (s->n_msgs == s->size)
+	{
+		size = s->size ? s->size * 2 : 16;
+
+		if (!(m = realloc(s->msgs, size * sizeof(*m))))
+			return -1;
+
+		s->msgs = m;
+		s->size = size;
+	}
+
+	s->msgs[s->n_msgs++] = (struct replay_message) { at, data, len };
+
+	return 0;
+}
+
+/* map trace file and split its records into scripts, start_ns is set to its start */
+static int replay_load(const char *path, int file, uint64_t *start_ns)
+{
+	const struct trace_file_header *h;
+	struct trace_record r;
+	struct replay_script *s;
+	struct stat st;
+	const char *map, *p, *end;
+	uint64_t at;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) || st.st_size < sizeof(*h))
+	{
+		if (fd >= 0)
+			close(fd);
+
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return -1;
+
+	h = (const struct trace_file_header *) map;
+
+	if (memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) || h->version != TRACE_VERSION)
+	{
+		fprintf(stderr, "%s: not a trace file\n", path);
+		return -1;
+	}
+
+	*start_ns = h->start_ns;
+	end = map + st.st_size;
+
+	for (p = map + sizeof(*h); p + sizeof(r) <= end; p += sizeof(r) + r.len)
+	{
+		memcpy(&r, p, sizeof(r));
+
+		/* daemon stopped in the middle of a write */
+		if (r.len > end - p - sizeof(r))
+		{
+			fprintf(stderr, "%s: truncated record ignored\n", path);
+			break;
+		}
+
+		if (r.type == TRACE_CLOSE)
+			continue;
+
+		if (!(s = replay_script_get(file, r.session)))
+			return -1;
+
+		/* file times are relative to its own start until all are loaded */
+		at = r.ts;
+
+		if (s->start == UINT64_MAX)
+			s->start = at;
+
+		if (r.type == TRACE_HELLO)
+		{
+			s->hello = p + sizeof(r);
+			s->hello_len = r.len;
+			continue;
+		}
+
+		s->base = r.base;
+
+		if (replay_script_add(s, at, p + sizeof(r), r.len))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int replay_out_reserve(struct replay_session *s, size_t len)
+{
+	size_t size;
+	char *out;
+
+	/* drop what has been written already */
+	if (s->out_off)
+	{
+		memmove(s->out, s->out + s->out_off, s->out_len - s->out_off);
+		s->out_len -= s->out_off;
+		s->out_off = 0;
+	}
+
+	if (s->out_len + len <= s->out_size)
+		return 0;
+
+	for (size = s->out_size ? s->out_size : 4096; size < s->out_len + len; size *= 2);
+
+	if (!(out = realloc(s->out, size)))
+		return -1;
+
+	s->out = out;
+	s->out_size = size;
+
+	return 0;
+}
+
+static void replay_watch(struct replay_session *s, bool write)
+{
+	struct epoll_event ev = { .events = EPOLLIN | (write ? EPOLLOUT : 0), .data.ptr = s };
+
+	if (write == s->want_write)
+		return;
+
+	s->want_write = write;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+static void replay_close(struct replay_session *s)
+{
+	if (s->state == SESSION_DONE)
+		return;
+
+	if (s->state != SESSION_WAIT)
+	{
+		epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+		close(s->fd);
+	}
+
+	framing_free(&s->framing);
+	free(s->out);
+	s->out = NULL;
+	s->state = SESSION_DONE;
+	s->inflight = 0;
+}
+
+static void replay_flush(struct replay_session *s)
+{
+	ssize_t n;
+
+	while (s->out_off < s->out_len)
+	{
+		n = write(s->fd, s->out + s->out_off, s->out_len - s->out_off);
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				disconnects++;
+				replay_close(s);
+				return;
+			}
+
+			break;
+		}
+
+		s->out_off += n;
+		bytes_out += n;
+	}
+
+	replay_watch(s, s->out_off < s->out_len);
+}
+
+/* frame message and queue it */
+static int replay_queue(struct replay_session *s, const char *msg, size_t len, int base)
+{
+	char header[32];
+	const char *trailer = framing_trailer(base);
+	int hlen = framing_header(base, len, header, sizeof(header));
+	size_t tlen = strlen(trailer);
+
+	if (replay_out_reserve(s, hlen + len + tlen))
+		return -1;
+
+	memcpy(s->out + s->out_len, header, hlen);
+	memcpy(s->out + s->out_len + hlen, msg, len);
+	memcpy(s->out + s->out_len + hlen + len, trailer, tlen);
+	s->out_len += hlen + len + tlen;
+
+	return 0;
+}
+
+/* when message i of the session is due, on the monotonic clock */
+static uint64_t replay_due(struct replay_session *s, int i)
+{
+	if (opt.speed <= 0)
+		return s->start;
+
+	return s->start + (uint64_t) ((s->script->msgs[i].at - s->script->start) / opt.speed);
+}
+
+static void replay_send(struct replay_session *s, uint64_t now)
+{
+	struct replay_script *sc = s->script;
+
+	while (s->state == SESSION_READY && s->next < sc->n_msgs && s->inflight < REPLAY_INFLIGHT_MAX)
+	{
+		if (opt.speed <= 0 ? s->inflight > 0 : replay_due(s, s->next) > now)
+			break;
+
+		if (replay_queue(s, sc->msgs[s->next].data, sc->msgs[s->next].len, sc->base))
+		{
+			replay_close(s);
+			return;
+		}
+
+		if (opt.speed > 0)
+			histogram_record(&lag, now - replay_due(s, s->next));
+
+		s->sent[(s->first + s->inflight) % REPLAY_INFLIGHT_MAX] = now;
+		s->inflight++;
+		s->next++;
+		sent++;
+	}
+
+	replay_flush(s);
+}
+
+static void replay_message(struct replay_session *s, char *msg, uint64_t now)
+{
+	char *p = msg;
+
+	if (s->state == SESSION_HELLO)
+	{
+		/* everything after the hello uses the recorded framing */
+		framing_init(&s->framing, s->script->base);
+		s->framing.max_size = SIZE_MAX;
+		s->state = SESSION_READY;
+
+		return;
+	}
+
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+
+	if (!strncmp(p, "<?xml", 5) && (p = strstr(p, "?>")))
+		p += 2;
+
+	if (p && !strncmp(p, "<notification", 13))
+	{
+		notifications++;
+		return;
+	}
+
+	if (!s->inflight)
+		return;
+
+	histogram_record(&latency, now - s->sent[s->first]);
+	s->first = (s->first + 1) % REPLAY_INFLIGHT_MAX;
+	s->inflight--;
+
+	if (strstr(msg, "<rpc-error"))
+		errors++;
+}
+
+static bool replay_session_done(struct replay_session *s)
+{
+	return s->state == SESSION_DONE || (s->state == SESSION_READY && s->next == s->script->n_msgs && !s->inflight);
+}
+
+static void replay_read(struct replay_session *s)
+{
+	static char buf[REPLAY_READ_SIZE];
+	char *msg;
+	size_t msg_len;
+	ssize_t n;
+	int off, rc;
+
+	while ((n = read(s->fd, buf, sizeof(buf))) != 0)
+	{
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			n = 0;
+			break;
+		}
+
+		bytes_in += n;
+
+		for (off = 0; off < n && s->state != SESSION_DONE; off += rc)
+		{
+			if ((rc = framing_decode(&s->framing, buf + off, n - off, &msg, &msg_len)) < 0)
+			{
+				fprintf(stderr, "invalid framing from server\n");
+				disconnects++;
+				replay_close(s);
+				return;
+			}
+
+			if (msg)
+				replay_message(s, msg, now_ns());
+		}
+	}
+
+	/* close-session ends a script, anything else is a disconnect */
+	if (!n)
+	{
+		if (!replay_session_done(s))
+			disconnects++;
+
+		replay_close(s);
+		return;
+	}
+
+	replay_send(s, now_ns());
+}
+
+static int replay_connect(void)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *res, *ai;
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	int fd = -1, one = 1;
+
+	if (opt.unix_path)
+	{
+		strncpy(sun.sun_path, opt.unix_path, sizeof(sun.sun_path) - 1);
+
+		if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+			return -1;
+
+		if (connect(fd, (struct sockaddr *) &sun, sizeof(sun)))
+		{
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	if (getaddrinfo(opt.host, opt.port, &hints, &res))
+		return -1;
+
+	for (ai = res; ai; ai = ai->ai_next)
+	{
+		if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol)) < 0)
+			continue;
+
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd >= 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+}
+
+static int replay_open(struct replay_session *s)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+	struct replay_script *sc = s->script;
+	char hello[512];
+	int len;
+
+	if ((s->fd = replay_connect()) < 0)
+		return -1;
+
+	fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) | O_NONBLOCK);
+
+	framing_init(&s->framing, 0);
+	s->state = SESSION_HELLO;
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev))
+		return -1;
+
+	if (sc->hello)
+		return replay_queue(s, sc->hello, sc->hello_len, 0);
+
+	len = snprintf(hello, sizeof(hello), REPLAY_HELLO,
+		       sc->base ? "<capability>urn:ietf:params:netconf:base:1.1</capability>" : "");
+
+	return replay_queue(s, hello, len, 0);
+}
+
+static void replay_latency_json(const char *name, const struct histogram *h)
+{
+	printf("\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+	       "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}",
+	       name, (unsigned long long) h->count,
+	       h->count ? (double) h->sum / h->count / 1000 : 0,
+	       histogram_percentile(h, 50) / 1000.0,
+	       histogram_percentile(h, 90) / 1000.0,
+	       histogram_percentile(h, 99) / 1000.0,
+	       histogram_percentile(h, 99.9) / 1000.0,
+	       h->max / 1000.0);
+}
+
+static void replay_report(uint64_t elapsed, uint64_t recorded)
+{
+	double seconds = elapsed / 1e9;
+
+	printf("{\"scripts\":%d,\"sessions\":%d,\"speed\":%g,\"recorded_seconds\":%.3f,\"seconds\":%.3f,",
+	       n_scripts, n_sessions, opt.speed, recorded / 1e9, seconds);
+	printf("\"requests\":%llu,\"replies\":%llu,\"errors\":%llu,\"notifications\":%llu,\"disconnects\":%llu,",
+	       (unsigned long long) sent, (unsigned long long) latency.count, (unsigned long long) errors,
+	       (unsigned long long) notifications, (unsigned long long) disconnects);
+	printf("\"requests_per_second\":%.1f,\"bytes_in\":%llu,\"bytes_out\":%llu,",
+	       seconds > 0 ? sent / seconds : 0,
+	       (unsigned long long) bytes_in, (unsigned long long) bytes_out);
+
+	replay_latency_json("latency", &latency);
+	printf(",");
+	replay_latency_json("lag", &lag);
+	printf("}\n");
+
+	fprintf(stderr, "%llu requests of %d sessions in %.2fs (recorded %.2fs), p50 %.1fus p99 %.1fus, lag p99 %.1fus, %llu errors\n",
+		(unsigned long long) sent, n_sessions, seconds, recorded / 1e9,
+		histogram_percentile(&latency, 50) / 1000.0,
+		histogram_percentile(&latency, 99) / 1000.0,
+		histogram_percentile(&lag, 99) / 1000.0,
+		(unsigned long long) errors);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] trace...\n"
+		"  -H host        server address (127.0.0.1)\n"
+		"  -p port        server port (1831)\n"
+		"  -u path        connect to a unix socket instead\n"
+		"  -x speed       1 for recorded timing, 10 for ten times faster, max (1)\n"
+		"  -c copies      sessions per recorded session (1)\n",
+		name);
+}
+
+/*
+ * netconfd-replay [options] trace...
+ *
+ * Loads the traces written by netconfd with trace_dir set, replays them and
+ * prints throughput, latency and lag as JSON.
+ */
+int main(int argc, char **argv)
+{
+	struct epoll_event events[64];
+	uint64_t *file_start, first = UINT64_MAX, origin = UINT64_MAX, last = 0, start, now, wake, drain = 0;
+	int i, j, n, c, busy, pending, timeout;
+
+	while ((c = getopt(argc, argv, "H:p:u:x:c:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'H': opt.host = optarg; break;
+			case 'p': opt.port = optarg; break;
+			case 'u': opt.unix_path = optarg; break;
+			case 'c': opt.copies = atoi(optarg); break;
+			case 'x': opt.speed = strcmp(optarg, "max") ? atof(optarg) : 0; break;
+
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc || opt.copies <= 0 || opt.speed < 0)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!(file_start = calloc(argc - optind, sizeof(*file_start))))
+		return EXIT_FAILURE;
+
+	for (i = optind; i < argc; i++)
+	{
+		if (replay_load(argv[i], i - optind, &file_start[i - optind]))
+		{
+			fprintf(stderr, "unable to load '%s'\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* one time line for the traces of all workers */
+	for (i = 0; i < argc - optind; i++)
+		first = file_start[i] < first ? file_start[i] : first;
+
+	for (i = 0; i < n_scripts; i++)
+	{
+		uint64_t shift = file_start[scripts[i].file] - first;
+
+		/* hello only, nothing to replay */
+		if (!scripts[i].n_msgs)
+		{
+			skipped++;
+			continue;
+		}
+
+		scripts[i].start += shift;
+		origin = scripts[i].start < origin ? scripts[i].start : origin;
+
+		for (j = 0; j < scripts[i].n_msgs; j++)
+		{
+			scripts[i].msgs[j].at += shift;
+			last = scripts[i].msgs[j].at > last ? scripts[i].msgs[j].at : last;
+		}
+	}
+
+	if (skipped)
+		fprintf(stderr, "%llu sessions without rpcs skipped\n", (unsigned long long) skipped);
+
+	if (origin == UINT64_MAX)
+	{
+		fprintf(stderr, "no rpcs in traces\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 || !(sessions = calloc(n_scripts * opt.copies, sizeof(*sessions))))
+		return EXIT_FAILURE;
+
+	start = now_ns();
+
+	for (i = 0; i < n_scripts; i++)
+	{
+		if (!scripts[i].n_msgs)
+			continue;
+
+		for (j = 0; j < opt.copies; j++)
+		{
+			struct replay_session *s = &sessions[n_sessions++];
+
+			s->script = &scripts[i];
+			s->state = SESSION_WAIT;
+			s->start = start + (opt.speed > 0 ? (uint64_t) ((scripts[i].start - origin) / opt.speed) : 0);
+		}
+	}
+
+	while (1)
+	{
+		now = now_ns();
+		wake = UINT64_MAX;
+
+		for (i = 0, busy = 0, pending = 0; i < n_sessions; i++)
+		{
+			struct replay_session *s = &sessions[i];
+
+			if (s->state == SESSION_WAIT && s->start <= now && replay_open(s))
+			{
+				fprintf(stderr, "unable to open session: %s\n", strerror(errno));
+				disconnects++;
+				replay_close(s);
+			}
+
+			if (s->state == SESSION_READY)
+				replay_send(s, now);
+
+			if (replay_session_done(s))
+				continue;
+
+			busy++;
+
+			/* still has something to send */
+			if (s->state != SESSION_READY || s->next < s->script->n_msgs)
+				pending++;
+
+			if (s->state == SESSION_WAIT)
+				wake = s->start < wake ? s->start : wake;
+			else if (s->state == SESSION_READY && opt.speed > 0 && s->next < s->script->n_msgs && s->inflight < REPLAY_INFLIGHT_MAX)
+				wake = replay_due(s, s->next) < wake ? replay_due(s, s->next) : wake;
+		}
+
+		if (!busy)
+			break;
+
+		/* everything is sent, the server gets a while to answer */
+		if (!pending && !drain)
+			drain = now;
+
+		if (drain && now >= drain + REPLAY_DRAIN_WAIT * 1000000ULL)
+			break;
+
+		timeout = wake == UINT64_MAX || wake > now + 100000000ULL ? 100 : (int) ((wake - now + 999999) / 1000000);
+
+		n = epoll_wait(epfd, events, 64, timeout);
+
+		for (i = 0; i < n; i++)
+		{
+			struct replay_session *s = events[i].data.ptr;
+
+			if (s->state == SESSION_DONE)
+				continue;
+
+			if (events[i].events & EPOLLOUT)
+				replay_flush(s);
+
+			if (s->state != SESSION_DONE && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				replay_read(s);
+		}
+	}
+
+	replay_report(now_ns() - start, last - origin);
+
+	for (i = 0; i < n_sessions; i++)
+		replay_close(&sessions[i]);
+
+	return disconnects ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roxml.h>
+
+#include "netconfd/netconfd.h"
+#include "netconfd/arena.h"
+
+#include "microbench.h"
+#include "fixtures.h"
+#include "../src/cache.h"
+#include "../src/config.h"
+#include "../src/framing.h"
+#include "../src/methods.h"
+#include "../src/monitoring.h"
+#include "../src/netconf.h"
+
+/* main() of the daemon is not linked in, keep handlers quiet */
+int netconfd_log_level = LOG_EMERG;
+
+/*
+ * Request handling of one session without its socket: hello analysis,
+ * method_handle_message_rpc() from parse to committed reply, rpc-error
+ * bodies and serialization of roxml replies. Providers, plugins and uci
+ * packages are not set up, so edit-config measures parsing and the walk
+ * over the configuration and get measures state spliced in as text.
+ */
+struct rpc_fixture
+{
+	struct arena arena;
+	char *msg;
+	node_t *root;
+};
+
+static void *rpc_fixture_new(char *msg)
+{
+	static int monitoring_ready = 0;
+	struct rpc_fixture *rf;
+
+	/* capabilities and lock table */
+	if (!monitoring_ready && !monitoring_init(1, 0))
+		monitoring_ready = 1;
+
+	if (!msg || !(rf = calloc(1, sizeof(*rf))))
+	{
+		free(msg);
+		return NULL;
+	}
+
+	arena_init(&rf->arena, 0);
+	rf->msg = msg;
+
+	return rf;
+}
+
+static void rpc_fixture_free(void *fixture)
+{
+	struct rpc_fixture *rf = fixture;
+
+	if (rf->root)
+		roxml_close(rf->root);
+
+	arena_free(&rf->arena);
+	free(rf->msg);
+	free(rf);
+}
+
+static void *setup_hello(size_t size)
+{
+	return rpc_fixture_new(strdup(FIXTURE_HELLO));
+}
+
+static void run_hello_analyze(void *fixture)
+{
+	struct rpc_fixture *rf = fixture;
+	bool compress;
+	int base;
+
+	if (method_analyze_message_hello(rf->msg, &base, &compress, &rf->arena))
+		abort();
+
+	arena_reset(&rf->arena);
+}
+
+static void run_hello_create(void *fixture)
+{
+	char *hello = NULL;
+	uint32_t id;
+
+	if (method_create_message_hello(&hello, &id))
+		abort();
+
+	bench_use(hello);
+	free(hello);
+}
+
+static void *setup_close_session(size_t size)
+{
+	return rpc_fixture_new(strdup(FIXTURE_CLOSE_SESSION));
+}
+
+static void *setup_get_monitoring(size_t size)
+{
+	return rpc_fixture_new(strdup(FIXTURE_GET_MONITORING));
+}
+
+/* rendered every time, or from the second run on taken from the reply cache */
+static void *setup_get_config(size_t size)
+{
+	config.reply_cache = 0;
+
+	return rpc_fixture_new(strdup(FIXTURE_GET_CONFIG));
+}
+
+static void *setup_get_config_cached(size_t size)
+{
+	config.reply_cache = 1024 * 1024;
+
+	return rpc_fixture_new(strdup(FIXTURE_GET_CONFIG));
+}
+
+static void *setup_unsupported(size_t size)
+{
+	return rpc_fixture_new(strdup(FIXTURE_UNSUPPORTED));
+}
+
+static void *setup_edit_config(size_t size)
+{
+	return rpc_fixture_new(fixture_edit_config(size));
+}
+
+static void run_dispatch(void *fixture)
+{
+	struct rpc_fixture *rf = fixture;
+	struct provider_request *deferred;
+	struct cache_entry *cached;
+	struct method_subscription sub = { 0 };
+	char *reply = NULL;
+
+	if (method_handle_message_rpc(rf->msg, &reply, &rf->arena, NULL, &deferred, &cached, &sub) < 0 || !reply)
+		abort();
+
+	bench_use(reply);
+	free(reply);
+	cache_put(cached);
+
+	arena_reset(&rf->arena);
+}
+
+static void *setup_rpc_error(size_t size)
+{
+	return rpc_fixture_new(strdup(""));
+}
+
+static void run_rpc_error(void *fixture)
+{
+	char *error = netconf_rpc_error("method not supported", RPC_ERROR_TAG_OPERATION_NOT_SUPPORTED, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, "bench");
+
+	bench_use(error);
+	free(error);
+}
+
+static void run_rpc_error_arena(void *fixture)
+{
+	struct rpc_fixture *rf = fixture;
+
+	bench_use(netconf_rpc_error_arena(&rf->arena, "method not supported", RPC_ERROR_TAG_OPERATION_NOT_SUPPORTED, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, "bench"));
+
+	arena_reset(&rf->arena);
+}
+
+/* reply tree as handlers leave it, serialized and framed for sending */
+static void *setup_commit(size_t size)
+{
+	struct rpc_fixture *rf = rpc_fixture_new(fixture_reply(size));
+
+	if (rf && !(rf->root = roxml_load_buf(rf->msg)))
+	{
+		rpc_fixture_free(rf);
+		return NULL;
+	}
+
+	return rf;
+}
+
+static void run_commit(void *fixture)
+{
+	struct rpc_fixture *rf = fixture;
+	char *reply = NULL, header[32];
+	int len;
+
+	len = roxml_commit_changes(rf->root, NULL, &reply, 0);
+
+	if (len <= 0 || framing_header(1, len, header, sizeof(header)) <= 0)
+		abort();
+
+	bench_use(header);
+	free(reply);
+}
+
+#define SIZED_CASES(_name, _setup, _run) \
+	{ _name, _setup, _run, rpc_fixture_free, 4096 }, \
+	{ _name, _setup, _run, rpc_fixture_free, 65536 }, \
+	{ _name, _setup, _run, rpc_fixture_free, 1048576 }
+
+static const struct bench_case cases[] =
+{
+	{ "hello/analyze", setup_hello, run_hello_analyze, rpc_fixture_free, sizeof(FIXTURE_HELLO) - 1 },
+	{ "hello/create", NULL, run_hello_create, NULL, 0 },
+	{ "dispatch/close-session", setup_close_session, run_dispatch, rpc_fixture_free, sizeof(FIXTURE_CLOSE_SESSION) - 1 },
+	{ "dispatch/unsupported", setup_unsupported, run_dispatch, rpc_fixture_free, sizeof(FIXTURE_UNSUPPORTED) - 1 },
+	{ "dispatch/get-monitoring", setup_get_monitoring, run_dispatch, rpc_fixture_free, sizeof(FIXTURE_GET_MONITORING) - 1 },
+	{ "dispatch/get-config", setup_get_config, run_dispatch, rpc_fixture_free, sizeof(FIXTURE_GET_CONFIG) - 1 },
+	{ "dispatch/get-config-cached", setup_get_config_cached, run_dispatch, rpc_fixture_free, sizeof(FIXTURE_GET_CONFIG) - 1 },
+	SIZED_CASES("dispatch/edit-config", setup_edit_config, run_dispatch),
+	{ "rpc-error/malloc", setup_rpc_error, run_rpc_error, rpc_fixture_free, 0 },
+	{ "rpc-error/arena", setup_rpc_error, run_rpc_error_arena, rpc_fixture_free, 0 },
+	SIZED_CASES("commit/reply", setup_commit, run_commit),
+	{ "commit/reply", setup_commit, run_commit, rpc_fixture_free, 52428800 },
+};
+
+const struct bench_suite bench_rpc = BENCH_SUITE("rpc", cases);
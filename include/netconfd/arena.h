@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_ARENA_H__
+#define __FREENETCONFD_ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+/*
+ * Plugin handlers get the request's arena in rpc_data.arena. What they take
+ * from it lives until the reply is sent and must not be freed.
+ */
+#define ARENA_CHUNK_SIZE 4096
+
+struct arena_chunk
+{
+	struct arena_chunk *next;
+	size_t size;
+	char data[];
+};
+
+struct arena
+{
+	struct arena_chunk *head;
+	struct arena_chunk *cur;
+	size_t used;
+	size_t chunk_size;
+	size_t retained;
+	size_t allocated;
+};
+
+struct arena_stats
+{
+	uint64_t allocs;
+	uint64_t bytes;
+	uint64_t chunks;
+	uint64_t resets;
+	uint64_t high_water;
+};
+
+/* totals over all arenas of this process */
+extern struct arena_stats arena_stats;
+
+void arena_init(struct arena *a, size_t chunk_size);
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_strdup(struct arena *a, const char *s);
+char *arena_strndup(struct arena *a, const char *s, size_t len);
+char *arena_vprintf(struct arena *a, const char *fmt, va_list ap);
+char *arena_printf(struct arena *a, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+#endif /* __FREENETCONFD_ARENA_H__ */
@@ -23,16 +23,38 @@
 
 #include <stdio.h>
 
+/*
+ * Most verbose level compiled in, calls above it are removed by the
+ * compiler. The log_level option filters further at run time.
+ */
+#ifndef NETCONFD_LOG_LEVEL
+#define NETCONFD_LOG_LEVEL LOG_DEBUG
+#endif
+
+/* longest part of a message body that is logged */
+#define NETCONFD_LOG_BODY 512
+
+/* syslog level, set from the log_level option */
+extern int netconfd_log_level;
+
+void netconfd_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define netconfd_log_enabled(level) \
+	((level) <= NETCONFD_LOG_LEVEL && netconfd_log_level >= (level))
+
 #define DEBUG(fmt, ...) do { \
-		fprintf(stderr, "netconfd: %s(%d): " fmt, __FILE__, __LINE__, ## __VA_ARGS__); \
+		if (netconfd_log_enabled(LOG_DEBUG)) \
+			netconfd_log(LOG_DEBUG, "%s(%d): " fmt, __FILE__, __LINE__, ## __VA_ARGS__); \
 	} while (0)
-//syslog(0, fmt, ## __VA_ARGS__); 
+
 #define LOG(fmt, ...) do { \
-		fprintf(stderr, "netconfd: "fmt, ## __VA_ARGS__); \
+		if (netconfd_log_enabled(LOG_INFO)) \
+			netconfd_log(LOG_INFO, fmt, ## __VA_ARGS__); \
 	} while (0)
-//syslog(0, fmt, ## __VA_ARGS__); 
+
 #define ERROR(fmt, ...) do { \
-		fprintf(stderr, "netconfd: "fmt, ## __VA_ARGS__); \
+		if (netconfd_log_enabled(LOG_ERR)) \
+			netconfd_log(LOG_ERR, fmt, ## __VA_ARGS__); \
 	} while (0)
 
 #ifndef typeof
@@ -18,10 +18,18 @@
 #define __FREENETCONFD_PLUGIN_H__
 
 
+#include <stddef.h>
+#include <stdint.h>
 #include <libubox/list.h>
 #include <roxml.h>
 
-enum response {RPC_OK, RPC_OK_CLOSE, RPC_DATA, RPC_ERROR, RPC_DATA_EXISTS, RPC_DATA_MISSING, RPC_NOTIFY_NETCONF_OK, RPC_NOTIFY_SNMP_OK, RPC_NOTIFY_ERROR};
+#include <netconfd/arena.h>
+
+enum response {RPC_OK, RPC_OK_CLOSE, RPC_DATA, RPC_ERROR, RPC_DATA_EXISTS, RPC_DATA_MISSING, RPC_NOTIFY_NETCONF_OK, RPC_NOTIFY_SNMP_OK, RPC_NOTIFY_ERROR, RPC_NOTIFY_PUSH_OK};
+
+struct provider_request;
+struct filter;
+struct push_spec;
 
 struct rpc_data
 {
@@ -29,6 +37,19 @@ struct rpc_data
 	node_t *out;
 	char *error;
 	int get_config;
+	/* per request scratch memory, reset once the reply is sent, see arena.h */
+	struct arena *arena;
+	/* set if ubus providers complete the reply later */
+	struct provider_request *deferred;
+	/* malloc'd xml spliced into the reply, see method_handle_get() */
+	char *data_xml;
+	/* session the request came in on, 0 if there is none */
+	uint32_t session_id;
+	/* compiled create-subscription filter or push spec, handed to the session */
+	struct filter *filter;
+	struct push_spec *push;
+	/* get-config reply body taken from the reply cache */
+	struct cache_entry *cached;
 };
 
 struct rpc_method
@@ -54,4 +75,11 @@ struct module_list
 	const struct module *m;
 };
 
+/*
+ * Raise a notification on a stream ("netconf", "snmp"), callable from any
+ * thread. xml is the event, it is sent wrapped in <notification> with the
+ * current eventTime. Returns 0 once queued and -1 if the event is dropped.
+ */
+int netconfd_notify(const char *stream, const char *xml, size_t len);
+
 #endif /* __FREENETCONFD_PLUGIN_H__ */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "netconfd/arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_MAX_RETAINED_CHUNKS 4
+
+struct arena_stats arena_stats;
+
+static inline size_t arena_align(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+static struct arena_chunk *arena_chunk_new(size_t size)
+{
+	struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+
+	if (!chunk)
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+
+	arena_stats.chunks++;
+
+	return chunk;
+}
+
+/*
+ * arena_init() - prepare request arena
+ *
+ * @struct arena*:	arena to initialize
+ * @size_t:		size of regular chunks, 0 for default
+ *
+ * No memory is allocated until the first arena_alloc().
+ */
+void arena_init(struct arena *a, size_t chunk_size)
+{
+	memset(a, 0, sizeof(*a));
+
+	a->chunk_size = chunk_size ? arena_align(chunk_size) : ARENA_CHUNK_SIZE;
+}
+
+/*
+ * arena_alloc() - bump allocate from arena
+ *
+ * Chunks kept from earlier requests are reused in order, new ones are
+ * appended only when all retained chunks are exhausted. Requests larger than
+ * the chunk size get a dedicated chunk.
+ */
+void *arena_alloc(struct arena *a, size_t size)
+{
+	struct arena_chunk *chunk;
+	void *p;
+
+	size = arena_align(size ? size : 1);
+
+	while (!a->cur || a->used + size > a->cur->size)
+	{
+		chunk = a->cur ? a->cur->next : a->head;
+
+		if (chunk && size <= chunk->size)
+		{
+			a->cur = chunk;
+			a->used = 0;
+			continue;
+		}
+
+		chunk = arena_chunk_new(size > a->chunk_size ? size : a->chunk_size);
+
+		if (!chunk)
+			return NULL;
+
+		a->retained += chunk->size;
+
+		if (!a->cur)
+		{
+			chunk->next = a->head;
+			a->head = chunk;
+		}
+		else
+		{
+			chunk->next = a->cur->next;
+			a->cur->next = chunk;
+		}
+
+		a->cur = chunk;
+		a->used = 0;
+	}
+
+	p = a->cur->data + a->used;
+	a->used += size;
+	a->allocated += size;
+
+	arena_stats.allocs++;
+	arena_stats.bytes += size;
+
+	return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t len)
+{
+	char *p = arena_alloc(a, len + 1);
+
+	if (!p)
+		return NULL;
+
+	memcpy(p, s, len);
+	p[len] = '\0';
+
+	return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s)
+{
+	return arena_strndup(a, s, strlen(s));
+}
+
+/*
+ * arena_vprintf() - format string into arena
+ *
+ * Formats directly into the free tail of the current chunk and only falls
+ * back to a second pass when the result does not fit.
+ */
+char *arena_vprintf(struct arena *a, const char *fmt, va_list ap)
+{
+	size_t avail = a->cur ? a->cur->size - a->used : 0;
+	char *p = a->cur ? a->cur->data + a->used : NULL;
+	va_list aq;
+	int len;
+
+	va_copy(aq, ap);
+	len = vsnprintf(p, avail, fmt, aq);
+	va_end(aq);
+
+	if (len < 0)
+		return NULL;
+
+	if ((size_t) len < avail)
+		return arena_alloc(a, len + 1);
+
+	p = arena_alloc(a, len + 1);
+
+	if (!p)
+		return NULL;
+
+	vsnprintf(p, len + 1, fmt, ap);
+
+	return p;
+}
+
+char *arena_printf(struct arena *a, const char *fmt, ...)
+{
+	va_list ap;
+	char *p;
+
+	va_start(ap, fmt);
+	p = arena_vprintf(a, fmt, ap);
+	va_end(ap);
+
+	return p;
+}
+
+/*
+ * arena_reset() - release everything allocated since last reset
+ *
+ * Rewinds to the first chunk in O(1). Only when an unusually large request
+ * made the arena grow past its retention limit are the extra chunks freed.
+ */
+void arena_reset(struct arena *a)
+{
+	struct arena_chunk *chunk, *next;
+
+	if (a->allocated > arena_stats.high_water)
+		arena_stats.high_water = a->allocated;
+
+	arena_stats.resets++;
+
+	a->cur = NULL;
+	a->used = 0;
+	a->allocated = 0;
+
+	if (a->retained <= a->chunk_size * ARENA_MAX_RETAINED_CHUNKS)
+		return;
+
+	for (chunk = a->head; chunk; chunk = next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+
+	a->head = NULL;
+	a->retained = 0;
+}
+
+void arena_free(struct arena *a)
+{
+	struct arena_chunk *chunk, *next;
+
+	for (chunk = a->head; chunk; chunk = next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+
+	arena_init(a, a->chunk_size);
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netconfd/netconfd.h"
+
+#include "cache.h"
+#include "config.h"
+#include "stats.h"
+
+/*
+ * Reply cache
+ *
+ * get-config replies depend only on the source datastore, its version and
+ * the filter. Their <data> element is kept serialized under a key made of
+ * datastore name and normalized filter, for the datastore version it was
+ * rendered at. Once the version moves on every entry is stale and the
+ * cache is emptied. A hit is queued as is between the envelope of the new
+ * reply, entries stay alive while replies referring to them are queued.
+ *
+ * config.reply_cache bounds the bytes held by each worker, entries larger
+ * than a quarter of it are not kept and the least recently used ones make
+ * room for new ones.
+ */
+#define CACHE_BUCKETS 256
+
+static struct cache_entry *buckets[CACHE_BUCKETS];
+static LIST_HEAD(lru);
+static uint32_t cache_version = 0;
+
+static size_t cache_size(const struct cache_entry *e)
+{
+	return sizeof(*e) + strlen(e->key) + 1 + e->len;
+}
+
+/* FNV-1a */
+static uint32_t cache_hash(const char *key)
+{
+	uint32_t h = 2166136261u;
+
+	while (*key)
+		h = (h ^ (unsigned char) *key++) * 16777619u;
+
+	return h;
+}
+
+/* cache_put() - drop a reference, the last one frees the entry */
+void cache_put(struct cache_entry *e)
+{
+	if (!e || --e->refs)
+		return;
+
+	free(e->key);
+	free(e->data);
+	free(e);
+}
+
+static void cache_unlink(struct cache_entry *e)
+{
+	struct cache_entry **p = &buckets[e->hash % CACHE_BUCKETS];
+
+	while (*p != e)
+		p = &(*p)->next;
+
+	*p = e->next;
+	list_del(&e->lru);
+
+	stats.cache_entries--;
+	stats.cache_bytes -= cache_size(e);
+
+	cache_put(e);
+}
+
+/* entries of an older datastore version are dropped all at once */
+static void cache_sync(uint32_t version)
+{
+	struct cache_entry *e, *tmp;
+
+	if (version == cache_version)
+		return;
+
+	list_for_each_entry_safe(e, tmp, &lru, lru)
+	{
+		cache_unlink(e);
+		stats.cache_invalidations++;
+	}
+
+	cache_version = version;
+}
+
+static struct cache_entry *cache_find(const char *key, uint32_t hash)
+{
+	struct cache_entry *e;
+
+	for (e = buckets[hash % CACHE_BUCKETS]; e; e = e->next)
+	{
+		if (e->hash == hash && !strcmp(e->key, key))
+			return e;
+	}
+
+	return NULL;
+}
+
+/*
+ * cache_lookup() - reply body stored for key
+ *
+ * @const char*:	datastore and normalized filter
+ * @uint32_t:		current datastore version
+ *
+ * Returns the entry with a reference taken for the caller, NULL on a miss.
+ */
+struct cache_entry *cache_lookup(const char *key, uint32_t version)
+{
+	struct cache_entry *e;
+
+	if (config.reply_cache <= 0)
+		return NULL;
+
+	cache_sync(version);
+
+	if (!(e = cache_find(key, cache_hash(key))))
+	{
+		stats.cache_misses++;
+		return NULL;
+	}
+
+	list_move(&e->lru, &lru);
+	stats.cache_hits++;
+	e->refs++;
+
+	return e;
+}
+
+/*
+ * cache_store() - keep reply body rendered at version
+ *
+ * @const char*:	datastore and normalized filter
+ * @uint32_t:		datastore version the body was rendered at
+ * @char*:		malloc'd body, taken over
+ * @size_t:		its length
+ *
+ * Returns the new entry with a reference taken for the caller, NULL if the
+ * body is not kept, it is freed then.
+ */
+struct cache_entry *cache_store(const char *key, uint32_t version, char *data, size_t len)
+{
+	struct cache_entry *e, *old;
+	size_t size;
+
+	if (!data || config.reply_cache <= 0 || (e = calloc(1, sizeof(*e))) == NULL)
+	{
+		free(data);
+		return NULL;
+	}
+
+	e->refs = 1;
+	e->data = data;
+	e->len = len;
+
+	if (!(e->key = strdup(key)))
+	{
+		cache_put(e);
+		return NULL;
+	}
+
+	size = cache_size(e);
+
+	if (size > (size_t) config.reply_cache / 4)
+	{
+		cache_put(e);
+		return NULL;
+	}
+
+	cache_sync(version);
+	e->hash = cache_hash(key);
+
+	if ((old = cache_find(key, e->hash)))
+		cache_unlink(old);
+
+	while (!list_empty(&lru) && stats.cache_bytes + size > (uint64_t) config.reply_cache)
+	{
+		cache_unlink(list_last_entry(&lru, struct cache_entry, lru));
+		stats.cache_evictions++;
+	}
+
+	e->next = buckets[e->hash % CACHE_BUCKETS];
+	buckets[e->hash % CACHE_BUCKETS] = e;
+	list_add(&e->lru, &lru);
+
+	stats.cache_entries++;
+	stats.cache_bytes += size;
+
+	/* one for the cache, one for the caller */
+	e->refs++;
+
+	return e;
+}
+
+void cache_exit(void)
+{
+	struct cache_entry *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, &lru, lru)
+		cache_unlink(e);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_CACHE_H__
+#define __FREENETCONFD_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libubox/list.h>
+
+/* comment standing in for the cached body in the rpc-reply */
+#define CACHE_MARKER "netconfd-cached"
+
+/* serialized reply body, shared by the cache and the replies still queued */
+struct cache_entry
+{
+	struct list_head lru;
+	struct cache_entry *next;
+	uint32_t hash;
+	int refs;
+	char *key;
+	char *data;
+	size_t len;
+};
+
+struct cache_entry *cache_lookup(const char *key, uint32_t version);
+struct cache_entry *cache_store(const char *key, uint32_t version, char *data, size_t len);
+void cache_put(struct cache_entry *e);
+void cache_exit(void);
+
+#endif /* __FREENETCONFD_CACHE_H__ */
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netconfd/netconfd.h"
+
+#include "changes.h"
+#include "config.h"
+#include "stats.h"
+#include "xml.h"
+
+/*
+ * Change log
+ *
+ * The datastore hands in what every change of a uci package did, as the
+ * <package> element of an edit-config that repeats it, together with the
+ * states of the package file before and after. A state is derived from
+ * the file's mtime, size and inode, so every worker, and a restarted
+ * process, gives the same file the same state. The last config.change_log
+ * bytes of changes are kept in a ring per worker.
+ *
+ * Tokens given to clients list the state of each package they were told.
+ * A worker answers with the changes of its own log that lead from that
+ * state to the current one, whichever worker handed the token out. Workers
+ * notice changes of others only when they next look at the file and may
+ * see two changes as one; a client holding the state in between is then
+ * not found in the chain and fetches everything again, like one whose
+ * changes were dropped from the ring. Replaying a chain that starts
+ * before the client's state ends at the same result, the edits set values
+ * rather than change them.
+ */
+struct change
+{
+	char *package;
+	uint64_t from;
+	uint64_t to;
+	/* NULL if the file changed but its content did not */
+	char *xml;
+	size_t len;
+};
+
+static struct change ring[CHANGES_MAX];
+static int head = 0, count = 0;
+
+static size_t changes_size(const struct change *c)
+{
+	return sizeof(*c) + strlen(c->package) + 1 + c->len;
+}
+
+static void changes_drop(void)
+{
+	struct change *c = &ring[head];
+
+	stats.change_log_entries--;
+	stats.change_log_bytes -= changes_size(c);
+
+	free(c->package);
+	free(c->xml);
+	memset(c, 0, sizeof(*c));
+
+	head = (head + 1) % CHANGES_MAX;
+	count--;
+}
+
+/*
+ * changes_add() - keep change of a package
+ *
+ * @const char*:	package
+ * @uint64_t:		state of its file before the change
+ * @uint64_t:		state after
+ * @char*:		malloc'd <package> element with the edits, taken over, NULL for none
+ * @size_t:		its length
+ */
+void changes_add(const char *package, uint64_t from, uint64_t to, char *xml, size_t len)
+{
+	struct change *c;
+
+	if (config.change_log <= 0 || from == to)
+	{
+		free(xml);
+		return;
+	}
+
+	if (count == CHANGES_MAX)
+		changes_drop();
+
+	c = &ring[(head + count) % CHANGES_MAX];
+
+	if (!(c->package = strdup(package)))
+	{
+		free(xml);
+		return;
+	}
+
+	c->from = from;
+	c->to = to;
+	c->xml = xml;
+	c->len = xml ? len : 0;
+	count++;
+
+	stats.change_log_entries++;
+	stats.change_log_bytes += changes_size(c);
+
+	/* the newest change stays while it fits */
+	while (count && stats.change_log_bytes > (uint64_t) config.change_log)
+		changes_drop();
+}
+
+/*
+ * changes_render() - append edits of a package between two states
+ *
+ * @struct xml_buf*:	output
+ * @const char*:	package
+ * @uint64_t:		state the client holds
+ * @uint64_t:		current state
+ *
+ * Returns the number of <package> elements appended, -1 and nothing
+ * appended if the log has no unbroken chain of changes between the two.
+ */
+int changes_render(struct xml_buf *out, const char *package, uint64_t from, uint64_t to)
+{
+	struct change *c;
+	uint64_t expect = to;
+	int i, first = -1, rendered = 0;
+
+	if (from == to)
+		return 0;
+
+	/* newest first, every change has to end where the later one starts */
+	for (i = count - 1; i >= 0 && first < 0; i--)
+	{
+		c = &ring[(head + i) % CHANGES_MAX];
+
+		if (strcmp(c->package, package))
+			continue;
+
+		if (c->to != expect)
+			return -1;
+
+		if (c->from == from)
+			first = i;
+
+		expect = c->from;
+	}
+
+	if (first < 0)
+		return -1;
+
+	for (i = first; i < count; i++)
+	{
+		c = &ring[(head + i) % CHANGES_MAX];
+
+		if (!c->len || strcmp(c->package, package))
+			continue;
+
+		xml_buf_append(out, c->xml, c->len);
+		rendered++;
+	}
+
+	return rendered;
+}
+
+/* changes_token() - append state of a package as handed to clients */
+void changes_token(struct xml_buf *out, const char *package, uint64_t state)
+{
+	char buf[20];
+
+	snprintf(buf, sizeof(buf), ":%016llx", (unsigned long long) state);
+	xml_buf_escape(out, package);
+	xml_buf_puts(out, buf);
+}
+
+/* changes_parse() - state of a package in a token, -1 if the token has none */
+int changes_parse(const char *token, const char *package, uint64_t *state)
+{
+	size_t len = strlen(package);
+	const char *p = token;
+	unsigned long long v;
+	char *end;
+
+	while (p)
+	{
+		if (!strncmp(p, package, len) && p[len] == ':')
+		{
+			v = strtoull(p + len + 1, &end, 16);
+
+			if (end == p + len + 1 || (*end && *end != ','))
+				return -1;
+
+			*state = v;
+
+			return 0;
+		}
+
+		if ((p = strchr(p, ',')))
+			p++;
+	}
+
+	return -1;
+}
+
+void changes_exit(void)
+{
+	while (count)
+		changes_drop();
+}
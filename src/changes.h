@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_CHANGES_H__
+#define __FREENETCONFD_CHANGES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHANGES_NS "urn:netconfd:changes"
+#define CHANGES_CAPABILITY "urn:netconfd:capability:changes:1.0"
+
+/* entries kept at most, whatever their size */
+#define CHANGES_MAX 1024
+
+struct xml_buf;
+
+void changes_add(const char *package, uint64_t from, uint64_t to, char *xml, size_t len);
+int changes_render(struct xml_buf *out, const char *package, uint64_t from, uint64_t to);
+void changes_token(struct xml_buf *out, const char *package, uint64_t state);
+int changes_parse(const char *token, const char *package, uint64_t *state);
+void changes_exit(void);
+
+#endif /* __FREENETCONFD_CHANGES_H__ */
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <zlib.h>
+
+#include "compress.h"
+
+/*
+ * Message compression
+ *
+ * Once both peers announced COMPRESS_CAPABILITY every base:1.1 message is
+ * sent as the deflate output for its XML, framed in chunks as usual. Each
+ * direction of a session is one raw deflate stream that lives as long as
+ * the session, so later messages are compressed against the ones before
+ * them. Every message ends with a sync flush, the peer can inflate it as
+ * soon as it is complete without waiting for more data.
+ *
+ * This file uses neither the event loop nor the daemon's globals, the
+ * benchmark tools link it as is.
+ */
+
+/* inflate buffers above this size are not kept between messages */
+#define COMPRESS_KEEP (64 * 1024)
+#define COMPRESS_MIN 4096
+
+struct compress
+{
+	z_stream def;
+	z_stream inf;
+	/* last inflated message */
+	char *buf;
+	size_t size;
+};
+
+/*
+ * compress_new() - start both streams of a session
+ *
+ * @int:	zlib level, 1 fastest to 9 smallest
+ *
+ * Returns NULL if zlib can not get its memory.
+ */
+struct compress *compress_new(int level)
+{
+	struct compress *z = calloc(1, sizeof(*z));
+
+	if (!z)
+		return NULL;
+
+	if (level < Z_BEST_SPEED || level > Z_BEST_COMPRESSION)
+		level = Z_DEFAULT_COMPRESSION;
+
+	if (deflateInit2(&z->def, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free(z);
+		return NULL;
+	}
+
+	if (inflateInit2(&z->inf, -MAX_WBITS) != Z_OK)
+	{
+		deflateEnd(&z->def);
+		free(z);
+		return NULL;
+	}
+
+	return z;
+}
+
+void compress_free(struct compress *z)
+{
+	if (!z)
+		return;
+
+	deflateEnd(&z->def);
+	inflateEnd(&z->inf);
+	free(z->buf);
+	free(z);
+}
+
+/* feed one piece to deflate, growing the output as needed */
+static int compress_feed(struct compress *z, const char *data, size_t len, int flush, char **out, size_t *used, size_t *size)
+{
+	size_t n;
+	char *p;
+	int rc;
+
+	do
+	{
+		if (*used == *size)
+		{
+			if (!(p = realloc(*out, *size * 2)))
+				return -1;
+
+			*out = p;
+			*size *= 2;
+		}
+
+		/* avail_in is an unsigned int */
+		n = len < UINT_MAX ? len : UINT_MAX;
+
+		z->def.next_in = (Bytef *) data;
+		z->def.avail_in = n;
+		z->def.next_out = (Bytef *) *out + *used;
+		z->def.avail_out = *size - *used;
+
+		rc = deflate(&z->def, n == len ? flush : Z_NO_FLUSH);
+
+		data += n - z->def.avail_in;
+		len -= n - z->def.avail_in;
+		*used = *size - z->def.avail_out;
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			return -1;
+	}
+	/* a flush is complete once deflate leaves output space unused */
+	while (len || (flush != Z_NO_FLUSH && *used == *size));
+
+	return 0;
+}
+
+/*
+ * compress_deflate() - compress one outgoing message
+ *
+ * @struct compress*:	session streams
+ * @const struct iovec*:	pieces of the message
+ * @int:		their number
+ * @char**:		set to the malloc'd output
+ * @size_t*:		set to its length
+ */
+int compress_deflate(struct compress *z, const struct iovec *parts, int n, char **out, size_t *out_len)
+{
+	size_t len = 0, used = 0, size;
+	int i;
+
+	for (i = 0; i < n; i++)
+		len += parts[i].iov_len;
+
+	/* repetitive xml shrinks well, the buffer grows for the rest */
+	size = len / 4 > COMPRESS_MIN ? len / 4 : COMPRESS_MIN;
+
+	if (!(*out = malloc(size)))
+		return -1;
+
+	for (i = 0; i < n; i++)
+	{
+		if (compress_feed(z, parts[i].iov_base, parts[i].iov_len, Z_NO_FLUSH, out, &used, &size))
+			goto fail;
+	}
+
+	if (compress_feed(z, NULL, 0, Z_SYNC_FLUSH, out, &used, &size))
+		goto fail;
+
+	*out_len = used;
+
+	return 0;
+
+fail:
+	free(*out);
+	*out = NULL;
+
+	return -1;
+}
+
+/*
+ * compress_inflate() - decompress one incoming message
+ *
+ * @struct compress*:	session streams
+ * @const char*:	compressed message
+ * @size_t:		its length
+ * @size_t:		largest decompressed size accepted
+ * @char**:		set to the NUL terminated message, valid until the next call
+ * @size_t*:		set to its length
+ */
+int compress_inflate(struct compress *z, const char *in, size_t len, size_t max, char **out, size_t *out_len)
+{
+	size_t used = 0, size;
+	char *p;
+	int rc;
+
+	if (z->size > COMPRESS_KEEP)
+	{
+		free(z->buf);
+		z->buf = NULL;
+		z->size = 0;
+	}
+
+	z->inf.next_in = (Bytef *) in;
+	z->inf.avail_in = len;
+
+	do
+	{
+		if (used == z->size)
+		{
+			if (used > max)
+				return -1;
+
+			size = z->size ? z->size * 2 : COMPRESS_MIN;
+
+			/* one more byte than max tells an oversized message apart */
+			if (max < SIZE_MAX && size > max + 1)
+				size = max + 1;
+
+			if (!(p = realloc(z->buf, size)))
+				return -1;
+
+			z->buf = p;
+			z->size = size;
+		}
+
+		z->inf.next_out = (Bytef *) z->buf + used;
+		z->inf.avail_out = z->size - used;
+
+		rc = inflate(&z->inf, Z_SYNC_FLUSH);
+		used = z->size - z->inf.avail_out;
+
+		/* the stream never ends while the session lasts */
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			return -1;
+
+		if (rc == Z_BUF_ERROR && z->inf.avail_in && z->inf.avail_out)
+			return -1;
+	}
+	while (z->inf.avail_in || used == z->size);
+
+	z->buf[used] = '\0';
+
+	*out = z->buf;
+	*out_len = used;
+
+	return 0;
+}
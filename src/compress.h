@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_COMPRESS_H__
+#define __FREENETCONFD_COMPRESS_H__
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* announced by both peers in their hello to compress base:1.1 messages */
+#define COMPRESS_CAPABILITY "urn:netconfd:capability:compression:zlib:1.0"
+
+/* per session zlib streams, one for each direction */
+struct compress;
+
+#ifdef ENABLE_ZLIB
+struct compress *compress_new(int level);
+void compress_free(struct compress *z);
+int compress_deflate(struct compress *z, const struct iovec *parts, int n, char **out, size_t *out_len);
+int compress_inflate(struct compress *z, const char *in, size_t len, size_t max, char **out, size_t *out_len);
+#else
+static inline struct compress *compress_new(int level) { return NULL; }
+static inline void compress_free(struct compress *z) { }
+static inline int compress_deflate(struct compress *z, const struct iovec *parts, int n, char **out, size_t *out_len) { return -1; }
+static inline int compress_inflate(struct compress *z, const char *in, size_t len, size_t max, char **out, size_t *out_len) { return -1; }
+#endif
+
+#endif /* __FREENETCONFD_COMPRESS_H__ */
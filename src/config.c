@@ -27,10 +27,45 @@
 
 #include "config.h"
 
+struct config_t config;
+
 enum
 {
 	ADDR,
 	PORT,
+	WORKERS,
+	HELLO_TIMEOUT,
+	IDLE_TIMEOUT,
+	RPC_TIMEOUT,
+	SCHED_QUANTUM,
+	SCHED_RPCS,
+	SSH_PORT,
+	SSH_HOSTKEY,
+	SSH_AUTHORIZED_KEYS,
+	TLS_PORT,
+	TLS_CERT,
+	TLS_KEY,
+	TLS_CA,
+	UNIX_PATH,
+	UNIX_MODE,
+	UNIX_ALLOW_UID,
+	UNIX_ALLOW_GID,
+	READ_BUFFER,
+	WRITE_BUFFER_MAX,
+	MAX_MESSAGE,
+	MAX_SESSIONS,
+	NOTIFY_INTERVAL,
+	LOG_LEVEL,
+	LOG_FILE,
+	TRACE_DIR,
+	SNMP_TRAP_ADDR,
+	SNMP_TRAP_PORT,
+	SNMP_COMMUNITY,
+	PUSH_DAMPENING,
+	REPLY_CACHE,
+	CHANGE_LOG,
+	COMPRESS_LEVEL,
+	HANDSHAKE_MAX,
 	__OPTIONS_COUNT
 };
 
@@ -38,6 +73,39 @@ const struct blobmsg_policy config_policy[__OPTIONS_COUNT] =
 {
 	[ADDR] = { .name = "addr", .type = BLOBMSG_TYPE_STRING },
 	[PORT] = { .name = "port", .type = BLOBMSG_TYPE_STRING },
+	[WORKERS] = { .name = "workers", .type = BLOBMSG_TYPE_INT32 },
+	[HELLO_TIMEOUT] = { .name = "hello_timeout", .type = BLOBMSG_TYPE_INT32 },
+	[IDLE_TIMEOUT] = { .name = "idle_timeout", .type = BLOBMSG_TYPE_INT32 },
+	[RPC_TIMEOUT] = { .name = "rpc_timeout", .type = BLOBMSG_TYPE_INT32 },
+	[SCHED_QUANTUM] = { .name = "sched_quantum", .type = BLOBMSG_TYPE_INT32 },
+	[SCHED_RPCS] = { .name = "sched_rpcs", .type = BLOBMSG_TYPE_INT32 },
+	[SSH_PORT] = { .name = "ssh_port", .type = BLOBMSG_TYPE_STRING },
+	[SSH_HOSTKEY] = { .name = "ssh_hostkey", .type = BLOBMSG_TYPE_STRING },
+	[SSH_AUTHORIZED_KEYS] = { .name = "ssh_authorized_keys", .type = BLOBMSG_TYPE_STRING },
+	[TLS_PORT] = { .name = "tls_port", .type = BLOBMSG_TYPE_STRING },
+	[TLS_CERT] = { .name = "tls_cert", .type = BLOBMSG_TYPE_STRING },
+	[TLS_KEY] = { .name = "tls_key", .type = BLOBMSG_TYPE_STRING },
+	[TLS_CA] = { .name = "tls_ca", .type = BLOBMSG_TYPE_STRING },
+	[UNIX_PATH] = { .name = "unix_path", .type = BLOBMSG_TYPE_STRING },
+	[UNIX_MODE] = { .name = "unix_mode", .type = BLOBMSG_TYPE_INT32 },
+	[UNIX_ALLOW_UID] = { .name = "unix_allow_uid", .type = BLOBMSG_TYPE_INT32 },
+	[UNIX_ALLOW_GID] = { .name = "unix_allow_gid", .type = BLOBMSG_TYPE_INT32 },
+	[READ_BUFFER] = { .name = "read_buffer", .type = BLOBMSG_TYPE_INT32 },
+	[WRITE_BUFFER_MAX] = { .name = "write_buffer_max", .type = BLOBMSG_TYPE_INT32 },
+	[MAX_MESSAGE] = { .name = "max_message", .type = BLOBMSG_TYPE_INT32 },
+	[MAX_SESSIONS] = { .name = "max_sessions", .type = BLOBMSG_TYPE_INT32 },
+	[NOTIFY_INTERVAL] = { .name = "notify_interval", .type = BLOBMSG_TYPE_INT32 },
+	[LOG_LEVEL] = { .name = "log_level", .type = BLOBMSG_TYPE_INT32 },
+	[LOG_FILE] = { .name = "log_file", .type = BLOBMSG_TYPE_STRING },
+	[TRACE_DIR] = { .name = "trace_dir", .type = BLOBMSG_TYPE_STRING },
+	[SNMP_TRAP_ADDR] = { .name = "snmp_trap_addr", .type = BLOBMSG_TYPE_STRING },
+	[SNMP_TRAP_PORT] = { .name = "snmp_trap_port", .type = BLOBMSG_TYPE_STRING },
+	[SNMP_COMMUNITY] = { .name = "snmp_community", .type = BLOBMSG_TYPE_STRING },
+	[PUSH_DAMPENING] = { .name = "push_dampening", .type = BLOBMSG_TYPE_INT32 },
+	[REPLY_CACHE] = { .name = "reply_cache", .type = BLOBMSG_TYPE_INT32 },
+	[CHANGE_LOG] = { .name = "change_log", .type = BLOBMSG_TYPE_INT32 },
+	[COMPRESS_LEVEL] = { .name = "compress_level", .type = BLOBMSG_TYPE_INT32 },
+	[HANDSHAKE_MAX] = { .name = "handshake_max", .type = BLOBMSG_TYPE_INT32 },
 };
 const struct uci_blob_param_list config_attr_list =
 {
@@ -45,17 +113,29 @@ const struct uci_blob_param_list config_attr_list =
 	.params = config_policy
 };
 
+static void config_get_string(char **dst, struct blob_attr *c, const char *def)
+{
+	if (c)
+		*dst = strdup(blobmsg_get_string(c));
+	else
+		*dst = def ? strdup(def) : NULL;
+}
+
+static void config_get_int(int *dst, struct blob_attr *c, int def)
+{
+	*dst = c ? (int) blobmsg_get_u32(c) : def;
+}
+
 /*
- * config_load() - load uci config file
+ * config_parse() - read uci config file into cfg
  *
- * Load and parse uci config file. If config file is found, parse configs to
- * internal structure defined in config.h.
+ * Options not set in the file get their defaults.
  */
-int config_load(void)
+static int config_parse(struct config_t *cfg)
 {
 	struct uci_context *uci = uci_alloc_context();
 	struct uci_package *conf = NULL;
-	struct blob_attr *tb[__OPTIONS_COUNT], *c;
+	struct blob_attr *tb[__OPTIONS_COUNT];
 	static struct blob_buf buf;
 
 	if (uci_load(uci, "netconfd", &conf))
@@ -70,21 +150,51 @@ int config_load(void)
 	uci_foreach_element(&conf->sections, section_elem)
 	{
 		struct uci_section *s = uci_to_section(section_elem);
+
+		/* other section types are read by the code they configure */
+		if (strcmp(s->type, "netconfd"))
+			continue;
+
 		uci_to_blob(&buf, s, &config_attr_list);
 	}
 
 	blobmsg_parse(config_policy, __OPTIONS_COUNT, tb, blob_data(buf.head), blob_len(buf.head));
 
-	/* defaults */
-	config.addr = NULL;
-	config.port = NULL;
-
-
-	if ((c = tb[ADDR]))
-		config.addr = strdup(blobmsg_get_string(c));
-
-	if ((c = tb[PORT]))
-		config.port = strdup(blobmsg_get_string(c));
+	config_get_string(&cfg->addr, tb[ADDR], NULL);
+	config_get_string(&cfg->port, tb[PORT], NULL);
+	config_get_int(&cfg->workers, tb[WORKERS], 1);
+	config_get_int(&cfg->hello_timeout, tb[HELLO_TIMEOUT], 30);
+	config_get_int(&cfg->idle_timeout, tb[IDLE_TIMEOUT], 3600);
+	config_get_int(&cfg->rpc_timeout, tb[RPC_TIMEOUT], 60);
+	config_get_int(&cfg->sched_quantum, tb[SCHED_QUANTUM], 65536);
+	config_get_int(&cfg->sched_rpcs, tb[SCHED_RPCS], 16);
+	config_get_string(&cfg->ssh_port, tb[SSH_PORT], "830");
+	config_get_string(&cfg->ssh_hostkey, tb[SSH_HOSTKEY], NULL);
+	config_get_string(&cfg->ssh_authorized_keys, tb[SSH_AUTHORIZED_KEYS], "/etc/netconfd/authorized_keys");
+	config_get_string(&cfg->tls_port, tb[TLS_PORT], "6513");
+	config_get_string(&cfg->tls_cert, tb[TLS_CERT], NULL);
+	config_get_string(&cfg->tls_key, tb[TLS_KEY], NULL);
+	config_get_string(&cfg->tls_ca, tb[TLS_CA], NULL);
+	config_get_string(&cfg->unix_path, tb[UNIX_PATH], NULL);
+	config_get_int(&cfg->unix_mode, tb[UNIX_MODE], -1);
+	config_get_int(&cfg->unix_allow_uid, tb[UNIX_ALLOW_UID], -1);
+	config_get_int(&cfg->unix_allow_gid, tb[UNIX_ALLOW_GID], -1);
+	config_get_int(&cfg->read_buffer, tb[READ_BUFFER], 16384);
+	config_get_int(&cfg->write_buffer_max, tb[WRITE_BUFFER_MAX], 4 * 1024 * 1024);
+	config_get_int(&cfg->max_message, tb[MAX_MESSAGE], 16 * 1024 * 1024);
+	config_get_int(&cfg->max_sessions, tb[MAX_SESSIONS], 256);
+	config_get_int(&cfg->notify_interval, tb[NOTIFY_INTERVAL], 3);
+	config_get_int(&cfg->log_level, tb[LOG_LEVEL], LOG_INFO);
+	config_get_string(&cfg->log_file, tb[LOG_FILE], "stderr");
+	config_get_string(&cfg->trace_dir, tb[TRACE_DIR], NULL);
+	config_get_string(&cfg->snmp_trap_addr, tb[SNMP_TRAP_ADDR], NULL);
+	config_get_string(&cfg->snmp_trap_port, tb[SNMP_TRAP_PORT], NULL);
+	config_get_string(&cfg->snmp_community, tb[SNMP_COMMUNITY], NULL);
+	config_get_int(&cfg->push_dampening, tb[PUSH_DAMPENING], 100);
+	config_get_int(&cfg->reply_cache, tb[REPLY_CACHE], 1024 * 1024);
+	config_get_int(&cfg->change_log, tb[CHANGE_LOG], 256 * 1024);
+	config_get_int(&cfg->compress_level, tb[COMPRESS_LEVEL], 6);
+	config_get_int(&cfg->handshake_max, tb[HANDSHAKE_MAX], 32);
 
 	blob_buf_free(&buf);
 	uci_unload(uci, conf);
@@ -93,8 +203,115 @@ int config_load(void)
 	return 0;
 }
 
+static void config_free(struct config_t *cfg)
+{
+	free(cfg->addr);
+	free(cfg->port);
+	free(cfg->ssh_port);
+	free(cfg->ssh_hostkey);
+	free(cfg->ssh_authorized_keys);
+	free(cfg->tls_port);
+	free(cfg->tls_cert);
+	free(cfg->tls_key);
+	free(cfg->tls_ca);
+	free(cfg->unix_path);
+	free(cfg->log_file);
+	free(cfg->trace_dir);
+	free(cfg->snmp_trap_addr);
+	free(cfg->snmp_trap_port);
+	free(cfg->snmp_community);
+}
+
+static bool config_string_changed(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a != b;
+
+	return strcmp(a, b);
+}
+
+/* option only read at startup, carry the running value over */
+static void config_keep_string(const char *name, char **new, char **old)
+{
+	if (config_string_changed(*new, *old))
+		LOG("change of %s takes effect after restart\n", name);
+
+	free(*new);
+	*new = *old;
+	*old = NULL;
+}
+
+static void config_keep_int(const char *name, int *new, int old)
+{
+	if (*new != old)
+		LOG("change of %s takes effect after restart\n", name);
+
+	*new = old;
+}
+
+/*
+ * config_load() - load uci config file
+ *
+ * Load and parse uci config file. If config file is found, parse configs to
+ * internal structure defined in config.h.
+ */
+int config_load(void)
+{
+	if (config_parse(&config))
+		return -1;
+
+	netconfd_log_level = config.log_level;
+
+	return 0;
+}
+
+/*
+ * config_reload() - load uci config file into running daemon
+ *
+ * Tunables are taken over as they are, the code using them reads them as
+ * needed. Workers and the ssh, tls and unix listeners are set up once at
+ * startup, changes to them are reported and ignored.
+ *
+ * Returns CONFIG_RELOAD_* flags for changes the caller has to apply and -1
+ * if the file could not be read.
+ */
+int config_reload(void)
+{
+	struct config_t cfg = { 0 };
+	int rc = 0;
+
+	if (config_parse(&cfg))
+		return -1;
+
+	if (config_string_changed(cfg.addr, config.addr) || config_string_changed(cfg.port, config.port))
+		rc |= CONFIG_RELOAD_LISTEN;
+
+	if (cfg.notify_interval != config.notify_interval)
+		rc |= CONFIG_RELOAD_NOTIFY;
+
+	config_keep_int("workers", &cfg.workers, config.workers);
+	config_keep_string("ssh_port", &cfg.ssh_port, &config.ssh_port);
+	config_keep_string("ssh_hostkey", &cfg.ssh_hostkey, &config.ssh_hostkey);
+	config_keep_string("ssh_authorized_keys", &cfg.ssh_authorized_keys, &config.ssh_authorized_keys);
+	config_keep_string("tls_port", &cfg.tls_port, &config.tls_port);
+	config_keep_string("tls_cert", &cfg.tls_cert, &config.tls_cert);
+	config_keep_string("tls_key", &cfg.tls_key, &config.tls_key);
+	config_keep_string("tls_ca", &cfg.tls_ca, &config.tls_ca);
+	config_keep_string("unix_path", &cfg.unix_path, &config.unix_path);
+	config_keep_int("unix_mode", &cfg.unix_mode, config.unix_mode);
+	config_keep_string("log_file", &cfg.log_file, &config.log_file);
+	config_keep_string("snmp_trap_addr", &cfg.snmp_trap_addr, &config.snmp_trap_addr);
+	config_keep_string("snmp_trap_port", &cfg.snmp_trap_port, &config.snmp_trap_port);
+
+	config_free(&config);
+	config = cfg;
+
+	netconfd_log_level = config.log_level;
+
+	return rc;
+}
+
 void config_exit(void)
 {
-	free(config.addr);
-	free(config.port);
+	config_free(&config);
 }
@@ -20,13 +20,70 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+/* changes config_reload() leaves to its caller */
+#define CONFIG_RELOAD_LISTEN (1 << 0)
+#define CONFIG_RELOAD_NOTIFY (1 << 1)
+
 int config_load(void);
+int config_reload(void);
 void config_exit(void);
 
 struct config_t
 {
 	char *addr;
 	char *port;
-} config;
+	int workers;
+	/* seconds, 0 disables */
+	int hello_timeout;
+	int idle_timeout;
+	int rpc_timeout;
+	/* per session budget of one scheduler turn, bytes and rpcs */
+	int sched_quantum;
+	int sched_rpcs;
+	/* ssh listener runs when a host key is set */
+	char *ssh_port;
+	char *ssh_hostkey;
+	char *ssh_authorized_keys;
+	/* tls listener runs when a certificate is set, pem files */
+	char *tls_port;
+	char *tls_cert;
+	char *tls_key;
+	char *tls_ca;
+	/* local listener runs when a path is set, -1 leaves mode or peers open */
+	char *unix_path;
+	int unix_mode;
+	int unix_allow_uid;
+	int unix_allow_gid;
+	/* bytes per session: read buffer, unsent replies before reading stops */
+	int read_buffer;
+	int write_buffer_max;
+	int max_message;
+	/* 0 for no limit */
+	int max_sessions;
+	/* seconds between netconf stream notifications, 0 disables */
+	int notify_interval;
+	/* syslog level, messages above it are dropped */
+	int log_level;
+	/* "stderr", "syslog" or a file name */
+	char *log_file;
+	/* directory for trace files, tracing is off while unset */
+	char *trace_dir;
+	/* trap listener runs when a port is set, any community unless one is set */
+	char *snmp_trap_addr;
+	char *snmp_trap_port;
+	char *snmp_community;
+	/* centiseconds between on-change updates unless a subscription asks otherwise */
+	int push_dampening;
+	/* bytes of get-config replies kept per worker, 0 disables */
+	int reply_cache;
+	/* bytes of uci changes kept per worker for get-changes, 0 disables */
+	int change_log;
+	/* zlib level of sessions that agreed to compression, 1 fastest to 9 smallest */
+	int compress_level;
+	/* ssh and tls handshakes running at once per worker, 0 for no limit */
+	int handshake_max;
+};
+
+extern struct config_t config;
 
 #endif /* __FREENETCONFD_CONFIG_H__ */
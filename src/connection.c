@@ -17,26 +17,53 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <netdb.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <sys/socket.h>
-#include <pthread.h>
+#include <sys/uio.h>
 
 #include <libubox/uloop.h>
+#include <libubox/blobmsg.h>
 #include <libubox/usock.h>
 #include <libubox/ustream.h>
 
 #include "netconfd/netconfd.h"
+#include "netconfd/arena.h"
 
 #include "config.h"
 #include "messages.h"
 #include "connection.h"
 #include "methods.h"
+#include "worker.h"
+#include "timer.h"
+#include "framing.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "provider.h"
+#include "metrics.h"
+#include "monitoring.h"
+#include "notification.h"
+#include "filter.h"
+#include "push.h"
+#include "cache.h"
+#include "compress.h"
 
 static void connection_accept_cb(struct uloop_fd *fd, unsigned int events);
+static void connection_unix_accept_cb(struct uloop_fd *fd, unsigned int events);
+static void connection_handoff_cb(struct uloop_fd *fd, unsigned int events);
 static void connection_close(struct ustream *s);
 
 static struct uloop_fd server = { .cb = connection_accept_cb };
-static struct connection *next_connection = NULL;
+static struct uloop_fd unix_server = { .cb = connection_unix_accept_cb, .fd = -1 };
+static struct uloop_fd handoff = { .cb = connection_handoff_cb };
+static int handoff_wr = -1;
+static pid_t unix_owner = 0;
 
 
 
@@ -58,409 +85,1494 @@ enum stream
 	STREAM_NONE,
 	STREAM_NETCONF,
 	STREAM_SNMP,
+	/* yang push subscriptions, grouped by push.c */
+	STREAM_PUSH,
 	_STREAM_MAX,
 };
 
 struct connection
 {
-	struct sockaddr_in sin;
+	struct sockaddr_storage addr;
 	struct ustream_fd us;
 	int step;
 	int base;
-	uint64_t msg_len;
-	char *buf;
+	struct framing framing;
+	bool closing;
 	int stream;
+	struct arena arena;
+	/* hello timeout until established, idle timeout afterwards */
+	struct timer timer;
+	/* deadline for a partially received rpc */
+	struct timer rpc_timer;
+	/* queued while it has more requests than one turn allows */
+	struct sched_entity sched;
+	/* in the members of group or push while stream is set */
+	struct list_head subscriber;
+	struct filter_group *group;
+	struct push_group *push;
+	uint32_t push_id;
+	/* waits for its first full push update */
+	bool push_sync;
+	/* reply waiting for ubus providers, later requests wait behind it */
+	struct provider_request *deferred;
+	/* netconf-state entry, registered once the hello is through */
+	struct monitoring_session *session;
+	/* ended by close-session rather than dropped */
+	bool closed;
+	/* both directions compressed once agreed in the hellos */
+	struct compress *zlib;
+};
+
+/* what a transport thread passes to the loop, small enough to be written atomically */
+struct connection_handoff_msg
+{
+	int fd;
+	int transport;
+	socklen_t len;
+	struct sockaddr_storage addr;
 };
 
-#define MAX_CONNECTION_NUM 10
-static struct connection *global_conn[MAX_CONNECTION_NUM];
-static int global_count = 0;
+/* subscribers of each stream grouped by filter */
+static struct filter_set stream_filters[_STREAM_MAX];
+static int stream_subscribers[_STREAM_MAX];
+static int session_count = 0;
+
+static void connection_unregister(struct connection *c)
+{
+	if (c->stream == STREAM_NONE)
+		return;
+
+	LOG("remove notify client\n");
+
+	list_del(&c->subscriber);
+
+	if (c->push)
+		push_group_put(c->push);
+	else
+		filter_group_put(&stream_filters[c->stream], c->group);
+
+	stream_subscribers[c->stream]--;
+	c->stream = STREAM_NONE;
+	c->group = NULL;
+	c->push = NULL;
+	stats.subscribers--;
+}
 
 static void notify_state(struct ustream *s)
 {
 	struct connection *c = container_of(s, struct connection, us.stream);
 
+	timer_cancel(&c->timer);
+	timer_cancel(&c->rpc_timer);
+	sched_remove(&c->sched);
+	connection_unregister(c);
+
+	if (c->deferred)
+		provider_request_abort(c->deferred);
+
+	if (c->step != NETCONF_MSG_STEP_HELLO)
+	{
+		if (!c->closed)
+			monitoring->dropped_sessions++;
+
+		monitoring_unlock_session(c->session->id);
+	}
+
+	trace_message(c->session->id, TRACE_CLOSE, c->base, NULL, 0);
+
+	monitoring_session_free(c->session);
 	ustream_free(&c->us.stream);
 	close(c->us.fd.fd);
 
+	if (c->zlib)
+		stats.compress_sessions--;
+
+	framing_free(&c->framing);
+	compress_free(c->zlib);
+	arena_free(&c->arena);
 	free(c);
 
+	session_count--;
+	stats.sessions--;
+
 	LOG("connection closed\n");
 }
 
-static void notify_read(struct ustream *s, int bytes)
+static void connection_timeout_cb(struct timer *t)
 {
-	struct connection *c = container_of(s, struct connection, us.stream);
+	struct connection *c = container_of(t, struct connection, timer);
 
-	char *data, *buf = NULL, *buf1 = NULL, *buf2 = NULL;
-	int data_len, rc;
+	if (c->step == NETCONF_MSG_STEP_HELLO)
+		LOG("hello not received within %d seconds\n", config.hello_timeout);
+	else
+		LOG("session idle for %d seconds\n", config.idle_timeout);
 
-	DEBUG("starting to read incoming data\n");
-
-	do
-	{
-		data = ustream_get_read_buf(s, &data_len);
+	connection_close(&c->us.stream);
+}
 
-		if (!data) break;
+static void connection_rpc_timeout_cb(struct timer *t)
+{
+	struct connection *c = container_of(t, struct connection, rpc_timer);
 
-		switch (c->step)
-		{
-			case NETCONF_MSG_STEP_HELLO:
-				DEBUG("handling hello\n");
+	LOG("rpc not completed within %d seconds\n", config.rpc_timeout);
 
-				buf1 = strchr(data, '<');
+	connection_close(&c->us.stream);
+}
 
-				if (!buf1)
-				{
-					LOG("start of hello message was not found\n");
-					connection_close(s);
-					return;
-				}
+/*
+ * connection_touch() - note activity on established session
+ *
+ * Notification subscribers only listen, so they are not subject to the idle
+ * timeout.
+ */
+static void connection_touch(struct connection *c)
+{
+	if (c->step == NETCONF_MSG_STEP_HELLO)
+		return;
 
-				if (buf1 != data)
-				{
-					LOG("start of hello message not found where expected\n");
-					connection_close(s);
-					return;
-				}
+	if (c->stream == STREAM_NONE && config.idle_timeout > 0)
+		timer_set(&c->timer, config.idle_timeout * 1000);
+	else
+		timer_cancel(&c->timer);
+}
 
-				buf2 = strstr(buf1, XML_NETCONF_BASE_1_0_END);
+static void connection_framing_init(struct connection *c, int base)
+{
+	framing_init(&c->framing, base);
 
-				if (!buf2)
-				{
-					DEBUG("end of netconf message was not found in this buffer\n");
-					return;
-				}
+	if (config.max_message > 0)
+		c->framing.max_size = config.max_message;
+}
 
-				*buf2 = '\0';
+/*
+ * Replies produced while handling one read are collected here and written
+ * with a single writev() once the session's turn is over. Sessions are
+ * handled one at a time, so one queue serves all of them.
+ */
+#define REPLY_QUEUE_MAX 64
+#define REPLY_HEADER_MAX 24
 
-				rc = method_analyze_message_hello(buf1, &c->base);
+static struct
+{
+	struct iovec iov[REPLY_QUEUE_MAX * 3];
+	char header[REPLY_QUEUE_MAX][REPLY_HEADER_MAX];
+	char *replies[REPLY_QUEUE_MAX];
+	struct cache_entry *cached[REPLY_QUEUE_MAX];
+	int n_iov;
+	int count;
+} reply_queue;
 
-				if (rc)
-				{
-					connection_close(s);
-					return;
-				}
+/*
+ * connection_flush() - write queued replies
+ *
+ * Writes straight to the socket when ustream holds no older data, anything
+ * the socket does not take right away is handed to ustream to buffer.
+ */
+static void connection_flush(struct connection *c)
+{
+	struct ustream *s = &c->us.stream;
+	ssize_t written = 0;
+	uint64_t start = metrics_now();
+	int i;
 
-				ustream_consume(s, buf2 + strlen(XML_NETCONF_BASE_1_0_END) - data);
+	if (!reply_queue.n_iov)
+		return;
 
-				if (c->base)
-					c->step = NETCONF_MSG_STEP_DATA_1;
-				else
-					c->step = NETCONF_MSG_STEP_DATA_0;
+	if (!ustream_pending_data(s, true) && !s->write_error)
+	{
+		do
+		{
+			written = writev(c->us.fd.fd, reply_queue.iov, reply_queue.n_iov);
+		}
+		while (written < 0 && errno == EINTR);
 
-				LOG("establishment completed\n");
-				break;
+		/* ustream reports real errors when it tries again */
+		if (written < 0)
+			written = 0;
+	}
 
-			default:
-				break;
-		}
+	for (i = 0; i < reply_queue.n_iov; i++)
+	{
+		struct iovec *iov = &reply_queue.iov[i];
 
-		data = ustream_get_read_buf(s, &data_len);
+		stats.bytes_out += iov->iov_len;
+		c->session->bytes_out += iov->iov_len;
 
-		if (!data) break;
-		switch (c->step)
+		if ((size_t) written >= iov->iov_len)
 		{
-			case NETCONF_MSG_STEP_DATA_0:
+			written -= iov->iov_len;
+			continue;
+		}
 
-				if (c->msg_len > (data_len + strlen(XML_NETCONF_BASE_1_0_END)))
-				{
-					c->step = NETCONF_MSG_STEP_DATA_1_BUF;
-					break;
-				}
+		ustream_write(s, (char *) iov->iov_base + written, iov->iov_len - written, i < reply_queue.n_iov - 1);
+		written = 0;
+	}
 
-				if (data_len < strlen(XML_NETCONF_BASE_1_0_END))
-				{
-					/* leftovers from netcat testing */
-					ustream_consume(s, data_len);
-					break;
-				}
+	for (i = 0; i < reply_queue.count; i++)
+	{
+		free(reply_queue.replies[i]);
+		cache_put(reply_queue.cached[i]);
+	}
 
-				buf2 = strstr(data, XML_NETCONF_BASE_1_0_END);
+	reply_queue.n_iov = 0;
+	reply_queue.count = 0;
 
-				if (!buf2)
-				{
-					connection_close(s);
-					return;
-				}
+	metrics_stage(METRICS_STAGE_WRITE, metrics_now() - start);
+}
 
-				*buf2 = '\0';
+static void connection_queue_parts(struct connection *c, const struct iovec *parts, int n, char *owned, struct cache_entry *cached);
 
-				DEBUG("received rpc\n\n %s\n\n", data);
-				rc = method_handle_message_rpc(data, &buf);
-				if (rc == -1)
-				{
-					/* FIXME */
-					connection_close(s);
-					return;
-				}
-				else if (rc == 3){
-					LOG("new client join netconf stream\n");
-					c->stream = STREAM_NETCONF;					
-					/* add c to global_conn */
-					global_conn[++global_count] = c;
-					if (global_conn[global_count] != c){
-						ERROR("store connetion failed\n");
-						return;
-					}
-					if (global_count > MAX_CONNECTION_NUM){
-						ERROR("reached the maximum number of connections\n");
-						return;
-					}		
-				}
-				else if (rc == 4){
-					LOG("new client join netconf snmp");
-					c->stream = STREAM_SNMP;
-					/* add c to global_conn */
-					global_conn[++global_count] = c;
-					if (global_conn[global_count] != c){
-						ERROR("store connetion failed\n");
-						return;
-					}
-					if (global_count > MAX_CONNECTION_NUM){
-						ERROR("reached the maximum number of connections\n");
-						return;
-					}	
-				}
-				if (rc == -1)
-				{
-					/* FIXME */
-					connection_close(s);
-					return;
-				}
+/*
+ * connection_queue() - frame message and queue it for connection_flush()
+ *
+ * @struct connection*:	session the message belongs to
+ * @char*:		message, must stay valid until the queue is flushed
+ * @size_t:		its length
+ * @bool:		whether the queue frees it once flushed
+ */
+static void connection_queue(struct connection *c, char *reply, size_t len, bool owned)
+{
+	const char *trailer = framing_trailer(c->base);
+	struct iovec part = { reply, len };
+	char *header;
+	int header_len;
 
-				DEBUG("sending rpc-reply\n\n %s\n\n", buf);
-				ustream_printf(s, "\n#%zu\n%s%s", strlen(buf), buf, XML_NETCONF_BASE_1_0_END);
-				free(buf);
+	if (c->zlib)
+	{
+		connection_queue_parts(c, &part, 1, owned ? reply : NULL, NULL);
+		return;
+	}
 
-				ustream_consume(s, buf2 + strlen(XML_NETCONF_BASE_1_0_END) - data);
-				c->msg_len = 0;
+	/* cached replies take more than three entries, count them too */
+	if (reply_queue.count == REPLY_QUEUE_MAX || reply_queue.n_iov + 3 > sizeof(reply_queue.iov) / sizeof(*reply_queue.iov))
+		connection_flush(c);
 
-				if (rc == 1)
-				{
-					connection_close(s);
-					return;
-				}
+	header = reply_queue.header[reply_queue.count];
+	header_len = framing_header(c->base, len, header, REPLY_HEADER_MAX);
 
-				break;
+	if (header_len > 0)
+		reply_queue.iov[reply_queue.n_iov++] = (struct iovec) { header, header_len };
 
-			case NETCONF_MSG_STEP_DATA_1:
+	reply_queue.iov[reply_queue.n_iov++] = (struct iovec) { reply, len };
+	reply_queue.iov[reply_queue.n_iov++] = (struct iovec) { (char *) trailer, strlen(trailer) };
+	reply_queue.replies[reply_queue.count] = owned ? reply : NULL;
+	reply_queue.cached[reply_queue.count++] = NULL;
+}
 
-				if (c->msg_len > (data_len + strlen(XML_NETCONF_BASE_1_1_END)))
-				{
-					c->step = NETCONF_MSG_STEP_DATA_1_BUF;
-					break;
-				}
+/*
+ * connection_deflate() - compress message for a session that agreed to it
+ *
+ * The output replaces the pieces, what they were held by is released right
+ * away. A message that can not be compressed would leave the peer's stream
+ * out of step, the session is closed instead.
+ */
+static int connection_deflate(struct connection *c, struct iovec *out, const struct iovec *parts, int n, char **owned, struct cache_entry **cached)
+{
+	struct ustream *s = &c->us.stream;
+	size_t raw = 0, len;
+	char *buf;
+	int i, rc;
 
-				if (data_len < strlen(XML_NETCONF_BASE_1_1_END))
-				{
-					/* leftovers from netcat testing */
-					ustream_consume(s, data_len);
-					break;
-				}
+	for (i = 0; i < n; i++)
+		raw += parts[i].iov_len;
 
-				buf2 = strstr(data, XML_NETCONF_BASE_1_1_END);
+	rc = compress_deflate(c->zlib, parts, n, &buf, &len);
 
-				if (!buf2)
-				{
-					connection_close(s);
-					return;
-				}
+	free(*owned);
+	cache_put(*cached);
+	*owned = NULL;
+	*cached = NULL;
+
+	if (rc)
+	{
+		ERROR("unable to compress message\n");
+		s->write_error = true;
+		ustream_state_change(s);
+		return -1;
+	}
 
-				*buf2 = '\0';
+	stats.compress_out_raw += raw;
+	stats.compress_out_wire += len;
 
-				DEBUG("received rpc\n\n %s\n\n", data);
-				rc = method_handle_message_rpc(data, &buf);
-				DEBUG("sending rpc-reply\n\n %s\n\n", buf);
-				ustream_printf(s, "\n#%zu\n%s%s", strlen(buf), buf, XML_NETCONF_BASE_1_1_END);
-				free(buf);
+	*owned = buf;
+	*out = (struct iovec) { buf, len };
 
-				ustream_consume(s, buf2 + strlen(XML_NETCONF_BASE_1_1_END) - data);
-				c->msg_len = 0;
+	return 0;
+}
 
-				if (rc == 1)
-				{
-					connection_close(s);
-					return;
-				}
+/*
+ * connection_queue_parts() - frame message made of pieces and queue it
+ *
+ * @struct connection*:	session the message belongs to
+ * @const struct iovec*:	pieces, must stay valid until the queue is flushed
+ * @int:		their number
+ * @char*:		malloc'd buffer freed once flushed, or NULL
+ * @struct cache_entry*:	reply cache reference dropped once flushed, or NULL
+ */
+static void connection_queue_parts(struct connection *c, const struct iovec *parts, int n, char *owned, struct cache_entry *cached)
+{
+	const char *trailer = framing_trailer(c->base);
+	struct iovec packed;
+	char *header;
+	size_t len = 0;
+	int i, header_len;
 
-				break;
+	if (c->zlib)
+	{
+		if (connection_deflate(c, &packed, parts, n, &owned, &cached))
+			return;
 
-			default:
-				break;
-		}
+		parts = &packed;
+		n = 1;
 	}
-	while (1);
+
+	if (reply_queue.count == REPLY_QUEUE_MAX || reply_queue.n_iov + n + 2 > sizeof(reply_queue.iov) / sizeof(*reply_queue.iov))
+		connection_flush(c);
+
+	for (i = 0; i < n; i++)
+		len += parts[i].iov_len;
+
+	header = reply_queue.header[reply_queue.count];
+	header_len = framing_header(c->base, len, header, REPLY_HEADER_MAX);
+
+	if (header_len > 0)
+		reply_queue.iov[reply_queue.n_iov++] = (struct iovec) { header, header_len };
+
+	for (i = 0; i < n; i++)
+		reply_queue.iov[reply_queue.n_iov++] = parts[i];
+
+	reply_queue.iov[reply_queue.n_iov++] = (struct iovec) { (char *) trailer, strlen(trailer) };
+	reply_queue.replies[reply_queue.count] = owned;
+	reply_queue.cached[reply_queue.count++] = cached;
 }
 
-static void connection_accept_cb(struct uloop_fd *fd, unsigned int events)
+/* queue malloc'd reply, the queue takes ownership */
+static void connection_queue_reply(struct connection *c, char *reply)
 {
-	struct connection *c;
-	unsigned int sl = sizeof(struct sockaddr_in);
-	int sfd, rc;
-	char *hello_message = NULL;
+	connection_queue(c, reply, strlen(reply), true);
+}
 
-	LOG("received new connection\n");
+/* queue reply whose body is a reply cache entry, the queue takes both */
+static void connection_queue_cached(struct connection *c, char *reply, struct cache_entry *e)
+{
+	char *pos = strstr(reply, "<!--" CACHE_MARKER "-->");
+	struct iovec parts[3];
 
-	if (!next_connection)
+	if (!pos)
 	{
-		next_connection = calloc(1, sizeof(*next_connection));
+		cache_put(e);
+		connection_queue_reply(c, reply);
+		return;
 	}
 
-	if (!next_connection)
+	parts[0] = (struct iovec) { reply, pos - reply };
+	parts[1] = (struct iovec) { e->data, e->len };
+	pos += strlen("<!--" CACHE_MARKER "-->");
+	parts[2] = (struct iovec) { pos, strlen(pos) };
+
+	connection_queue_parts(c, parts, 3, reply, e);
+}
+
+/* join stream, the filter is taken over */
+static int connection_subscribe(struct connection *c, int stream, struct filter *filter)
+{
+	struct filter_group *g;
+
+	if (c->stream != STREAM_NONE)
 	{
-		ERROR("not enough memory to accept connection\n");
-		return;
+		filter_free(filter);
+		return -1;
 	}
 
-	c = next_connection;
-	sfd = accept(server.fd, (struct sockaddr *) &c->sin, &sl);
+	if (!(g = filter_group_get(&stream_filters[stream], filter)))
+		return -1;
 
-//	printf("id : %d, port : %d\n", inet_ntoa(c->sin.sin_addr), c->sin.sin_port);
-	if (sfd < 0)
+	c->stream = stream;
+	c->group = g;
+	list_add_tail(&c->subscriber, &g->members);
+	stream_subscribers[stream]++;
+	stats.subscribers++;
+	connection_touch(c);
+
+	return 0;
+}
+
+/* start yang push subscription, the spec is taken over */
+static int connection_subscribe_push(struct connection *c, struct push_spec *spec)
+{
+	uint32_t id = spec->id;
+	struct push_group *g;
+
+	if (c->stream != STREAM_NONE)
 	{
-		ERROR("failed accepting connection\n");
-		return;
+		push_spec_free(spec);
+		return -1;
 	}
 
-	DEBUG("configuring connection parameters\n");
+	if (!(g = push_group_get(spec)))
+		return -1;
 
-	c->us.stream.string_data = true;
-	c->us.stream.notify_read = notify_read;
-	c->us.stream.notify_state = notify_state;
-	c->us.stream.r.buffer_len = 16384;
-	c->step = NETCONF_MSG_STEP_HELLO;
-	c->stream = STREAM_NONE;
+	c->stream = STREAM_PUSH;
+	c->push = g;
+	c->push_id = id;
+	c->push_sync = true;
+	list_add_tail(&c->subscriber, &g->members);
+	stream_subscribers[STREAM_PUSH]++;
+	stats.subscribers++;
+	connection_touch(c);
 
-	DEBUG("crafting hello message\n");
-	rc = method_create_message_hello(&hello_message);
+	push_group_join(g);
 
-	if (rc)
+	return 0;
+}
+
+/* subscribe for an accepted create-subscription, see struct method_subscription */
+static int connection_join(void *priv, int rc, struct filter *filter, struct push_spec *push)
+{
+	struct connection *c = priv;
+
+	if (rc == RPC_NOTIFY_PUSH_OK)
 	{
-		ERROR("failed to create hello message\n");
-		close(sfd);
+		LOG("new client join yang push\n");
+		return connection_subscribe_push(c, push);
+	}
+
+	if (rc == RPC_NOTIFY_SNMP_OK)
+	{
+		LOG("new client join netconf snmp\n");
+		return connection_subscribe(c, STREAM_SNMP, filter);
+	}
+
+	LOG("new client join netconf stream\n");
+	return connection_subscribe(c, STREAM_NETCONF, filter);
+}
+
+/*
+ * connection_congested() - whether too many replies wait to be sent
+ *
+ * A client that does not read its replies stops being served, its requests
+ * then pile up in the kernel instead of replies in our memory.
+ */
+static bool connection_congested(struct connection *c)
+{
+	return config.write_buffer_max > 0 && ustream_pending_data(&c->us.stream, true) > config.write_buffer_max;
+}
+
+static int connection_classify(struct sched_entity *e);
+
+/* providers answered, send the reply and go on with requests queued meanwhile */
+static void connection_deferred_cb(struct provider_request *r, char *reply, void *priv)
+{
+	struct connection *c = priv;
+
+	c->deferred = NULL;
+
+	if (!reply)
+	{
+		ERROR("unable to complete rpc-reply\n");
+		connection_close(&c->us.stream);
 		return;
 	}
 
-	ustream_fd_init(&c->us, sfd);
-	next_connection = NULL;
+	DEBUG("sending rpc-reply\n\n %.*s\n\n", NETCONFD_LOG_BODY, reply);
+	connection_queue_reply(c, reply);
+	connection_flush(c);
 
-	DEBUG("sending hello message\n");
-	ustream_printf(&c->us.stream, "%s%s", hello_message, XML_NETCONF_BASE_1_0_END);
-	free(hello_message);
+	if (!c->sched.queued)
+		sched_wake(&c->sched, connection_classify(&c->sched));
 }
 
-static void
-connection_close(struct ustream *s)
+/*
+ * connection_handle_message() - process one complete netconf message
+ *
+ * Returns 0 to continue, 1 to close the session once the queued replies
+ * are flushed and -1 to close it right away.
+ */
+static int connection_handle_message(struct connection *c, char *msg)
 {
-	struct connection *c = container_of(s, struct connection, us.stream);
+	struct provider_request *deferred;
+	struct cache_entry *cached;
+	struct method_subscription sub = { .join = connection_join, .priv = c };
+	char *reply = NULL;
+	bool compress;
+	int rc;
 
-	char *data;
-	int data_len;
-	int i;
+	while (*msg == ' ' || *msg == '\t' || *msg == '\r' || *msg == '\n')
+		msg++;
 
-	for (i = 1; i <= global_count; i++){
-		if (global_conn[i] == c){
-			LOG("remove notify client\n");
-			if (i == global_count){
-				global_conn[i] = NULL;
-			}
-			else{
-				global_conn[i] = global_conn[global_count];
-				global_conn[global_count] = NULL;
+	/* nothing but whitespace between two messages */
+	if (!*msg)
+		return 0;
+
+	if (c->step == NETCONF_MSG_STEP_HELLO)
+	{
+		DEBUG("handling hello\n");
+
+		if (*msg != '<')
+		{
+			LOG("start of hello message not found where expected\n");
+			return -1;
+		}
+
+		rc = method_analyze_message_hello(msg, &c->base, &compress, &c->arena);
+		arena_reset(&c->arena);
+
+		if (rc)
+		{
+			monitoring->in_bad_hellos++;
+			return -1;
+		}
+
+		/* msg is not used anymore, the decoder may drop it */
+		connection_framing_init(c, c->base);
+
+		/* chunked framing only, it carries the compressed bytes as they are */
+		if (compress && c->base)
+		{
+			if (!(c->zlib = compress_new(config.compress_level)))
+			{
+				ERROR("not enough memory for compressed session\n");
+				return -1;
 			}
-			global_count--;
+
+			stats.compress_sessions++;
+			LOG("compression agreed\n");
 		}
+
+		if (c->base)
+			c->step = NETCONF_MSG_STEP_DATA_1;
+		else
+			c->step = NETCONF_MSG_STEP_DATA_0;
+
+		connection_touch(c);
+
+		notification_event_time(c->session->login_time, sizeof(c->session->login_time));
+		monitoring_session_add(c->session);
+		monitoring->in_sessions++;
+
+		LOG("establishment completed\n");
+		return 0;
 	}
 
-	data = ustream_get_read_buf(s, &data_len);
+	DEBUG("received rpc\n\n %.*s\n\n", NETCONFD_LOG_BODY, msg);
+	sub.active = c->stream != STREAM_NONE;
+	rc = method_handle_message_rpc(msg, &reply, &c->arena, c->session, &deferred, &cached, &sub);
+	stats.rpcs++;
+	monitoring->in_rpcs++;
+	c->session->in_rpcs++;
 
-	if (data)
+	/* replies go out in order, nothing else is handled until this one is complete */
+	if (deferred)
 	{
-		ustream_consume(s, data_len);
+		if (provider_request_start(deferred, &reply, connection_deferred_cb, c))
+		{
+			c->deferred = deferred;
+			arena_reset(&c->arena);
+			return 0;
+		}
+
+		if (!reply)
+		{
+			ERROR("unable to complete rpc-reply\n");
+			arena_reset(&c->arena);
+			return -1;
+		}
 	}
 
-	ustream_set_read_blocked(s, true);
+	if (rc == -1)
+	{
+		stats.rpc_errors++;
+		monitoring->in_bad_rpcs++;
+		c->session->in_bad_rpcs++;
+		/* FIXME: reply with malformed-message */
+		free(reply);
+		cache_put(cached);
+		arena_reset(&c->arena);
+		return -1;
+	}
 
-	close(c->us.fd.fd);
+	if (reply)
+	{
+		DEBUG("sending rpc-reply\n\n %.*s\n\n", NETCONFD_LOG_BODY, reply);
 
-	LOG("closing connection\n");
+		if (cached)
+			connection_queue_cached(c, reply, cached);
+		else
+			connection_queue_reply(c, reply);
+	}
+
+	arena_reset(&c->arena);
+
+	if (rc == 1)
+		c->closed = true;
+
+	return rc == 1 ? 1 : 0;
 }
 
-int
-server_init()
+/* replace received message with what it decompresses to */
+static int connection_inflate(struct connection *c, char **msg, size_t *msg_len)
 {
-	server.fd = usock(USOCK_TCP | USOCK_SERVER, config.addr, config.port);
+	size_t len = *msg_len;
 
-	if (server.fd < 0)
-	{
-		ERROR("unable to open socket %s:%s\n", config.addr, config.port);
+	if (compress_inflate(c->zlib, *msg, len, c->framing.max_size, msg, msg_len))
 		return -1;
-	}
 
-	uloop_fd_add(&server, ULOOP_READ);
+	stats.compress_in_wire += len;
+	stats.compress_in_raw += *msg_len;
 
 	return 0;
 }
 
-void *
-subscription_netconf()
+/*
+ * connection_run() - handle complete messages within one turn's budget
+ *
+ * Clients may pipeline requests. Complete messages are processed until the
+ * input is exhausted or the budget of bytes or config.sched_rpcs requests
+ * is used up, then the replies are flushed together. At least one message
+ * is handled per turn however large it is.
+ *
+ * Returns the number of input bytes consumed.
+ */
+static int connection_run(struct sched_entity *e, int budget)
 {
-	LOG("subscription_netconf start\n");
-	struct connection *c;
-	int i = 1;
-	char *hello_message = NULL;
-	int flag = 0;
-	int rc;
+	struct connection *c = container_of(e, struct connection, sched);
+	struct ustream *s = &c->us.stream;
 
-	rc = method_create_notification_netconf(&hello_message);
-	if (rc)
+	char *data, *msg;
+	size_t msg_len;
+	uint64_t start;
+	int data_len, len, used = 0, rpcs = 0, rc = 0;
+
+	while (!c->closing && !c->deferred && used < budget && (config.sched_rpcs <= 0 || rpcs < config.sched_rpcs) &&
+		   !connection_congested(c) && (data = ustream_get_read_buf(s, &data_len)))
 	{
-		ERROR("failed to create notification_netconf message\n");
-		pthread_exit(0);
-	}
-	do{
-		if (global_count <= 0){
-			if (flag == 0){
-				LOG("none client notify stream_netconf\n");
-				flag = 1;
-			}
-			continue;
+		start = metrics_now();
+		len = framing_decode(&c->framing, data, data_len, &msg, &msg_len);
+		metrics_stage(METRICS_STAGE_FRAMING, metrics_now() - start);
+
+		if (len < 0)
+		{
+			LOG("invalid message framing\n");
+			rc = -1;
+			break;
 		}
-		else {
-			if (i > global_count){
-				i = 1;
-				continue;
-			}
-			else {
-				c = global_conn[i];
-				if (c->stream != STREAM_NETCONF)
+
+		if (msg && c->zlib && connection_inflate(c, &msg, &msg_len))
+		{
+			LOG("invalid compressed message\n");
+			rc = -1;
+		}
+		else if (msg)
+		{
+			trace_message(c->session->id, c->step == NETCONF_MSG_STEP_HELLO ? TRACE_HELLO : TRACE_RPC, c->base, msg, msg_len);
+			rc = connection_handle_message(c, msg);
+			rpcs++;
+		}
+
+		ustream_consume(s, len);
+		used += len;
+		stats.bytes_in += len;
+		c->session->bytes_in += len;
+
+		if (rc)
+			break;
+	}
+
+	connection_flush(c);
+
+	if (rc)
+	{
+		connection_close(s);
+		return used;
+	}
+
+	/* deadline only runs while a message is half received */
+	if (!framing_pending(&c->framing))
+		timer_cancel(&c->rpc_timer);
+	else if (config.rpc_timeout > 0 && !c->rpc_timer.pending)
+		timer_set(&c->rpc_timer, config.rpc_timeout * 1000);
+
+	return used;
+}
+
+/* class of the next request waiting in the read buffer */
+static int connection_classify(struct sched_entity *e)
+{
+	struct connection *c = container_of(e, struct connection, sched);
+
+	char *data;
+	int data_len;
+
+	if (c->closing || c->deferred || connection_congested(c) || !(data = ustream_get_read_buf(&c->us.stream, &data_len)))
+		return SCHED_CLASS_IDLE;
+
+	if (c->step == NETCONF_MSG_STEP_HELLO)
+		return SCHED_CLASS_SESSION;
+
+	/* continuation of a message whose start is already decoded */
+	if (framing_pending(&c->framing))
+		return SCHED_CLASS_DEFAULT;
+
+	return method_classify_rpc(data, data_len);
+}
+
+/*
+ * notify_read() - give session one turn as soon as data arrives
+ *
+ * Whatever does not fit into that turn is left to the scheduler, so a
+ * session flooding requests can not hold up the others.
+ */
+static void notify_read(struct ustream *s, int bytes)
+{
+	struct connection *c = container_of(s, struct connection, us.stream);
+
+	DEBUG("starting to read incoming data\n");
+
+	connection_touch(c);
+
+	/* already waiting for its turn, new data is handled then */
+	if (c->sched.queued)
+		return;
+
+	connection_run(&c->sched, sched_quantum());
+	sched_wake(&c->sched, connection_classify(&c->sched));
+}
+
+/* replies went out, resume a session that was held back by its backlog */
+static void notify_write(struct ustream *s, int bytes)
+{
+	struct connection *c = container_of(s, struct connection, us.stream);
+
+	if (c->sched.queued || connection_congested(c))
+		return;
+
+	sched_wake(&c->sched, connection_classify(&c->sched));
+}
+
+/*
+ * connection_attach() - start netconf session on connected socket
+ *
+ * @int:			connected stream socket, owned by the session
+ * @const struct sockaddr*:	peer address, NULL if there is none
+ * @socklen_t:			length of peer address
+ * @int:			enum monitoring_transport
+ *
+ * Sends our hello and waits for the client's. The socket is closed on
+ * failure.
+ */
+int connection_attach(int fd, const struct sockaddr *addr, socklen_t len, int transport)
+{
+	struct monitoring_session *session;
+	struct connection *c;
+	char *hello_message = NULL;
+	int rc;
+
+	if (config.max_sessions > 0 && session_count >= config.max_sessions)
+	{
+		LOG("rejecting connection, %d sessions open\n", session_count);
+		stats.sessions_rejected++;
+		close(fd);
+		return -1;
+	}
+
+	/* with several workers, every session needs a place in the shared table */
+	if (!(session = monitoring_session_new()))
+	{
+		LOG("rejecting connection, no room to list another session\n");
+		stats.sessions_rejected++;
+		close(fd);
+		return -1;
+	}
+
+	c = calloc(1, sizeof(*c));
+
+	if (!c)
+	{
+		ERROR("not enough memory to accept connection\n");
+		monitoring_session_free(session);
+		close(fd);
+		return -1;
+	}
+
+	c->session = session;
+
+	if (addr && len <= sizeof(c->addr))
+	{
+		memcpy(&c->addr, addr, len);
+
+		if (addr->sa_family == AF_INET)
+			inet_ntop(AF_INET, &((struct sockaddr_in *) addr)->sin_addr, c->session->source_host, sizeof(c->session->source_host));
+		else if (addr->sa_family == AF_INET6)
+			inet_ntop(AF_INET6, &((struct sockaddr_in6 *) addr)->sin6_addr, c->session->source_host, sizeof(c->session->source_host));
+	}
+
+	c->session->transport = transport;
+
+	DEBUG("configuring connection parameters\n");
+
+	c->us.stream.string_data = true;
+	c->us.stream.notify_read = notify_read;
+	c->us.stream.notify_state = notify_state;
+	c->us.stream.notify_write = notify_write;
+	c->us.stream.r.buffer_len = config.read_buffer > 0 ? config.read_buffer : 16384;
+	c->step = NETCONF_MSG_STEP_HELLO;
+	c->stream = STREAM_NONE;
+	c->closing = false;
+	connection_framing_init(c, 0);
+	c->timer.cb = connection_timeout_cb;
+	c->rpc_timer.cb = connection_rpc_timeout_cb;
+	c->sched.run = connection_run;
+	c->sched.classify = connection_classify;
+	arena_init(&c->arena, 0);
+
+	DEBUG("crafting hello message\n");
+	rc = method_create_message_hello(&hello_message, &c->session->id);
+
+	if (rc)
+	{
+		ERROR("failed to create hello message\n");
+		framing_free(&c->framing);
+		monitoring_session_free(c->session);
+		free(c);
+		close(fd);
+		return -1;
+	}
+
+	ustream_fd_init(&c->us, fd);
+	session_count++;
+	stats.sessions++;
+	stats.sessions_accepted++;
+
+	DEBUG("sending hello message\n");
+	ustream_printf(&c->us.stream, "%s%s", hello_message, XML_NETCONF_BASE_1_0_END);
+	free(hello_message);
+
+	if (config.hello_timeout > 0)
+		timer_set(&c->timer, config.hello_timeout * 1000);
+
+	return 0;
+}
+
+static void connection_accept_cb(struct uloop_fd *fd, unsigned int events)
+{
+	struct sockaddr_storage addr;
+	socklen_t sl = sizeof(addr);
+	int sfd;
+
+	LOG("received new connection\n");
+
+	sfd = accept(fd->fd, (struct sockaddr *) &addr, &sl);
+
+	if (sfd < 0)
+	{
+		ERROR("failed accepting connection\n");
+		return;
+	}
+
+	connection_attach(sfd, (struct sockaddr *) &addr, sl, TRANSPORT_TCP);
+}
+
+/* peers are let in if their uid or gid is allowed, root always is */
+static bool connection_unix_allowed(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (config.unix_allow_uid < 0 && config.unix_allow_gid < 0)
+		return true;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+		return false;
+
+	if (cred.uid == 0)
+		return true;
+
+	if (config.unix_allow_uid >= 0 && cred.uid == (uid_t) config.unix_allow_uid)
+		return true;
+
+	if (config.unix_allow_gid >= 0 && cred.gid == (gid_t) config.unix_allow_gid)
+		return true;
+
+	LOG("rejecting local client uid %d gid %d pid %d\n", (int) cred.uid, (int) cred.gid, (int) cred.pid);
+
+	return false;
+}
+
+static void connection_unix_accept_cb(struct uloop_fd *fd, unsigned int events)
+{
+	int sfd;
+
+	sfd = accept4(fd->fd, NULL, NULL, SOCK_CLOEXEC);
+
+	/* workers share the socket, another one may have been faster */
+	if (sfd < 0)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			ERROR("failed accepting local connection\n");
+
+		return;
+	}
+
+	LOG("received new local connection\n");
+
+	if (!connection_unix_allowed(sfd))
+	{
+		close(sfd);
+		return;
+	}
+
+	connection_attach(sfd, NULL, 0, TRANSPORT_UNIX);
+}
+
+/*
+ * connection_handoff() - pass socket to the event loop
+ *
+ * @int:	socket the session is run on
+ * @int:	enum monitoring_transport
+ * @int:	socket connected to the client, for its address, -1 if none
+ *
+ * Transports that terminate a secure channel on their own threads hand the
+ * plain text end of a socket pair over here. Safe to call from any thread,
+ * the session is started by connection_attach() on the loop.
+ */
+int connection_handoff(int fd, int transport, int peer)
+{
+	struct connection_handoff_msg m = { .fd = fd, .transport = transport, .len = sizeof(m.addr) };
+	ssize_t n;
+
+	if (peer < 0 || getpeername(peer, (struct sockaddr *) &m.addr, &m.len))
+		m.len = 0;
+
+	do
+	{
+		n = write(handoff_wr, &m, sizeof(m));
+	}
+	while (n < 0 && errno == EINTR);
+
+	return n == sizeof(m) ? 0 : -1;
+}
+
+/*
+ * Handshakes of the ssh and tls transports run on their own threads before
+ * there is a session to count against max_sessions. At most
+ * config.handshake_max of them run in a worker, and each gets
+ * config.hello_timeout seconds in total: the loop then shuts the socket
+ * down, which fails whatever blocking io the thread is waiting in.
+ */
+enum
+{
+	HANDSHAKE_RUNNING,
+	HANDSHAKE_DONE,
+	HANDSHAKE_EXPIRING,
+	HANDSHAKE_EXPIRED,
+};
+
+struct handshake
+{
+	struct timer timer;
+	int fd;
+	int state;
+	/* held by the transport thread and, while armed, the timer */
+	int refs;
+};
+
+static int handshakes = 0;
+
+static void connection_handshake_put(struct handshake *h)
+{
+	if (!__atomic_sub_fetch(&h->refs, 1, __ATOMIC_ACQ_REL))
+		free(h);
+}
+
+static void connection_handshake_timeout_cb(struct timer *t)
+{
+	struct handshake *h = container_of(t, struct handshake, timer);
+	int state = HANDSHAKE_RUNNING;
+
+	if (__atomic_compare_exchange_n(&h->state, &state, HANDSHAKE_EXPIRING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		LOG("handshake not completed within %d seconds\n", config.hello_timeout);
+		shutdown(h->fd, SHUT_RDWR);
+		__atomic_store_n(&h->state, HANDSHAKE_EXPIRED, __ATOMIC_RELEASE);
+		stats.handshakes_expired++;
+	}
+
+	connection_handshake_put(h);
+}
+
+/*
+ * connection_handshake_start() - admit handshake of a secure transport
+ *
+ * @int:	accepted socket, must stay open until connection_handshake_done()
+ *
+ * Called on the loop. Returns NULL if the connection is to be refused.
+ */
+struct handshake *connection_handshake_start(int fd)
+{
+	struct handshake *h;
+	int running = __atomic_load_n(&handshakes, __ATOMIC_ACQUIRE);
+
+	if (config.handshake_max > 0 && running >= config.handshake_max)
+	{
+		LOG("rejecting connection, %d handshakes running\n", running);
+		stats.handshakes_rejected++;
+		return NULL;
+	}
+
+	if (!(h = calloc(1, sizeof(*h))))
+		return NULL;
+
+	h->fd = fd;
+	h->state = HANDSHAKE_RUNNING;
+	h->refs = 1;
+	h->timer.cb = connection_handshake_timeout_cb;
+
+	if (config.hello_timeout > 0)
+	{
+		h->refs++;
+		timer_set(&h->timer, config.hello_timeout * 1000);
+	}
+
+	__atomic_add_fetch(&handshakes, 1, __ATOMIC_ACQ_REL);
+
+	return h;
+}
+
+/*
+ * connection_handshake_done() - end handshake started on the loop
+ *
+ * Safe to call from any thread, exactly once per handshake and before the
+ * socket is closed. Returns -1 if the deadline passed first.
+ */
+int connection_handshake_done(struct handshake *h)
+{
+	int state = HANDSHAKE_RUNNING;
+	bool done = __atomic_compare_exchange_n(&h->state, &state, HANDSHAKE_DONE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+	/* the loop is shutting the socket down, it may not be closed under it */
+	while (!done && __atomic_load_n(&h->state, __ATOMIC_ACQUIRE) == HANDSHAKE_EXPIRING)
+		sched_yield();
+
+	__atomic_sub_fetch(&handshakes, 1, __ATOMIC_ACQ_REL);
+	connection_handshake_put(h);
+
+	return done ? 0 : -1;
+}
+
+static void connection_handoff_cb(struct uloop_fd *fd, unsigned int events)
+{
+	struct connection_handoff_msg m;
+
+	/* writes up to PIPE_BUF bytes are atomic */
+	while (read(fd->fd, &m, sizeof(m)) == sizeof(m))
+		connection_attach(m.fd, m.len ? (struct sockaddr *) &m.addr : NULL, m.len, m.transport);
+}
+
+static int connection_handoff_init(void)
+{
+	int p[2];
+
+	if (pipe2(p, O_CLOEXEC))
+		return -1;
+
+	handoff.fd = p[0];
+	handoff_wr = p[1];
+
+	/* uloop makes the read end non-blocking, writers may block */
+	uloop_fd_add(&handoff, ULOOP_READ);
+
+	return 0;
+}
+
+/*
+ * connection_close() - stop session and schedule its release
+ *
+ * Called from within ustream callbacks, so the connection itself is freed
+ * later from notify_state() once ustream has unwound.
+ */
+static void
+connection_close(struct ustream *s)
+{
+	struct connection *c = container_of(s, struct connection, us.stream);
+
+	char *data;
+	int data_len;
+
+	if (c->closing)
+		return;
+
+	c->closing = true;
+
+	timer_cancel(&c->timer);
+	timer_cancel(&c->rpc_timer);
+	sched_remove(&c->sched);
+	connection_unregister(c);
+
+	if (c->deferred)
+	{
+		provider_request_abort(c->deferred);
+		c->deferred = NULL;
+	}
+
+	data = ustream_get_read_buf(s, &data_len);
+
+	if (data)
+	{
+		ustream_consume(s, data_len);
+	}
+
+	ustream_set_read_blocked(s, true);
+	ustream_state_change(s);
+
+	LOG("closing connection\n");
+}
+
+/*
+ * server_socket_reuseport() - open listening socket shared between workers
+ *
+ * usock() does not set SO_REUSEPORT, so every worker binds its own socket
+ * here and the kernel spreads incoming connections across them.
+ */
+static int
+server_socket_reuseport(const char *host, const char *service)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE,
+	};
+	struct addrinfo *result, *rp;
+	int fd = -1, yes = 1;
+
+	if (getaddrinfo(host, service, &hints, &result))
+		return -1;
+
+	for (rp = result; rp; rp = rp->ai_next)
+	{
+		fd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+		if (fd < 0)
+			continue;
+
+		if (!setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) &&
+			!setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) &&
+			!bind(fd, rp->ai_addr, rp->ai_addrlen) &&
+			!listen(fd, SOMAXCONN))
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	return fd;
+}
+
+/*
+ * connection_listen() - open listening tcp socket
+ *
+ * Every worker gets its own socket when there are several of them.
+ */
+int
+connection_listen(const char *host, const char *service)
+{
+	if (worker_count > 1)
+		return server_socket_reuseport(host, service);
+
+	return usock(USOCK_TCP | USOCK_SERVER, host, service);
+}
+
+/*
+ * server_unix_init() - open local listening socket
+ *
+ * Called before workers are forked, a unix socket path can not be bound
+ * more than once, so they all accept on this one. Does nothing unless
+ * unix_path is set.
+ */
+int
+server_unix_init(void)
+{
+	if (!config.unix_path)
+		return 0;
+
+	/* left over from a previous run that did not exit cleanly */
+	unlink(config.unix_path);
+
+	unix_server.fd = usock(USOCK_UNIX | USOCK_SERVER, config.unix_path, NULL);
+
+	if (unix_server.fd < 0)
+	{
+		ERROR("unable to open socket %s\n", config.unix_path);
+		return -1;
+	}
+
+	if (config.unix_mode >= 0 && chmod(config.unix_path, config.unix_mode))
+		ERROR("unable to change mode of %s\n", config.unix_path);
+
+	unix_owner = getpid();
+
+	return 0;
+}
+
+void
+server_unix_exit(void)
+{
+	if (unix_server.fd < 0)
+		return;
+
+	if (unix_server.registered)
+		uloop_fd_delete(&unix_server);
+
+	close(unix_server.fd);
+	unix_server.fd = -1;
+
+	/* workers come and go, the socket belongs to whoever created it */
+	if (getpid() == unix_owner)
+		unlink(config.unix_path);
+}
+
+/*
+ * server_rebind() - move tcp listener to configured address
+ *
+ * The old socket is only closed once the new one is listening, sessions
+ * accepted on it are not affected.
+ */
+int
+server_rebind(void)
+{
+	int fd = connection_listen(config.addr, config.port);
+
+	if (fd < 0)
+	{
+		ERROR("unable to open socket %s:%s, keeping the old one\n", config.addr, config.port);
+		return -1;
+	}
+
+	uloop_fd_delete(&server);
+	close(server.fd);
+
+	server.fd = fd;
+	uloop_fd_add(&server, ULOOP_READ);
+
+	LOG("accepting connections on '%s:%s'\n", config.addr, config.port);
+
+	return 0;
+}
+
+int
+server_init()
+{
+	server.fd = connection_listen(config.addr, config.port);
+
+	if (server.fd < 0)
+	{
+		ERROR("unable to open socket %s:%s\n", config.addr, config.port);
+		return -1;
+	}
+
+	if (connection_handoff_init())
+	{
+		ERROR("unable to create handoff pipe\n");
+		close(server.fd);
+		return -1;
+	}
+
+	uloop_fd_add(&server, ULOOP_READ);
+
+	if (unix_server.fd >= 0)
+	{
+		uloop_fd_add(&unix_server, ULOOP_READ);
+		LOG("accepting local connections on '%s'\n", config.unix_path);
+	}
+
+	return 0;
+}
+
+/* stream id for a name used in create-subscription, -1 if unknown */
+int
+connection_stream_id(const char *name)
+{
+	if (!name || !strcmp(name, "netconf"))
+		return STREAM_NETCONF;
+
+	if (!strcmp(name, "snmp"))
+		return STREAM_SNMP;
+
+	return -1;
+}
+
+/* number of sessions of this worker subscribed to stream */
+int
+connection_subscribers(int stream)
+{
+	if (stream < 0 || stream >= _STREAM_MAX)
+		return 0;
+
+	return stream_subscribers[stream];
+}
+
+/*
+ * connection_notify() - fan out encoded notifications
+ *
+ * @int:		stream id
+ * @char**:		messages, still owned by the caller
+ * @size_t*:		their lengths
+ * @int:		number of messages
+ *
+ * Filters are matched once per group of subscribers with equal filters,
+ * each subscriber then gets what passed its group's filter with one write.
+ * Subscribers that can not keep up lose notifications rather than grow
+ * without bounds.
+ */
+void
+connection_notify(int stream, char **msgs, size_t *lens, int n)
+{
+	struct filter_group *g;
+	struct connection *c;
+	int i, k, passed;
+
+	if (stream < 0 || stream >= _STREAM_MAX || !stream_subscribers[stream])
+		return;
+
+	/* group masks hold one bit per message */
+	for (; n > 0; msgs += k, lens += k, n -= k)
+	{
+		k = n < 64 ? n : 64;
+
+		filter_set_match(&stream_filters[stream], msgs, lens, k);
+
+		list_for_each_entry(g, &stream_filters[stream].groups, list)
+		{
+			passed = __builtin_popcountll(g->mask);
+
+			list_for_each_entry(c, &g->members, subscriber)
+			{
+				if (c->closing)
+					continue;
+
+				stats.notifications_filtered += k - passed;
+
+				if (!passed)
+					continue;
+
+				if (connection_congested(c))
+				{
+					stats.notifications_dropped += passed;
 					continue;
-				sleep(3);
-				ustream_printf(&c->us.stream, "%s", hello_message);
-				i++;
+				}
+
+				for (i = 0; i < k; i++)
+				{
+					if (g->mask & (uint64_t) 1 << i)
+						connection_queue(c, msgs[i], lens[i], false);
+				}
+
+				connection_flush(c);
+				stats.notifications_sent += passed;
+				monitoring->out_notifications += passed;
+				c->session->out_notifications += passed;
 			}
 		}
-	}while(1);
+	}
 }
 
-int 
+/*
+ * connection_push() - write yang push update to the members of a group
+ *
+ * @struct list_head*:	members of the push group
+ * @const char*:	message up to the subscription id
+ * @size_t:		its length
+ * @const char*:	message after the id
+ * @size_t:		its length
+ * @bool:		to members still waiting for their first update only
+ *
+ * Both parts are shared, each member only adds its id. Returns the number
+ * of members still waiting for their first update because their session
+ * is backed up.
+ */
+int
+connection_push(struct list_head *members, const char *head, size_t head_len, const char *body, size_t body_len, bool sync)
+{
+	struct connection *c;
+	struct iovec parts[3];
+	int waiting = 0;
+	char id[16];
+
+	list_for_each_entry(c, members, subscriber)
+	{
+		if (c->closing || c->push_sync != sync)
+			continue;
+
+		/* the first update is kept for a later try, later ones are dropped */
+		if (connection_congested(c))
+		{
+			if (c->push_sync)
+				waiting++;
+			else
+				stats.notifications_dropped++;
+
+			continue;
+		}
+
+		c->push_sync = false;
+
+		parts[0] = (struct iovec) { (char *) head, head_len };
+		parts[1] = (struct iovec) { id, snprintf(id, sizeof(id), "%u", c->push_id) };
+		parts[2] = (struct iovec) { (char *) body, body_len };
+
+		connection_queue_parts(c, parts, 3, NULL, NULL);
+		connection_flush(c);
+
+		stats.notifications_sent++;
+		monitoring->out_notifications++;
+		c->session->out_notifications++;
+	}
+
+	return waiting;
+}
+
+static void subscription_netconf_cb(struct uloop_timeout *t);
+
+static struct uloop_timeout notify_timer = { .cb = subscription_netconf_cb };
+static char *notification_netconf = NULL;
+
+/* send the netconf stream notification to every subscriber */
+static void subscription_netconf_cb(struct uloop_timeout *t)
+{
+	size_t len = strlen(notification_netconf);
+
+	connection_notify(STREAM_NETCONF, &notification_netconf, &len, 1);
+
+	if (config.notify_interval > 0)
+		uloop_timeout_set(t, config.notify_interval * 1000);
+}
+
+/* (re)start notifications with the configured interval */
+void
+subscription_reschedule(void)
+{
+	if (config.notify_interval > 0)
+		uloop_timeout_set(&notify_timer, config.notify_interval * 1000);
+	else
+		uloop_timeout_cancel(&notify_timer);
+}
+
+int
 subscription_init()
 {
-	pthread_t stream_netconf_pid;
-
-    pthread_attr_t attr1;  
-    pthread_attr_init(&attr1);  
-    pthread_attr_setdetachstate(&attr1, PTHREAD_CREATE_DETACHED); 
-
-    // 创建stream netconf的订阅上报线程
-    if(pthread_create(&stream_netconf_pid, &attr1, subscription_netconf, NULL) == -1){
-        ERROR("fail to create pthread subscription_netconf\n");
-        return -1;
-    }
-	if(pthread_join(stream_netconf_pid, NULL) == -1){
-        ERROR("fail to join pthread subscription_netconf\n");
-        return -1;
-    }
-    return 0;
-}
\ No newline at end of file
+	int i;
+
+	for (i = 0; i < _STREAM_MAX; i++)
+		filter_set_init(&stream_filters[i]);
+
+	if (method_create_notification_netconf(&notification_netconf))
+	{
+		ERROR("failed to create notification_netconf message\n");
+		return -1;
+	}
+
+	subscription_reschedule();
+
+	return 0;
+}
@@ -16,8 +16,27 @@
 #ifndef __FREENETCONFD_CONNECTION_H__
 #define __FREENETCONFD_CONNECTION_H__
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+struct list_head;
+struct handshake;
+
 int server_init();
+int server_rebind(void);
+int server_unix_init(void);
+void server_unix_exit(void);
+int connection_listen(const char *host, const char *service);
+int connection_attach(int fd, const struct sockaddr *addr, socklen_t len, int transport);
+int connection_handoff(int fd, int transport, int peer);
+struct handshake *connection_handshake_start(int fd);
+int connection_handshake_done(struct handshake *h);
+int connection_stream_id(const char *name);
+int connection_subscribers(int stream);
+void connection_notify(int stream, char **msgs, size_t *lens, int n);
+int connection_push(struct list_head *members, const char *head, size_t head_len, const char *body, size_t body_len, bool sync);
 int subscription_init();
-void *subscription_netconf();
+void subscription_reschedule(void);
 
 #endif /* __FREENETCONFD_CONNECTION_H__ */
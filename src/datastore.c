@@ -0,0 +1,1255 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libubox/list.h>
+#include <uci.h>
+#include <uci_blob.h>
+
+#include "netconfd/netconfd.h"
+#include "netconfd/netconf.h"
+
+#include "datastore.h"
+#include "methods.h"
+#include "xml.h"
+#include "stats.h"
+#include "config.h"
+#include "changes.h"
+
+/*
+ * UCI datastore
+ *
+ * Exposes the uci packages listed in the "uci" config section as
+ * configuration:
+ *
+ *   <uci xmlns="urn:netconfd:uci">
+ *     <package name="network">
+ *       <section name="lan" type="interface">
+ *         <option name="proto">static</option>
+ *         <list name="dns"><value>192.0.2.1</value></list>
+ *       </section>
+ *     </package>
+ *   </uci>
+ *
+ * Packages stay loaded in one uci context together with their rendered
+ * xml. Both are reused as long as the file's mtime, size and inode are
+ * unchanged, so a get-config costs a stat() per package. edit-config only
+ * touches options whose value differs and commits each changed package
+ * once, after all of the request has been applied.
+ *
+ * Every package remembers the datastore version it last changed at, so
+ * on-change subscriptions can render just the packages changed since
+ * their previous update. The watch callback learns about each change.
+ *
+ * While the change log is on, a snapshot of every loaded package is kept.
+ * A change compares it to the new state and logs the difference as the
+ * <package> element of an edit-config that makes the same change, along
+ * with the states of the file before and after it.
+ */
+struct datastore_snapshot;
+
+struct datastore_package
+{
+	struct list_head list;
+	char *name;
+	struct uci_package *pkg;
+	/* file state pkg was loaded from */
+	struct stat st;
+	/* pkg rendered, valid while xml.data is set */
+	struct xml_buf xml;
+	/* changed by the edit in progress */
+	bool dirty;
+	/* version at the last change */
+	uint32_t changed;
+	/* state the change log compares the next change to */
+	struct datastore_snapshot *snap;
+	/* the file was missing, its return is a change */
+	bool gone;
+};
+
+enum
+{
+	DATASTORE_NS,
+	DATASTORE_PACKAGE,
+	__DATASTORE_MAX
+};
+
+static const struct blobmsg_policy datastore_policy[__DATASTORE_MAX] =
+{
+	[DATASTORE_NS] = { .name = "ns", .type = BLOBMSG_TYPE_STRING },
+	[DATASTORE_PACKAGE] = { .name = "package", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+static const struct uci_blob_param_list datastore_attr_list =
+{
+	.n_params = __DATASTORE_MAX,
+	.params = datastore_policy
+};
+
+static struct uci_context *uci = NULL;
+static LIST_HEAD(packages);
+static char *datastore_ns = NULL;
+static uint32_t version = 0;
+static void (*watch)(void) = NULL;
+
+static void datastore_snapshot_free(struct datastore_snapshot *snap);
+static void datastore_log(struct datastore_package *dp, struct datastore_snapshot *old, bool known, uint64_t from);
+
+/* note a change of package, or of all of them if dp is NULL */
+static void datastore_changed(struct datastore_package *dp)
+{
+	version++;
+
+	if (dp)
+		dp->changed = version;
+
+	if (watch)
+		watch();
+}
+
+static void datastore_clear(void)
+{
+	struct datastore_package *dp, *tmp;
+
+	list_for_each_entry_safe(dp, tmp, &packages, list)
+	{
+		if (dp->pkg)
+			uci_unload(uci, dp->pkg);
+
+		list_del(&dp->list);
+		xml_buf_free(&dp->xml);
+		datastore_snapshot_free(dp->snap);
+		free(dp->name);
+		free(dp);
+	}
+
+	free(datastore_ns);
+	datastore_ns = NULL;
+}
+
+/* read the "config uci" section of the netconfd package */
+static int datastore_parse(void)
+{
+	struct uci_package *conf = NULL;
+	struct blob_attr *tb[__DATASTORE_MAX], *cur;
+	struct datastore_package *dp;
+	struct uci_element *e;
+	static struct blob_buf buf;
+	int rem;
+
+	if (uci_load(uci, "netconfd", &conf))
+		return -1;
+
+	uci_foreach_element(&conf->sections, e)
+	{
+		struct uci_section *s = uci_to_section(e);
+
+		if (strcmp(s->type, "uci"))
+			continue;
+
+		blob_buf_init(&buf, 0);
+		uci_to_blob(&buf, s, &datastore_attr_list);
+		blobmsg_parse(datastore_policy, __DATASTORE_MAX, tb, blob_data(buf.head), blob_len(buf.head));
+
+		if (!datastore_ns)
+			datastore_ns = strdup(tb[DATASTORE_NS] ? blobmsg_get_string(tb[DATASTORE_NS]) : DATASTORE_DEFAULT_NS);
+
+		if (!tb[DATASTORE_PACKAGE])
+			continue;
+
+		blobmsg_for_each_attr(cur, tb[DATASTORE_PACKAGE], rem)
+		{
+			if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
+				continue;
+
+			if (!(dp = calloc(1, sizeof(*dp))) || !(dp->name = strdup(blobmsg_get_string(cur))))
+			{
+				free(dp);
+				break;
+			}
+
+			dp->changed = version;
+
+			list_add_tail(&dp->list, &packages);
+		}
+	}
+
+	blob_buf_free(&buf);
+	uci_unload(uci, conf);
+
+	return 0;
+}
+
+int datastore_init(void)
+{
+	if (!(uci = uci_alloc_context()))
+		return -1;
+
+	return datastore_parse();
+}
+
+int datastore_reload(void)
+{
+	int rc;
+
+	datastore_clear();
+	version++;
+	rc = datastore_parse();
+
+	if (watch)
+		watch();
+
+	return rc;
+}
+
+void datastore_exit(void)
+{
+	datastore_clear();
+
+	if (uci)
+		uci_free_context(uci);
+
+	uci = NULL;
+}
+
+/* changes whenever the data of any package may have changed */
+uint32_t datastore_version(void)
+{
+	return version;
+}
+
+bool datastore_match(const char *name, const char *ns)
+{
+	if (list_empty(&packages) || strcmp(name, DATASTORE_ELEMENT))
+		return false;
+
+	return !ns || !strcmp(ns, datastore_ns);
+}
+
+static struct datastore_package *datastore_find(const char *name)
+{
+	struct datastore_package *dp;
+
+	list_for_each_entry(dp, &packages, list)
+	{
+		if (!strcmp(dp->name, name))
+			return dp;
+	}
+
+	return NULL;
+}
+
+static bool datastore_stat_changed(const struct stat *a, const struct stat *b)
+{
+	return a->st_mtim.tv_sec != b->st_mtim.tv_sec || a->st_mtim.tv_nsec != b->st_mtim.tv_nsec ||
+		   a->st_size != b->st_size || a->st_ino != b->st_ino;
+}
+
+/* state of the file pkg was loaded from, the same in every worker, 0 without pkg */
+static uint64_t datastore_state(struct datastore_package *dp)
+{
+	uint64_t id[4] = { dp->st.st_mtim.tv_sec, dp->st.st_mtim.tv_nsec, dp->st.st_size, dp->st.st_ino };
+	const unsigned char *p = (const unsigned char *) id;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	if (!dp->pkg)
+		return 0;
+
+	/* FNV-1a */
+	for (i = 0; i < sizeof(id); i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+
+	return hash ? hash : 1;
+}
+
+static void datastore_path(struct datastore_package *dp, char *path, size_t size)
+{
+	snprintf(path, size, "%s/%s", uci->confdir, dp->name);
+}
+
+static void datastore_unload(struct datastore_package *dp)
+{
+	if (dp->pkg)
+		uci_unload(uci, dp->pkg);
+
+	dp->pkg = NULL;
+	memset(&dp->st, 0, sizeof(dp->st));
+	xml_buf_free(&dp->xml);
+	datastore_snapshot_free(dp->snap);
+	dp->snap = NULL;
+}
+
+/*
+ * Snapshots hold every section and option of a package as an item, sorted
+ * by section and option name so two of them are compared in one pass. A
+ * section's own item has an empty option name and sorts first. Strings
+ * are kept '\0' terminated in one buffer, list values one after another.
+ */
+enum
+{
+	DATASTORE_ITEM_SECTION,
+	DATASTORE_ITEM_OPTION,
+	DATASTORE_ITEM_LIST,
+};
+
+struct datastore_item
+{
+	/* offsets into the strings */
+	uint32_t section;
+	uint32_t option;
+	uint32_t value;
+	/* bytes of the value with its terminators */
+	uint32_t len;
+	int kind;
+};
+
+struct datastore_snapshot
+{
+	struct datastore_item *items;
+	int n;
+	struct xml_buf strings;
+};
+
+#define DATASTORE_STR(snap, off) ((snap)->strings.data + (off))
+
+static void datastore_snapshot_free(struct datastore_snapshot *snap)
+{
+	if (!snap)
+		return;
+
+	xml_buf_free(&snap->strings);
+	free(snap->items);
+	free(snap);
+}
+
+static uint32_t datastore_snapshot_str(struct xml_buf *b, const char *s)
+{
+	uint32_t off = b->len;
+
+	xml_buf_append(b, s, strlen(s) + 1);
+
+	return off;
+}
+
+/* qsort() passes no context, snapshots are sorted one at a time */
+static const char *sort_strings;
+
+static int datastore_item_cmp(const void *a, const void *b)
+{
+	const struct datastore_item *x = a, *y = b;
+	int rc = strcmp(sort_strings + x->section, sort_strings + y->section);
+
+	return rc ? rc : strcmp(sort_strings + x->option, sort_strings + y->option);
+}
+
+static struct datastore_snapshot *datastore_snapshot(struct uci_package *p)
+{
+	struct datastore_snapshot *snap;
+	struct datastore_item *item;
+	struct uci_element *se, *oe, *le;
+	struct uci_option *o;
+	uint32_t section, none;
+	int n = 0;
+
+	uci_foreach_element(&p->sections, se)
+	{
+		n++;
+
+		uci_foreach_element(&uci_to_section(se)->options, oe)
+			n++;
+	}
+
+	if (!(snap = calloc(1, sizeof(*snap))) || !(snap->items = calloc(n ? n : 1, sizeof(*snap->items))))
+	{
+		free(snap);
+		return NULL;
+	}
+
+	none = datastore_snapshot_str(&snap->strings, "");
+
+	uci_foreach_element(&p->sections, se)
+	{
+		item = &snap->items[snap->n++];
+		item->kind = DATASTORE_ITEM_SECTION;
+		item->section = section = datastore_snapshot_str(&snap->strings, se->name);
+		item->option = none;
+		item->value = datastore_snapshot_str(&snap->strings, uci_to_section(se)->type);
+		item->len = snap->strings.len - item->value;
+
+		uci_foreach_element(&uci_to_section(se)->options, oe)
+		{
+			o = uci_to_option(oe);
+			item = &snap->items[snap->n++];
+			item->section = section;
+			item->option = datastore_snapshot_str(&snap->strings, oe->name);
+			item->value = snap->strings.len;
+
+			if (o->type == UCI_TYPE_STRING)
+			{
+				item->kind = DATASTORE_ITEM_OPTION;
+				datastore_snapshot_str(&snap->strings, o->v.string);
+			}
+			else
+			{
+				item->kind = DATASTORE_ITEM_LIST;
+
+				uci_foreach_element(&o->v.list, le)
+					datastore_snapshot_str(&snap->strings, le->name);
+			}
+
+			item->len = snap->strings.len - item->value;
+		}
+	}
+
+	if (snap->strings.error)
+	{
+		datastore_snapshot_free(snap);
+		return NULL;
+	}
+
+	sort_strings = snap->strings.data;
+	qsort(snap->items, snap->n, sizeof(*snap->items), datastore_item_cmp);
+
+	return snap;
+}
+
+/*
+ * datastore_fresh() - make sure package matches its file
+ *
+ * Reloads the package if the file was changed behind our back, by uci
+ * on the command line for example.
+ */
+static int datastore_fresh(struct datastore_package *dp)
+{
+	struct datastore_snapshot *old;
+	bool loaded = dp->pkg != NULL;
+	uint64_t from = datastore_state(dp);
+	char path[256];
+	struct stat st;
+
+	datastore_path(dp, path, sizeof(path));
+
+	if (stat(path, &st))
+	{
+		old = dp->snap;
+		dp->snap = NULL;
+		datastore_unload(dp);
+		dp->gone = true;
+
+		if (loaded)
+		{
+			datastore_changed(dp);
+			datastore_log(dp, old, true, from);
+		}
+
+		return -1;
+	}
+
+	if (dp->pkg && !datastore_stat_changed(&st, &dp->st))
+	{
+		stats.datastore_hits++;
+		return 0;
+	}
+
+	if (loaded)
+		DEBUG("uci package '%s' changed on disk\n", dp->name);
+
+	old = dp->snap;
+	dp->snap = NULL;
+	datastore_unload(dp);
+
+	if (uci_load(uci, dp->name, &dp->pkg))
+	{
+		ERROR("unable to load uci package '%s'\n", dp->name);
+		dp->pkg = NULL;
+
+		if (loaded)
+		{
+			dp->gone = true;
+			datastore_changed(dp);
+			datastore_log(dp, old, true, from);
+		}
+
+		return -1;
+	}
+
+	dp->st = st;
+	stats.datastore_loads++;
+
+	/* a package seen missing before coming back is a change too */
+	if (loaded || dp->gone)
+	{
+		datastore_changed(dp);
+		datastore_log(dp, old, !loaded || old, from);
+	}
+	else if (config.change_log > 0)
+		dp->snap = datastore_snapshot(dp->pkg);
+
+	dp->gone = false;
+
+	return 0;
+}
+
+static void datastore_attr(struct xml_buf *b, const char *name, const char *value)
+{
+	xml_buf_puts(b, " ");
+	xml_buf_puts(b, name);
+	xml_buf_puts(b, "=\"");
+	xml_buf_escape(b, value);
+	xml_buf_puts(b, "\"");
+}
+
+static void datastore_render_package(struct datastore_package *dp)
+{
+	struct xml_buf *b = &dp->xml;
+	struct uci_element *se, *oe, *le;
+	struct uci_section *s;
+	struct uci_option *o;
+
+	xml_buf_puts(b, "<package");
+	datastore_attr(b, "name", dp->name);
+	xml_buf_puts(b, ">");
+
+	uci_foreach_element(&dp->pkg->sections, se)
+	{
+		s = uci_to_section(se);
+
+		xml_buf_puts(b, "<section");
+		datastore_attr(b, "name", se->name);
+		datastore_attr(b, "type", s->type);
+
+		if (s->anonymous)
+			datastore_attr(b, "anonymous", "true");
+
+		xml_buf_puts(b, ">");
+
+		uci_foreach_element(&s->options, oe)
+		{
+			o = uci_to_option(oe);
+
+			if (o->type == UCI_TYPE_STRING)
+			{
+				xml_buf_puts(b, "<option");
+				datastore_attr(b, "name", oe->name);
+				xml_buf_puts(b, ">");
+				xml_buf_escape(b, o->v.string);
+				xml_buf_puts(b, "</option>");
+				continue;
+			}
+
+			xml_buf_puts(b, "<list");
+			datastore_attr(b, "name", oe->name);
+			xml_buf_puts(b, ">");
+
+			uci_foreach_element(&o->v.list, le)
+			{
+				xml_buf_puts(b, "<value>");
+				xml_buf_escape(b, le->name);
+				xml_buf_puts(b, "</value>");
+			}
+
+			xml_buf_puts(b, "</list>");
+		}
+
+		xml_buf_puts(b, "</section>");
+	}
+
+	xml_buf_puts(b, "</package>");
+}
+
+/* <option> or <list> element setting item of snap */
+static void datastore_diff_value(struct xml_buf *b, struct datastore_snapshot *snap, struct datastore_item *item)
+{
+	const char *v = DATASTORE_STR(snap, item->value), *end = v + item->len;
+
+	if (item->kind == DATASTORE_ITEM_OPTION)
+	{
+		xml_buf_puts(b, "<option");
+		datastore_attr(b, "name", DATASTORE_STR(snap, item->option));
+		xml_buf_puts(b, ">");
+		xml_buf_escape(b, v);
+		xml_buf_puts(b, "</option>");
+		return;
+	}
+
+	xml_buf_puts(b, "<list");
+	datastore_attr(b, "name", DATASTORE_STR(snap, item->option));
+	xml_buf_puts(b, ">");
+
+	for (; v < end; v += strlen(v) + 1)
+	{
+		xml_buf_puts(b, "<value>");
+		xml_buf_escape(b, v);
+		xml_buf_puts(b, "</value>");
+	}
+
+	xml_buf_puts(b, "</list>");
+}
+
+static void datastore_diff_delete(struct xml_buf *b, const char *element, const char *name)
+{
+	xml_buf_puts(b, "<");
+	xml_buf_puts(b, element);
+	datastore_attr(b, "name", name);
+	xml_buf_puts(b, " operation=\"delete\"/>");
+}
+
+static bool datastore_item_equal(struct datastore_snapshot *a, struct datastore_item *x, struct datastore_snapshot *b, struct datastore_item *y)
+{
+	return x->kind == y->kind && x->len == y->len && !memcmp(DATASTORE_STR(a, x->value), DATASTORE_STR(b, y->value), x->len);
+}
+
+/* forget what was appended to b since start */
+static void datastore_rewind(struct xml_buf *b, size_t start)
+{
+	b->len = start;
+
+	if (b->data)
+		b->data[start] = '\0';
+}
+
+/*
+ * datastore_diff() - <package> element of the edit-config turning a into b
+ *
+ * @struct xml_buf*:	output
+ * @const char*:	package
+ * @struct datastore_snapshot*:	state before, NULL for none
+ * @struct datastore_snapshot*:	state after, NULL if the package is gone
+ *
+ * Sections are named with their type whenever anything in them changed.
+ * Returns false and appends nothing if a and b are the same.
+ */
+static bool datastore_diff(struct xml_buf *out, const char *name, struct datastore_snapshot *a, struct datastore_snapshot *b)
+{
+	int i = 0, j = 0, na = a ? a->n : 0, nb = b ? b->n : 0, c;
+	struct datastore_item *x, *y;
+	size_t start = out->len, mark, opts, body;
+	uint32_t sa, sb;
+	bool retyped;
+
+	xml_buf_puts(out, "<package");
+	datastore_attr(out, "name", name);
+
+	if (!b)
+	{
+		xml_buf_puts(out, " operation=\"delete\"/>");
+		return true;
+	}
+
+	xml_buf_puts(out, ">");
+	body = out->len;
+
+	while (i < na || j < nb)
+	{
+		x = i < na ? &a->items[i] : NULL;
+		y = j < nb ? &b->items[j] : NULL;
+		c = !x ? 1 : !y ? -1 : strcmp(DATASTORE_STR(a, x->section), DATASTORE_STR(b, y->section));
+
+		if (c < 0)
+		{
+			datastore_diff_delete(out, "section", DATASTORE_STR(a, x->section));
+
+			for (sa = x->section; i < na && a->items[i].section == sa; i++);
+
+			continue;
+		}
+
+		/* the section item sorts first, the type follows from it */
+		mark = out->len;
+		xml_buf_puts(out, "<section");
+		datastore_attr(out, "name", DATASTORE_STR(b, y->section));
+		datastore_attr(out, "type", DATASTORE_STR(b, y->value));
+		xml_buf_puts(out, ">");
+
+		if (c > 0)
+		{
+			for (sb = y->section, j++; j < nb && b->items[j].section == sb; j++)
+				datastore_diff_value(out, b, &b->items[j]);
+
+			xml_buf_puts(out, "</section>");
+			continue;
+		}
+
+		opts = out->len;
+		retyped = !datastore_item_equal(a, x, b, y);
+		sa = x->section;
+		sb = y->section;
+
+		for (i++, j++; ; )
+		{
+			x = i < na && a->items[i].section == sa ? &a->items[i] : NULL;
+			y = j < nb && b->items[j].section == sb ? &b->items[j] : NULL;
+
+			if (!x && !y)
+				break;
+
+			c = !x ? 1 : !y ? -1 : strcmp(DATASTORE_STR(a, x->option), DATASTORE_STR(b, y->option));
+
+			if (c < 0)
+				datastore_diff_delete(out, x->kind == DATASTORE_ITEM_LIST ? "list" : "option", DATASTORE_STR(a, x->option));
+			else if (c > 0 || !datastore_item_equal(a, x, b, y))
+				datastore_diff_value(out, b, y);
+
+			i += c <= 0;
+			j += c >= 0;
+		}
+
+		/* untouched sections are left out */
+		if (out->len == opts && !retyped)
+		{
+			datastore_rewind(out, mark);
+			continue;
+		}
+
+		xml_buf_puts(out, "</section>");
+	}
+
+	if (out->len == body)
+	{
+		datastore_rewind(out, start);
+		return false;
+	}
+
+	xml_buf_puts(out, "</package>");
+
+	return true;
+}
+
+/*
+ * datastore_log() - tell the change log what the change of dp did
+ *
+ * @struct datastore_package*:	changed package, without pkg if it is gone
+ * @struct datastore_snapshot*:	its state before, NULL if it did not exist, freed
+ * @bool:		whether old really is the state before
+ * @uint64_t:		datastore_state() before the change
+ *
+ * Called once dp->st describes the new file. Changes that can not be told
+ * are not logged, clients holding the state before fetch everything.
+ */
+static void datastore_log(struct datastore_package *dp, struct datastore_snapshot *old, bool known, uint64_t from)
+{
+	struct xml_buf b = { 0 };
+
+	dp->snap = dp->pkg && config.change_log > 0 ? datastore_snapshot(dp->pkg) : NULL;
+
+	if (known && (!dp->pkg || dp->snap))
+	{
+		/* a file rewritten with the same content still moves the state */
+		if (!datastore_diff(&b, dp->name, old, dp->snap))
+		{
+			xml_buf_free(&b);
+			changes_add(dp->name, from, datastore_state(dp), NULL, 0);
+		}
+		else if (b.error)
+			xml_buf_free(&b);
+		else
+			changes_add(dp->name, from, datastore_state(dp), b.data, b.len);
+	}
+
+	datastore_snapshot_free(old);
+}
+
+static bool datastore_selected(const char *name, char **packages, int n)
+{
+	int i;
+
+	if (!n)
+		return true;
+
+	for (i = 0; i < n; i++)
+	{
+		if (packages[i] && !strcmp(packages[i], name))
+			return true;
+	}
+
+	return false;
+}
+
+/* selected packages, only those changed after since unless all is set */
+static int datastore_render_since(struct xml_buf *out, char **names, int n, bool all, uint32_t since)
+{
+	struct datastore_package *dp;
+	size_t start = out->len;
+	int rendered = 0;
+
+	xml_buf_puts(out, "<" DATASTORE_ELEMENT);
+	datastore_attr(out, "xmlns", datastore_ns);
+	xml_buf_puts(out, ">");
+
+	list_for_each_entry(dp, &packages, list)
+	{
+		if (!datastore_selected(dp->name, names, n))
+			continue;
+
+		if (datastore_fresh(dp))
+		{
+			/* gone, an empty package tells subscribers */
+			if (!all && dp->changed > since)
+			{
+				xml_buf_puts(out, "<package");
+				datastore_attr(out, "name", dp->name);
+				xml_buf_puts(out, "/>");
+				rendered++;
+			}
+
+			continue;
+		}
+
+		if (!all && dp->changed <= since)
+			continue;
+
+		if (!dp->xml.data || dp->xml.error)
+		{
+			xml_buf_free(&dp->xml);
+			datastore_render_package(dp);
+		}
+
+		xml_buf_append(out, dp->xml.data, dp->xml.len);
+		rendered++;
+	}
+
+	xml_buf_puts(out, "</" DATASTORE_ELEMENT ">");
+
+	/* nothing changed, leave no empty element behind */
+	if (!all && !rendered && !out->error)
+	{
+		out->len = start;
+
+		if (out->data)
+			out->data[start] = '\0';
+	}
+
+	return rendered;
+}
+
+/*
+ * datastore_render() - append <uci> element with the selected packages
+ *
+ * @struct xml_buf*:	output
+ * @char**:		package names, all packages if n is 0
+ * @int:		number of names
+ *
+ * Returns -1 if no packages are configured.
+ */
+int datastore_render(struct xml_buf *out, char **names, int n)
+{
+	if (list_empty(&packages))
+		return -1;
+
+	datastore_render_since(out, names, n, true, 0);
+
+	return 0;
+}
+
+/*
+ * datastore_render_changes() - append <uci> element with changed packages
+ *
+ * @struct xml_buf*:	output
+ * @char**:		package names, all packages if n is 0
+ * @int:		number of names
+ * @uint32_t:		datastore_version() of the previous call
+ *
+ * Packages changed after that version are rendered whole, removed ones as
+ * empty <package>. Returns the number of packages, nothing is appended if
+ * none changed.
+ */
+int datastore_render_changes(struct xml_buf *out, char **names, int n, uint32_t since)
+{
+	if (list_empty(&packages))
+		return 0;
+
+	return datastore_render_since(out, names, n, false, since);
+}
+
+/*
+ * datastore_render_log() - append <uci> element with the edits since a token
+ *
+ * @struct xml_buf*:	output
+ * @char**:		package names, all packages if n is 0
+ * @int:		number of names
+ * @const char*:	token the client holds, from datastore_token()
+ *
+ * Returns the number of <package> elements appended, -1 and nothing
+ * appended if the token lacks a selected package or the change log does
+ * not lead from its state to the current one.
+ */
+int datastore_render_log(struct xml_buf *out, char **names, int n, const char *since)
+{
+	struct datastore_package *dp;
+	size_t start = out->len;
+	int rc, rendered = 0;
+	uint64_t from;
+
+	if (list_empty(&packages))
+		return 0;
+
+	xml_buf_puts(out, "<" DATASTORE_ELEMENT);
+	datastore_attr(out, "xmlns", datastore_ns);
+	xml_buf_puts(out, ">");
+
+	list_for_each_entry(dp, &packages, list)
+	{
+		if (!datastore_selected(dp->name, names, n))
+			continue;
+
+		if (changes_parse(since, dp->name, &from) || (rc = changes_render(out, dp->name, from, datastore_state(dp))) < 0)
+		{
+			datastore_rewind(out, start);
+			return -1;
+		}
+
+		rendered += rc;
+	}
+
+	xml_buf_puts(out, "</" DATASTORE_ELEMENT ">");
+
+	return rendered;
+}
+
+/*
+ * datastore_token() - append token for the current state of packages
+ *
+ * @struct xml_buf*:	output
+ * @char**:		package names, all packages if n is 0
+ * @int:		number of names
+ *
+ * Any worker can tell the edits since, see changes.c.
+ */
+void datastore_token(struct xml_buf *out, char **names, int n)
+{
+	struct datastore_package *dp;
+	bool first = true;
+
+	list_for_each_entry(dp, &packages, list)
+	{
+		if (!datastore_selected(dp->name, names, n))
+			continue;
+
+		if (!first)
+			xml_buf_puts(out, ",");
+
+		changes_token(out, dp->name, datastore_state(dp));
+		first = false;
+	}
+}
+
+/* datastore_check() - look for packages changed on disk, the watch is told */
+void datastore_check(void)
+{
+	struct datastore_package *dp;
+
+	list_for_each_entry(dp, &packages, list)
+		datastore_fresh(dp);
+}
+
+/* datastore_watch() - set function called after every change */
+void datastore_watch(void (*cb)(void))
+{
+	watch = cb;
+}
+
+/* element name without namespace prefix */
+static const char *datastore_local_name(const char *name)
+{
+	const char *colon = name ? strchr(name, ':') : NULL;
+
+	return colon ? colon + 1 : name;
+}
+
+static char *datastore_get_attr(struct arena *arena, node_t *n, char *name)
+{
+	return rpc_get_content(arena, roxml_get_attr(n, name, 0));
+}
+
+static bool datastore_op_delete(struct arena *arena, node_t *n)
+{
+	char *op = datastore_get_attr(arena, n, "operation");
+
+	return op && (!strcmp(op, "delete") || !strcmp(op, "remove"));
+}
+
+static char *datastore_error(rpc_error_tag_t tag, const char *fmt, const char *arg)
+{
+	char msg[256];
+
+	snprintf(msg, sizeof(msg), fmt, arg);
+
+	return netconf_rpc_error(msg, tag, RPC_ERROR_TYPE_APPLICATION, RPC_ERROR_SEVERITY_ERROR, NULL);
+}
+
+/* whether list option o holds exactly the <value> children of n */
+static bool datastore_list_equal(struct arena *arena, struct uci_option *o, node_t *n)
+{
+	struct uci_element *le;
+	char *value;
+	int i = 0, count = roxml_get_chld_nb(n);
+
+	if (!o || o->type != UCI_TYPE_LIST)
+		return false;
+
+	uci_foreach_element(&o->v.list, le)
+	{
+		if (i >= count)
+			return false;
+
+		value = rpc_get_content(arena, roxml_get_chld(n, NULL, i++));
+
+		if (!value || strcmp(value, le->name))
+			return false;
+	}
+
+	return i == count;
+}
+
+/*
+ * datastore_edit_option() - apply <option> or <list> to section
+ *
+ * Returns the number of changes made, -1 on failure.
+ */
+static int datastore_edit_option(struct datastore_package *dp, struct uci_section *s, node_t *n, struct arena *arena, char **error)
+{
+	const char *el = datastore_local_name(rpc_get_name(arena, n));
+	char *name = datastore_get_attr(arena, n, "name"), *value;
+	struct uci_ptr ptr = { .p = dp->pkg, .s = s, .package = dp->name, .section = s->e.name };
+	int i, count;
+
+	if (!el || !name)
+	{
+		*error = datastore_error(RPC_ERROR_TAG_DATA_MISSING, "option without name in '%s'", dp->name);
+		return -1;
+	}
+
+	ptr.option = name;
+	ptr.o = uci_lookup_option(uci, s, name);
+
+	if (datastore_op_delete(arena, n))
+	{
+		if (!ptr.o)
+			return 0;
+
+		return uci_delete(uci, &ptr) ? -1 : 1;
+	}
+
+	if (!strcmp(el, "option"))
+	{
+		if (!(value = rpc_get_content(arena, n)))
+			value = "";
+
+		if (ptr.o && ptr.o->type == UCI_TYPE_STRING && !strcmp(ptr.o->v.string, value))
+			return 0;
+
+		ptr.value = value;
+
+		return uci_set(uci, &ptr) ? -1 : 1;
+	}
+
+	if (strcmp(el, "list"))
+	{
+		*error = datastore_error(RPC_ERROR_TAG_INVALID_VALUE, "unknown element '%s'", el);
+		return -1;
+	}
+
+	if (datastore_list_equal(arena, ptr.o, n))
+		return 0;
+
+	/* lists are replaced as a whole */
+	if (ptr.o && uci_delete(uci, &ptr))
+		return -1;
+
+	count = roxml_get_chld_nb(n);
+
+	for (i = 0; i < count; i++)
+	{
+		if (!(value = rpc_get_content(arena, roxml_get_chld(n, NULL, i))))
+			continue;
+
+		ptr.o = uci_lookup_option(uci, s, name);
+		ptr.value = value;
+
+		if (uci_add_list(uci, &ptr))
+			return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * datastore_edit_section() - apply <section> to package
+ *
+ * Returns the number of changes made, -1 on failure. A failure may come
+ * after some of the changes were made in memory.
+ */
+static int datastore_edit_section(struct datastore_package *dp, node_t *n, struct arena *arena, char **error)
+{
+	char *name = datastore_get_attr(arena, n, "name");
+	char *type = datastore_get_attr(arena, n, "type");
+	struct uci_ptr ptr = { .p = dp->pkg, .package = dp->name, .section = name };
+	int i, rc, changes = 0, count;
+
+	if (!name)
+	{
+		*error = datastore_error(RPC_ERROR_TAG_DATA_MISSING, "section without name in '%s'", dp->name);
+		return -1;
+	}
+
+	ptr.s = uci_lookup_section(uci, dp->pkg, name);
+
+	if (datastore_op_delete(arena, n))
+	{
+		if (!ptr.s)
+			return 0;
+
+		return uci_delete(uci, &ptr) ? -1 : 1;
+	}
+
+	/* new section, or one changing its type */
+	if (!ptr.s || (type && strcmp(ptr.s->type, type)))
+	{
+		if (!type)
+		{
+			*error = datastore_error(RPC_ERROR_TAG_DATA_MISSING, "new section '%s' needs a type", name);
+			return -1;
+		}
+
+		ptr.value = type;
+
+		if (uci_set(uci, &ptr))
+			return -1;
+
+		changes++;
+	}
+
+	count = roxml_get_chld_nb(n);
+
+	for (i = 0; i < count; i++)
+	{
+		rc = datastore_edit_option(dp, ptr.s, roxml_get_chld(n, NULL, i), arena, error);
+
+		if (rc < 0)
+			return -1;
+
+		changes += rc;
+	}
+
+	return changes;
+}
+
+static int datastore_edit_package(node_t *n, struct arena *arena, char **error)
+{
+	char *name = datastore_get_attr(arena, n, "name");
+	struct datastore_package *dp;
+	int i, rc, count;
+
+	if (!name || !(dp = datastore_find(name)))
+	{
+		*error = datastore_error(RPC_ERROR_TAG_INVALID_VALUE, "uci package '%s' not available", name ? name : "");
+		return -1;
+	}
+
+	if (datastore_fresh(dp))
+	{
+		*error = datastore_error(RPC_ERROR_TAG_OPERATION_FAILED, "unable to load uci package '%s'", name);
+		return -1;
+	}
+
+	count = roxml_get_chld_nb(n);
+
+	for (i = 0; i < count; i++)
+	{
+		rc = datastore_edit_section(dp, roxml_get_chld(n, NULL, i), arena, error);
+
+		/* a failed section may be half applied, it is reloaded as well */
+		if (rc)
+			dp->dirty = true;
+
+		if (rc < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * datastore_edit() - apply edit-config to uci packages
+ *
+ * @node_t*:		<uci> element of the config
+ * @struct arena*:	request arena
+ * @char**:		set to malloc'd rpc-error content on failure
+ *
+ * Every package is changed in memory first. Only if all of the edit
+ * applied, changed packages are committed, each with one uci_commit();
+ * otherwise they are reloaded from their files.
+ */
+int datastore_edit(node_t *n, struct arena *arena, char **error)
+{
+	struct datastore_snapshot *old;
+	struct datastore_package *dp;
+	char path[256];
+	int i, rc = 0, count = roxml_get_chld_nb(n), stat_failed;
+	uint64_t from;
+
+	for (i = 0; i < count && !rc; i++)
+		rc = datastore_edit_package(roxml_get_chld(n, NULL, i), arena, error);
+
+	list_for_each_entry(dp, &packages, list)
+	{
+		if (!dp->dirty)
+			continue;
+
+		dp->dirty = false;
+
+		if (rc)
+		{
+			datastore_unload(dp);
+			continue;
+		}
+
+		if (uci_commit(uci, &dp->pkg, false))
+		{
+			ERROR("unable to commit uci package '%s'\n", dp->name);
+			*error = datastore_error(RPC_ERROR_TAG_OPERATION_FAILED, "unable to commit '%s'", dp->name);
+			datastore_unload(dp);
+			rc = -1;
+			continue;
+		}
+
+		stats.datastore_commits++;
+		from = datastore_state(dp);
+		old = dp->snap;
+		dp->snap = NULL;
+
+		/* the committed package is current, only its xml has to be redone */
+		datastore_path(dp, path, sizeof(path));
+		stat_failed = stat(path, &dp->st);
+
+		datastore_changed(dp);
+		datastore_log(dp, old, old != NULL && !stat_failed, from);
+
+		if (stat_failed)
+			datastore_unload(dp);
+
+		xml_buf_free(&dp->xml);
+	}
+
+	if (rc && !*error)
+		*error = datastore_error(RPC_ERROR_TAG_OPERATION_FAILED, "%s", "uci edit failed");
+
+	return rc;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_DATASTORE_H__
+#define __FREENETCONFD_DATASTORE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <roxml.h>
+
+#define DATASTORE_ELEMENT "uci"
+#define DATASTORE_DEFAULT_NS "urn:netconfd:uci"
+
+/* packages a filter may name */
+#define DATASTORE_FILTER_MAX 32
+
+struct xml_buf;
+struct arena;
+
+int datastore_init(void);
+int datastore_reload(void);
+void datastore_exit(void);
+
+bool datastore_match(const char *name, const char *ns);
+int datastore_render(struct xml_buf *out, char **packages, int n);
+int datastore_render_changes(struct xml_buf *out, char **packages, int n, uint32_t since);
+int datastore_render_log(struct xml_buf *out, char **packages, int n, const char *since);
+void datastore_token(struct xml_buf *out, char **packages, int n);
+void datastore_check(void);
+void datastore_watch(void (*cb)(void));
+int datastore_edit(node_t *uci, struct arena *arena, char **error);
+uint32_t datastore_version(void);
+
+#endif /* __FREENETCONFD_DATASTORE_H__ */
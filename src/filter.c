@@ -0,0 +1,1665 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netconfd/netconfd.h"
+
+#include "filter.h"
+#include "stats.h"
+#include "xml.h"
+
+/*
+ * Notification filters
+ *
+ * RFC 5277 subscriptions may carry a subtree or an xpath filter, it is
+ * compiled once when the subscription is created. Compiled filters are
+ * reduced to a normalized key and subscribers with equal keys share a group,
+ * so each event is matched once per distinct filter however many sessions
+ * subscribed with it. Groups are indexed by the names of the top level
+ * event elements their filter can select, an event is only matched against
+ * the groups listed under its own elements and those that may match
+ * anything.
+ *
+ * Events and filters are read by a small non-validating parser that indexes
+ * elements in place instead of building a tree of copies. The xpath
+ * supported are location paths of child and descendant steps with name
+ * tests, and predicates that compare a relative path, "." or text() to a
+ * literal, joined by "and" and "or".
+ */
+
+/* elements of one event or filter */
+#define FILTER_NODES_MAX 65536
+/* longest namespace prefix looked up */
+#define FILTER_PREFIX_MAX 64
+
+enum filter_type
+{
+	FILTER_SUBTREE,
+	FILTER_XPATH,
+};
+
+enum xpath_op
+{
+	XPATH_EXISTS,
+	XPATH_EQ,
+	XPATH_NE,
+};
+
+/* element of a parsed document, strings point into the text */
+struct xnode
+{
+	const char *name;
+	const char *attrs;
+	const char *text;
+	int name_len;
+	int attrs_len;
+	int text_len;
+	int parent;
+	int child;
+	int last;
+	int next;
+};
+
+struct xdoc
+{
+	struct xnode *nodes;
+	int n;
+	int size;
+};
+
+/* subtree filter element, value is set for content match nodes */
+struct filter_node
+{
+	char *name;
+	char *ns;
+	char *value;
+	struct filter_node *children;
+	int n_children;
+};
+
+/* relative path in a predicate, compared with a literal or tested for existence */
+struct xpath_term
+{
+	char **names;
+	int n_names;
+	int op;
+	char *value;
+	/* an "or" follows, terms up to here form one conjunction */
+	bool or_next;
+};
+
+struct xpath_pred
+{
+	struct xpath_term *terms;
+	int n_terms;
+};
+
+struct xpath_step
+{
+	bool descendant;
+	/* NULL for * */
+	char *name;
+	char *ns;
+	struct xpath_pred *preds;
+	int n_preds;
+};
+
+struct xpath_path
+{
+	struct xpath_step *steps;
+	int n_steps;
+};
+
+struct filter
+{
+	int type;
+	char *key;
+	struct filter_node *nodes;
+	int n_nodes;
+	struct xpath_path *paths;
+	int n_paths;
+	/* top level event elements the filter can select */
+	const char **names;
+	int n_names;
+	bool any;
+};
+
+/* index entry, links of all groups that can select an element of this name */
+struct filter_name
+{
+	struct list_head list;
+	struct list_head links;
+	char *name;
+};
+
+struct filter_link
+{
+	struct list_head list;
+	struct filter_group *group;
+	struct filter_name *name;
+};
+
+/* events are parsed into the same document, one at a time */
+static struct xdoc event_doc;
+static uint64_t event_stamp = 0;
+
+static bool xspace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool xname_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+	       c == '_' || c == '-' || c == '.' || (unsigned char) c >= 0x80;
+}
+
+static int xdoc_add(struct xdoc *d)
+{
+	struct xnode *nodes;
+	int size;
+
+	if (d->n == d->size)
+	{
+		if (d->size >= FILTER_NODES_MAX)
+			return -1;
+
+		size = d->size ? d->size * 2 : 64;
+
+		if (!(nodes = realloc(d->nodes, size * sizeof(*nodes))))
+			return -1;
+
+		d->nodes = nodes;
+		d->size = size;
+	}
+
+	return d->n++;
+}
+
+static void xdoc_text(struct xdoc *d, int cur, const char *p, const char *end)
+{
+	struct xnode *x;
+
+	if (cur < 0)
+		return;
+
+	x = &d->nodes[cur];
+
+	/* leaf values only, the first run of text before any child */
+	if (!x->text && x->child < 0)
+	{
+		x->text = p;
+		x->text_len = end - p;
+	}
+}
+
+/*
+ * xdoc_parse() - index elements of a document
+ *
+ * Comments, processing instructions and doctype are skipped, end tags are
+ * not checked against their start tags. Returns -1 unless there is exactly
+ * one root element and everything is closed.
+ */
+static int xdoc_parse(struct xdoc *d, const char *p, size_t len)
+{
+	const char *end = p + len, *q, *name, *attrs;
+	struct xnode *parent;
+	int cur = -1, i;
+	bool empty;
+	char quote;
+
+	d->n = 0;
+
+	while (p < end)
+	{
+		if (*p != '<')
+		{
+			if (!(q = memchr(p, '<', end - p)))
+				q = end;
+
+			xdoc_text(d, cur, p, q);
+			p = q;
+			continue;
+		}
+
+		if (end - p >= 4 && !memcmp(p, "<!--", 4))
+		{
+			if (!(q = memmem(p + 4, end - p - 4, "-->", 3)))
+				return -1;
+
+			p = q + 3;
+			continue;
+		}
+
+		if (end - p >= 9 && !memcmp(p, "<![CDATA[", 9))
+		{
+			if (!(q = memmem(p + 9, end - p - 9, "]]>", 3)))
+				return -1;
+
+			xdoc_text(d, cur, p + 9, q);
+			p = q + 3;
+			continue;
+		}
+
+		if (end - p < 2)
+			return -1;
+
+		if (p[1] == '?' || p[1] == '!' || p[1] == '/')
+		{
+			if (!(q = memchr(p, '>', end - p)))
+				return -1;
+
+			if (p[1] == '/')
+			{
+				if (cur < 0)
+					return -1;
+
+				cur = d->nodes[cur].parent;
+			}
+
+			p = q + 1;
+			continue;
+		}
+
+		/* a second root element */
+		if (cur < 0 && d->n)
+			return -1;
+
+		name = ++p;
+
+		while (p < end && !xspace(*p) && *p != '/' && *p != '>')
+			p++;
+
+		if (p == name || p == end || (i = xdoc_add(d)) < 0)
+			return -1;
+
+		/* attribute values may hold '>' */
+		for (attrs = p, quote = 0; p < end && (quote || *p != '>'); p++)
+		{
+			if (quote)
+			{
+				if (*p == quote)
+					quote = 0;
+			}
+			else if (*p == '"' || *p == '\'')
+				quote = *p;
+		}
+
+		if (p == end)
+			return -1;
+
+		empty = p[-1] == '/';
+
+		d->nodes[i] = (struct xnode)
+		{
+			.name = name, .name_len = attrs - name,
+			.attrs = attrs, .attrs_len = p - attrs - empty,
+			.parent = cur, .child = -1, .last = -1, .next = -1,
+		};
+
+		if (cur >= 0)
+		{
+			parent = &d->nodes[cur];
+
+			if (parent->last >= 0)
+				d->nodes[parent->last].next = i;
+			else
+				parent->child = i;
+
+			parent->last = i;
+		}
+
+		if (!empty)
+			cur = i;
+
+		p++;
+	}
+
+	return cur < 0 && d->n ? 0 : -1;
+}
+
+/* local part of a qualified name, prefix_len is 0 without prefix */
+static const char *xname_local(const char *name, int len, int *local_len, int *prefix_len)
+{
+	const char *colon = memchr(name, ':', len);
+
+	if (!colon)
+	{
+		*prefix_len = 0;
+		*local_len = len;
+		return name;
+	}
+
+	*prefix_len = colon - name;
+	*local_len = len - *prefix_len - 1;
+
+	return colon + 1;
+}
+
+static bool xnode_is(const struct xnode *x, const char *name)
+{
+	int len, prefix_len;
+	const char *local = xname_local(x->name, x->name_len, &len, &prefix_len);
+
+	return (size_t) len == strlen(name) && !memcmp(local, name, len);
+}
+
+/* raw value of an attribute in the text of a start tag */
+static bool xattr(const char *p, int len, const char *name, const char **value, int *value_len)
+{
+	const char *end = p + len, *n;
+	size_t name_len = strlen(name);
+	char quote;
+	int n_len;
+
+	while (p < end)
+	{
+		while (p < end && xspace(*p))
+			p++;
+
+		for (n = p; p < end && *p != '=' && !xspace(*p); p++);
+
+		n_len = p - n;
+
+		while (p < end && xspace(*p))
+			p++;
+
+		if (p == end || *p++ != '=')
+			return false;
+
+		while (p < end && xspace(*p))
+			p++;
+
+		if (p == end || (*p != '"' && *p != '\''))
+			return false;
+
+		quote = *p++;
+		n = n_len == name_len && !memcmp(n, name, n_len) ? p : NULL;
+
+		if (!(p = memchr(p, quote, end - p)))
+			return false;
+
+		if (n)
+		{
+			*value = n;
+			*value_len = p - n;
+			return true;
+		}
+
+		p++;
+	}
+
+	return false;
+}
+
+/*
+ * xdoc_ns() - namespace of a prefix in scope of element i
+ *
+ * The default namespace is only looked for below element stop, prefixes
+ * are resolved all the way up. Sets an empty string if there is none.
+ */
+static void xdoc_ns(const struct xdoc *d, int i, const char *prefix, int prefix_len, int stop, const char **ns, int *len)
+{
+	char attr[FILTER_PREFIX_MAX + sizeof("xmlns:")];
+
+	if (prefix_len > FILTER_PREFIX_MAX)
+		i = -1;
+	else if (prefix_len)
+		snprintf(attr, sizeof(attr), "xmlns:%.*s", prefix_len, prefix);
+	else
+		strcpy(attr, "xmlns");
+
+	for (; i >= 0 && (prefix_len || i != stop); i = d->nodes[i].parent)
+	{
+		if (xattr(d->nodes[i].attrs, d->nodes[i].attrs_len, attr, ns, len))
+			return;
+	}
+
+	*ns = "";
+	*len = 0;
+}
+
+static bool xnode_ns_is(const struct xdoc *d, int i, const char *ns)
+{
+	const char *name = d->nodes[i].name, *v;
+	int local_len, prefix_len, len;
+
+	xname_local(name, d->nodes[i].name_len, &local_len, &prefix_len);
+	xdoc_ns(d, i, name, prefix_len, -1, &v, &len);
+
+	return (size_t) len == strlen(ns) && !memcmp(v, ns, len);
+}
+
+static int utf8_encode(unsigned long c, char *out)
+{
+	if (c < 0x80)
+	{
+		out[0] = c;
+		return 1;
+	}
+
+	if (c < 0x800)
+	{
+		out[0] = 0xc0 | c >> 6;
+		out[1] = 0x80 | (c & 0x3f);
+		return 2;
+	}
+
+	if (c < 0x10000)
+	{
+		out[0] = 0xe0 | c >> 12;
+		out[1] = 0x80 | (c >> 6 & 0x3f);
+		out[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+
+	out[0] = 0xf0 | (c >> 18 & 0x07);
+	out[1] = 0x80 | (c >> 12 & 0x3f);
+	out[2] = 0x80 | (c >> 6 & 0x3f);
+	out[3] = 0x80 | (c & 0x3f);
+
+	return 4;
+}
+
+/* next character of text with references replaced, returns its bytes in out */
+static int xtext_char(const char **p, const char *end, char *out)
+{
+	static const struct
+	{
+		const char *name;
+		char c;
+	} entities[] =
+	{
+		{ "lt;", '<' }, { "gt;", '>' }, { "amp;", '&' }, { "quot;", '"' }, { "apos;", '\'' },
+	};
+	const char *s = *p, *semi;
+	unsigned long c;
+	char *num_end;
+	size_t i;
+
+	if (*s == '&' && (semi = memchr(s, ';', end - s < 12 ? end - s : 12)))
+	{
+		if (s[1] == '#')
+		{
+			c = s[2] == 'x' ? strtoul(s + 3, &num_end, 16) : strtoul(s + 2, &num_end, 10);
+
+			if (num_end == semi && c <= 0x10ffff)
+			{
+				*p = semi + 1;
+				return utf8_encode(c, out);
+			}
+		}
+
+		for (i = 0; i < sizeof(entities) / sizeof(*entities); i++)
+		{
+			if ((size_t) (semi - s) == strlen(entities[i].name) && !memcmp(s + 1, entities[i].name, semi - s))
+			{
+				*p = semi + 1;
+				out[0] = entities[i].c;
+				return 1;
+			}
+		}
+	}
+
+	out[0] = *s;
+	*p = s + 1;
+
+	return 1;
+}
+
+static void xtext_trim(const char **p, int *len)
+{
+	while (*len && xspace(**p))
+	{
+		(*p)++;
+		(*len)--;
+	}
+
+	while (*len && xspace((*p)[*len - 1]))
+		(*len)--;
+}
+
+/* compare text, after trimming and replacing references, with a value */
+static bool xtext_equal(const char *text, int len, const char *value)
+{
+	const char *end;
+	char c[4];
+	int n, i;
+
+	if (!text)
+		return !*value;
+
+	xtext_trim(&text, &len);
+
+	for (end = text + len; text < end; value += n)
+	{
+		n = xtext_char(&text, end, c);
+
+		for (i = 0; i < n; i++)
+		{
+			if (value[i] != c[i])
+				return false;
+		}
+	}
+
+	return !*value;
+}
+
+static char *xtext_dup(const char *text, int len, bool trim)
+{
+	const char *end;
+	char *s, *p;
+
+	if (trim)
+		xtext_trim(&text, &len);
+
+	/* references only get shorter */
+	if (!(s = p = malloc(len + 1)))
+		return NULL;
+
+	for (end = text + len; text < end; )
+		p += xtext_char(&text, end, p);
+
+	*p = '\0';
+
+	return s;
+}
+
+static bool xtext_blank(const char *text, int len)
+{
+	xtext_trim(&text, &len);
+
+	return !len;
+}
+
+static void filter_node_free(struct filter_node *fn)
+{
+	int i;
+
+	for (i = 0; i < fn->n_children; i++)
+		filter_node_free(&fn->children[i]);
+
+	free(fn->children);
+	free(fn->name);
+	free(fn->ns);
+	free(fn->value);
+}
+
+static void xpath_path_free(struct xpath_path *path)
+{
+	struct xpath_step *s;
+	struct xpath_term *t;
+	int i, j, k, l;
+
+	for (i = 0; i < path->n_steps; i++)
+	{
+		s = &path->steps[i];
+
+		for (j = 0; j < s->n_preds; j++)
+		{
+			for (k = 0; k < s->preds[j].n_terms; k++)
+			{
+				t = &s->preds[j].terms[k];
+
+				for (l = 0; l < t->n_names; l++)
+					free(t->names[l]);
+
+				free(t->names);
+				free(t->value);
+			}
+
+			free(s->preds[j].terms);
+		}
+
+		free(s->preds);
+		free(s->name);
+		free(s->ns);
+	}
+
+	free(path->steps);
+}
+
+/* filter_free() - release compiled filter, NULL is ignored */
+void filter_free(struct filter *f)
+{
+	int i;
+
+	if (!f)
+		return;
+
+	for (i = 0; i < f->n_nodes; i++)
+		filter_node_free(&f->nodes[i]);
+
+	for (i = 0; i < f->n_paths; i++)
+		xpath_path_free(&f->paths[i]);
+
+	free(f->nodes);
+	free(f->paths);
+	free(f->names);
+	free(f->key);
+	free(f);
+}
+
+/* filter_key() - normalized form, equal for filters that select the same */
+const char *filter_key(const struct filter *f)
+{
+	return f->key;
+}
+
+static int subtree_compile(const struct xdoc *d, int i, int stop, struct filter_node *fn)
+{
+	const struct xnode *x = &d->nodes[i];
+	const char *local, *ns;
+	int local_len, prefix_len, ns_len, j, n = 0;
+
+	local = xname_local(x->name, x->name_len, &local_len, &prefix_len);
+	xdoc_ns(d, i, x->name, prefix_len, stop, &ns, &ns_len);
+
+	if (!(fn->name = strndup(local, local_len)) || (ns_len && !(fn->ns = strndup(ns, ns_len))))
+		return -1;
+
+	for (j = x->child; j >= 0; j = d->nodes[j].next)
+		n++;
+
+	if (!n)
+	{
+		if (x->text && !xtext_blank(x->text, x->text_len) && !(fn->value = xtext_dup(x->text, x->text_len, true)))
+			return -1;
+
+		return 0;
+	}
+
+	if (!(fn->children = calloc(n, sizeof(*fn->children))))
+		return -1;
+
+	for (j = x->child; j >= 0; j = d->nodes[j].next)
+	{
+		if (subtree_compile(d, j, stop, &fn->children[fn->n_children++]))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* keys of siblings sorted and joined, their order does not change what is selected */
+static void key_siblings(struct xml_buf *b, char **keys, int n)
+{
+	int i;
+
+	qsort(keys, n, sizeof(*keys), key_cmp);
+
+	for (i = 0; i < n; i++)
+	{
+		if (i)
+			xml_buf_puts(b, ",");
+
+		if (keys[i])
+			xml_buf_puts(b, keys[i]);
+		else
+			b->error = true;
+	}
+}
+
+static char *subtree_key(const struct filter_node *fn)
+{
+	struct xml_buf b = { 0 };
+	char num[32], **keys;
+	int i;
+
+	xml_buf_puts(&b, fn->name);
+
+	if (fn->ns)
+	{
+		snprintf(num, sizeof(num), "{%zu:", strlen(fn->ns));
+		xml_buf_puts(&b, num);
+		xml_buf_puts(&b, fn->ns);
+		xml_buf_puts(&b, "}");
+	}
+
+	if (fn->value)
+	{
+		snprintf(num, sizeof(num), "=%zu:", strlen(fn->value));
+		xml_buf_puts(&b, num);
+		xml_buf_puts(&b, fn->value);
+	}
+
+	if (fn->n_children)
+	{
+		if (!(keys = calloc(fn->n_children, sizeof(*keys))))
+			b.error = true;
+
+		for (i = 0; keys && i < fn->n_children; i++)
+			keys[i] = subtree_key(&fn->children[i]);
+
+		xml_buf_puts(&b, "(");
+
+		if (keys)
+			key_siblings(&b, keys, fn->n_children);
+
+		xml_buf_puts(&b, ")");
+
+		for (i = 0; keys && i < fn->n_children; i++)
+			free(keys[i]);
+
+		free(keys);
+	}
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return NULL;
+	}
+
+	return b.data;
+}
+
+static int subtree_filter_compile(const struct xdoc *d, struct filter *f, const char **error)
+{
+	struct xml_buf b = { 0 };
+	char **keys;
+	int i, n = 0;
+
+	for (i = d->nodes[0].child; i >= 0; i = d->nodes[i].next)
+		n++;
+
+	if (!n)
+	{
+		*error = "empty filter";
+		return -1;
+	}
+
+	f->type = FILTER_SUBTREE;
+
+	if (!(f->nodes = calloc(n, sizeof(*f->nodes))) || !(f->names = calloc(n, sizeof(*f->names))))
+		return -1;
+
+	for (i = d->nodes[0].child; i >= 0; i = d->nodes[i].next)
+	{
+		if (subtree_compile(d, i, 0, &f->nodes[f->n_nodes]))
+		{
+			f->n_nodes++;
+			return -1;
+		}
+
+		f->names[f->n_names++] = f->nodes[f->n_nodes++].name;
+	}
+
+	if (!(keys = calloc(n, sizeof(*keys))))
+		return -1;
+
+	for (i = 0; i < n; i++)
+		keys[i] = subtree_key(&f->nodes[i]);
+
+	xml_buf_puts(&b, "subtree:");
+	key_siblings(&b, keys, n);
+
+	for (i = 0; i < n; i++)
+		free(keys[i]);
+
+	free(keys);
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return -1;
+	}
+
+	f->key = b.data;
+
+	return 0;
+}
+
+/* xpath parser state, prefixes are resolved on the filter element */
+struct xpath_parser
+{
+	const char *p;
+	const struct xdoc *d;
+	const char *error;
+};
+
+static void xp_space(struct xpath_parser *x)
+{
+	while (xspace(*x->p))
+		x->p++;
+}
+
+static bool xp_accept(struct xpath_parser *x, const char *tok)
+{
+	size_t len = strlen(tok);
+
+	xp_space(x);
+
+	if (strncmp(x->p, tok, len))
+		return false;
+
+	/* keywords are not the start of a longer name */
+	if (xname_char(tok[len - 1]) && xname_char(x->p[len]))
+		return false;
+
+	x->p += len;
+
+	return true;
+}
+
+/* name with optional prefix, the local part is returned, prefix_len is 0 without prefix */
+static char *xp_name(struct xpath_parser *x, const char **prefix, int *prefix_len)
+{
+	const char *start, *local;
+
+	xp_space(x);
+
+	start = local = x->p;
+	*prefix = NULL;
+	*prefix_len = 0;
+
+	if (!xname_char(*x->p) || *x->p == '-' || *x->p == '.' || (*x->p >= '0' && *x->p <= '9'))
+		return NULL;
+
+	while (xname_char(*x->p))
+		x->p++;
+
+	if (*x->p == ':' && xname_char(x->p[1]))
+	{
+		*prefix = start;
+		*prefix_len = x->p - start;
+		local = ++x->p;
+
+		while (xname_char(*x->p))
+			x->p++;
+	}
+
+	return strndup(local, x->p - local);
+}
+
+static char *xp_literal(struct xpath_parser *x)
+{
+	const char *start, *end;
+	char quote;
+
+	xp_space(x);
+
+	if (*x->p == '"' || *x->p == '\'')
+	{
+		quote = *x->p++;
+
+		if (!(end = strchr(x->p, quote)))
+			return NULL;
+
+		start = x->p;
+		x->p = end + 1;
+
+		return strndup(start, end - start);
+	}
+
+	for (start = x->p; (*x->p >= '0' && *x->p <= '9') || *x->p == '.' || *x->p == '-'; x->p++);
+
+	if (start == x->p)
+		return NULL;
+
+	return strndup(start, x->p - start);
+}
+
+static int xp_term(struct xpath_parser *x, struct xpath_term *t)
+{
+	const char *prefix;
+	char **names;
+	int prefix_len;
+
+	if (!xp_accept(x, "text()") && !xp_accept(x, "."))
+	{
+		do
+		{
+			if (!(names = realloc(t->names, (t->n_names + 1) * sizeof(*names))))
+				return -1;
+
+			t->names = names;
+
+			if (!(t->names[t->n_names] = xp_name(x, &prefix, &prefix_len)))
+				return -1;
+
+			t->n_names++;
+		}
+		while (xp_accept(x, "/"));
+	}
+
+	if (xp_accept(x, "!="))
+		t->op = XPATH_NE;
+	else if (xp_accept(x, "="))
+		t->op = XPATH_EQ;
+	else
+		return 0;
+
+	return (t->value = xp_literal(x)) ? 0 : -1;
+}
+
+static int xp_pred(struct xpath_parser *x, struct xpath_pred *pred)
+{
+	struct xpath_term *terms;
+
+	do
+	{
+		if (!(terms = realloc(pred->terms, (pred->n_terms + 1) * sizeof(*terms))))
+			return -1;
+
+		pred->terms = terms;
+		memset(&terms[pred->n_terms], 0, sizeof(*terms));
+
+		if (xp_term(x, &terms[pred->n_terms++]))
+			return -1;
+
+		if (xp_accept(x, "or"))
+			terms[pred->n_terms - 1].or_next = true;
+		else if (!xp_accept(x, "and"))
+			break;
+	}
+	while (true);
+
+	return xp_accept(x, "]") ? 0 : -1;
+}
+
+static int xp_step(struct xpath_parser *x, struct xpath_step *s)
+{
+	struct xpath_pred *preds;
+	const char *prefix, *ns;
+	int prefix_len, ns_len;
+
+	if (!xp_accept(x, "*"))
+	{
+		if (!(s->name = xp_name(x, &prefix, &prefix_len)))
+			return -1;
+
+		if (prefix_len)
+		{
+			xdoc_ns(x->d, 0, prefix, prefix_len, -1, &ns, &ns_len);
+
+			if (!ns_len)
+			{
+				x->error = "unknown namespace prefix in xpath";
+				return -1;
+			}
+
+			if (!(s->ns = strndup(ns, ns_len)))
+				return -1;
+		}
+	}
+
+	while (xp_accept(x, "["))
+	{
+		if (!(preds = realloc(s->preds, (s->n_preds + 1) * sizeof(*preds))))
+			return -1;
+
+		s->preds = preds;
+		memset(&preds[s->n_preds], 0, sizeof(*preds));
+
+		if (xp_pred(x, &preds[s->n_preds++]))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int xp_path(struct xpath_parser *x, struct xpath_path *path)
+{
+	struct xpath_step *steps;
+	bool descendant;
+
+	if (xp_accept(x, "//"))
+		descendant = true;
+	else
+	{
+		xp_accept(x, "/");
+		descendant = false;
+	}
+
+	do
+	{
+		if (!(steps = realloc(path->steps, (path->n_steps + 1) * sizeof(*steps))))
+			return -1;
+
+		path->steps = steps;
+		memset(&steps[path->n_steps], 0, sizeof(*steps));
+		steps[path->n_steps].descendant = descendant;
+
+		if (xp_step(x, &steps[path->n_steps++]))
+			return -1;
+
+		if (xp_accept(x, "//"))
+			descendant = true;
+		else if (xp_accept(x, "/"))
+			descendant = false;
+		else
+			break;
+	}
+	while (true);
+
+	return 0;
+}
+
+/* the parsed expression written out again, which drops the spelling of the original */
+static void xpath_key(struct xml_buf *b, const struct filter *f)
+{
+	const struct xpath_step *s;
+	const struct xpath_term *t;
+	char num[32];
+	int i, j, k, l, m;
+
+	xml_buf_puts(b, "xpath:");
+
+	for (i = 0; i < f->n_paths; i++)
+	{
+		if (i)
+			xml_buf_puts(b, "|");
+
+		for (j = 0; j < f->paths[i].n_steps; j++)
+		{
+			s = &f->paths[i].steps[j];
+
+			xml_buf_puts(b, s->descendant ? "//" : "/");
+
+			if (s->ns)
+			{
+				xml_buf_puts(b, "{");
+				xml_buf_puts(b, s->ns);
+				xml_buf_puts(b, "}");
+			}
+
+			xml_buf_puts(b, s->name ? s->name : "*");
+
+			for (k = 0; k < s->n_preds; k++)
+			{
+				xml_buf_puts(b, "[");
+
+				for (l = 0; l < s->preds[k].n_terms; l++)
+				{
+					t = &s->preds[k].terms[l];
+
+					if (!t->n_names)
+						xml_buf_puts(b, ".");
+
+					for (m = 0; m < t->n_names; m++)
+					{
+						if (m)
+							xml_buf_puts(b, "/");
+
+						xml_buf_puts(b, t->names[m]);
+					}
+
+					if (t->op != XPATH_EXISTS)
+					{
+						snprintf(num, sizeof(num), "%s%zu:", t->op == XPATH_EQ ? "=" : "!=", strlen(t->value));
+						xml_buf_puts(b, num);
+						xml_buf_puts(b, t->value);
+					}
+
+					if (l < s->preds[k].n_terms - 1)
+						xml_buf_puts(b, t->or_next ? " or " : " and ");
+				}
+
+				xml_buf_puts(b, "]");
+			}
+		}
+	}
+}
+
+static int xpath_filter_compile(const struct xdoc *d, struct filter *f, const char **error)
+{
+	struct xpath_parser x = { .d = d };
+	struct xpath_path *paths;
+	struct xpath_step *first;
+	struct xml_buf b = { 0 };
+	const char *v;
+	char *select;
+	int i, len, rc = -1;
+
+	f->type = FILTER_XPATH;
+
+	if (!xattr(d->nodes[0].attrs, d->nodes[0].attrs_len, "select", &v, &len))
+	{
+		*error = "xpath filter without select";
+		return -1;
+	}
+
+	if (!(select = xtext_dup(v, len, false)))
+		return -1;
+
+	x.p = select;
+
+	do
+	{
+		if (!(paths = realloc(f->paths, (f->n_paths + 1) * sizeof(*paths))))
+			goto exit;
+
+		f->paths = paths;
+		memset(&paths[f->n_paths], 0, sizeof(*paths));
+
+		if (xp_path(&x, &paths[f->n_paths++]))
+			goto invalid;
+	}
+	while (xp_accept(&x, "|"));
+
+	xp_space(&x);
+
+	if (*x.p)
+		goto invalid;
+
+	if (!(f->names = calloc(f->n_paths, sizeof(*f->names))))
+		goto exit;
+
+	/* only paths starting with a named child step go into the index */
+	for (i = 0; i < f->n_paths; i++)
+	{
+		first = &f->paths[i].steps[0];
+
+		if (first->descendant || !first->name)
+			f->any = true;
+		else
+			f->names[f->n_names++] = first->name;
+	}
+
+	xpath_key(&b, f);
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		goto exit;
+	}
+
+	f->key = b.data;
+	rc = 0;
+	goto exit;
+
+invalid:
+	*error = x.error ? x.error : "unsupported xpath";
+
+exit:
+	free(select);
+
+	return rc;
+}
+
+/*
+ * filter_compile() - compile subscription filter
+ *
+ * @const char*:	the <filter> element as sent by the client
+ * @size_t:		its length
+ * @struct filter**:	set to the compiled filter
+ * @const char**:	set to the reason when the filter is refused
+ *
+ * Subtree filter elements without a namespace of their own match elements
+ * of any namespace, xpath prefixes are resolved on the filter element.
+ */
+int filter_compile(const char *xml, size_t len, struct filter **out, const char **error)
+{
+	struct xdoc d = { 0 };
+	struct filter *f = NULL;
+	const char *type;
+	int type_len, rc = -1;
+
+	*out = NULL;
+	*error = "invalid filter";
+
+	if (xdoc_parse(&d, xml, len) || !xnode_is(&d.nodes[0], "filter"))
+		goto exit;
+
+	if (!(f = calloc(1, sizeof(*f))))
+		goto exit;
+
+	if (!xattr(d.nodes[0].attrs, d.nodes[0].attrs_len, "type", &type, &type_len) ||
+	    (type_len == 7 && !memcmp(type, "subtree", 7)))
+		rc = subtree_filter_compile(&d, f, error);
+	else if (type_len == 5 && !memcmp(type, "xpath", 5))
+		rc = xpath_filter_compile(&d, f, error);
+	else
+		*error = "unsupported filter type";
+
+exit:
+	free(d.nodes);
+
+	if (rc)
+		filter_free(f);
+	else
+		*out = f;
+
+	return rc;
+}
+
+static bool subtree_match(const struct xdoc *d, const struct filter_node *fn, int i)
+{
+	const struct xnode *x = &d->nodes[i];
+	const struct filter_node *c;
+	bool selection = false;
+	int j, k;
+
+	if (!xnode_is(x, fn->name) || (fn->ns && !xnode_ns_is(d, i, fn->ns)))
+		return false;
+
+	if (fn->value)
+		return x->child < 0 && xtext_equal(x->text, x->text_len, fn->value);
+
+	/* every content match node has to match a sibling */
+	for (k = 0; k < fn->n_children; k++)
+	{
+		c = &fn->children[k];
+
+		if (!c->value)
+		{
+			selection = true;
+			continue;
+		}
+
+		for (j = x->child; j >= 0 && !subtree_match(d, c, j); j = d->nodes[j].next);
+
+		if (j < 0)
+			return false;
+	}
+
+	if (!selection)
+		return true;
+
+	for (k = 0; k < fn->n_children; k++)
+	{
+		c = &fn->children[k];
+
+		if (c->value)
+			continue;
+
+		for (j = x->child; j >= 0; j = d->nodes[j].next)
+		{
+			if (subtree_match(d, c, j))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static bool xpath_term_match(const struct xdoc *d, const struct xpath_term *t, int k, int i)
+{
+	const struct xnode *x = &d->nodes[i];
+	int j;
+
+	if (k == t->n_names)
+	{
+		if (t->op == XPATH_EXISTS)
+			return true;
+
+		/* values of leaves, elements with children compare as empty */
+		return xtext_equal(x->child < 0 ? x->text : NULL, x->text_len, t->value) == (t->op == XPATH_EQ);
+	}
+
+	for (j = x->child; j >= 0; j = d->nodes[j].next)
+	{
+		if (xnode_is(&d->nodes[j], t->names[k]) && xpath_term_match(d, t, k + 1, j))
+			return true;
+	}
+
+	return false;
+}
+
+static bool xpath_pred_match(const struct xdoc *d, const struct xpath_pred *pred, int i)
+{
+	bool all = true;
+	int k;
+
+	for (k = 0; k < pred->n_terms; k++)
+	{
+		all = all && xpath_term_match(d, &pred->terms[k], 0, i);
+
+		if (pred->terms[k].or_next || k == pred->n_terms - 1)
+		{
+			if (all)
+				return true;
+
+			all = true;
+		}
+	}
+
+	return false;
+}
+
+static bool xpath_step_match(const struct xdoc *d, const struct xpath_step *s, int i)
+{
+	int k;
+
+	if (s->name && !xnode_is(&d->nodes[i], s->name))
+		return false;
+
+	if (s->ns && !xnode_ns_is(d, i, s->ns))
+		return false;
+
+	for (k = 0; k < s->n_preds; k++)
+	{
+		if (!xpath_pred_match(d, &s->preds[k], i))
+			return false;
+	}
+
+	return true;
+}
+
+/* whether steps from k on select anything below element i */
+static bool xpath_match(const struct xdoc *d, const struct xpath_path *path, int k, int i)
+{
+	const struct xpath_step *s = &path->steps[k];
+	int j;
+
+	if (k == path->n_steps)
+		return true;
+
+	for (j = d->nodes[i].child; j >= 0; j = d->nodes[j].next)
+	{
+		if (xpath_step_match(d, s, j) && xpath_match(d, path, k + 1, j))
+			return true;
+
+		if (s->descendant && xpath_match(d, path, k, j))
+			return true;
+	}
+
+	return false;
+}
+
+/* the notification element is the context, its children are the event */
+static bool filter_match_doc(const struct filter *f, const struct xdoc *d)
+{
+	int i, j;
+
+	if (f->type == FILTER_XPATH)
+	{
+		for (i = 0; i < f->n_paths; i++)
+		{
+			if (xpath_match(d, &f->paths[i], 0, 0))
+				return true;
+		}
+
+		return false;
+	}
+
+	for (i = 0; i < f->n_nodes; i++)
+	{
+		for (j = d->nodes[0].child; j >= 0; j = d->nodes[j].next)
+		{
+			if (subtree_match(d, &f->nodes[i], j))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* filter_match() - whether filter selects anything of a notification message */
+bool filter_match(const struct filter *f, const char *msg, size_t len)
+{
+	if (xdoc_parse(&event_doc, msg, len))
+		return false;
+
+	return filter_match_doc(f, &event_doc);
+}
+
+static unsigned int filter_hash(const char *s, size_t len)
+{
+	unsigned int h = 2166136261u;
+
+	while (len--)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+
+	return h % FILTER_BUCKETS;
+}
+
+static struct filter_name *filter_name_find(struct filter_set *s, const char *name, size_t len)
+{
+	struct filter_name *n;
+
+	list_for_each_entry(n, &s->buckets[filter_hash(name, len)], list)
+	{
+		if (strlen(n->name) == len && !memcmp(n->name, name, len))
+			return n;
+	}
+
+	return NULL;
+}
+
+static void filter_group_unindex(struct filter_group *g)
+{
+	struct filter_link *l;
+	int i;
+
+	for (i = 0; i < g->n_links; i++)
+	{
+		l = &g->links[i];
+		list_del(&l->list);
+
+		if (l->name && list_empty(&l->name->links))
+		{
+			list_del(&l->name->list);
+			free(l->name->name);
+			free(l->name);
+		}
+	}
+
+	free(g->links);
+	g->links = NULL;
+	g->n_links = 0;
+}
+
+static int filter_group_index(struct filter_set *s, struct filter_group *g)
+{
+	const struct filter *f = g->filter;
+	struct filter_name *n;
+	struct filter_link *l;
+	size_t len;
+	int i;
+
+	if (!(g->links = calloc(f->n_names + f->any, sizeof(*g->links))))
+		return -1;
+
+	for (i = 0; i < f->n_names; i++)
+	{
+		len = strlen(f->names[i]);
+
+		if (!(n = filter_name_find(s, f->names[i], len)))
+		{
+			if (!(n = calloc(1, sizeof(*n))) || !(n->name = strdup(f->names[i])))
+			{
+				free(n);
+				filter_group_unindex(g);
+				return -1;
+			}
+
+			INIT_LIST_HEAD(&n->links);
+			list_add_tail(&n->list, &s->buckets[filter_hash(f->names[i], len)]);
+		}
+
+		l = &g->links[g->n_links++];
+		l->group = g;
+		l->name = n;
+		list_add_tail(&l->list, &n->links);
+	}
+
+	if (f->any)
+	{
+		l = &g->links[g->n_links++];
+		l->group = g;
+		list_add_tail(&l->list, &s->wildcard);
+	}
+
+	return 0;
+}
+
+/* filter_set_init() - empty set of groups for one stream */
+void filter_set_init(struct filter_set *s)
+{
+	int i;
+
+	INIT_LIST_HEAD(&s->groups);
+	INIT_LIST_HEAD(&s->wildcard);
+
+	for (i = 0; i < FILTER_BUCKETS; i++)
+		INIT_LIST_HEAD(&s->buckets[i]);
+
+	s->all = NULL;
+	s->filtered = 0;
+}
+
+/*
+ * filter_group_get() - group for a new subscriber
+ *
+ * @struct filter_set*:	groups of the stream subscribed to
+ * @struct filter*:	compiled filter, NULL for all events
+ *
+ * Takes ownership of the filter, it is freed if a group with an equal one
+ * exists. Returns the group with a reference taken for the subscriber, NULL
+ * if a new group can not be set up.
+ */
+struct filter_group *filter_group_get(struct filter_set *s, struct filter *f)
+{
+	struct filter_group *g;
+
+	list_for_each_entry(g, &s->groups, list)
+	{
+		if (f ? g->filter && !strcmp(f->key, g->filter->key) : !g->filter)
+		{
+			filter_free(f);
+			g->refs++;
+			return g;
+		}
+	}
+
+	if (!(g = calloc(1, sizeof(*g))))
+	{
+		filter_free(f);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&g->members);
+	g->filter = f;
+	g->refs = 1;
+
+	if (f && filter_group_index(s, g))
+	{
+		filter_free(f);
+		free(g);
+		return NULL;
+	}
+
+	if (f)
+		s->filtered++;
+	else
+		s->all = g;
+
+	list_add_tail(&g->list, &s->groups);
+	stats.filter_groups++;
+
+	DEBUG("new subscription group '%s'\n", f ? f->key : "all");
+
+	return g;
+}
+
+/* filter_group_put() - drop a subscriber's reference, the last one frees the group */
+void filter_group_put(struct filter_set *s, struct filter_group *g)
+{
+	if (--g->refs)
+		return;
+
+	if (g->filter)
+	{
+		filter_group_unindex(g);
+		filter_free(g->filter);
+		s->filtered--;
+	}
+	else
+		s->all = NULL;
+
+	list_del(&g->list);
+	free(g);
+	stats.filter_groups--;
+}
+
+static void filter_group_try(const struct xdoc *d, struct filter_group *g, int i)
+{
+	if (g->stamp == event_stamp)
+		return;
+
+	g->stamp = event_stamp;
+
+	if (filter_match_doc(g->filter, d))
+		g->mask |= (uint64_t) 1 << i;
+}
+
+/*
+ * filter_set_match() - find the groups each message of a batch goes to
+ *
+ * @struct filter_set*:	groups of the stream
+ * @char**:		notification messages
+ * @size_t*:		their lengths
+ * @int:		number of messages, at most 64
+ *
+ * Sets the mask of every group to the messages it passes. Messages are only
+ * parsed if there are filtered groups at all, then once each, and matched
+ * against the groups indexed under their top level elements.
+ */
+void filter_set_match(struct filter_set *s, char **msgs, size_t *lens, int n)
+{
+	uint64_t all = n < 64 ? ((uint64_t) 1 << n) - 1 : ~(uint64_t) 0;
+	const struct xnode *x;
+	struct filter_group *g;
+	struct filter_name *name;
+	struct filter_link *l;
+	const char *local;
+	int i, j, len, prefix_len;
+
+	list_for_each_entry(g, &s->groups, list)
+		g->mask = g->filter ? 0 : all;
+
+	if (!s->filtered)
+		return;
+
+	for (i = 0; i < n; i++)
+	{
+		if (xdoc_parse(&event_doc, msgs[i], lens[i]))
+			continue;
+
+		event_stamp++;
+
+		for (j = event_doc.nodes[0].child; j >= 0; j = x->next)
+		{
+			x = &event_doc.nodes[j];
+			local = xname_local(x->name, x->name_len, &len, &prefix_len);
+
+			if (!(name = filter_name_find(s, local, len)))
+				continue;
+
+			list_for_each_entry(l, &name->links, list)
+				filter_group_try(&event_doc, l->group, i);
+		}
+
+		list_for_each_entry(l, &s->wildcard, list)
+			filter_group_try(&event_doc, l->group, i);
+	}
+}
+
+/* filter_exit() - release the event parse buffer */
+void filter_exit(void)
+{
+	free(event_doc.nodes);
+	event_doc = (struct xdoc) { 0 };
+}
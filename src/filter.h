@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_FILTER_H__
+#define __FREENETCONFD_FILTER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libubox/list.h>
+
+/* buckets of the event name index of a stream */
+#define FILTER_BUCKETS 64
+
+struct filter;
+struct filter_link;
+
+/* subscribers of one stream with equal filters */
+struct filter_group
+{
+	/* in the set's groups */
+	struct list_head list;
+	/* entries of the subscribers, owned by their sessions */
+	struct list_head members;
+	/* NULL passes every event */
+	struct filter *filter;
+	int refs;
+	/* messages of the current batch that passed */
+	uint64_t mask;
+	/* event the filter was last matched against */
+	uint64_t stamp;
+	struct filter_link *links;
+	int n_links;
+};
+
+/* the filter groups of one stream and their index by event name */
+struct filter_set
+{
+	struct list_head groups;
+	struct list_head buckets[FILTER_BUCKETS];
+	/* links of filters that may match any event */
+	struct list_head wildcard;
+	struct filter_group *all;
+	int filtered;
+};
+
+int filter_compile(const char *xml, size_t len, struct filter **f, const char **error);
+void filter_free(struct filter *f);
+const char *filter_key(const struct filter *f);
+bool filter_match(const struct filter *f, const char *msg, size_t len);
+
+void filter_set_init(struct filter_set *s);
+struct filter_group *filter_group_get(struct filter_set *s, struct filter *f);
+void filter_group_put(struct filter_set *s, struct filter_group *g);
+void filter_set_match(struct filter_set *s, char **msgs, size_t *lens, int n);
+void filter_exit(void);
+
+#endif /* __FREENETCONFD_FILTER_H__ */
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "framing.h"
+#include "messages.h"
+
+/* RFC 6242: chunk-size = 1..4294967295 */
+#define FRAMING_MAX_CHUNK 4294967295ULL
+
+/* assembly buffers above this size are released after each message */
+#define FRAMING_KEEP_SIZE (64 * 1024)
+
+enum framing_state
+{
+	FRAMING_HDR_LF,
+	FRAMING_HDR_HASH,
+	FRAMING_HDR_SIZE_FIRST,
+	FRAMING_HDR_SIZE,
+	FRAMING_END_LF,
+	FRAMING_DATA,
+	FRAMING_COMPLETE,
+};
+
+void framing_init(struct framing *f, int base)
+{
+	free(f->msg);
+	memset(f, 0, sizeof(*f));
+
+	f->base = base;
+	f->state = FRAMING_HDR_LF;
+	f->max_size = FRAMING_MAX_MESSAGE;
+}
+
+void framing_free(struct framing *f)
+{
+	free(f->msg);
+	f->msg = NULL;
+	f->msg_len = f->msg_size = 0;
+}
+
+static int framing_append(struct framing *f, const char *data, size_t len)
+{
+	size_t size;
+	char *msg;
+
+	if (f->msg_len + len > f->max_size)
+		return -1;
+
+	if (f->msg_len + len + 1 > f->msg_size)
+	{
+		size = f->msg_size ? f->msg_size * 2 : 4096;
+
+		while (size < f->msg_len + len + 1)
+			size *= 2;
+
+		if (!(msg = realloc(f->msg, size)))
+			return -1;
+
+		f->msg = msg;
+		f->msg_size = size;
+	}
+
+	memcpy(f->msg + f->msg_len, data, len);
+	f->msg_len += len;
+	f->msg[f->msg_len] = '\0';
+
+	return 0;
+}
+
+/* forget message handed out by the previous call */
+static void framing_rewind(struct framing *f)
+{
+	if (f->state != FRAMING_COMPLETE)
+		return;
+
+	f->state = FRAMING_HDR_LF;
+	f->msg_len = 0;
+	f->scan = 0;
+
+	if (f->msg_size > FRAMING_KEEP_SIZE)
+		framing_free(f);
+}
+
+/* base:1.0, message ends with "]]>]]>" */
+static int framing_decode_eom(struct framing *f, char *data, size_t len, char **msg, size_t *msg_len)
+{
+	const size_t eom_len = strlen(XML_NETCONF_BASE_1_0_END);
+	size_t old = f->msg_len, skip = 0, start, pos;
+	char *end;
+
+	/* common case, whole message in one read: hand it out in place */
+	if (!f->msg_len && (end = memmem(data, len, XML_NETCONF_BASE_1_0_END, eom_len)))
+	{
+		*end = '\0';
+		*msg = data;
+		*msg_len = end - data;
+
+		return *msg_len + eom_len;
+	}
+
+	/* whitespace between messages must not count as a started message */
+	while (!f->msg_len && skip < len && (data[skip] == ' ' || data[skip] == '\t' || data[skip] == '\r' || data[skip] == '\n'))
+		skip++;
+
+	if (framing_append(f, data + skip, len - skip))
+		return -1;
+
+	/* marker may straddle the previous read */
+	start = f->scan > eom_len - 1 ? f->scan - (eom_len - 1) : 0;
+	end = memmem(f->msg + start, f->msg_len - start, XML_NETCONF_BASE_1_0_END, eom_len);
+
+	if (!end)
+	{
+		f->scan = f->msg_len;
+		return len;
+	}
+
+	pos = end - f->msg;
+
+	f->msg_len = pos;
+	f->msg[pos] = '\0';
+	f->state = FRAMING_COMPLETE;
+
+	*msg = f->msg;
+	*msg_len = pos;
+
+	return skip + pos + eom_len - old;
+}
+
+/* zero copy path for a message made of one chunk that arrived in one read */
+static int framing_decode_single_chunk(struct framing *f, char *data, size_t len, char **msg, size_t *msg_len)
+{
+	const size_t end_len = strlen(XML_NETCONF_BASE_1_1_END);
+	uint64_t size = 0;
+	size_t p = 2;
+
+	if (len < 4 || data[0] != '\n' || data[1] != '#' || data[2] < '1' || data[2] > '9')
+		return 0;
+
+	while (p < len && data[p] >= '0' && data[p] <= '9' && size <= f->max_size)
+		size = size * 10 + (data[p++] - '0');
+
+	if (p >= len || data[p] != '\n' || size > f->max_size)
+		return 0;
+
+	p++;
+
+	if (len - p < size + end_len || memcmp(data + p + size, XML_NETCONF_BASE_1_1_END, end_len))
+		return 0;
+
+	data[p + size] = '\0';
+
+	*msg = data + p;
+	*msg_len = size;
+
+	return p + size + end_len;
+}
+
+/* base:1.1, RFC 6242 chunked framing */
+static int framing_decode_chunked(struct framing *f, char *data, size_t len, char **msg, size_t *msg_len)
+{
+	size_t i = 0, n;
+	int rc;
+	char c;
+
+	if (!f->msg_len && f->state == FRAMING_HDR_LF)
+	{
+		rc = framing_decode_single_chunk(f, data, len, msg, msg_len);
+
+		if (rc)
+			return rc;
+	}
+
+	while (i < len)
+	{
+		switch (f->state)
+		{
+			case FRAMING_DATA:
+				n = len - i < f->chunk_left ? len - i : f->chunk_left;
+
+				if (framing_append(f, data + i, n))
+					return -1;
+
+				i += n;
+				f->chunk_left -= n;
+
+				if (!f->chunk_left)
+					f->state = FRAMING_HDR_LF;
+
+				break;
+
+			case FRAMING_HDR_LF:
+				c = data[i++];
+
+				/* tolerate stray whitespace between messages */
+				if (!f->msg_len && (c == ' ' || c == '\t' || c == '\r'))
+					break;
+
+				if (c != '\n')
+					return -1;
+
+				f->state = FRAMING_HDR_HASH;
+				break;
+
+			case FRAMING_HDR_HASH:
+				c = data[i++];
+
+				if (c == '\n' && !f->msg_len)
+					break;
+
+				if (c != '#')
+					return -1;
+
+				f->state = FRAMING_HDR_SIZE_FIRST;
+				break;
+
+			case FRAMING_HDR_SIZE_FIRST:
+				c = data[i++];
+
+				if (c == '#')
+				{
+					f->state = FRAMING_END_LF;
+				}
+				else if (c >= '1' && c <= '9')
+				{
+					f->chunk_left = c - '0';
+					f->state = FRAMING_HDR_SIZE;
+				}
+				else
+					return -1;
+
+				break;
+
+			case FRAMING_HDR_SIZE:
+				c = data[i++];
+
+				if (c == '\n')
+				{
+					f->state = FRAMING_DATA;
+					break;
+				}
+
+				if (c < '0' || c > '9')
+					return -1;
+
+				f->chunk_left = f->chunk_left * 10 + (c - '0');
+
+				if (f->chunk_left > FRAMING_MAX_CHUNK || f->msg_len + f->chunk_left > f->max_size)
+					return -1;
+
+				break;
+
+			case FRAMING_END_LF:
+				if (data[i++] != '\n')
+					return -1;
+
+				/* end of chunks without any chunk, still hand out a string */
+				if (!f->msg && framing_append(f, "", 0))
+					return -1;
+
+				f->state = FRAMING_COMPLETE;
+
+				*msg = f->msg;
+				*msg_len = f->msg_len;
+
+				return i;
+
+			default:
+				return -1;
+		}
+	}
+
+	return i;
+}
+
+/*
+ * framing_decode() - extract next netconf message from received data
+ *
+ * @struct framing*:	per session decoder state
+ * @char*:		received data, may be modified
+ * @size_t:		length of received data
+ * @char**:		set to the NUL terminated message once one is complete
+ * @size_t*:		length of that message
+ *
+ * Returns the number of bytes consumed from data and -1 on framing errors.
+ * Partial messages are buffered internally, so either a message is returned
+ * or all of data is consumed. A returned message points into data or into
+ * the decoder and stays valid until the next call.
+ */
+int framing_decode(struct framing *f, char *data, size_t len, char **msg, size_t *msg_len)
+{
+	*msg = NULL;
+	*msg_len = 0;
+
+	framing_rewind(f);
+
+	if (f->base)
+		return framing_decode_chunked(f, data, len, msg, msg_len);
+
+	return framing_decode_eom(f, data, len, msg, msg_len);
+}
+
+/* whether part of a message has been received */
+int framing_pending(const struct framing *f)
+{
+	if (f->state == FRAMING_COMPLETE)
+		return 0;
+
+	return f->msg_len || f->state != FRAMING_HDR_LF;
+}
+
+/*
+ * framing_header() - render header preceding a message of len bytes
+ *
+ * Returns header length, 0 for base:1.0 which has none.
+ */
+int framing_header(int base, size_t len, char *buf, size_t size)
+{
+	if (!base)
+		return 0;
+
+	return snprintf(buf, size, "\n#%zu\n", len);
+}
+
+const char *framing_trailer(int base)
+{
+	return base ? XML_NETCONF_BASE_1_1_END : XML_NETCONF_BASE_1_0_END;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_FRAMING_H__
+#define __FREENETCONFD_FRAMING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAMING_MAX_MESSAGE (16 * 1024 * 1024)
+
+struct framing
+{
+	/* 0 for end-of-message framing, 1 for chunked framing */
+	int base;
+	int state;
+	uint64_t chunk_left;
+	size_t max_size;
+
+	/* message assembled from several reads or chunks */
+	char *msg;
+	size_t msg_len;
+	size_t msg_size;
+	size_t scan;
+};
+
+void framing_init(struct framing *f, int base);
+void framing_free(struct framing *f);
+int framing_decode(struct framing *f, char *data, size_t len, char **msg, size_t *msg_len);
+int framing_pending(const struct framing *f);
+int framing_header(int base, size_t len, char *buf, size_t size);
+const char *framing_trailer(int base);
+
+#endif /* __FREENETCONFD_FRAMING_H__ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "histogram.h"
+
+static unsigned int histogram_index(uint64_t value)
+{
+	unsigned int exp;
+
+	if (value < HISTOGRAM_SUB)
+		return value;
+
+	exp = 63 - __builtin_clzll(value);
+
+	return (exp - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB + ((value >> (exp - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+}
+
+/* middle of the range of values counted in bucket i */
+static uint64_t histogram_value(unsigned int i)
+{
+	unsigned int exp, sub;
+
+	if (i < HISTOGRAM_SUB)
+		return i;
+
+	exp = i / HISTOGRAM_SUB - 1 + HISTOGRAM_SUB_BITS;
+	sub = i % HISTOGRAM_SUB;
+
+	return ((uint64_t) (HISTOGRAM_SUB + sub) << (exp - HISTOGRAM_SUB_BITS)) + ((1ULL << (exp - HISTOGRAM_SUB_BITS)) >> 1);
+}
+
+/* constant time, no allocation: a bucket increment and four scalars */
+void histogram_record(struct histogram *h, uint64_t value)
+{
+	h->buckets[histogram_index(value)]++;
+
+	if (!h->count || value < h->min)
+		h->min = value;
+
+	if (value > h->max)
+		h->max = value;
+
+	h->count++;
+	h->sum += value;
+}
+
+/*
+ * histogram_percentile() - value below which percentile % of samples fall
+ *
+ * @const struct histogram*:	histogram to look at
+ * @double:			0 to 100
+ */
+uint64_t histogram_percentile(const struct histogram *h, double percentile)
+{
+	uint64_t rank, seen = 0, value;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = (uint64_t) (percentile / 100.0 * h->count + 0.5);
+
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+
+		if (seen < rank)
+			continue;
+
+		value = histogram_value(i);
+
+		/* bucket midpoints may lie outside what was actually seen */
+		if (value < h->min)
+			return h->min;
+
+		return value > h->max ? h->max : value;
+	}
+
+	return h->max;
+}
+
+void histogram_reset(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_HISTOGRAM_H__
+#define __FREENETCONFD_HISTOGRAM_H__
+
+#include <stdint.h>
+
+/*
+ * Log-linear buckets like HdrHistogram: every power of two is split into
+ * HISTOGRAM_SUB buckets, so a value is known within 1/HISTOGRAM_SUB of
+ * itself over the whole 64 bit range.
+ */
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((65 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB)
+
+struct histogram
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_record(struct histogram *h, uint64_t value);
+uint64_t histogram_percentile(const struct histogram *h, double percentile);
+void histogram_reset(struct histogram *h);
+
+#endif /* __FREENETCONFD_HISTOGRAM_H__ */
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "netconfd/netconfd.h"
+
+#include "log.h"
+
+/*
+ * Asynchronous logging
+ *
+ * Messages are formatted by the thread logging them straight into a slot
+ * of a bounded ring and written out by a thread of their own, so neither
+ * the event loop nor the ssh and tls threads wait for syslog or the disk.
+ * The ring is the bounded queue of Dmitry Vyukov: producers claim a slot
+ * with a compare and swap of the tail, a per slot sequence number tells
+ * the consumer when it is filled. A full ring drops the message and counts
+ * it instead of blocking.
+ *
+ * The writer sleeps on a futex while the ring is empty, producers only
+ * make the wake up system call if it actually sleeps.
+ *
+ * Until log_start() and after log_stop() messages are written directly,
+ * this is what the supervisor process does.
+ */
+#define LOG_RING_SIZE 256
+#define LOG_MSG_MAX 512
+/* writes batched into one writev() */
+#define LOG_BATCH 32
+/* writer checks for a stop request at least this often, ms */
+#define LOG_IDLE_WAIT 1000
+
+enum log_sink
+{
+	LOG_SINK_STDERR,
+	LOG_SINK_SYSLOG,
+	LOG_SINK_FILE,
+};
+
+struct log_slot
+{
+	size_t seq;
+	struct timespec ts;
+	int level;
+	int len;
+	char msg[LOG_MSG_MAX];
+};
+
+static struct log_slot *ring = NULL;
+static size_t head = 0;
+static size_t tail __attribute__((aligned(64))) = 0;
+static int sleeping __attribute__((aligned(64))) = 0;
+static uint64_t dropped = 0;
+
+static bool running = false;
+static bool stopping = false;
+static bool reopen = false;
+static pthread_t writer;
+
+static int sink = LOG_SINK_STDERR;
+static char *path = NULL;
+static int fd = STDERR_FILENO;
+
+static void log_futex(int *addr, int op, int val, const struct timespec *timeout)
+{
+	syscall(SYS_futex, addr, op | FUTEX_PRIVATE_FLAG, val, timeout, NULL, 0);
+}
+
+static int log_open(void)
+{
+	int new = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+
+	if (new < 0)
+		return -1;
+
+	if (fd != STDERR_FILENO)
+		close(fd);
+
+	fd = new;
+
+	return 0;
+}
+
+/* one line per message, timestamped unless syslog does that */
+static int log_format(char *prefix, size_t size, const struct timespec *ts)
+{
+	struct tm tm;
+	int len;
+
+	if (sink == LOG_SINK_STDERR)
+		return snprintf(prefix, size, "%s: ", PROJECT_NAME);
+
+	gmtime_r(&ts->tv_sec, &tm);
+	len = strftime(prefix, size, "%Y-%m-%dT%H:%M:%S", &tm);
+	len += snprintf(prefix + len, size - len, ".%03ldZ %s[%d]: ", ts->tv_nsec / 1000000, PROJECT_NAME, (int) getpid());
+
+	return len;
+}
+
+static void log_write(struct log_slot **slots, int n)
+{
+	struct iovec iov[2 * LOG_BATCH];
+	char prefix[LOG_BATCH][64];
+	int i;
+
+	if (sink == LOG_SINK_SYSLOG)
+	{
+		for (i = 0; i < n; i++)
+			syslog(slots[i]->level, "%.*s", slots[i]->len, slots[i]->msg);
+
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		iov[2 * i].iov_base = prefix[i];
+		iov[2 * i].iov_len = log_format(prefix[i], sizeof(prefix[i]), &slots[i]->ts);
+		iov[2 * i + 1].iov_base = slots[i]->msg;
+		iov[2 * i + 1].iov_len = slots[i]->len;
+	}
+
+	/* nothing to be done about a failing log file */
+	if (writev(fd, iov, 2 * n) < 0)
+		;
+}
+
+/* slot at position pos if it is filled, NULL otherwise */
+static struct log_slot *log_peek(size_t pos)
+{
+	struct log_slot *s = &ring[pos & (LOG_RING_SIZE - 1)];
+
+	if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return NULL;
+
+	return s;
+}
+
+/* write out everything queued, returns the number of messages */
+static int log_drain(void)
+{
+	struct log_slot *slots[LOG_BATCH];
+	uint64_t lost;
+	int i, n, total = 0;
+
+	do
+	{
+		for (n = 0; n < LOG_BATCH && (slots[n] = log_peek(head + n)); n++);
+
+		if (n)
+			log_write(slots, n);
+
+		/* hand the slots back to producers for the next round */
+		for (i = 0; i < n; i++, head++)
+			__atomic_store_n(&slots[i]->seq, head + LOG_RING_SIZE, __ATOMIC_RELEASE);
+
+		total += n;
+	}
+	while (n == LOG_BATCH);
+
+	if ((lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED)))
+	{
+		struct log_slot s = { .level = LOG_WARNING }, *p = &s;
+
+		clock_gettime(CLOCK_REALTIME, &s.ts);
+		s.len = snprintf(s.msg, sizeof(s.msg), "%llu log messages dropped\n", (unsigned long long) lost);
+		log_write(&p, 1);
+	}
+
+	return total;
+}
+
+static void *log_writer(void *arg)
+{
+	struct timespec timeout = { .tv_sec = LOG_IDLE_WAIT / 1000, .tv_nsec = (LOG_IDLE_WAIT % 1000) * 1000000 };
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+	{
+		if (__atomic_exchange_n(&reopen, false, __ATOMIC_ACQ_REL))
+			log_open();
+
+		if (log_drain())
+			continue;
+
+		/* producers see the flag or we see their message */
+		__atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+
+		if (!log_peek(head))
+			log_futex(&sleeping, FUTEX_WAIT, 1, &timeout);
+
+		__atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+	}
+
+	log_drain();
+
+	return NULL;
+}
+
+/* claim a slot for writing, NULL if the ring is full */
+static struct log_slot *log_claim(size_t *pos)
+{
+	struct log_slot *s;
+	size_t seq, t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+	intptr_t diff;
+
+	for (;;)
+	{
+		s = &ring[t & (LOG_RING_SIZE - 1)];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t) seq - (intptr_t) t;
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&tail, &t, t + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0)
+			return NULL;
+		else
+			t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+	}
+
+	*pos = t;
+
+	return s;
+}
+
+/*
+ * netconfd_log() - queue message for the log writer
+ *
+ * @int:		syslog level
+ * @const char*:	printf format
+ *
+ * Called through the LOG, ERROR and DEBUG macros, which do the level
+ * checks. Safe to call from any thread.
+ */
+void netconfd_log(int level, const char *fmt, ...)
+{
+	struct log_slot *s, local;
+	va_list ap;
+	size_t pos = 0;
+
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+		s = &local;
+	else if (!(s = log_claim(&pos)))
+	{
+		__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &s->ts);
+	s->level = level;
+
+	va_start(ap, fmt);
+	s->len = vsnprintf(s->msg, sizeof(s->msg), fmt, ap);
+	va_end(ap);
+
+	if (s->len < 0)
+		s->len = 0;
+
+	/* truncated, keep the line break */
+	if (s->len >= sizeof(s->msg))
+	{
+		s->len = sizeof(s->msg) - 1;
+		s->msg[s->len - 1] = '\n';
+	}
+
+	if (s == &local)
+	{
+		log_write(&s, 1);
+		return;
+	}
+
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&sleeping, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&sleeping, 0, __ATOMIC_SEQ_CST))
+		log_futex(&sleeping, FUTEX_WAKE, 1, NULL);
+}
+
+/*
+ * log_init() - choose where messages go
+ *
+ * @const char*:	LOG_TARGET_STDERR, LOG_TARGET_SYSLOG or a file name
+ *
+ * Called before the workers are forked, they all write to the same file.
+ */
+int log_init(const char *target)
+{
+	if (!target || !strcmp(target, LOG_TARGET_STDERR))
+		return 0;
+
+	if (!strcmp(target, LOG_TARGET_SYSLOG))
+	{
+		openlog(PROJECT_NAME, LOG_PID, LOG_DAEMON);
+		sink = LOG_SINK_SYSLOG;
+		return 0;
+	}
+
+	if (!(path = strdup(target)) || log_open())
+	{
+		ERROR("unable to open log file '%s'\n", target);
+		free(path);
+		path = NULL;
+		return -1;
+	}
+
+	sink = LOG_SINK_FILE;
+
+	return 0;
+}
+
+/* hand messages over to a writer thread of this process */
+int log_start(void)
+{
+	size_t i;
+
+	if (!(ring = calloc(LOG_RING_SIZE, sizeof(*ring))))
+		return -1;
+
+	for (i = 0; i < LOG_RING_SIZE; i++)
+		ring[i].seq = i;
+
+	if (pthread_create(&writer, NULL, log_writer, NULL))
+	{
+		free(ring);
+		ring = NULL;
+		return -1;
+	}
+
+	__atomic_store_n(&running, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* open the log file again, after it was rotated */
+void log_reopen(void)
+{
+	if (sink != LOG_SINK_FILE)
+		return;
+
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+	{
+		log_open();
+		return;
+	}
+
+	__atomic_store_n(&reopen, true, __ATOMIC_RELEASE);
+	log_futex(&sleeping, FUTEX_WAKE, 1, NULL);
+}
+
+/*
+ * log_stop() - write out what is queued and go back to writing directly
+ *
+ * The ring is left allocated, threads that still fill a slot they claimed
+ * before may do so, their message is lost.
+ */
+void log_stop(void)
+{
+	if (__atomic_exchange_n(&running, false, __ATOMIC_ACQ_REL))
+	{
+		__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+		__atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+		log_futex(&sleeping, FUTEX_WAKE, 1, NULL);
+		pthread_join(writer, NULL);
+	}
+
+	if (sink == LOG_SINK_SYSLOG)
+		closelog();
+	else if (sink == LOG_SINK_FILE && fd != STDERR_FILENO)
+		close(fd);
+
+	sink = LOG_SINK_STDERR;
+	fd = STDERR_FILENO;
+	free(path);
+	path = NULL;
+}
+
+/* messages lost to a full ring that the writer has not reported yet */
+uint64_t log_dropped(void)
+{
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
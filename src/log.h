@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_LOG_H__
+#define __FREENETCONFD_LOG_H__
+
+#include <stdint.h>
+
+/* log_file values that are not paths */
+#define LOG_TARGET_STDERR "stderr"
+#define LOG_TARGET_SYSLOG "syslog"
+
+int log_init(const char *target);
+int log_start(void);
+void log_reopen(void);
+void log_stop(void);
+uint64_t log_dropped(void);
+
+#endif /* __FREENETCONFD_LOG_H__ */
@@ -20,6 +20,12 @@
 #define XML_NETCONF_BASE_1_0_END "]]>]]>"
 #define XML_NETCONF_BASE_1_1_END "\n##\n"
 
+#ifdef ENABLE_ZLIB
+#define XML_NETCONF_CAPABILITY_COMPRESS "<capability>urn:netconfd:capability:compression:zlib:1.0</capability>"
+#else
+#define XML_NETCONF_CAPABILITY_COMPRESS ""
+#endif
+
 #define XML_NETCONF_HELLO \
 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
 "<hello xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\">" \
@@ -28,6 +34,8 @@
   "<capability>urn:ietf:params:netconf:base:1.1</capability>" \
   "<capability>urn:ietf:params:netconf:capability:notification:1.0</capability>" \
   "<capability>urn:ietf:params:netconf:capability:xpath:1.0</capability>" \
+  "<capability>urn:netconfd:capability:changes:1.0</capability>" \
+  XML_NETCONF_CAPABILITY_COMPRESS \
  "</capabilities>" \
 "</hello>"
 
@@ -20,14 +20,30 @@
 #include <stdint.h>
 #include <time.h>
 
+#include <libubox/blobmsg.h>
+
 #include "netconfd/netconfd.h"
 #include "netconfd/netconf.h"
 #include "netconfd/plugin.h"
+#include "netconfd/arena.h"
 
 #include "netconf.h"
 #include "methods.h"
 #include "messages.h"
 #include "config.h"
+#include "worker.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "provider.h"
+#include "datastore.h"
+#include "xml.h"
+#include "metrics.h"
+#include "monitoring.h"
+#include "filter.h"
+#include "push.h"
+#include "cache.h"
+#include "changes.h"
+#include "compress.h"
 
 
 #ifndef ARRAY_SIZE
@@ -46,6 +62,7 @@ static int method_handle_close_session(struct rpc_data *data);
 static int method_handle_kill_session(struct rpc_data *data);
 static int method_handle_stream(struct rpc_data *data);
 static int method_handle_create_subscription(struct rpc_data *data);
+static int method_handle_get_changes(struct rpc_data *data);
 
 const struct rpc_method rpc_methods[] =
 {
@@ -60,22 +77,336 @@ const struct rpc_method rpc_methods[] =
 	{ "kill-session", method_handle_kill_session },
 	{ "stream", method_handle_stream},
 	{ "create-subscription", method_handle_create_subscription},
+	{ "get-changes", method_handle_get_changes },
+};
+
+const int rpc_method_count = ARRAY_SIZE(rpc_methods);
+
+/* scheduling class by operation, everything else is SCHED_CLASS_DEFAULT */
+static const struct
+{
+	const char *name;
+	int class;
+} rpc_classes[] =
+{
+	{ "lock", SCHED_CLASS_SESSION },
+	{ "unlock", SCHED_CLASS_SESSION },
+	{ "close-session", SCHED_CLASS_SESSION },
+	{ "kill-session", SCHED_CLASS_SESSION },
+	{ "get", SCHED_CLASS_BULK },
+	{ "get-config", SCHED_CLASS_BULK },
+	{ "copy-config", SCHED_CLASS_BULK },
+	{ "get-changes", SCHED_CLASS_BULK },
 };
 
+/* comment replaced by data rendered outside of roxml once the reply is committed */
+#define METHOD_DATA_MARKER "netconfd-data"
+
+/* how far into a message the operation is looked for */
+#define RPC_CLASSIFY_SCAN 1024
+
+#define RPC_NAME_MAX 256
+#define RPC_CONTENT_MIN 128
+
+/*
+ * rpc_get_name() - copy node name into request arena
+ *
+ * Keeps names out of roxml's own release pool so nothing has to be tracked
+ * and freed per string.
+ */
+char *rpc_get_name(struct arena *arena, node_t *n)
+{
+	char *buf;
+
+	if (!n || !(buf = arena_alloc(arena, RPC_NAME_MAX)))
+		return NULL;
+
+	return roxml_get_name(n, buf, RPC_NAME_MAX);
+}
+
+/*
+ * rpc_get_content() - copy node content into request arena
+ *
+ * Short values fit into the first guess, longer ones are fetched again once
+ * roxml told us their real size.
+ */
+char *rpc_get_content(struct arena *arena, node_t *n)
+{
+	int size = 0;
+	char *buf;
+
+	if (!n || !(buf = arena_alloc(arena, RPC_CONTENT_MIN)))
+		return NULL;
+
+	roxml_get_content(n, buf, RPC_CONTENT_MIN, &size);
+
+	if (size < RPC_CONTENT_MIN)
+		return buf;
+
+	if (!(buf = arena_alloc(arena, size + 1)))
+		return NULL;
+
+	return roxml_get_content(n, buf, size + 1, &size);
+}
+
+/*
+ * method_classify_rpc() - scheduling class of a received rpc
+ *
+ * @const char*:	start of the raw message, framing included
+ * @size_t:		bytes available
+ *
+ * Only looks at the name of the first element inside <rpc>, so requests
+ * can be ordered before they are parsed.
+ */
+int method_classify_rpc(const char *data, size_t len)
+{
+	const char *p = data, *end, *name, *colon;
+	bool in_rpc = false;
+	size_t n;
+	int i;
+
+	if (len > RPC_CLASSIFY_SCAN)
+		len = RPC_CLASSIFY_SCAN;
+
+	end = data + len;
+
+	while ((p = memchr(p, '<', end - p)) && ++p < end)
+	{
+		/* declarations, comments and closing tags */
+		if (*p == '?' || *p == '!' || *p == '/')
+			continue;
+
+		name = p;
+
+		while (p < end && *p != '>' && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			p++;
+
+		if (p == end)
+			break;
+
+		if ((colon = memchr(name, ':', p - name)))
+			name = colon + 1;
+
+		n = p - name;
+
+		if (!in_rpc)
+		{
+			in_rpc = n == 3 && !memcmp(name, "rpc", 3);
+			continue;
+		}
+
+		for (i = 0; i < ARRAY_SIZE(rpc_classes); i++)
+		{
+			if (strlen(rpc_classes[i].name) == n && !memcmp(name, rpc_classes[i].name, n))
+				return rpc_classes[i].class;
+		}
+
+		break;
+	}
+
+	return SCHED_CLASS_DEFAULT;
+}
+
+/*
+ * method_get_providers() - start gathering subtrees served by ubus providers
+ *
+ * Without filter all providers are asked, otherwise those serving a top
+ * level element of the filter. Returns whether any provider is involved.
+ */
+static bool method_get_providers(struct rpc_data *data, node_t *filter)
+{
+	struct provider_request *r;
+	struct provider *p;
+	node_t *n;
+	char *name, *ns;
+	int i, count = filter ? roxml_get_chld_nb(filter) : 0;
+
+	if (!(r = provider_request_new(PROVIDER_GET)))
+		return false;
+
+	if (!filter)
+	{
+		for (p = provider_next(NULL); p; p = provider_next(p))
+			provider_request_add(r, p, NULL);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		n = roxml_get_chld(filter, NULL, i);
+		name = rpc_get_name(data->arena, n);
+		ns = rpc_get_content(data->arena, roxml_get_ns(n));
+
+		if (name && (p = provider_lookup(name, ns)))
+			provider_request_add(r, p, NULL);
+	}
+
+	if (!provider_request_pending(r))
+	{
+		provider_request_abort(r);
+		return false;
+	}
+
+	data->deferred = r;
+
+	return true;
+}
+
+/* top level filter element with the given name and namespace, NULL if none */
+static node_t *method_filter_find(struct rpc_data *data, node_t *filter, bool (*match)(const char *, const char *))
+{
+	char *name, *ns;
+	node_t *cur;
+	int i, count = roxml_get_chld_nb(filter);
+
+	for (i = 0; i < count; i++)
+	{
+		cur = roxml_get_chld(filter, NULL, i);
+		name = rpc_get_name(data->arena, cur);
+		ns = rpc_get_content(data->arena, roxml_get_ns(cur));
+
+		if (name && match(name, ns))
+			return cur;
+	}
+
+	return NULL;
+}
+
+/* uci packages named by filter, none for all of them, -1 if it asks for other things only */
+static int method_datastore_names(struct rpc_data *data, node_t *filter, char **names)
+{
+	node_t *n;
+	int i, count, n_names = 0;
+
+	if (!filter)
+		return 0;
+
+	if (!(n = method_filter_find(data, filter, datastore_match)))
+		return -1;
+
+	count = roxml_get_chld_nb(n);
+
+	for (i = 0; i < count && n_names < DATASTORE_FILTER_MAX; i++)
+		names[n_names++] = rpc_get_content(data->arena, roxml_get_attr(roxml_get_chld(n, NULL, i), "name", 0));
+
+	return n_names;
+}
+
+/* uci packages selected by filter */
+static void method_get_datastore(struct rpc_data *data, struct xml_buf *b, node_t *filter)
+{
+	char *names[DATASTORE_FILTER_MAX];
+	int n_names = method_datastore_names(data, filter, names);
+
+	if (n_names >= 0)
+		datastore_render(b, names, n_names);
+}
+
+static bool method_metrics_match(const char *name, const char *ns)
+{
+	return !strcmp(name, METRICS_ELEMENT) && (!ns || !strcmp(ns, METRICS_NS));
+}
+
+/* latency histograms and session counters, only if asked for by name */
+static void method_get_metrics(struct rpc_data *data, struct xml_buf *b, node_t *filter)
+{
+	if (!filter || !method_filter_find(data, filter, method_metrics_match))
+		return;
+
+	metrics_render(b);
+}
+
+/* netconf-state, or the sections of it named by the filter */
+static void method_get_monitoring(struct rpc_data *data, struct xml_buf *b, node_t *filter)
+{
+	char *names[8];
+	node_t *n;
+	int i, count, n_names = 0;
+
+	if (filter)
+	{
+		if (!(n = method_filter_find(data, filter, monitoring_match)))
+			return;
+
+		count = roxml_get_chld_nb(n);
+
+		for (i = 0; i < count && n_names < ARRAY_SIZE(names); i++)
+			names[n_names++] = rpc_get_name(data->arena, roxml_get_chld(n, NULL, i));
+	}
+
+	monitoring_render(b, names, n_names);
+}
+
+/* replace the comment holding marker with text, returns the new reply */
+static char *method_splice(char *xml, const char *marker, const char *text)
+{
+	struct xml_buf b = { 0 };
+	char *pos, comment[64];
+
+	snprintf(comment, sizeof(comment), "<!--%s-->", marker);
+
+	if (!(pos = strstr(xml, comment)))
+		return xml;
+
+	xml_buf_append(&b, xml, pos - xml);
+	xml_buf_puts(&b, text);
+	xml_buf_puts(&b, pos + strlen(comment));
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return xml;
+	}
+
+	free(xml);
+
+	return b.data;
+}
+
+/* element content as blobmsg: leaves become strings, others tables */
+static void method_xml_to_blob(struct arena *arena, struct blob_buf *b, node_t *n)
+{
+	int i, count = roxml_get_chld_nb(n);
+	node_t *cur;
+	char *name, *value;
+	void *t;
+
+	for (i = 0; i < count; i++)
+	{
+		cur = roxml_get_chld(n, NULL, i);
+
+		if (!(name = rpc_get_name(arena, cur)))
+			continue;
+
+		if (roxml_get_chld_nb(cur))
+		{
+			t = blobmsg_open_table(b, name);
+			method_xml_to_blob(arena, b, cur);
+			blobmsg_close_table(b, t);
+			continue;
+		}
+
+		value = rpc_get_content(arena, cur);
+		blobmsg_add_string(b, name, value ? value : "");
+	}
+}
+
 /*
  * method_analyze_message_hello() - analyze rpc hello message
  *
  * @char*:	xml message for parsing
  * @int*:	netconf 'base' we deduce from message
+ * @bool*:	set if the client asks for compressed messages
+ * @struct arena*:	request arena for temporary strings
  *
  * Checks if rpc message is a valid hello message and parse rcp base version
  * client supports.
  */
-int method_analyze_message_hello(char *xml_in, int *base)
+int method_analyze_message_hello(char *xml_in, int *base, bool *compress, struct arena *arena)
 {
 	int rc = -1, num_nodes = 0;
 	node_t **nodes;
 	int tbase = -1;
+	bool tcompress = false;
 
 	node_t *root = roxml_load_buf(xml_in);
 
@@ -96,7 +427,9 @@ int method_analyze_message_hello(char *xml_in, int *base)
 	{
 		if (!nodes[i]) continue;
 
-		char *value = roxml_get_content(nodes[i], NULL, 0, NULL);
+		char *value = rpc_get_content(arena, nodes[i]);
+
+		if (!value) continue;
 
 		if (strcmp(value, "urn:ietf:params:netconf:base:1.1") == 0)
 		{
@@ -106,12 +439,19 @@ int method_analyze_message_hello(char *xml_in, int *base)
 		{
 			tbase = 0;
 		}
+#ifdef ENABLE_ZLIB
+		else if (strcmp(value, COMPRESS_CAPABILITY) == 0)
+		{
+			tcompress = true;
+		}
+#endif
 	}
 
 	if (tbase == -1)
 		goto exit;
 
 	*base = tbase;
+	*compress = tcompress;
 
 	rc = 0;
 
@@ -164,15 +504,20 @@ exit:
 	return rc;
 }
 
-int method_create_message_hello(char **xml_out)
+int method_create_message_hello(char **xml_out, uint32_t *id)
 {
 	int rc = -1, len;
 	char c_session_id[BUFSIZ];
-	static uint32_t session_id = 0;
+	static uint32_t session_seq = 0;
+	uint32_t session_id;
 
 	/* prevent variable overflow */
-	if (++session_id == 0)
-		session_id = 1;
+	if (++session_seq > (UINT32_MAX - 1) / worker_count)
+		session_seq = 1;
+
+	/* workers hand out interleaved ids so sessions stay unique */
+	session_id = (session_seq - 1) * worker_count + worker_id + 1;
+	*id = session_id;
 
 	node_t *root = roxml_load_buf(XML_NETCONF_HELLO);
 
@@ -190,7 +535,7 @@ int method_create_message_hello(char **xml_out)
 		goto exit;
 	}
 
-	len = snprintf(c_session_id, BUFSIZ, "%d", session_id);
+	len = snprintf(c_session_id, BUFSIZ, "%u", session_id);
 
 	if (len <= 0)
 	{
@@ -223,21 +568,76 @@ exit:
 	return rc;
 }
 
+/*
+ * method_subscribe() - subscribe the session an accepted create-subscription came in on
+ *
+ * Returns rc with the id of a push subscription in *push_id, or RPC_ERROR
+ * with data->error set if the session already has a subscription or can
+ * not join the stream.
+ */
+static int
+method_subscribe(struct rpc_data *data, struct method_subscription *sub, int rc, uint32_t *push_id)
+{
+	struct filter *filter = data->filter;
+	struct push_spec *push = data->push;
+
+	if (!sub->join || (rc == RPC_NOTIFY_PUSH_OK && !push))
+	{
+		data->error = netconf_rpc_error("subscriptions need a session", RPC_ERROR_TAG_OPERATION_NOT_SUPPORTED, RPC_ERROR_TYPE_PROTOCOL, RPC_ERROR_SEVERITY_ERROR, NULL);
+		return RPC_ERROR;
+	}
+
+	/* RFC 5277, one subscription per session */
+	if (sub->active)
+	{
+		data->error = netconf_rpc_error("subscription already active", RPC_ERROR_TAG_IN_USE, RPC_ERROR_TYPE_PROTOCOL, RPC_ERROR_SEVERITY_ERROR, NULL);
+		return RPC_ERROR;
+	}
+
+	data->filter = NULL;
+	data->push = NULL;
+
+	if (push)
+		*push_id = push->id;
+
+	if (sub->join(sub->priv, rc, filter, push))
+	{
+		data->error = netconf_rpc_error("unable to set up subscription", RPC_ERROR_TAG_OPERATION_FAILED, RPC_ERROR_TYPE_APPLICATION, RPC_ERROR_SEVERITY_ERROR, NULL);
+		return RPC_ERROR;
+	}
+
+	return rc;
+}
+
 /*
  * method_handle_message - handle all rpc messages
  *
  * @char*:	xml message for parsing
  * @char**:	xml message we create for response
+ * @struct arena*:	request arena, handlers allocate their scratch from it
+ * @struct monitoring_session*:	session the request came in on, NULL if none
+ * @struct provider_request**:	set if providers still have to complete the reply
+ * @struct cache_entry**:	set if the reply body is a reply cache entry
+ * @struct method_subscription*:	how create-subscription joins the session, NULL join without one
  *
  * Get netconf method from rpc message and call apropriate rpc method which
- * will parse and return response message.
+ * will parse and return response message. A deferred reply is passed to
+ * provider_request_start() together with the request. A cached body takes
+ * the place of the CACHE_MARKER comment in the reply.
  */
-int method_handle_message_rpc(char *xml_in, char **xml_out)
+int method_handle_message_rpc(char *xml_in, char **xml_out, struct arena *arena, struct monitoring_session *session, struct provider_request **deferred, struct cache_entry **cached, struct method_subscription *sub)
 {
 	int rc = -1;
 	char *operation_name = NULL;
 	char *ns = NULL;
-	struct rpc_data data = { NULL, NULL, NULL, 0};
+	char *error = NULL;
+	struct rpc_data data = { .arena = arena, .session_id = session ? session->id : 0 };
+	uint64_t start = metrics_now(), parsed = 0, handled = 0, now;
+	uint32_t push_id = 0;
+	int op = -1;
+
+	*deferred = NULL;
+	*cached = NULL;
 
 	//xml
 	node_t *root_in = roxml_load_buf(xml_in);
@@ -259,8 +659,8 @@ int method_handle_message_rpc(char *xml_in, char **xml_out)
 	if (!n_ns) goto exit;
 
 	//op_name
-	operation_name = roxml_get_name(operation, NULL, 0);
-	ns = roxml_get_content(n_ns, NULL, 0, NULL);
+	operation_name = rpc_get_name(arena, operation);
+	ns = rpc_get_content(arena, n_ns);
 
 	if (!operation_name || !ns)
 	{
@@ -281,13 +681,15 @@ int method_handle_message_rpc(char *xml_in, char **xml_out)
 		int flags = ROXML_ATTR_NODE;
 		node_t *n_arg = roxml_get_attr(rpc_in, NULL, i);
 
-		char *name = roxml_get_name(n_arg, NULL, 0);
+		char *name = rpc_get_name(arena, n_arg);
+
+		if (!name) continue;
 
 		// default namespace
 		if (!strcmp(name, ""))
 			flags |= ROXML_NS_NODE;
 
-		char *value = roxml_get_content(n_arg, NULL, 0, NULL);
+		char *value = rpc_get_content(arena, n_arg);
 
 		roxml_add_node(rpc_out, 0, flags, name, value);
 	}
@@ -303,21 +705,33 @@ int method_handle_message_rpc(char *xml_in, char **xml_out)
 		if (!strcmp(operation_name, rpc_methods[i].query))
 		{
 			method = &rpc_methods[i];
+			op = i;
 			break;
 		}
 	}
 
+	parsed = metrics_now();
+	metrics_stage(METRICS_STAGE_PARSE, parsed - start);
+
 	if (!method)
 	{
 		ERROR("method not supported\n");
-		data.error = netconf_rpc_error("method not supported", RPC_ERROR_TAG_OPERATION_NOT_SUPPORTED, 0, 0, NULL);
+		error = netconf_rpc_error_arena(arena, "method not supported", RPC_ERROR_TAG_OPERATION_NOT_SUPPORTED, 0, 0, NULL);
 		rc = RPC_ERROR;
 	}
 	else
 	{
 		rc = method->handler(&data);
+
+		/* the session is subscribed before the reply says it is */
+		if (rc == RPC_NOTIFY_NETCONF_OK || rc == RPC_NOTIFY_SNMP_OK || rc == RPC_NOTIFY_PUSH_OK)
+			rc = method_subscribe(&data, sub, rc, &push_id);
 	}
 
+	/* errors set by handlers are malloc'd and freed below */
+	if (data.error)
+		error = data.error;
+
 	switch (rc)
 	{
 		case RPC_OK:
@@ -344,62 +758,110 @@ int method_handle_message_rpc(char *xml_in, char **xml_out)
 			rc = 4;
 			break;
 
-		case RPC_ERROR:
-			if (!data.error)
-				data.error = netconf_rpc_error("UNKNOWN ERROR", 0, 0, 0, NULL);
+		case RPC_NOTIFY_PUSH_OK:
+		{
+			char id[16];
+			node_t *n;
 
-			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", data.error);
+			snprintf(id, sizeof(id), "%u", push_id);
+			n = roxml_add_node(data.out, 0, ROXML_ELM_NODE, "id", id);
+			roxml_add_node(n, 0, ROXML_ATTR_NODE | ROXML_NS_NODE, "", PUSH_SN_NS);
+			rc = 5;
+			break;
+		}
 
-			free(data.error);
-			data.error = NULL;
+		case RPC_ERROR:
+			if (!error)
+				error = netconf_rpc_error_arena(arena, "UNKNOWN ERROR", 0, 0, 0, NULL);
+
+			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", error);
 
 			rc = 0;
 			break;
 
 		case RPC_DATA_EXISTS:
-			if (!data.error)
-				data.error = netconf_rpc_error("Data exists!", RPC_ERROR_TAG_DATA_EXISTS, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, NULL);
-
-			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", data.error);
+			if (!error)
+				error = netconf_rpc_error_arena(arena, "Data exists!", RPC_ERROR_TAG_DATA_EXISTS, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, NULL);
 
-			free(data.error);
-			data.error = NULL;
+			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", error);
 
 			rc = 0;
 			break;
 
 		case RPC_DATA_MISSING:
-			if (!data.error)
-				data.error = netconf_rpc_error("Data missing!", RPC_ERROR_TAG_DATA_MISSING, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, NULL);
-
-			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", data.error);
+			if (!error)
+				error = netconf_rpc_error_arena(arena, "Data missing!", RPC_ERROR_TAG_DATA_MISSING, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, NULL);
 
-			free(data.error);
-			data.error = NULL;
+			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", error);
 
 			rc = 0;
 			break;
 		case RPC_NOTIFY_ERROR:
-			if (!data.error)
-				data.error = netconf_rpc_error("Stream missing!", RPC_ERROR_TAG_DATA_MISSING, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, NULL);
+			if (!error)
+				error = netconf_rpc_error_arena(arena, "Stream missing!", RPC_ERROR_TAG_DATA_MISSING, RPC_ERROR_TYPE_RPC, RPC_ERROR_SEVERITY_ERROR, NULL);
 
-			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", data.error);
-
-			free(data.error);
-			data.error = NULL;
+			roxml_add_node(data.out, 0, ROXML_ELM_NODE, "rpc-error", error);
 
 			rc = 0;
 			break;
 	}
 
+	if (error)
+	{
+		stats.rpc_errors++;
+		monitoring_rpc_error(session);
+	}
+
+	handled = metrics_now();
+	metrics_stage(METRICS_STAGE_HANDLER, handled - parsed);
+
 exit:
 
+	free(data.error);
+
 	if (data.out)
 	{
 		roxml_commit_changes(data.out, NULL, xml_out, 0);
 		roxml_close(data.out);
 	}
 
+	if (data.data_xml)
+	{
+		if (*xml_out)
+			*xml_out = method_splice(*xml_out, METHOD_DATA_MARKER, data.data_xml);
+
+		free(data.data_xml);
+	}
+
+	if (handled)
+	{
+		now = metrics_now();
+		metrics_stage(METRICS_STAGE_SERIALIZE, now - handled);
+		metrics_rpc(op, now - start);
+	}
+
+	/* the session took filter or spec if it subscribed */
+	filter_free(data.filter);
+	push_spec_free(data.push);
+
+	/* handlers only defer replies carrying data */
+	if (data.deferred)
+	{
+		if (rc == 0 && *xml_out)
+			*deferred = data.deferred;
+		else
+			provider_request_abort(data.deferred);
+	}
+
+	if (data.cached)
+	{
+		if (rc == 0 && *xml_out)
+			*cached = data.cached;
+		else
+			cache_put(data.cached);
+	}
+
+	/* only xpath results and plugin lookups still live in roxml's pool */
 	roxml_release(RELEASE_ALL);
 	roxml_close(root_in);
 	return rc;
@@ -428,15 +890,42 @@ method_handle_get(struct rpc_data *data)
 		int i;
 		for (i = 0; i < count; i++){
 			node_t *rpc_arg = roxml_get_chld(data->in, NULL, i);
-			char *arg = roxml_get_name(rpc_arg, NULL, 0);
+			char *arg = rpc_get_name(data->arena, rpc_arg);
 			node_t *rpc_name = roxml_get_chld(rpc_arg, NULL, i);
-			char *name = roxml_get_name(rpc_name, NULL, 0);
+			char *name = rpc_get_name(data->arena, rpc_name);
 			printf("%s : %s\n", arg, name);
 		}
 	}
 
 	filter = roxml_get_chld(data->in, "filter", 0);
 
+	/*
+	 * Data rendered from caches or counters is spliced into the reply
+	 * as text instead of being built as roxml nodes.
+	 */
+	struct xml_buf b = { 0 };
+
+	method_get_datastore(data, &b, filter);
+
+	/* state data, not part of get-config */
+	if (!data->get_config)
+	{
+		method_get_monitoring(data, &b, filter);
+		method_get_metrics(data, &b, filter);
+	}
+
+	if (b.len && !b.error)
+	{
+		data->data_xml = b.data;
+		roxml_add_node(n_data, 0, ROXML_CMT_NODE, NULL, METHOD_DATA_MARKER);
+	}
+	else
+		xml_buf_free(&b);
+
+	/* subtrees of ubus providers are filled in once they answered */
+	if (!data->get_config && method_get_providers(data, filter))
+		roxml_add_node(n_data, 0, ROXML_CMT_NODE, NULL, PROVIDER_MARKER);
+
 	if ((n_filter = roxml_xpath(data->in, "//filter", &nb)))
 	{
 		nb = roxml_get_chld_nb(n_filter[0]);
@@ -478,13 +967,115 @@ method_handle_get(struct rpc_data *data)
 	return RPC_DATA;
 }
 
+static int method_name_cmp(const void *a, const void *b)
+{
+	const char *x = *(char * const *) a, *y = *(char * const *) b;
+
+	if (!x || !y)
+		return !!x - !!y;
+
+	return strcmp(x, y);
+}
+
+/*
+ * method_cache_key() - reply cache key of a get-config
+ *
+ * The reply depends on the source and the uci packages the filter selects
+ * only, the key names those sorted so that filters selecting the same
+ * packages share it however they are written.
+ */
+static int method_cache_key(struct rpc_data *data, struct xml_buf *key)
+{
+	char *names[DATASTORE_FILTER_MAX], *source = NULL, len[24];
+	node_t *n = roxml_get_chld(data->in, "source", 0);
+	int i, n_names;
+
+	if (n && (n = roxml_get_chld(n, NULL, 0)))
+		source = rpc_get_name(data->arena, n);
+
+	n_names = method_datastore_names(data, roxml_get_chld(data->in, "filter", 0), names);
+	qsort(names, n_names > 0 ? n_names : 0, sizeof(*names), method_name_cmp);
+
+	xml_buf_puts(key, source ? source : "running");
+	xml_buf_puts(key, n_names < 0 ? " -" : n_names ? " =" : " *");
+
+	for (i = 0; i < n_names; i++)
+	{
+		if (!names[i])
+		{
+			xml_buf_puts(key, "!");
+			continue;
+		}
+
+		snprintf(len, sizeof(len), "%zu:", strlen(names[i]));
+		xml_buf_puts(key, len);
+		xml_buf_puts(key, names[i]);
+	}
+
+	if (key->error)
+	{
+		xml_buf_free(key);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* keep the <data> element just rendered, the reply then refers to the entry */
+static void method_cache_store(struct rpc_data *data, const char *key)
+{
+	node_t *n_data = roxml_get_chld(data->out, "data", 0);
+	char *body = NULL;
+
+	if (!n_data || roxml_commit_changes(n_data, NULL, &body, 0) <= 0 || !body)
+	{
+		free(body);
+		return;
+	}
+
+	if (data->data_xml)
+		body = method_splice(body, METHOD_DATA_MARKER, data->data_xml);
+
+	if (!(data->cached = cache_store(key, datastore_version(), body, strlen(body))))
+		return;
+
+	roxml_del_node(n_data);
+	free(data->data_xml);
+	data->data_xml = NULL;
+	roxml_add_node(data->out, 0, ROXML_CMT_NODE, NULL, CACHE_MARKER);
+}
+
 static int
 method_handle_get_config(struct rpc_data *data)
 {
+	struct xml_buf key = { 0 };
+	int rc;
+
 	// TODO: merge with get
 
 	data->get_config = 1;
-	return method_handle_get(data);
+
+	if (config.reply_cache <= 0 || method_cache_key(data, &key))
+		return method_handle_get(data);
+
+	/* files changed on disk bump the version before it is compared */
+	datastore_check();
+
+	if ((data->cached = cache_lookup(key.data, datastore_version())))
+	{
+		roxml_add_node(data->out, 0, ROXML_CMT_NODE, NULL, CACHE_MARKER);
+		xml_buf_free(&key);
+		return RPC_DATA;
+	}
+
+	rc = method_handle_get(data);
+
+	if (rc == RPC_DATA)
+		method_cache_store(data, key.data);
+
+	xml_buf_free(&key);
+
+	return rc;
 }
 
 static int
@@ -494,15 +1085,26 @@ method_handle_edit_config(struct rpc_data *data)
 
 
 	node_t *rpc_arg = roxml_get_chld(data->in, NULL, 0);
-	char *arg = roxml_get_name(rpc_arg, NULL, 0);
+	char *arg = rpc_get_name(data->arena, rpc_arg);
 	node_t *rpc_name = roxml_get_chld(rpc_arg, NULL, 0);
-	char *target_database = roxml_get_name(rpc_name, NULL, 0);
+	char *target_database = rpc_get_name(data->arena, rpc_name);
 
 
 	if (!config) return RPC_ERROR;
 
+	uint32_t holder = monitoring_lock_holder(TARGET_RUNNING);
+
+	if (holder && holder != data->session_id)
+	{
+		data->error = netconf_rpc_error("running is locked by another session", RPC_ERROR_TAG_IN_USE, RPC_ERROR_TYPE_PROTOCOL, 0, NULL);
+		return RPC_ERROR;
+	}
+
 
 	int rc = RPC_OK;
+	static struct blob_buf b;
+	struct provider_request *r = provider_request_new(PROVIDER_SET);
+	struct provider *p;
 
 	int child_count = roxml_get_chld_nb(config);
 
@@ -510,10 +1112,46 @@ method_handle_edit_config(struct rpc_data *data)
 	{
 		node_t *cur = roxml_get_chld(config, NULL, i);
 
-		char *module = roxml_get_name(cur, NULL, 0);
-		char *ns = roxml_get_content(roxml_get_ns(cur), NULL, 0, NULL);
+		char *module = rpc_get_name(data->arena, cur);
+		char *ns = rpc_get_content(data->arena, roxml_get_ns(cur));
+
+		if (module && datastore_match(module, ns))
+		{
+			if (datastore_edit(cur, data->arena, &data->error))
+			{
+				if (r)
+					provider_request_abort(r);
+
+				return RPC_ERROR;
+			}
+
+			continue;
+		}
+
+		if (!r || !module || !(p = provider_lookup(module, ns)))
+			continue;
+
+		blob_buf_init(&b, 0);
+		method_xml_to_blob(data->arena, &b, cur);
+
+		if (provider_request_add(r, p, b.head))
+		{
+			provider_request_abort(r);
+			return RPC_ERROR;
+		}
 	}
 
+	/* providers decide between <ok/> and rpc-error */
+	if (r && provider_request_pending(r))
+	{
+		data->deferred = r;
+		roxml_add_node(data->out, 0, ROXML_CMT_NODE, NULL, PROVIDER_MARKER);
+		return RPC_DATA;
+	}
+
+	if (r)
+		provider_request_abort(r);
+
 	return rc;
 }
 
@@ -525,9 +1163,9 @@ method_handle_copy_config(struct rpc_data *data)
 	char *database[2];
 	for (i = 0; i < count; i++){
 		node_t *rpc_arg = roxml_get_chld(data->in, NULL, i);
-		char *arg = roxml_get_name(rpc_arg, NULL, 0);
+		char *arg = rpc_get_name(data->arena, rpc_arg);
 		node_t *rpc_name = roxml_get_chld(rpc_arg, NULL, 0);
-		database[i] = roxml_get_name(rpc_name, NULL, 0);
+		database[i] = rpc_get_name(data->arena, rpc_name);
 	}
 	return RPC_OK;
 }
@@ -536,19 +1174,41 @@ static int
 method_handle_delete_config(struct rpc_data *data)
 {
 	node_t *rpc_arg = roxml_get_chld(data->in, NULL, 0);
-	char *arg = roxml_get_name(rpc_arg, NULL, 0);
+	char *arg = rpc_get_name(data->arena, rpc_arg);
 	node_t *rpc_name = roxml_get_chld(rpc_arg, NULL, 0);
-	char *target_database = roxml_get_name(rpc_name, NULL, 0);
+	char *target_database = rpc_get_name(data->arena, rpc_name);
 	return RPC_OK;
 }
 
+/* datastore named by <target>, sets data->error and returns -1 if there is none */
+static int
+method_lock_target(struct rpc_data *data)
+{
+	node_t *target = roxml_get_chld(data->in, "target", 0);
+	int t = monitoring_target(rpc_get_name(data->arena, roxml_get_chld(target, NULL, 0)));
+
+	if (t < 0)
+		data->error = netconf_rpc_error("target can not be locked", RPC_ERROR_TAG_INVALID_VALUE, RPC_ERROR_TYPE_PROTOCOL, 0, NULL);
+
+	return t;
+}
+
 static int
 method_handle_lock(struct rpc_data *data)
 {
-	node_t *rpc_arg = roxml_get_chld(data->in, NULL, 0);
-	char *arg = roxml_get_name(rpc_arg, NULL, 0);
-	node_t *rpc_name = roxml_get_chld(rpc_arg, NULL, 0);
-	char *target_database = roxml_get_name(rpc_name, NULL, 0);
+	char msg[64];
+	uint32_t holder;
+	int target;
+
+	if ((target = method_lock_target(data)) < 0)
+		return RPC_ERROR;
+
+	if ((holder = monitoring_lock(target, data->session_id)))
+	{
+		snprintf(msg, sizeof(msg), "lock is held by session %u", holder);
+		data->error = netconf_rpc_error(msg, RPC_ERROR_TAG_LOCK_DENIED, RPC_ERROR_TYPE_PROTOCOL, 0, NULL);
+		return RPC_ERROR;
+	}
 
 	return RPC_OK;
 }
@@ -556,10 +1216,17 @@ method_handle_lock(struct rpc_data *data)
 static int
 method_handle_unlock(struct rpc_data *data)
 {
-	node_t *rpc_arg = roxml_get_chld(data->in, NULL, 0);
-	char *arg = roxml_get_name(rpc_arg, NULL, 0);
-	node_t *rpc_name = roxml_get_chld(rpc_arg, NULL, 0);
-	char *target_database = roxml_get_name(rpc_name, NULL, 0);
+	int target;
+
+	if ((target = method_lock_target(data)) < 0)
+		return RPC_ERROR;
+
+	if (monitoring_unlock(target, data->session_id))
+	{
+		data->error = netconf_rpc_error("lock is not held by this session", RPC_ERROR_TAG_OPERATION_FAILED, RPC_ERROR_TYPE_PROTOCOL, 0, NULL);
+		return RPC_ERROR;
+	}
+
 	return RPC_OK;
 }
 
@@ -581,23 +1248,245 @@ method_handle_stream(struct rpc_data *data)
 	return method_handle_get(data);
 }
 
+/* compile the filter of a create-subscription, refused filters are an rpc-error */
+static int
+method_compile_filter(struct rpc_data *data, node_t *n)
+{
+	const char *error = "invalid filter";
+	char *xml = NULL;
+	int rc = -1;
+
+	roxml_commit_changes(n, NULL, &xml, 0);
+
+	if (xml)
+		rc = filter_compile(xml, strlen(xml), &data->filter, &error);
+
+	if (rc)
+		data->error = netconf_rpc_error((char *) error, RPC_ERROR_TAG_INVALID_VALUE, RPC_ERROR_TYPE_PROTOCOL, 0, NULL);
+
+	free(xml);
+
+	return rc;
+}
+
+static int
+method_push_error(struct rpc_data *data, char *msg, char *app_tag)
+{
+	data->error = netconf_rpc_error(msg, RPC_ERROR_TAG_INVALID_VALUE, RPC_ERROR_TYPE_APPLICATION, 0, app_tag);
+
+	return RPC_ERROR;
+}
+
+/* centiseconds in element name of n, def if there is none */
+static int
+method_push_period(struct rpc_data *data, node_t *n, char *name, unsigned int def, unsigned int *period)
+{
+	char *value = rpc_get_content(data->arena, roxml_get_chld(n, name, 0)), *end;
+	unsigned long v;
+
+	if (!value)
+	{
+		*period = def;
+		return 0;
+	}
+
+	v = strtoul(value, &end, 10);
+
+	if (end == value || *end || v > UINT32_MAX / 10)
+		return -1;
+
+	*period = v;
+
+	return 0;
+}
+
+/* names of the children of n, from their name attribute or element names */
+static int
+method_push_names(struct rpc_data *data, node_t *n, bool attr, char **names, int *count)
+{
+	int i, nb = roxml_get_chld_nb(n);
+	node_t *cur;
+	char *name;
+
+	for (i = 0; i < nb; i++)
+	{
+		cur = roxml_get_chld(n, NULL, i);
+		name = attr ? rpc_get_content(data->arena, roxml_get_attr(cur, "name", 0)) : rpc_get_name(data->arena, cur);
+
+		if (push_spec_add(names, count, name))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * method_push_subscription() - periodic or on-change subscription
+ *
+ * RFC 8641 <periodic> or <on-change> in create-subscription, periods in
+ * centiseconds. A <datastore-subtree-filter> selects uci packages, and for
+ * periodic updates netconf-state sections and metrics; without it periodic
+ * updates carry uci and netconf-state and on-change updates uci.
+ */
+static int
+method_push_subscription(struct rpc_data *data, node_t *periodic, node_t *on_change)
+{
+	node_t *filter = roxml_get_chld(data->in, "datastore-subtree-filter", 0), *n;
+	struct push_spec *spec;
+	unsigned int period;
+	char *name, *ns;
+	int i, count;
+
+	if (periodic && on_change)
+		return method_push_error(data, "periodic and on-change exclude each other", NULL);
+
+	if (periodic && (method_push_period(data, periodic, "period", 0, &period) || period < PUSH_PERIOD_MIN))
+		return method_push_error(data, "period not supported", "ietf-yang-push:period-unsupported");
+
+	if (on_change && method_push_period(data, on_change, "dampening-period", config.push_dampening, &period))
+		return method_push_error(data, "dampening period not supported", "ietf-yang-push:dampening-period-unsupported");
+
+	if (!(spec = data->push = push_spec_new(periodic ? PUSH_PERIODIC : PUSH_ON_CHANGE, period)))
+		return RPC_ERROR;
+
+	if (!filter)
+	{
+		spec->uci = true;
+		spec->monitoring = !!periodic;
+	}
+
+	count = filter ? roxml_get_chld_nb(filter) : 0;
+
+	for (i = 0; i < count; i++)
+	{
+		n = roxml_get_chld(filter, NULL, i);
+		name = rpc_get_name(data->arena, n);
+		ns = rpc_get_content(data->arena, roxml_get_ns(n));
+
+		if (!name)
+			continue;
+
+		if (datastore_match(name, ns))
+		{
+			spec->uci = true;
+
+			if (method_push_names(data, n, true, spec->packages, &spec->n_packages))
+				return method_push_error(data, "too many uci packages", NULL);
+		}
+		else if (on_change)
+			return method_push_error(data, "on-change is only supported for uci", "ietf-yang-push:on-change-unsupported");
+		else if (monitoring_match(name, ns))
+		{
+			spec->monitoring = true;
+
+			if (method_push_names(data, n, false, spec->sections, &spec->n_sections))
+				return method_push_error(data, "too many netconf-state sections", NULL);
+		}
+		else if (method_metrics_match(name, ns))
+			spec->metrics = true;
+		else
+			return method_push_error(data, "subtree not available for push", NULL);
+	}
+
+	if (!spec->uci && !spec->monitoring && !spec->metrics)
+		return method_push_error(data, "nothing selected", NULL);
+
+	spec->id = push_next_id();
+
+	return RPC_NOTIFY_PUSH_OK;
+}
+
 static int
 method_handle_create_subscription(struct rpc_data *data)
 {
+	node_t *periodic = roxml_get_chld(data->in, "periodic", 0);
+	node_t *on_change = roxml_get_chld(data->in, "on-change", 0);
+
+	if (periodic || on_change)
+		return method_push_subscription(data, periodic, on_change);
+
 	node_t *streams = roxml_get_chld(data->in, "stream", 0);
 	if (!streams) return RPC_ERROR;
 
 	node_t *stream = roxml_get_chld(streams, NULL, 0);
-	char *name = roxml_get_name(stream, NULL, 0);	
+	char *name = rpc_get_name(data->arena, stream);	
+	node_t *filter = roxml_get_chld(data->in, "filter", 0);
+	int rc;
+
+	if (!name) return RPC_NOTIFY_ERROR;
 	
 	if (!strcmp(name, "netconf")){
 		// printf("stream : %s\n", name);
-		return RPC_NOTIFY_NETCONF_OK;
+		rc = RPC_NOTIFY_NETCONF_OK;
 	}
 	else if (!strcmp(name, "snmp")){
 		// printf("stream : %s\n", name);
-		return RPC_NOTIFY_SNMP_OK;
+		rc = RPC_NOTIFY_SNMP_OK;
 	}
 	else
 		return RPC_NOTIFY_ERROR;
-}
\ No newline at end of file
+
+	if (filter && method_compile_filter(data, filter))
+		return RPC_ERROR;
+
+	return rc;
+}
+
+/*
+ * method_handle_get_changes() - uci changes since a version the client holds
+ *
+ * <get-changes xmlns="urn:netconfd:changes"> with the <since> token of an
+ * earlier reply and optionally a get-config filter. The reply carries the
+ * current token and either the <edits> since, in edit-config form, or the
+ * whole <config> if the token is missing or the change log does not lead
+ * from it to the current state.
+ */
+static int
+method_handle_get_changes(struct rpc_data *data)
+{
+	char *names[DATASTORE_FILTER_MAX];
+	char *since_token = rpc_get_content(data->arena, roxml_get_chld(data->in, "since", 0));
+	struct xml_buf b = { 0 }, edits = { 0 };
+	int n_names = method_datastore_names(data, roxml_get_chld(data->in, "filter", 0), names);
+
+	/* changes on disk are logged before the token is handed out */
+	datastore_check();
+
+	xml_buf_puts(&b, "<changes xmlns=\"" CHANGES_NS "\"><version>");
+	datastore_token(&b, names, n_names < 0 ? 0 : n_names);
+	xml_buf_puts(&b, "</version>");
+
+	if (n_names < 0)
+		xml_buf_puts(&b, "<edits/>");
+	else if (since_token && datastore_render_log(&edits, names, n_names, since_token) >= 0)
+	{
+		xml_buf_puts(&b, "<edits>");
+
+		if (edits.len)
+			xml_buf_append(&b, edits.data, edits.len);
+
+		xml_buf_puts(&b, "</edits>");
+		stats.changes_incremental++;
+	}
+	else
+	{
+		xml_buf_puts(&b, "<config>");
+		datastore_render(&b, names, n_names);
+		xml_buf_puts(&b, "</config>");
+		stats.changes_full++;
+	}
+
+	xml_buf_puts(&b, "</changes>");
+	xml_buf_free(&edits);
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return RPC_ERROR;
+	}
+
+	data->data_xml = b.data;
+	roxml_add_node(data->out, 0, ROXML_CMT_NODE, NULL, METHOD_DATA_MARKER);
+
+	return RPC_DATA;
+}
@@ -17,9 +17,39 @@
 #ifndef __FREENETCONFD_METHODS_H__
 #define __FREENETCONFD_METHODS_H__
 
-int method_analyze_message_hello(char *method_in, int *base);
-int method_create_message_hello(char **method_out);
-int method_handle_message_rpc(char *method_in, char **method_out);
+#include <stddef.h>
+#include <stdbool.h>
+#include <roxml.h>
+#include <stdint.h>
+
+#include "netconfd/plugin.h"
+
+struct arena;
+struct provider_request;
+struct monitoring_session;
+struct filter;
+struct push_spec;
+struct cache_entry;
+
+/* how create-subscription reaches the session, set up by the caller */
+struct method_subscription
+{
+	/* the session already has a subscription */
+	bool active;
+	/* subscribes the session for rc, takes filter and spec over, -1 on failure */
+	int (*join)(void *priv, int rc, struct filter *filter, struct push_spec *push);
+	void *priv;
+};
+
+extern const struct rpc_method rpc_methods[];
+extern const int rpc_method_count;
+
+int method_analyze_message_hello(char *method_in, int *base, bool *compress, struct arena *arena);
+int method_create_message_hello(char **method_out, uint32_t *session_id);
+int method_handle_message_rpc(char *method_in, char **method_out, struct arena *arena, struct monitoring_session *session, struct provider_request **deferred, struct cache_entry **cached, struct method_subscription *sub);
 int method_create_notification_netconf(char **xml_out);
+int method_classify_rpc(const char *data, size_t len);
+char *rpc_get_name(struct arena *arena, node_t *n);
+char *rpc_get_content(struct arena *arena, node_t *n);
 
 #endif /* __FREENETCONFD_METHODS_H__ */
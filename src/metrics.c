@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <libubox/blobmsg.h>
+
+#include "netconfd/plugin.h"
+
+#include "metrics.h"
+#include "histogram.h"
+#include "methods.h"
+#include "worker.h"
+#include "monitoring.h"
+#include "xml.h"
+
+/*
+ * Latency histograms
+ *
+ * One histogram per rpc operation, covering parse, handler and serialize,
+ * and one per processing stage over all operations. Every worker is a
+ * process with a single event loop thread, which is the only writer and,
+ * through ubus and <get>, the only reader. Recording is a bucket increment
+ * without locks or atomics; the cost on the hot path are the clock reads.
+ */
+#define METRICS_OPS_MAX 32
+
+static const char *metrics_stage_names[__METRICS_STAGE_MAX] =
+{
+	[METRICS_STAGE_FRAMING] = "framing",
+	[METRICS_STAGE_PARSE] = "parse",
+	[METRICS_STAGE_HANDLER] = "handler",
+	[METRICS_STAGE_SERIALIZE] = "serialize",
+	[METRICS_STAGE_WRITE] = "write",
+};
+
+static struct histogram stages[__METRICS_STAGE_MAX];
+/* indexed like rpc_methods, the last slot takes unknown operations */
+static struct histogram ops[METRICS_OPS_MAX + 1];
+
+void metrics_stage(enum metrics_stage stage, uint64_t ns)
+{
+	histogram_record(&stages[stage], ns);
+}
+
+/* @int: index into rpc_methods, -1 for operations not supported */
+void metrics_rpc(int op, uint64_t ns)
+{
+	if (op < 0 || op >= METRICS_OPS_MAX)
+		op = METRICS_OPS_MAX;
+
+	histogram_record(&ops[op], ns);
+}
+
+void metrics_reset(void)
+{
+	memset(stages, 0, sizeof(stages));
+	memset(ops, 0, sizeof(ops));
+}
+
+static void metrics_histogram_to_blob(struct blob_buf *b, const char *name, const struct histogram *h)
+{
+	void *t = blobmsg_open_table(b, NULL);
+
+	blobmsg_add_string(b, "name", name);
+	blobmsg_add_u64(b, "count", h->count);
+	blobmsg_add_u64(b, "mean_us", h->count ? h->sum / h->count / 1000 : 0);
+	blobmsg_add_u64(b, "min_us", h->min / 1000);
+	blobmsg_add_u64(b, "p50_us", histogram_percentile(h, 50) / 1000);
+	blobmsg_add_u64(b, "p90_us", histogram_percentile(h, 90) / 1000);
+	blobmsg_add_u64(b, "p99_us", histogram_percentile(h, 99) / 1000);
+	blobmsg_add_u64(b, "p999_us", histogram_percentile(h, 99.9) / 1000);
+	blobmsg_add_u64(b, "max_us", h->max / 1000);
+
+	blobmsg_close_table(b, t);
+}
+
+/* operations and stages seen so far, as arrays of tables */
+void metrics_to_blob(struct blob_buf *b)
+{
+	void *a;
+	int i;
+
+	blobmsg_add_u32(b, "worker", worker_id);
+
+	a = blobmsg_open_array(b, "operation");
+
+	for (i = 0; i < rpc_method_count && i < METRICS_OPS_MAX; i++)
+	{
+		if (ops[i].count)
+			metrics_histogram_to_blob(b, rpc_methods[i].query, &ops[i]);
+	}
+
+	if (ops[METRICS_OPS_MAX].count)
+		metrics_histogram_to_blob(b, "unsupported", &ops[METRICS_OPS_MAX]);
+
+	blobmsg_close_array(b, a);
+
+	a = blobmsg_open_array(b, "stage");
+
+	for (i = 0; i < __METRICS_STAGE_MAX; i++)
+		metrics_histogram_to_blob(b, metrics_stage_names[i], &stages[i]);
+
+	blobmsg_close_array(b, a);
+}
+
+/* metrics_render() - <metrics> element with histograms and session counters */
+void metrics_render(struct xml_buf *b)
+{
+	static struct blob_buf bb;
+
+	blob_buf_init(&bb, 0);
+	metrics_to_blob(&bb);
+	monitoring_sessions_to_blob(&bb);
+
+	xml_buf_puts(b, "<" METRICS_ELEMENT " xmlns=\"" METRICS_NS "\">");
+	xml_buf_members(b, bb.head);
+	xml_buf_puts(b, "</" METRICS_ELEMENT ">");
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_METRICS_H__
+#define __FREENETCONFD_METRICS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#define METRICS_ELEMENT "metrics"
+#define METRICS_NS "urn:netconfd:metrics"
+
+enum metrics_stage
+{
+	METRICS_STAGE_FRAMING,
+	METRICS_STAGE_PARSE,
+	METRICS_STAGE_HANDLER,
+	METRICS_STAGE_SERIALIZE,
+	METRICS_STAGE_WRITE,
+	__METRICS_STAGE_MAX
+};
+
+struct blob_buf;
+struct xml_buf;
+
+/* nanoseconds, monotonic */
+static inline uint64_t metrics_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void metrics_stage(enum metrics_stage stage, uint64_t ns);
+void metrics_rpc(int op, uint64_t ns);
+void metrics_to_blob(struct blob_buf *b);
+void metrics_reset(void);
+void metrics_render(struct xml_buf *b);
+
+#endif /* __FREENETCONFD_METRICS_H__ */
@@ -0,0 +1,553 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <libubox/blobmsg.h>
+
+#include "netconfd/netconfd.h"
+
+#include "monitoring.h"
+#include "messages.h"
+#include "notification.h"
+#include "worker.h"
+#include "xml.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
+#endif
+
+/*
+ * ietf-netconf-monitoring
+ *
+ * Nothing is collected when the state is asked for. Counters are bumped
+ * where the events happen, sessions register once their hello is through
+ * with everything that never changes already formatted, and capabilities
+ * are cut out of our hello once. Rendering is a walk over a few counters
+ * and the sessions.
+ *
+ * Statistics, locks and sessions have to be the same whichever worker
+ * answers, so they live in memory shared by all workers. Every worker only
+ * writes its own cache line of counters, readers add them up. Locks are
+ * taken with a compare and swap of the holder's session id, which is
+ * unique across workers. With several workers each one keeps its sessions
+ * in its own part of a table sized by max_sessions at startup, and a
+ * session is listed once its id is stored in the slot. A worker whose part
+ * is full refuses further connections, so no session is left out.
+ */
+
+/* slots per worker if max_sessions is unlimited */
+#define MONITORING_SESSIONS 1024
+
+struct monitoring_lock
+{
+	uint32_t session;
+	int64_t since;
+};
+
+struct monitoring_shared
+{
+	char start_time[32];
+	struct monitoring_lock locks[__TARGET_MAX];
+	struct monitoring_counters workers[];
+};
+
+static const char *monitoring_targets[__TARGET_MAX] =
+{
+	[TARGET_RUNNING] = "running",
+};
+
+static const char *monitoring_transports[__TRANSPORT_MAX] =
+{
+	[TRANSPORT_TCP] = "nd:tcp",
+	[TRANSPORT_UNIX] = "nd:unix",
+	[TRANSPORT_SSH] = "ncm:netconf-ssh",
+	[TRANSPORT_TLS] = "ncm:netconf-tls",
+};
+
+enum
+{
+	SECTION_CAPABILITIES = 1 << 0,
+	SECTION_DATASTORES = 1 << 1,
+	SECTION_SESSIONS = 1 << 2,
+	SECTION_STATISTICS = 1 << 3,
+	SECTION_ALL = (1 << 4) - 1,
+};
+
+static const struct
+{
+	const char *name;
+	int section;
+} monitoring_sections[] =
+{
+	{ "capabilities", SECTION_CAPABILITIES },
+	{ "datastores", SECTION_DATASTORES },
+	{ "sessions", SECTION_SESSIONS },
+	{ "statistics", SECTION_STATISTICS },
+};
+
+/* used until monitoring_start() picked the worker's slot */
+static struct monitoring_counters local;
+struct monitoring_counters *monitoring = &local;
+
+static struct monitoring_shared *shared = NULL;
+static size_t shared_size = 0;
+static int shared_slots = 0;
+
+/* table of all workers' sessions, session_slots each, none with one worker */
+static struct monitoring_session *shared_sessions = NULL;
+static int session_slots = 0;
+
+static LIST_HEAD(sessions);
+/* this worker's unused slots of the table */
+static LIST_HEAD(free_sessions);
+static char *capabilities = NULL;
+
+/*
+ * monitoring_init() - map state shared by all workers
+ *
+ * @int:	number of workers
+ * @int:	sessions per worker, 0 for no limit
+ *
+ * Must be called before the workers are forked.
+ */
+int monitoring_init(int workers, int sessions)
+{
+	const char *start, *end;
+	size_t counters;
+
+	shared_slots = workers > 0 ? workers : 1;
+	counters = sizeof(*shared) + shared_slots * sizeof(struct monitoring_counters);
+
+	/* a single worker lists its sessions straight from its own list */
+	if (shared_slots > 1)
+		session_slots = sessions > 0 ? sessions : MONITORING_SESSIONS;
+
+	shared_size = counters + (size_t) shared_slots * session_slots * sizeof(struct monitoring_session);
+
+	shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (shared == MAP_FAILED)
+	{
+		ERROR("unable to map shared monitoring state\n");
+		shared = NULL;
+		return -1;
+	}
+
+	if (session_slots)
+		shared_sessions = (struct monitoring_session *) ((char *) shared + counters);
+
+	notification_event_time(shared->start_time, sizeof(shared->start_time));
+
+	/* the capabilities element of our hello is valid netconf-state content */
+	start = strstr(XML_NETCONF_HELLO, "<capabilities>");
+	end = strstr(XML_NETCONF_HELLO, "</capabilities>");
+
+	if (start && end)
+		capabilities = strndup(start, end + strlen("</capabilities>") - start);
+
+	return 0;
+}
+
+/*
+ * monitoring_start() - pick this worker's counters and sessions slots
+ *
+ * Locks held and sessions listed by a previous instance of this worker,
+ * which went away without releasing them, are dropped.
+ */
+void monitoring_start(void)
+{
+	struct monitoring_session *s;
+	uint32_t holder;
+	int i;
+
+	if (!shared || worker_id >= shared_slots)
+		return;
+
+	monitoring = &shared->workers[worker_id];
+
+	for (i = 0; i < session_slots; i++)
+	{
+		s = &shared_sessions[worker_id * session_slots + i];
+		memset(s, 0, sizeof(*s));
+		s->shared = true;
+		list_add_tail(&s->list, &free_sessions);
+	}
+
+	for (i = 0; i < __TARGET_MAX; i++)
+	{
+		holder = __atomic_load_n(&shared->locks[i].session, __ATOMIC_ACQUIRE);
+
+		if (holder && (holder - 1) % worker_count == worker_id)
+			__atomic_compare_exchange_n(&shared->locks[i].session, &holder, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+}
+
+void monitoring_exit(void)
+{
+	monitoring = &local;
+
+	if (shared)
+		munmap(shared, shared_size);
+
+	shared = NULL;
+	shared_sessions = NULL;
+	session_slots = 0;
+	INIT_LIST_HEAD(&free_sessions);
+
+	free(capabilities);
+	capabilities = NULL;
+}
+
+/*
+ * monitoring_session_new() - zeroed entry for a new session
+ *
+ * Returns NULL if this worker's part of the shared table is full, or
+ * without memory.
+ */
+struct monitoring_session *monitoring_session_new(void)
+{
+	struct monitoring_session *s;
+
+	if (session_slots)
+	{
+		if (list_empty(&free_sessions))
+			return NULL;
+
+		s = list_first_entry(&free_sessions, struct monitoring_session, list);
+		list_del_init(&s->list);
+
+		return s;
+	}
+
+	if (!(s = calloc(1, sizeof(*s))))
+		return NULL;
+
+	INIT_LIST_HEAD(&s->list);
+
+	return s;
+}
+
+void monitoring_session_free(struct monitoring_session *s)
+{
+	monitoring_session_del(s);
+
+	if (!s->shared)
+	{
+		free(s);
+		return;
+	}
+
+	memset(s, 0, sizeof(*s));
+	s->shared = true;
+	list_add(&s->list, &free_sessions);
+}
+
+void monitoring_session_add(struct monitoring_session *s)
+{
+	list_add_tail(&s->list, &sessions);
+	__atomic_store_n(&s->listed, s->id, __ATOMIC_RELEASE);
+}
+
+/* safe for sessions that never registered */
+void monitoring_session_del(struct monitoring_session *s)
+{
+	/* unlisted before the slot is written again */
+	__atomic_store_n(&s->listed, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	list_del_init(&s->list);
+}
+
+/* per session counters as "session" array, for ubus and <get> */
+void monitoring_sessions_to_blob(struct blob_buf *b)
+{
+	struct monitoring_session *s;
+	void *a, *t;
+
+	a = blobmsg_open_array(b, "session");
+
+	list_for_each_entry(s, &sessions, list)
+	{
+		t = blobmsg_open_table(b, NULL);
+		blobmsg_add_u32(b, "id", s->id);
+		blobmsg_add_u64(b, "rpcs", s->in_rpcs);
+		blobmsg_add_u64(b, "bytes_in", s->bytes_in);
+		blobmsg_add_u64(b, "bytes_out", s->bytes_out);
+		blobmsg_close_table(b, t);
+	}
+
+	blobmsg_close_array(b, a);
+}
+
+/* lock target by datastore name, -1 if it can not be locked */
+int monitoring_target(const char *name)
+{
+	int i;
+
+	for (i = 0; name && i < __TARGET_MAX; i++)
+	{
+		if (!strcmp(name, monitoring_targets[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * monitoring_lock() - take global lock on datastore
+ *
+ * @int:	enum monitoring_target
+ * @uint32_t:	session asking for it
+ *
+ * Returns 0 once the lock is held, otherwise the session holding it.
+ */
+uint32_t monitoring_lock(int target, uint32_t session)
+{
+	struct monitoring_lock *l;
+	uint32_t holder = 0;
+
+	if (!shared)
+		return 0;
+
+	l = &shared->locks[target];
+
+	if (!__atomic_compare_exchange_n(&l->session, &holder, session, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return holder;
+
+	__atomic_store_n(&l->since, (int64_t) time(NULL), __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* returns -1 if session did not hold the lock */
+int monitoring_unlock(int target, uint32_t session)
+{
+	if (!shared)
+		return 0;
+
+	if (!__atomic_compare_exchange_n(&shared->locks[target].session, &session, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return -1;
+
+	return 0;
+}
+
+/* drop every lock of a session that is going away */
+void monitoring_unlock_session(uint32_t session)
+{
+	int i;
+
+	for (i = 0; i < __TARGET_MAX; i++)
+		monitoring_unlock(i, session);
+}
+
+/* session holding lock on target, 0 if none does */
+uint32_t monitoring_lock_holder(int target)
+{
+	if (!shared)
+		return 0;
+
+	return __atomic_load_n(&shared->locks[target].session, __ATOMIC_ACQUIRE);
+}
+
+bool monitoring_match(const char *name, const char *ns)
+{
+	return !strcmp(name, MONITORING_ELEMENT) && (!ns || !strcmp(ns, MONITORING_NS));
+}
+
+static void monitoring_printf(struct xml_buf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void monitoring_printf(struct xml_buf *b, const char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (len > 0)
+		xml_buf_append(b, buf, len < sizeof(buf) ? len : sizeof(buf) - 1);
+}
+
+static void monitoring_render_datastores(struct xml_buf *b)
+{
+	struct monitoring_lock *l;
+	char since[32];
+	uint32_t holder;
+	time_t t;
+	struct tm tm;
+	int i;
+
+	xml_buf_puts(b, "<datastores>");
+
+	for (i = 0; i < __TARGET_MAX; i++)
+	{
+		monitoring_printf(b, "<datastore><name>%s</name>", monitoring_targets[i]);
+
+		if (shared && (holder = __atomic_load_n(&shared->locks[i].session, __ATOMIC_ACQUIRE)))
+		{
+			l = &shared->locks[i];
+			t = __atomic_load_n(&l->since, __ATOMIC_ACQUIRE);
+			gmtime_r(&t, &tm);
+			strftime(since, sizeof(since), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+			monitoring_printf(b, "<locks><global-lock><locked-by-session>%u</locked-by-session>"
+					  "<locked-time>%s</locked-time></global-lock></locks>", holder, since);
+		}
+
+		xml_buf_puts(b, "</datastore>");
+	}
+
+	xml_buf_puts(b, "</datastores>");
+}
+
+/*
+ * monitoring_session_copy() - read a session another worker listed
+ *
+ * The copy is only used if the slot still holds the same session
+ * afterwards. Its counters may be an increment off, like the statistics.
+ */
+static bool monitoring_session_copy(const struct monitoring_session *s, struct monitoring_session *copy)
+{
+	uint32_t id = __atomic_load_n(&s->listed, __ATOMIC_ACQUIRE);
+
+	if (!id)
+		return false;
+
+	memcpy(copy, s, sizeof(*copy));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&s->listed, __ATOMIC_RELAXED) == id && copy->transport < __TRANSPORT_MAX;
+}
+
+static void monitoring_render_session(struct xml_buf *b, const struct monitoring_session *s)
+{
+	monitoring_printf(b, "<session><session-id>%u</session-id><transport>%s</transport>",
+			  s->id, monitoring_transports[s->transport]);
+
+	if (*s->source_host)
+		monitoring_printf(b, "<source-host>%s</source-host>", s->source_host);
+
+	monitoring_printf(b, "<login-time>%s</login-time><in-rpcs>%llu</in-rpcs><in-bad-rpcs>%llu</in-bad-rpcs>"
+			  "<out-rpc-errors>%llu</out-rpc-errors><out-notifications>%llu</out-notifications></session>",
+			  s->login_time, (unsigned long long) s->in_rpcs, (unsigned long long) s->in_bad_rpcs,
+			  (unsigned long long) s->out_rpc_errors, (unsigned long long) s->out_notifications);
+}
+
+static void monitoring_render_sessions(struct xml_buf *b)
+{
+	struct monitoring_session *s, copy;
+	int i, j;
+
+	xml_buf_puts(b, "<sessions>");
+
+	list_for_each_entry(s, &sessions, list)
+		monitoring_render_session(b, s);
+
+	for (i = 0; i < shared_slots && session_slots; i++)
+	{
+		if (i == worker_id)
+			continue;
+
+		for (j = 0; j < session_slots; j++)
+		{
+			if (monitoring_session_copy(&shared_sessions[i * session_slots + j], &copy))
+				monitoring_render_session(b, &copy);
+		}
+	}
+
+	xml_buf_puts(b, "</sessions>");
+}
+
+static void monitoring_render_statistics(struct xml_buf *b)
+{
+	struct monitoring_counters sum = { 0 }, *c;
+	int i, n = shared ? shared_slots : 0;
+
+	if (!shared)
+		sum = *monitoring;
+
+	/* single writer per slot, a torn read is one increment off at worst */
+	for (i = 0; i < n; i++)
+	{
+		c = &shared->workers[i];
+		sum.in_bad_hellos += c->in_bad_hellos;
+		sum.in_sessions += c->in_sessions;
+		sum.dropped_sessions += c->dropped_sessions;
+		sum.in_rpcs += c->in_rpcs;
+		sum.in_bad_rpcs += c->in_bad_rpcs;
+		sum.out_rpc_errors += c->out_rpc_errors;
+		sum.out_notifications += c->out_notifications;
+	}
+
+	xml_buf_puts(b, "<statistics>");
+
+	if (shared)
+		monitoring_printf(b, "<netconf-start-time>%s</netconf-start-time>", shared->start_time);
+
+	monitoring_printf(b, "<in-bad-hellos>%llu</in-bad-hellos><in-sessions>%llu</in-sessions>"
+			  "<dropped-sessions>%llu</dropped-sessions><in-rpcs>%llu</in-rpcs><in-bad-rpcs>%llu</in-bad-rpcs>",
+			  (unsigned long long) sum.in_bad_hellos, (unsigned long long) sum.in_sessions,
+			  (unsigned long long) sum.dropped_sessions, (unsigned long long) sum.in_rpcs,
+			  (unsigned long long) sum.in_bad_rpcs);
+	monitoring_printf(b, "<out-rpc-errors>%llu</out-rpc-errors><out-notifications>%llu</out-notifications>",
+			  (unsigned long long) sum.out_rpc_errors, (unsigned long long) sum.out_notifications);
+
+	xml_buf_puts(b, "</statistics>");
+}
+
+/*
+ * monitoring_render() - write netconf-state element
+ *
+ * @struct xml_buf*:	output
+ * @char**:		names of the sections asked for
+ * @int:		number of names, 0 for all of them
+ */
+void monitoring_render(struct xml_buf *b, char **names, int n)
+{
+	int i, j, sections = n ? 0 : SECTION_ALL;
+
+	for (i = 0; i < n; i++)
+	{
+		for (j = 0; names[i] && j < ARRAY_SIZE(monitoring_sections); j++)
+		{
+			if (!strcmp(names[i], monitoring_sections[j].name))
+				sections |= monitoring_sections[j].section;
+		}
+	}
+
+	xml_buf_puts(b, "<" MONITORING_ELEMENT " xmlns=\"" MONITORING_NS "\" xmlns:ncm=\"" MONITORING_NS "\""
+		     " xmlns:nd=\"urn:netconfd:transport\">");
+
+	if ((sections & SECTION_CAPABILITIES) && capabilities)
+		xml_buf_puts(b, capabilities);
+
+	if (sections & SECTION_DATASTORES)
+		monitoring_render_datastores(b);
+
+	if (sections & SECTION_SESSIONS)
+		monitoring_render_sessions(b);
+
+	if (sections & SECTION_STATISTICS)
+		monitoring_render_statistics(b);
+
+	xml_buf_puts(b, "</" MONITORING_ELEMENT ">");
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_MONITORING_H__
+#define __FREENETCONFD_MONITORING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include <libubox/list.h>
+
+/* RFC 6022 */
+#define MONITORING_ELEMENT "netconf-state"
+#define MONITORING_NS "urn:ietf:params:xml:ns:yang:ietf-netconf-monitoring"
+
+enum monitoring_transport
+{
+	TRANSPORT_TCP,
+	TRANSPORT_UNIX,
+	TRANSPORT_SSH,
+	TRANSPORT_TLS,
+	__TRANSPORT_MAX
+};
+
+/* datastores that can be locked, only running is advertised */
+enum monitoring_target
+{
+	TARGET_RUNNING,
+	__TARGET_MAX
+};
+
+/* netconf-state/statistics, one set per worker */
+struct monitoring_counters
+{
+	uint64_t in_bad_hellos;
+	uint64_t in_sessions;
+	uint64_t dropped_sessions;
+	uint64_t in_rpcs;
+	uint64_t in_bad_rpcs;
+	uint64_t out_rpc_errors;
+	uint64_t out_notifications;
+} __attribute__((aligned(64)));
+
+/* netconf-state/sessions/session, registered once the hello is through */
+struct monitoring_session
+{
+	struct list_head list;
+	/* id while registered, the other workers list the session by it */
+	uint32_t listed;
+	/* a slot of the shared table rather than malloc'd */
+	bool shared;
+	uint32_t id;
+	int transport;
+	char source_host[INET6_ADDRSTRLEN];
+	char login_time[32];
+	uint64_t in_rpcs;
+	uint64_t in_bad_rpcs;
+	uint64_t out_rpc_errors;
+	uint64_t out_notifications;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+};
+
+struct xml_buf;
+struct blob_buf;
+
+/* this worker's slot, written only by its event loop */
+extern struct monitoring_counters *monitoring;
+
+int monitoring_init(int workers, int sessions);
+void monitoring_start(void);
+void monitoring_exit(void);
+
+struct monitoring_session *monitoring_session_new(void);
+void monitoring_session_free(struct monitoring_session *s);
+void monitoring_session_add(struct monitoring_session *s);
+void monitoring_session_del(struct monitoring_session *s);
+void monitoring_sessions_to_blob(struct blob_buf *b);
+
+int monitoring_target(const char *name);
+uint32_t monitoring_lock(int target, uint32_t session);
+int monitoring_unlock(int target, uint32_t session);
+void monitoring_unlock_session(uint32_t session);
+uint32_t monitoring_lock_holder(int target);
+
+bool monitoring_match(const char *name, const char *ns);
+void monitoring_render(struct xml_buf *b, char **sections, int n);
+
+static inline void monitoring_rpc_error(struct monitoring_session *s)
+{
+	monitoring->out_rpc_errors++;
+
+	if (s)
+		s->out_rpc_errors++;
+}
+
+#endif /* __FREENETCONFD_MONITORING_H__ */
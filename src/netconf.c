@@ -17,6 +17,7 @@
 
 #include "netconfd/netconfd.h"
 #include "netconfd/netconf.h"
+#include "netconfd/arena.h"
 
 #include "netconf.h"
 #include "messages.h"
@@ -24,6 +25,7 @@
 #include <dirent.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 char *rpc_error_tags[__RPC_ERROR_TAG_COUNT] =
 {
@@ -32,7 +34,8 @@ char *rpc_error_tags[__RPC_ERROR_TAG_COUNT] =
 	"in-use",
 	"invalid-value",
 	"data-missing",
-	"data-exists"
+	"data-exists",
+	"lock-denied"
 };
 
 char *rpc_error_types[__RPC_ERROR_TYPE_COUNT] =
@@ -50,16 +53,23 @@ char *rpc_error_severities[__RPC_ERROR_SEVERITY_COUNT] =
 	"warning"
 };
 
-char *netconf_rpc_error(char *msg, rpc_error_tag_t rpc_error_tag, rpc_error_type_t rpc_error_type, rpc_error_severity_t rpc_error_severity, char *error_app_tag)
+#define RPC_ERROR_FORMAT \
+	"<error-type>%s</error-type><error-tag>%s</error-tag>" \
+	"<error-severity>%s</error-severity><error-message xml:lang=\"en\">%s</error-message>%s%s%s"
+
+/*
+ * netconf_rpc_error_format() - render rpc-error body
+ *
+ * Writes at most len bytes into buf and returns the full length like
+ * snprintf(), so callers can size their buffer with a first NULL pass.
+ */
+static int netconf_rpc_error_format(char *buf, size_t len, char *msg, rpc_error_tag_t rpc_error_tag, rpc_error_type_t rpc_error_type, rpc_error_severity_t rpc_error_severity, char *error_app_tag)
 {
 	// defaults
 	char *tag = "operation-failed";
 	char *type = "rpc";
 	char *severity = "error";
 
-	char *rpc_error = NULL;
-	int rc;
-
 	// truncate too big messages
 	if (!msg || strlen(msg) > 400)
 		msg = "";
@@ -73,19 +83,50 @@ char *netconf_rpc_error(char *msg, rpc_error_tag_t rpc_error_tag, rpc_error_type
 	if (rpc_error_severity > 0 && rpc_error_severity < __RPC_ERROR_SEVERITY_COUNT)
 		severity = rpc_error_severities[rpc_error_severity];
 
-	char *error_app_tag_buff = NULL;
+	return snprintf(buf, len, RPC_ERROR_FORMAT, type, tag, severity, msg,
+			error_app_tag ? "<error-app-tag>" : "",
+			error_app_tag ? error_app_tag : "",
+			error_app_tag ? "</error-app-tag>" : "");
+}
+
+char *netconf_rpc_error(char *msg, rpc_error_tag_t rpc_error_tag, rpc_error_type_t rpc_error_type, rpc_error_severity_t rpc_error_severity, char *error_app_tag)
+{
+	char *rpc_error = NULL;
+	int len;
+
+	len = netconf_rpc_error_format(NULL, 0, msg, rpc_error_tag, rpc_error_type, rpc_error_severity, error_app_tag);
+
+	if (len < 0 || !(rpc_error = malloc(len + 1)))
+	{
+		ERROR("unable to allocate rpc-error\n");
+		return NULL;
+	}
+
+	netconf_rpc_error_format(rpc_error, len + 1, msg, rpc_error_tag, rpc_error_type, rpc_error_severity, error_app_tag);
+
+	return rpc_error;
+}
+
+/*
+ * netconf_rpc_error_arena() - netconf_rpc_error() allocating from request arena
+ *
+ * The result must not be freed, it goes away with the arena reset after the
+ * reply has been sent.
+ */
+char *netconf_rpc_error_arena(struct arena *arena, char *msg, rpc_error_tag_t rpc_error_tag, rpc_error_type_t rpc_error_type, rpc_error_severity_t rpc_error_severity, char *error_app_tag)
+{
+	char *rpc_error;
+	int len;
+
+	len = netconf_rpc_error_format(NULL, 0, msg, rpc_error_tag, rpc_error_type, rpc_error_severity, error_app_tag);
 
-	if (error_app_tag){
-		rc = asprintf(&error_app_tag_buff, "<error-app-tag>%s</error-app-tag>", error_app_tag);
-		if (rc != 0)
-			ERROR("asprintf error\n");
+	if (len < 0 || !(rpc_error = arena_alloc(arena, len + 1)))
+	{
+		ERROR("unable to allocate rpc-error\n");
+		return NULL;
 	}
 
-	rc = asprintf(&rpc_error, "<error-type>%s</error-type><error-tag>%s</error-tag>"
-			 "<error-severity>%s</error-severity><error-message xml:lang=\"en\">%s</error-message>%s", type, tag, severity, msg, error_app_tag_buff ? error_app_tag_buff : "");
-	if (rc != 0)
-		ERROR("asprintf error\n");
-	free(error_app_tag_buff);
+	netconf_rpc_error_format(rpc_error, len + 1, msg, rpc_error_tag, rpc_error_type, rpc_error_severity, error_app_tag);
 
 	return rpc_error;
 }
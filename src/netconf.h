@@ -19,6 +19,11 @@
 
 #include <roxml.h>
 
+#include "netconfd/netconf.h"
+
+struct arena;
+
 /* RFC: http://tools.ietf.org/html/rfc6241#appendix-A */
+char *netconf_rpc_error_arena(struct arena *arena, char *msg, rpc_error_tag_t rpc_error_tag, rpc_error_type_t rpc_error_type, rpc_error_severity_t rpc_error_severity, char *error_app_tag);
 
 #endif /* __FREENETCONFD_SRC_NETCONF_H__ */
@@ -25,6 +25,23 @@
 #include "connection.h"
 #include "config.h"
 #include "ubus.h"
+#include "worker.h"
+#include "ssh.h"
+#include "tls.h"
+#include "reload.h"
+#include "provider.h"
+#include "datastore.h"
+#include "monitoring.h"
+#include "log.h"
+#include "trace.h"
+#include "notification.h"
+#include "snmp.h"
+#include "filter.h"
+#include "push.h"
+#include "cache.h"
+#include "changes.h"
+
+int netconfd_log_level = LOG_INFO;
 
 int
 main(int argc, char **argv)
@@ -39,6 +56,74 @@ main(int argc, char **argv)
 		goto exit;
 	}
 
+	/* before forking, all workers append to the one log file */
+	rc = log_init(config.log_file);
+
+	if (rc)
+	{
+		ERROR("log init failed\n");
+		goto exit;
+	}
+
+	/* before forking, all workers accept on the one local socket */
+	rc = server_unix_init();
+
+	if (rc)
+	{
+		ERROR("local server init failed\n");
+		goto exit;
+	}
+
+	/* before forking, worker 0 reads traps and passes them on */
+	rc = snmp_init(config.workers);
+
+	if (rc)
+	{
+		ERROR("snmp init failed\n");
+		goto exit;
+	}
+
+	/* before forking, so all workers share tls session ticket keys */
+	rc = tls_server_init();
+
+	if (rc)
+	{
+		ERROR("tls server init failed\n");
+		goto exit;
+	}
+
+	/* before forking, statistics, locks and sessions are shared by all workers */
+	rc = monitoring_init(worker_number(config.workers), config.max_sessions);
+
+	if (rc)
+	{
+		ERROR("monitoring init failed\n");
+		goto exit;
+	}
+
+	rc = worker_init(config.workers);
+
+	if (rc < 0)
+	{
+		ERROR("worker init failed\n");
+		goto exit;
+	}
+	else if (rc > 0)
+	{
+		/* supervisor, all workers have stopped */
+		rc = EXIT_SUCCESS;
+		goto exit;
+	}
+
+	/* the supervisor keeps writing directly */
+	rc = log_start();
+
+	if (rc)
+	{
+		ERROR("log start failed\n");
+		goto exit;
+	}
+
 	rc = uloop_init();
 
 	if (rc)
@@ -47,6 +132,24 @@ main(int argc, char **argv)
 		goto exit;
 	}
 
+	monitoring_start();
+
+	rc = trace_reload();
+
+	if (rc)
+	{
+		ERROR("trace init failed\n");
+		goto exit;
+	}
+
+	rc = reload_init();
+
+	if (rc)
+	{
+		ERROR("reload init failed\n");
+		goto exit;
+	}
+
 	rc = server_init();
 
 	if (rc)
@@ -55,6 +158,22 @@ main(int argc, char **argv)
 		goto exit;
 	}
 
+	rc = ssh_server_init();
+
+	if (rc)
+	{
+		ERROR("ssh server init failed\n");
+		goto exit;
+	}
+
+	rc = tls_server_start();
+
+	if (rc)
+	{
+		ERROR("tls server start failed\n");
+		goto exit;
+	}
+
 	rc = ubus_init();
 
 	if (rc)
@@ -63,14 +182,48 @@ main(int argc, char **argv)
 		goto exit;
 	}
 
+	rc = datastore_init();
+
+	if (rc)
+	{
+		ERROR("datastore init failed\n");
+		goto exit;
+	}
+
+	rc = provider_init();
+
+	if (rc)
+	{
+		ERROR("provider init failed\n");
+		goto exit;
+	}
+
 	rc = subscription_init();
 	if (rc)
 	{
 		ERROR("subscription init failed\n");
 		goto exit;
 	}
+
+	push_init();
+
+	rc = notification_bus_init();
+
+	if (rc)
+	{
+		ERROR("notification bus init failed\n");
+		goto exit;
+	}
+
+	rc = snmp_start();
+
+	if (rc)
+	{
+		ERROR("snmp start failed\n");
+		goto exit;
+	}
 	
-	LOG("%s is accepting connections on '%s:%s'\n", PROJECT_NAME, config.addr, config.port);
+	LOG("%s worker %d is accepting connections on '%s:%s'\n", PROJECT_NAME, worker_id, config.addr, config.port);
 
 	/* main loop */
 	uloop_run();
@@ -79,10 +232,38 @@ main(int argc, char **argv)
 exit:
 	/* FIXME: implement netconf_exit() */
 
+	ssh_server_exit();
+
+	tls_server_exit();
+
+	server_unix_exit();
+
+	trace_exit();
+
+	notification_bus_exit();
+
+	snmp_exit();
+
+	push_exit();
+
+	cache_exit();
+
+	changes_exit();
+
+	filter_exit();
+
 	uloop_done();
 
+	provider_exit();
+
+	datastore_exit();
+
+	monitoring_exit();
+
 	ubus_exit();
 
+	log_stop();
+
 	config_exit();
 
 	return rc;
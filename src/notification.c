@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <libubox/blobmsg.h>
+#include <libubox/uloop.h>
+
+#include "netconfd/netconfd.h"
+#include "netconfd/plugin.h"
+
+#include "notification.h"
+#include "connection.h"
+#include "stats.h"
+#include "xml.h"
+
+/* RFC 3339 timestamp for eventTime */
+void notification_event_time(char *buf, size_t size)
+{
+	struct timespec ts;
+	struct tm tm;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	gmtime_r(&ts.tv_sec, &tm);
+	strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+/*
+ * notification_encode() - render event as notification message
+ *
+ * @struct blob_attr*:	table, each member is one top level element
+ * @const char*:	eventTime value
+ * @size_t*:		set to the message length
+ *
+ * Returns malloc'd message or NULL.
+ */
+char *notification_encode(struct blob_attr *event, const char *event_time, size_t *len)
+{
+	struct xml_buf b = { 0 };
+
+	xml_buf_puts(&b, NOTIFICATION_START);
+	xml_buf_puts(&b, event_time);
+	xml_buf_puts(&b, "</eventTime>");
+	xml_buf_members(&b, event);
+
+	xml_buf_puts(&b, NOTIFICATION_END);
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return NULL;
+	}
+
+	*len = b.len;
+
+	return b.data;
+}
+
+/*
+ * notification_publish() - send batch of events to a stream's subscribers
+ *
+ * @const char*:	stream name as used in create-subscription
+ * @struct blob_attr*:	array of event tables
+ *
+ * Every event is encoded once, whatever the number of subscribers.
+ * Returns the number of events published or -1 for an unknown stream.
+ */
+int notification_publish(const char *stream, struct blob_attr *events)
+{
+	char *msgs[NOTIFICATION_BATCH];
+	size_t lens[NOTIFICATION_BATCH];
+	char event_time[32];
+	struct blob_attr *cur;
+	int id, rem, i, n = 0, total = 0;
+
+	if ((id = connection_stream_id(stream)) < 0)
+		return -1;
+
+	notification_event_time(event_time, sizeof(event_time));
+
+	blobmsg_for_each_attr(cur, events, rem)
+	{
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_TABLE)
+			continue;
+
+		stats.notifications++;
+
+		if (!(msgs[n] = notification_encode(cur, event_time, &lens[n])))
+			continue;
+
+		if (++n < NOTIFICATION_BATCH)
+			continue;
+
+		connection_notify(id, msgs, lens, n);
+
+		for (i = 0; i < n; i++)
+			free(msgs[i]);
+
+		total += n;
+		n = 0;
+	}
+
+	if (n)
+		connection_notify(id, msgs, lens, n);
+
+	for (i = 0; i < n; i++)
+		free(msgs[i]);
+
+	return total + n;
+}
+
+/*
+ * Notification bus
+ *
+ * netconfd_notify() may be called from any thread. Events are encoded by
+ * the producer and pushed onto the intrusive queue of Dmitry Vyukov: a
+ * producer swaps itself in as head and then links its predecessor to it,
+ * so pushing is two atomic operations and never waits for another thread.
+ * The event loop is the single consumer. It is woken through an eventfd,
+ * written only by the producer that finds the loop not signalled yet, so
+ * a burst of events costs one wake up. The queue is bounded by a counter,
+ * events above NOTIFY_QUEUE_MAX are dropped and counted.
+ */
+#define NOTIFY_QUEUE_MAX 65536
+/* events fanned out per loop callback before others get a turn */
+#define NOTIFY_DRAIN_MAX 4096
+
+struct notify_event
+{
+	struct notify_event *next;
+	int stream;
+	size_t len;
+	char msg[];
+};
+
+static void notification_bus_cb(struct uloop_fd *fd, unsigned int events);
+
+static struct notify_event stub;
+static struct notify_event *head __attribute__((aligned(64))) = &stub;
+static struct notify_event *tail __attribute__((aligned(64))) = &stub;
+static int queued __attribute__((aligned(64))) = 0;
+static int signalled __attribute__((aligned(64))) = 0;
+static uint64_t dropped = 0;
+
+static struct uloop_fd bus_fd = { .cb = notification_bus_cb, .fd = -1 };
+
+static void notification_push(struct notify_event *e)
+{
+	struct notify_event *prev;
+
+	e->next = NULL;
+	prev = __atomic_exchange_n(&head, e, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, e, __ATOMIC_RELEASE);
+}
+
+/* oldest event, NULL if there is none or a producer is half way through */
+static struct notify_event *notification_pop(void)
+{
+	struct notify_event *t = tail, *next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+
+	if (t == &stub)
+	{
+		if (!next)
+			return NULL;
+
+		tail = t = next;
+		next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next)
+	{
+		tail = next;
+		return t;
+	}
+
+	if (t != __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	/* t is the last event, put the stub behind it to take it out */
+	notification_push(&stub);
+
+	if ((next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE)))
+	{
+		tail = next;
+		return t;
+	}
+
+	return NULL;
+}
+
+static void notification_signal(void)
+{
+	uint64_t one = 1;
+
+	if (__atomic_exchange_n(&signalled, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	if (write(__atomic_load_n(&bus_fd.fd, __ATOMIC_RELAXED), &one, sizeof(one)) < 0)
+		;
+}
+
+/*
+ * netconfd_notify() - raise notification from any thread
+ *
+ * @const char*:	stream name as used in create-subscription, NULL for netconf
+ * @const char*:	xml of the event, the content of <notification> after eventTime
+ * @size_t:		its length
+ *
+ * Returns 0 once the event is queued, -1 for an unknown stream, before the
+ * bus is running or if the queue is full.
+ */
+int netconfd_notify(const char *stream, const char *xml, size_t len)
+{
+	static __thread time_t cached_sec = 0;
+	static __thread char cached[32];
+	static __thread size_t cached_len = 0;
+	const size_t start_len = strlen(NOTIFICATION_START), end_len = strlen(NOTIFICATION_END);
+	struct notify_event *e;
+	struct timespec ts;
+	int id;
+	char *p;
+
+	if ((id = connection_stream_id(stream)) < 0 || __atomic_load_n(&bus_fd.fd, __ATOMIC_RELAXED) < 0)
+		return -1;
+
+	if (__atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED) > NOTIFY_QUEUE_MAX)
+	{
+		__atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	/* eventTime has seconds resolution, format it once per second */
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	if (ts.tv_sec != cached_sec)
+	{
+		notification_event_time(cached, sizeof(cached));
+		cached_len = strlen(cached);
+		cached_sec = ts.tv_sec;
+	}
+
+	e = malloc(sizeof(*e) + start_len + cached_len + strlen("</eventTime>") + len + end_len + 1);
+
+	if (!e)
+	{
+		__atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	p = e->msg;
+	p = mempcpy(p, NOTIFICATION_START, start_len);
+	p = mempcpy(p, cached, cached_len);
+	p = mempcpy(p, "</eventTime>", strlen("</eventTime>"));
+	p = mempcpy(p, xml, len);
+	p = mempcpy(p, NOTIFICATION_END, end_len);
+	*p = '\0';
+
+	e->stream = id;
+	e->len = p - e->msg;
+
+	notification_push(e);
+	notification_signal();
+
+	return 0;
+}
+
+/* send events of one stream that came in a row */
+static void notification_bus_send(struct notify_event **batch, int n)
+{
+	char *msgs[NOTIFICATION_BATCH];
+	size_t lens[NOTIFICATION_BATCH];
+	int i;
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++)
+	{
+		msgs[i] = batch[i]->msg;
+		lens[i] = batch[i]->len;
+	}
+
+	connection_notify(batch[0]->stream, msgs, lens, n);
+
+	for (i = 0; i < n; i++)
+		free(batch[i]);
+
+	__atomic_sub_fetch(&queued, n, __ATOMIC_RELAXED);
+}
+
+/*
+ * notification_bus_drain() - fan out queued events
+ *
+ * Returns the number of events handled, at most NOTIFY_DRAIN_MAX.
+ */
+int notification_bus_drain(void)
+{
+	struct notify_event *batch[NOTIFICATION_BATCH], *e;
+	int n = 0, total = 0;
+
+	while (total < NOTIFY_DRAIN_MAX && (e = notification_pop()))
+	{
+		if (n == NOTIFICATION_BATCH || (n && batch[0]->stream != e->stream))
+		{
+			notification_bus_send(batch, n);
+			n = 0;
+		}
+
+		batch[n++] = e;
+		total++;
+		stats.notifications++;
+	}
+
+	notification_bus_send(batch, n);
+
+	return total;
+}
+
+static void notification_bus_cb(struct uloop_fd *fd, unsigned int events)
+{
+	uint64_t count;
+
+	if (read(fd->fd, &count, sizeof(count)) < 0)
+		;
+
+	/* producers from here on signal again */
+	__atomic_store_n(&signalled, 0, __ATOMIC_SEQ_CST);
+
+	/* more left, come back after the sessions had their turn */
+	if (notification_bus_drain() == NOTIFY_DRAIN_MAX)
+		notification_signal();
+}
+
+int notification_bus_init(void)
+{
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	bus_fd.fd = fd;
+
+	if (uloop_fd_add(&bus_fd, ULOOP_READ))
+	{
+		close(fd);
+		bus_fd.fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* events still queued are dropped */
+void notification_bus_exit(void)
+{
+	struct notify_event *e;
+	int fd = bus_fd.fd;
+
+	if (fd < 0)
+		return;
+
+	uloop_fd_delete(&bus_fd);
+	__atomic_store_n(&bus_fd.fd, -1, __ATOMIC_RELAXED);
+	close(fd);
+
+	while ((e = notification_pop()))
+	{
+		__atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+		free(e);
+	}
+}
+
+int notification_bus_queued(void)
+{
+	return __atomic_load_n(&queued, __ATOMIC_RELAXED);
+}
+
+uint64_t notification_bus_dropped(void)
+{
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_NOTIFICATION_H__
+#define __FREENETCONFD_NOTIFICATION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* events encoded and sent per fan out round */
+#define NOTIFICATION_BATCH 64
+
+/* a message is NOTIFICATION_START, eventTime, the event and NOTIFICATION_END */
+#define NOTIFICATION_START \
+"<notification xmlns=\"urn:ietf:params:xml:ns:netconf:notification:1.0\"><eventTime>"
+#define NOTIFICATION_END "</notification>"
+
+struct blob_attr;
+
+void notification_event_time(char *buf, size_t size);
+char *notification_encode(struct blob_attr *event, const char *event_time, size_t *len);
+int notification_publish(const char *stream, struct blob_attr *events);
+
+int notification_bus_init(void);
+void notification_bus_exit(void);
+int notification_bus_drain(void);
+int notification_bus_queued(void);
+uint64_t notification_bus_dropped(void);
+
+#endif /* __FREENETCONFD_NOTIFICATION_H__ */
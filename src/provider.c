@@ -0,0 +1,690 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <uci.h>
+#include <uci_blob.h>
+#include <libubus.h>
+
+#include "netconfd/netconfd.h"
+#include "netconfd/netconf.h"
+
+#include "provider.h"
+#include "ubus.h"
+#include "timer.h"
+#include "xml.h"
+#include "stats.h"
+
+/*
+ * Data providers
+ *
+ * A provider maps one top level element to a ubus object, typically a system
+ * daemon. <get> calls its get method and renders the returned table below the
+ * element, edit-config hands the element's content to its set method.
+ *
+ * All providers a request touches are invoked at once with
+ * ubus_invoke_async(), the reply is sent when the last of them answered, so
+ * a request spanning several daemons takes as long as the slowest one. Get
+ * answers are kept for a short time and reused by later requests.
+ *
+ * Object ids are looked up when the providers are loaded and afterwards
+ * follow the ubus.object.add and ubus.object.remove events of ubusd, so a
+ * request never waits for a lookup. While a provider's object is gone its
+ * calls fail right away.
+ */
+#define PROVIDER_DEFAULT_CACHE 1000
+#define PROVIDER_DEFAULT_TIMEOUT 2000
+
+struct provider
+{
+	struct list_head list;
+	/* element and namespace served, ubus object and methods called */
+	char *name;
+	char *ns;
+	char *object;
+	char *get;
+	char *set;
+	/* milliseconds, cache 0 disables caching */
+	int cache;
+	int timeout;
+	/* kept current by object events, 0 while the object is gone */
+	uint32_t id;
+	/* rendered answer of the last get */
+	char *cached;
+	size_t cached_len;
+	uint64_t cached_until;
+	/* calls in flight, a provider dropped by reload lives until they are done */
+	int refs;
+	bool removed;
+};
+
+struct provider_call
+{
+	struct provider_request *r;
+	struct provider *p;
+	/* object id the call went to */
+	uint32_t id;
+	struct ubus_request req;
+	struct timer timer;
+	struct blob_attr *args;
+	struct xml_buf out;
+	bool pending;
+	int status;
+};
+
+struct provider_request
+{
+	enum provider_op op;
+	/* reply holding PROVIDER_MARKER */
+	char *reply;
+	provider_done_cb cb;
+	void *priv;
+	int pending;
+	int n_calls;
+	struct provider_call *calls;
+};
+
+enum
+{
+	PROVIDER_NAME,
+	PROVIDER_NS,
+	PROVIDER_OBJECT,
+	PROVIDER_GET_METHOD,
+	PROVIDER_SET_METHOD,
+	PROVIDER_CACHE,
+	PROVIDER_TIMEOUT,
+	__PROVIDER_MAX
+};
+
+static const struct blobmsg_policy provider_policy[__PROVIDER_MAX] =
+{
+	[PROVIDER_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+	[PROVIDER_NS] = { .name = "ns", .type = BLOBMSG_TYPE_STRING },
+	[PROVIDER_OBJECT] = { .name = "object", .type = BLOBMSG_TYPE_STRING },
+	[PROVIDER_GET_METHOD] = { .name = "get", .type = BLOBMSG_TYPE_STRING },
+	[PROVIDER_SET_METHOD] = { .name = "set", .type = BLOBMSG_TYPE_STRING },
+	[PROVIDER_CACHE] = { .name = "cache", .type = BLOBMSG_TYPE_INT32 },
+	[PROVIDER_TIMEOUT] = { .name = "timeout", .type = BLOBMSG_TYPE_INT32 },
+};
+
+static const struct uci_blob_param_list provider_attr_list =
+{
+	.n_params = __PROVIDER_MAX,
+	.params = provider_policy
+};
+
+static LIST_HEAD(providers);
+
+static uint64_t provider_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static char *provider_strdup(struct blob_attr *attr, const char *def)
+{
+	if (attr)
+		return strdup(blobmsg_get_string(attr));
+
+	return def ? strdup(def) : NULL;
+}
+
+static void provider_free(struct provider *p)
+{
+	free(p->name);
+	free(p->ns);
+	free(p->object);
+	free(p->get);
+	free(p->set);
+	free(p->cached);
+	free(p);
+}
+
+static void provider_put(struct provider *p)
+{
+	if (--p->refs == 0 && p->removed)
+		provider_free(p);
+}
+
+/* drop providers from the list, those still in use are freed by their last call */
+static void provider_clear(void)
+{
+	struct provider *p, *tmp;
+
+	list_for_each_entry_safe(p, tmp, &providers, list)
+	{
+		list_del(&p->list);
+		p->removed = true;
+
+		if (!p->refs)
+			provider_free(p);
+	}
+}
+
+/* read "config provider" sections of the netconfd package */
+static int provider_parse(void)
+{
+	struct uci_context *uci = uci_alloc_context();
+	struct uci_package *conf = NULL;
+	struct blob_attr *tb[__PROVIDER_MAX];
+	struct uci_element *e;
+	struct provider *p;
+	static struct blob_buf buf;
+
+	if (uci_load(uci, "netconfd", &conf))
+	{
+		uci_free_context(uci);
+		return -1;
+	}
+
+	uci_foreach_element(&conf->sections, e)
+	{
+		struct uci_section *s = uci_to_section(e);
+
+		if (strcmp(s->type, "provider"))
+			continue;
+
+		blob_buf_init(&buf, 0);
+		uci_to_blob(&buf, s, &provider_attr_list);
+		blobmsg_parse(provider_policy, __PROVIDER_MAX, tb, blob_data(buf.head), blob_len(buf.head));
+
+		if (!tb[PROVIDER_NAME] || !tb[PROVIDER_OBJECT])
+		{
+			ERROR("provider section needs name and object\n");
+			continue;
+		}
+
+		if (!(p = calloc(1, sizeof(*p))))
+			break;
+
+		p->name = provider_strdup(tb[PROVIDER_NAME], NULL);
+		p->ns = provider_strdup(tb[PROVIDER_NS], NULL);
+		p->object = provider_strdup(tb[PROVIDER_OBJECT], NULL);
+		p->get = provider_strdup(tb[PROVIDER_GET_METHOD], "get");
+		p->set = provider_strdup(tb[PROVIDER_SET_METHOD], "set");
+		p->cache = tb[PROVIDER_CACHE] ? (int) blobmsg_get_u32(tb[PROVIDER_CACHE]) : PROVIDER_DEFAULT_CACHE;
+		p->timeout = tb[PROVIDER_TIMEOUT] ? (int) blobmsg_get_u32(tb[PROVIDER_TIMEOUT]) : PROVIDER_DEFAULT_TIMEOUT;
+
+		if (p->timeout <= 0)
+			p->timeout = PROVIDER_DEFAULT_TIMEOUT;
+
+		list_add_tail(&p->list, &providers);
+
+		DEBUG("provider '%s' served by '%s'\n", p->name, p->object);
+	}
+
+	blob_buf_free(&buf);
+	uci_unload(uci, conf);
+	uci_free_context(uci);
+
+	return 0;
+}
+
+enum
+{
+	OBJECT_EVENT_ID,
+	OBJECT_EVENT_PATH,
+	__OBJECT_EVENT_MAX
+};
+
+static const struct blobmsg_policy object_event_policy[__OBJECT_EVENT_MAX] =
+{
+	[OBJECT_EVENT_ID] = { .name = "id", .type = BLOBMSG_TYPE_INT32 },
+	[OBJECT_EVENT_PATH] = { .name = "path", .type = BLOBMSG_TYPE_STRING },
+};
+
+/* ubusd announces objects as they come and go */
+static void provider_object_event_cb(struct ubus_context *ctx, struct ubus_event_handler *ev,
+	const char *type, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__OBJECT_EVENT_MAX];
+	bool add = !strcmp(type, "ubus.object.add");
+	const char *path;
+	struct provider *p;
+	uint32_t id;
+
+	blobmsg_parse(object_event_policy, __OBJECT_EVENT_MAX, tb, blob_data(msg), blob_len(msg));
+
+	if (!tb[OBJECT_EVENT_ID] || !tb[OBJECT_EVENT_PATH])
+		return;
+
+	id = blobmsg_get_u32(tb[OBJECT_EVENT_ID]);
+	path = blobmsg_get_string(tb[OBJECT_EVENT_PATH]);
+
+	list_for_each_entry(p, &providers, list)
+	{
+		if (strcmp(p->object, path))
+			continue;
+
+		if (add)
+			p->id = id;
+		else if (p->id == id)
+			p->id = 0;
+
+		DEBUG("provider '%s' object %s\n", p->name, add ? "added" : "removed");
+	}
+}
+
+static struct ubus_event_handler object_event = { .cb = provider_object_event_cb };
+
+/* look up the objects of freshly loaded providers, once per load */
+static void provider_resolve(void)
+{
+	struct ubus_context *ctx = ubus_ctx_get();
+	struct provider *p;
+
+	if (!ctx)
+		return;
+
+	list_for_each_entry(p, &providers, list)
+	{
+		if (ubus_lookup_id(ctx, p->object, &p->id))
+		{
+			LOG("provider '%s' object '%s' not found yet\n", p->name, p->object);
+			p->id = 0;
+		}
+	}
+}
+
+int provider_init(void)
+{
+	struct ubus_context *ctx = ubus_ctx_get();
+
+	/* before the lookups, an object added meanwhile is not missed */
+	if (ctx && ubus_register_event_handler(ctx, &object_event, "ubus.object.*"))
+		ERROR("unable to follow ubus objects\n");
+
+	if (provider_parse())
+		return -1;
+
+	provider_resolve();
+
+	return 0;
+}
+
+/* requests in flight finish with the providers they started with */
+int provider_reload(void)
+{
+	provider_clear();
+
+	if (provider_parse())
+		return -1;
+
+	provider_resolve();
+
+	return 0;
+}
+
+void provider_exit(void)
+{
+	struct ubus_context *ctx = ubus_ctx_get();
+
+	if (ctx)
+		ubus_unregister_event_handler(ctx, &object_event);
+
+	provider_clear();
+}
+
+/*
+ * provider_lookup() - provider serving a top level element
+ *
+ * @const char*:	element name
+ * @const char*:	its namespace, NULL matches any
+ */
+struct provider *provider_lookup(const char *name, const char *ns)
+{
+	struct provider *p;
+
+	list_for_each_entry(p, &providers, list)
+	{
+		if (strcmp(p->name, name))
+			continue;
+
+		if (ns && p->ns && strcmp(p->ns, ns))
+			continue;
+
+		return p;
+	}
+
+	return NULL;
+}
+
+/* iterate over all providers, start with NULL */
+struct provider *provider_next(struct provider *p)
+{
+	struct list_head *next = p ? p->list.next : providers.next;
+
+	if (next == &providers)
+		return NULL;
+
+	return list_entry(next, struct provider, list);
+}
+
+struct provider_request *provider_request_new(enum provider_op op)
+{
+	struct provider_request *r = calloc(1, sizeof(*r));
+
+	if (r)
+		r->op = op;
+
+	return r;
+}
+
+/*
+ * provider_request_add() - include provider in request
+ *
+ * @struct provider_request*:	request not started yet
+ * @struct provider*:		provider to call
+ * @struct blob_attr*:		arguments of the call, copied, may be NULL
+ */
+int provider_request_add(struct provider_request *r, struct provider *p, struct blob_attr *args)
+{
+	struct provider_call *calls, *call;
+
+	if (!(calls = realloc(r->calls, (r->n_calls + 1) * sizeof(*calls))))
+		return -1;
+
+	r->calls = calls;
+	call = &r->calls[r->n_calls];
+	memset(call, 0, sizeof(*call));
+
+	if (args && !(call->args = blob_memdup(args)))
+		return -1;
+
+	call->r = r;
+	call->p = p;
+	p->refs++;
+	r->n_calls++;
+
+	return 0;
+}
+
+/* whether the request has any provider to call */
+bool provider_request_pending(struct provider_request *r)
+{
+	return r->n_calls > 0;
+}
+
+static void provider_request_free(struct provider_request *r)
+{
+	int i;
+
+	for (i = 0; i < r->n_calls; i++)
+	{
+		provider_put(r->calls[i].p);
+		free(r->calls[i].args);
+		xml_buf_free(&r->calls[i].out);
+	}
+
+	free(r->calls);
+	free(r->reply);
+	free(r);
+}
+
+/*
+ * provider_request_reply() - complete reply once all providers answered
+ *
+ * The answers replace PROVIDER_MARKER. If any provider failed, the reply is
+ * an rpc-error instead, a partial <data> would look like missing state.
+ */
+static char *provider_request_reply(struct provider_request *r)
+{
+	const char *marker = "<!--" PROVIDER_MARKER "-->";
+	struct provider_call *failed = NULL;
+	struct xml_buf b = { 0 };
+	char msg[256], *error, *pos, *head;
+	int i;
+
+	for (i = 0; i < r->n_calls && !failed; i++)
+	{
+		if (r->calls[i].status)
+			failed = &r->calls[i];
+	}
+
+	if (failed)
+	{
+		/* keep the attributes of the rpc-reply, message-id in particular */
+		if (!(head = strstr(r->reply, "<rpc-reply")) || !(head = strchr(head, '>')))
+			return NULL;
+
+		snprintf(msg, sizeof(msg), "%s: %s", failed->p->name, ubus_strerror(failed->status));
+		error = netconf_rpc_error(msg, RPC_ERROR_TAG_OPERATION_FAILED, RPC_ERROR_TYPE_APPLICATION, RPC_ERROR_SEVERITY_ERROR, NULL);
+
+		xml_buf_append(&b, r->reply, head + 1 - r->reply);
+		xml_buf_puts(&b, "<rpc-error>");
+		xml_buf_puts(&b, error ? error : "");
+		xml_buf_puts(&b, "</rpc-error></rpc-reply>");
+
+		free(error);
+		stats.rpc_errors++;
+	}
+	else
+	{
+		if (!(pos = strstr(r->reply, marker)))
+			return NULL;
+
+		xml_buf_append(&b, r->reply, pos - r->reply);
+
+		if (r->op == PROVIDER_SET)
+			xml_buf_puts(&b, "<ok/>");
+
+		for (i = 0; i < r->n_calls; i++)
+			xml_buf_append(&b, r->calls[i].out.data, r->calls[i].out.len);
+
+		xml_buf_puts(&b, pos + strlen(marker));
+	}
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return NULL;
+	}
+
+	return b.data;
+}
+
+static void provider_call_done(struct provider_call *call)
+{
+	struct provider_request *r = call->r;
+	struct provider *p = call->p;
+	char *reply;
+
+	timer_cancel(&call->timer);
+	call->pending = false;
+
+	if (call->status)
+	{
+		LOG("provider '%s' failed: %s\n", p->name, ubus_strerror(call->status));
+		stats.provider_errors++;
+
+		/* gone unless an event brought a new id meanwhile */
+		if (call->status == UBUS_STATUS_NOT_FOUND && p->id == call->id)
+			p->id = 0;
+	}
+	else if (r->op == PROVIDER_GET && p->cache > 0 && !call->out.error)
+	{
+		free(p->cached);
+
+		if ((p->cached = malloc(call->out.len + 1)))
+		{
+			memcpy(p->cached, call->out.data, call->out.len + 1);
+			p->cached_len = call->out.len;
+			p->cached_until = provider_now() + p->cache;
+		}
+	}
+	else if (r->op == PROVIDER_SET)
+	{
+		/* state changed, the next get has to ask */
+		p->cached_until = 0;
+	}
+
+	if (--r->pending)
+		return;
+
+	reply = provider_request_reply(r);
+	r->cb(r, reply, r->priv);
+	provider_request_free(r);
+}
+
+static void provider_data_cb(struct ubus_request *req, int type, struct blob_attr *msg)
+{
+	struct provider_call *call = req->priv;
+	struct provider *p = call->p;
+
+	if (call->r->op != PROVIDER_GET || !msg)
+		return;
+
+	xml_buf_puts(&call->out, "<");
+	xml_buf_puts(&call->out, p->name);
+
+	if (p->ns)
+	{
+		xml_buf_puts(&call->out, " xmlns=\"");
+		xml_buf_escape(&call->out, p->ns);
+		xml_buf_puts(&call->out, "\"");
+	}
+
+	xml_buf_puts(&call->out, ">");
+	xml_buf_members(&call->out, msg);
+	xml_buf_puts(&call->out, "</");
+	xml_buf_puts(&call->out, p->name);
+	xml_buf_puts(&call->out, ">");
+}
+
+static void provider_complete_cb(struct ubus_request *req, int ret)
+{
+	struct provider_call *call = req->priv;
+
+	call->status = ret;
+	provider_call_done(call);
+}
+
+static void provider_timeout_cb(struct timer *t)
+{
+	struct provider_call *call = container_of(t, struct provider_call, timer);
+
+	ubus_abort_request(ubus_ctx_get(), &call->req);
+
+	call->status = UBUS_STATUS_TIMEOUT;
+	provider_call_done(call);
+}
+
+static int provider_invoke(struct provider_call *call)
+{
+	struct ubus_context *ctx = ubus_ctx_get();
+	struct provider *p = call->p;
+	const char *method = call->r->op == PROVIDER_GET ? p->get : p->set;
+
+	if (!ctx)
+		return UBUS_STATUS_CONNECTION_FAILED;
+
+	/* never looked up here, an object event brings the id back */
+	if (!p->id)
+		return UBUS_STATUS_NOT_FOUND;
+
+	call->id = p->id;
+
+	/* a failed send says nothing about the object, the id is kept */
+	if (ubus_invoke_async(ctx, p->id, method, call->args, &call->req))
+		return UBUS_STATUS_CONNECTION_FAILED;
+
+	call->req.data_cb = provider_data_cb;
+	call->req.complete_cb = provider_complete_cb;
+	call->req.priv = call;
+	ubus_complete_request_async(ctx, &call->req);
+
+	call->timer.cb = provider_timeout_cb;
+	timer_set(&call->timer, p->timeout);
+
+	stats.provider_calls++;
+
+	return 0;
+}
+
+/*
+ * provider_request_start() - invoke all providers of a request
+ *
+ * @struct provider_request*:	request, owned by this function from now on
+ * @char**:			reply with PROVIDER_MARKER, taken over as well
+ * @provider_done_cb:		called with the final reply once all answered
+ * @void*:			passed to it
+ *
+ * Returns 0 if every answer was cached and *reply already holds the final
+ * reply, 1 if the callback follows later.
+ */
+int provider_request_start(struct provider_request *r, char **reply, provider_done_cb cb, void *priv)
+{
+	struct provider_call *call;
+	uint64_t now = provider_now();
+	int i;
+
+	r->reply = *reply;
+	r->cb = cb;
+	r->priv = priv;
+	*reply = NULL;
+
+	for (i = 0; i < r->n_calls; i++)
+	{
+		call = &r->calls[i];
+
+		if (r->op == PROVIDER_GET && call->p->cached && now < call->p->cached_until)
+		{
+			xml_buf_append(&call->out, call->p->cached, call->p->cached_len);
+			stats.provider_cache_hits++;
+			continue;
+		}
+
+		if ((call->status = provider_invoke(call)))
+			continue;
+
+		call->pending = true;
+		r->pending++;
+	}
+
+	if (r->pending)
+		return 1;
+
+	*reply = provider_request_reply(r);
+	provider_request_free(r);
+
+	return 0;
+}
+
+/* session went away, forget the answers still outstanding */
+void provider_request_abort(struct provider_request *r)
+{
+	struct ubus_context *ctx = ubus_ctx_get();
+	int i;
+
+	for (i = 0; i < r->n_calls; i++)
+	{
+		if (!r->calls[i].pending)
+			continue;
+
+		timer_cancel(&r->calls[i].timer);
+
+		if (ctx)
+			ubus_abort_request(ctx, &r->calls[i].req);
+	}
+
+	provider_request_free(r);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_PROVIDER_H__
+#define __FREENETCONFD_PROVIDER_H__
+
+#include <stdbool.h>
+
+/*
+ * Comment left in a reply where the answers of the providers go once they
+ * are in, see provider_request_start().
+ */
+#define PROVIDER_MARKER "netconfd-provider"
+
+enum provider_op
+{
+	PROVIDER_GET,
+	PROVIDER_SET,
+};
+
+struct blob_attr;
+struct provider;
+struct provider_request;
+
+typedef void (*provider_done_cb)(struct provider_request *r, char *reply, void *priv);
+
+int provider_init(void);
+int provider_reload(void);
+void provider_exit(void);
+
+struct provider *provider_lookup(const char *name, const char *ns);
+struct provider *provider_next(struct provider *p);
+
+struct provider_request *provider_request_new(enum provider_op op);
+int provider_request_add(struct provider_request *r, struct provider *p, struct blob_attr *args);
+bool provider_request_pending(struct provider_request *r);
+int provider_request_start(struct provider_request *r, char **reply, provider_done_cb cb, void *priv);
+void provider_request_abort(struct provider_request *r);
+
+#endif /* __FREENETCONFD_PROVIDER_H__ */
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netconfd/netconfd.h"
+
+#include "push.h"
+#include "connection.h"
+#include "datastore.h"
+#include "monitoring.h"
+#include "metrics.h"
+#include "notification.h"
+#include "stats.h"
+#include "xml.h"
+
+/*
+ * YANG push
+ *
+ * Periodic and on-change subscriptions in the manner of RFC 8641, made
+ * with create-subscription. Subscriptions asking for the same data in the
+ * same mode and period share a group with one timer; every update is
+ * rendered once and written to all members, only the subscription id is
+ * filled in per member.
+ *
+ * On-change subscriptions follow the uci datastore: commits and files
+ * changed on disk, which is looked at once a second while there are such
+ * subscriptions, arm the group timer. After an update the group waits for
+ * its dampening period, changes in the meantime go out together in the
+ * next update. Updates carry just the packages changed since the previous
+ * one. New members first get a full update of their own, those whose
+ * session is backed up get it on a later try and nothing before it.
+ */
+#define PUSH_POLL_MS 1000
+#define PUSH_SYNC_RETRY_MS 1000
+
+static void push_poll_cb(struct timer *t);
+
+static LIST_HEAD(groups);
+static struct timer poll_timer = { .cb = push_poll_cb };
+static int on_change_groups = 0;
+static uint32_t next_id = 0;
+
+static uint64_t push_now(void)
+{
+	return metrics_now() / 1000000;
+}
+
+/* push_spec_new() - empty spec, the period is in centiseconds */
+struct push_spec *push_spec_new(int mode, unsigned int period)
+{
+	struct push_spec *spec = calloc(1, sizeof(*spec));
+
+	if (!spec)
+		return NULL;
+
+	spec->mode = mode;
+	spec->period = period;
+
+	return spec;
+}
+
+/* push_spec_add() - copy name into one of the spec's name lists */
+int push_spec_add(char **names, int *n, const char *name)
+{
+	if (!name || *n == PUSH_SELECT_MAX || !(names[*n] = strdup(name)))
+		return -1;
+
+	(*n)++;
+
+	return 0;
+}
+
+static void push_spec_release(struct push_spec *spec)
+{
+	int i;
+
+	for (i = 0; i < spec->n_packages; i++)
+		free(spec->packages[i]);
+
+	for (i = 0; i < spec->n_sections; i++)
+		free(spec->sections[i]);
+}
+
+/* push_spec_free() - release spec, NULL is ignored */
+void push_spec_free(struct push_spec *spec)
+{
+	if (!spec)
+		return;
+
+	push_spec_release(spec);
+	free(spec);
+}
+
+/* push_next_id() - id for a new subscription of this worker */
+uint32_t push_next_id(void)
+{
+	return ++next_id;
+}
+
+static int push_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void push_key_names(struct xml_buf *b, const char *what, char **names, int n)
+{
+	char num[24];
+	int i;
+
+	qsort(names, n, sizeof(*names), push_name_cmp);
+
+	xml_buf_puts(b, what);
+	xml_buf_puts(b, "(");
+
+	for (i = 0; i < n; i++)
+	{
+		snprintf(num, sizeof(num), "%zu:", strlen(names[i]));
+		xml_buf_puts(b, num);
+		xml_buf_puts(b, names[i]);
+	}
+
+	xml_buf_puts(b, ")");
+}
+
+/* spec written out with sorted names, equal for subscriptions getting the same updates */
+static char *push_key(struct push_spec *spec)
+{
+	struct xml_buf b = { 0 };
+	char head[48];
+
+	snprintf(head, sizeof(head), "%s/%u", spec->mode == PUSH_PERIODIC ? "periodic" : "on-change", spec->period);
+	xml_buf_puts(&b, head);
+
+	if (spec->uci)
+		push_key_names(&b, " uci", spec->packages, spec->n_packages);
+
+	if (spec->monitoring)
+		push_key_names(&b, " netconf-state", spec->sections, spec->n_sections);
+
+	if (spec->metrics)
+		xml_buf_puts(&b, " metrics");
+
+	if (b.error)
+	{
+		xml_buf_free(&b);
+		return NULL;
+	}
+
+	return b.data;
+}
+
+/*
+ * push_send() - write update to the members of a group
+ *
+ * @struct push_group*:	the group
+ * @const char*:	element of the update
+ * @struct xml_buf*:	everything after the id, freed
+ * @bool:		to members waiting for a full update only
+ *
+ * Returns the number of members left waiting for a full update.
+ */
+static int push_send(struct push_group *g, const char *element, struct xml_buf *body, bool sync)
+{
+	int waiting;
+	char head[256], event_time[32];
+	int len;
+
+	notification_event_time(event_time, sizeof(event_time));
+	len = snprintf(head, sizeof(head), NOTIFICATION_START "%s</eventTime><%s xmlns=\"" PUSH_NS "\"><id>", event_time, element);
+
+	if (body->error || len < 0 || len >= sizeof(head))
+	{
+		ERROR("unable to render push update\n");
+		xml_buf_free(body);
+		return 0;
+	}
+
+	waiting = connection_push(&g->members, head, len, body->data, body->len, sync);
+	xml_buf_free(body);
+
+	return waiting;
+}
+
+/* full contents, to new members or to all of a periodic group */
+static int push_update(struct push_group *g, bool sync)
+{
+	struct push_spec *spec = &g->spec;
+	struct xml_buf body = { 0 };
+
+	xml_buf_puts(&body, "</id><datastore-contents>");
+
+	if (spec->uci)
+		datastore_render(&body, spec->packages, spec->n_packages);
+
+	if (spec->monitoring)
+		monitoring_render(&body, spec->sections, spec->n_sections);
+
+	if (spec->metrics)
+		metrics_render(&body);
+
+	xml_buf_puts(&body, "</datastore-contents></push-update>" NOTIFICATION_END);
+
+	stats.push_updates++;
+
+	return push_send(g, "push-update", &body, sync);
+}
+
+/* packages changed since the previous update, nothing if none of them did */
+static void push_changes(struct push_group *g)
+{
+	struct push_spec *spec = &g->spec;
+	struct xml_buf body = { 0 };
+	int n;
+
+	xml_buf_puts(&body, "</id><datastore-changes>");
+	n = datastore_render_changes(&body, spec->packages, spec->n_packages, g->seen);
+
+	/* rendering may have found more changes on disk, they are included */
+	g->seen = datastore_version();
+
+	if (!n)
+	{
+		xml_buf_free(&body);
+		return;
+	}
+
+	xml_buf_puts(&body, "</datastore-changes></push-change-update>" NOTIFICATION_END);
+
+	stats.push_changes++;
+	g->last = push_now();
+	push_send(g, "push-change-update", &body, false);
+}
+
+/* wake the group once the dampening period since its last update is over */
+static void push_arm(struct push_group *g)
+{
+	uint64_t now = push_now(), due = g->last + g->spec.period * 10;
+
+	timer_set(&g->timer, due > now ? due - now : 0);
+}
+
+static void push_timer_cb(struct timer *t)
+{
+	struct push_group *g = container_of(t, struct push_group, timer);
+	uint64_t now = push_now(), period = g->spec.period * 10;
+
+	if (g->spec.mode == PUSH_ON_CHANGE)
+	{
+		if (g->seen == datastore_version())
+			return;
+
+		if (now >= g->last + period)
+			push_changes(g);
+		else
+			push_arm(g);
+
+		return;
+	}
+
+	if (now >= g->last + period)
+	{
+		push_update(g, false);
+		g->last = now;
+	}
+
+	timer_set(t, g->last + period - now);
+}
+
+/* full update to members that joined, those backed up are tried again */
+static void push_sync_cb(struct timer *t)
+{
+	struct push_group *g = container_of(t, struct push_group, sync_timer);
+
+	if (push_update(g, true) > 0)
+		timer_set(t, PUSH_SYNC_RETRY_MS);
+}
+
+/* datastore watch, on-change groups that are not waiting already are woken */
+static void push_changed(void)
+{
+	struct push_group *g;
+
+	list_for_each_entry(g, &groups, list)
+	{
+		if (g->spec.mode == PUSH_ON_CHANGE && !g->timer.pending)
+			push_arm(g);
+	}
+}
+
+static void push_poll_cb(struct timer *t)
+{
+	datastore_check();
+
+	if (on_change_groups)
+		timer_set(t, PUSH_POLL_MS);
+}
+
+/*
+ * push_group_get() - group for a new subscription
+ *
+ * @struct push_spec*:	what was asked for, taken over
+ *
+ * Returns the group with a reference taken for the subscriber, NULL if a
+ * new group can not be set up.
+ */
+struct push_group *push_group_get(struct push_spec *spec)
+{
+	struct push_group *g;
+	char *key;
+
+	if (!(key = push_key(spec)))
+	{
+		push_spec_free(spec);
+		return NULL;
+	}
+
+	list_for_each_entry(g, &groups, list)
+	{
+		if (!strcmp(g->key, key))
+		{
+			free(key);
+			push_spec_free(spec);
+			g->refs++;
+			return g;
+		}
+	}
+
+	if (!(g = calloc(1, sizeof(*g))))
+	{
+		free(key);
+		push_spec_free(spec);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&g->members);
+	g->refs = 1;
+	g->spec = *spec;
+	g->key = key;
+	g->timer.cb = push_timer_cb;
+	g->sync_timer.cb = push_sync_cb;
+	g->seen = datastore_version();
+	g->last = push_now();
+	free(spec);
+
+	list_add_tail(&g->list, &groups);
+	stats.push_groups++;
+
+	if (g->spec.mode == PUSH_ON_CHANGE && !on_change_groups++)
+		timer_set(&poll_timer, PUSH_POLL_MS);
+	else if (g->spec.mode == PUSH_PERIODIC)
+		timer_set(&g->timer, g->spec.period * 10);
+
+	DEBUG("new push group '%s'\n", key);
+
+	return g;
+}
+
+/* push_group_put() - drop a subscriber's reference, the last one frees the group */
+void push_group_put(struct push_group *g)
+{
+	if (--g->refs)
+		return;
+
+	timer_cancel(&g->timer);
+	timer_cancel(&g->sync_timer);
+	list_del(&g->list);
+
+	if (g->spec.mode == PUSH_ON_CHANGE && !--on_change_groups)
+		timer_cancel(&poll_timer);
+
+	push_spec_release(&g->spec);
+	free(g->key);
+	free(g);
+	stats.push_groups--;
+}
+
+/* push_group_join() - a member was added, it gets a full update right away */
+void push_group_join(struct push_group *g)
+{
+	timer_set(&g->sync_timer, 0);
+}
+
+void push_init(void)
+{
+	datastore_watch(push_changed);
+}
+
+void push_exit(void)
+{
+	datastore_watch(NULL);
+	timer_cancel(&poll_timer);
+}
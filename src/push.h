@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_PUSH_H__
+#define __FREENETCONFD_PUSH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libubox/list.h>
+
+#include "timer.h"
+
+/* RFC 8641 */
+#define PUSH_NS "urn:ietf:params:xml:ns:yang:ietf-yang-push"
+/* RFC 8639, the subscription id in the create-subscription reply */
+#define PUSH_SN_NS "urn:ietf:params:xml:ns:yang:ietf-subscribed-notifications"
+
+/* centiseconds, one timer tick */
+#define PUSH_PERIOD_MIN 10
+/* uci packages or netconf-state sections one subscription may name */
+#define PUSH_SELECT_MAX 32
+
+enum push_mode
+{
+	PUSH_PERIODIC,
+	PUSH_ON_CHANGE,
+};
+
+/* what a subscription asked for, filled in by create-subscription */
+struct push_spec
+{
+	int mode;
+	/* centiseconds, the period or the dampening period */
+	unsigned int period;
+	/* uci packages, all of them if uci is set and there are no names */
+	bool uci;
+	char *packages[PUSH_SELECT_MAX];
+	int n_packages;
+	/* netconf-state sections, likewise */
+	bool monitoring;
+	char *sections[PUSH_SELECT_MAX];
+	int n_sections;
+	bool metrics;
+	uint32_t id;
+};
+
+/* subscriptions with the same spec, updates are rendered once for all */
+struct push_group
+{
+	struct list_head list;
+	/* entries of the subscribers, owned by their sessions */
+	struct list_head members;
+	int refs;
+	struct push_spec spec;
+	char *key;
+	struct timer timer;
+	/* full update to members that joined and did not get one yet */
+	struct timer sync_timer;
+	/* on-change: datastore version covered and time of the last update */
+	uint32_t seen;
+	uint64_t last;
+};
+
+struct push_spec *push_spec_new(int mode, unsigned int period);
+int push_spec_add(char **names, int *n, const char *name);
+void push_spec_free(struct push_spec *spec);
+uint32_t push_next_id(void);
+
+struct push_group *push_group_get(struct push_spec *spec);
+void push_group_put(struct push_group *g);
+void push_group_join(struct push_group *g);
+
+void push_init(void);
+void push_exit(void);
+
+#endif /* __FREENETCONFD_PUSH_H__ */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include <libubox/uloop.h>
+
+#include "netconfd/netconfd.h"
+
+#include "config.h"
+#include "connection.h"
+#include "worker.h"
+#include "reload.h"
+#include "provider.h"
+#include "datastore.h"
+#include "log.h"
+#include "trace.h"
+
+/*
+ * Configuration reload
+ *
+ * SIGHUP is turned into a read event on the loop through a pipe, so the
+ * reload itself runs between callbacks like everything else. Sessions are
+ * kept; new limits apply to them from the next time they are checked.
+ */
+static void reload_signal_cb(struct uloop_fd *fd, unsigned int events);
+
+static struct uloop_fd signal_fd = { .cb = reload_signal_cb, .fd = -1 };
+static int signal_wr = -1;
+
+static void reload_signal_handler(int sig)
+{
+	char c = 0;
+	int errno_saved = errno;
+
+	/* pipe full means a reload is pending already */
+	if (write(signal_wr, &c, 1) < 0)
+		;
+
+	errno = errno_saved;
+}
+
+static void reload_signal_cb(struct uloop_fd *fd, unsigned int events)
+{
+	char buf[16];
+
+	while (read(fd->fd, buf, sizeof(buf)) > 0);
+
+	reload();
+}
+
+/* apply uci config to running worker */
+int reload(void)
+{
+	int rc = config_reload();
+
+	if (rc < 0)
+	{
+		ERROR("configuration reload failed\n");
+		return -1;
+	}
+
+	if (rc & CONFIG_RELOAD_LISTEN)
+		server_rebind();
+
+	if (rc & CONFIG_RELOAD_NOTIFY)
+		subscription_reschedule();
+
+	provider_reload();
+	datastore_reload();
+
+	/* after logrotate moved the file away */
+	log_reopen();
+
+	trace_reload();
+
+	LOG("worker %d reloaded configuration\n", worker_id);
+
+	return 0;
+}
+
+/*
+ * reload_request() - reload all workers
+ *
+ * With several workers the supervisor is asked to pass SIGHUP on to each
+ * of them, this one included.
+ */
+int reload_request(void)
+{
+	if (worker_count > 1)
+		return kill(getppid(), SIGHUP);
+
+	return reload();
+}
+
+int reload_init(void)
+{
+	struct sigaction sa = { .sa_handler = reload_signal_handler, .sa_flags = SA_RESTART };
+	int p[2];
+
+	if (pipe2(p, O_CLOEXEC | O_NONBLOCK))
+		return -1;
+
+	signal_fd.fd = p[0];
+	signal_wr = p[1];
+
+	uloop_fd_add(&signal_fd, ULOOP_READ);
+
+	sigemptyset(&sa.sa_mask);
+
+	return sigaction(SIGHUP, &sa, NULL);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libubox/uloop.h>
+
+#include "netconfd/netconfd.h"
+
+#include "scheduler.h"
+#include "config.h"
+#include "stats.h"
+
+/*
+ * Cross session RPC scheduler
+ *
+ * A session gets one quantum of work when its data arrives. Sessions with
+ * work left after that are queued here and served in deficit round robin
+ * order, one round per event loop iteration, so reads, accepts and timers
+ * of other sessions are handled in between. Sessions are queued by the
+ * class of their next request and higher classes are served first within a
+ * round, which lets lock or kill-session overtake bulk <get>s.
+ */
+#define SCHED_QUANTUM_DEFAULT 65536
+
+static void sched_round_cb(struct uloop_timeout *t);
+
+static struct list_head ready[__SCHED_CLASS_MAX] =
+{
+	LIST_HEAD_INIT(ready[SCHED_CLASS_SESSION]),
+	LIST_HEAD_INIT(ready[SCHED_CLASS_DEFAULT]),
+	LIST_HEAD_INIT(ready[SCHED_CLASS_BULK]),
+};
+
+static struct uloop_timeout round_timer = { .cb = sched_round_cb };
+
+int sched_quantum(void)
+{
+	return config.sched_quantum > 0 ? config.sched_quantum : SCHED_QUANTUM_DEFAULT;
+}
+
+/*
+ * sched_wake() - queue entity with pending work
+ *
+ * @struct sched_entity*:	entity, must not be queued yet
+ * @int:			class of its next work item
+ */
+void sched_wake(struct sched_entity *e, int class)
+{
+	if (e->queued || class == SCHED_CLASS_IDLE)
+		return;
+
+	if (class < 0 || class >= __SCHED_CLASS_MAX)
+		class = SCHED_CLASS_DEFAULT;
+
+	list_add_tail(&e->list, &ready[class]);
+	e->queued = true;
+	stats.sched_queued++;
+
+	if (!round_timer.pending)
+		uloop_timeout_set(&round_timer, 0);
+}
+
+void sched_remove(struct sched_entity *e)
+{
+	if (!e->queued)
+		return;
+
+	list_del(&e->list);
+	e->queued = false;
+	e->deficit = 0;
+	stats.sched_queued--;
+}
+
+static void sched_round_cb(struct uloop_timeout *t)
+{
+	struct list_head round[__SCHED_CLASS_MAX];
+	struct sched_entity *e;
+	int class, next, used;
+	bool more = false;
+
+	stats.sched_rounds++;
+
+	/* entities requeued during this round wait for the next one */
+	for (class = 0; class < __SCHED_CLASS_MAX; class++)
+	{
+		INIT_LIST_HEAD(&round[class]);
+		list_splice_init(&ready[class], &round[class]);
+	}
+
+	for (class = 0; class < __SCHED_CLASS_MAX; class++)
+	{
+		while (!list_empty(&round[class]))
+		{
+			e = list_first_entry(&round[class], struct sched_entity, list);
+			list_del(&e->list);
+			e->queued = false;
+			stats.sched_queued--;
+
+			/* a large message may overdraw, the debt is paid in later rounds */
+			e->deficit += sched_quantum();
+
+			if (e->deficit > 0)
+			{
+				used = e->run(e, e->deficit);
+				e->deficit -= used;
+			}
+
+			next = e->classify(e);
+
+			if (next == SCHED_CLASS_IDLE)
+			{
+				e->deficit = 0;
+				continue;
+			}
+
+			list_add_tail(&e->list, &ready[next]);
+			e->queued = true;
+			stats.sched_queued++;
+		}
+	}
+
+	for (class = 0; class < __SCHED_CLASS_MAX; class++)
+		more |= !list_empty(&ready[class]);
+
+	if (more)
+		uloop_timeout_set(&round_timer, 0);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_SCHEDULER_H__
+#define __FREENETCONFD_SCHEDULER_H__
+
+#include <stdbool.h>
+
+#include <libubox/list.h>
+
+/* operation classes, served in this order every round */
+enum sched_class
+{
+	SCHED_CLASS_SESSION,
+	SCHED_CLASS_DEFAULT,
+	SCHED_CLASS_BULK,
+	__SCHED_CLASS_MAX,
+	SCHED_CLASS_IDLE = -1,
+};
+
+struct sched_entity;
+
+/* process work worth up to budget bytes, return bytes actually used */
+typedef int (*sched_run_handler)(struct sched_entity *e, int budget);
+/* class of the next pending work item, SCHED_CLASS_IDLE if there is none */
+typedef int (*sched_class_handler)(struct sched_entity *e);
+
+struct sched_entity
+{
+	struct list_head list;
+	sched_run_handler run;
+	sched_class_handler classify;
+	int deficit;
+	bool queued;
+};
+
+void sched_wake(struct sched_entity *e, int class);
+void sched_remove(struct sched_entity *e);
+int sched_quantum(void);
+
+#endif /* __FREENETCONFD_SCHEDULER_H__ */
@@ -0,0 +1,784 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <libubox/uloop.h>
+#include <libubox/usock.h>
+
+#include "netconfd/netconfd.h"
+
+#include "config.h"
+#include "connection.h"
+#include "notification.h"
+#include "stats.h"
+#include "worker.h"
+#include "snmp.h"
+
+/*
+ * SNMP trap listener
+ *
+ * SNMPv2c traps (RFC 3416) are received in batches with recvmmsg() and
+ * become notifications of the "snmp" stream. Decoding works on the
+ * received datagram in place, rendering goes into one static buffer, so a
+ * trap storm costs no allocations. Each batch is handed to
+ * connection_notify() in one go, and nothing is decoded while this worker
+ * has no snmp subscribers.
+ *
+ * The port is bound before the workers are forked and only worker 0
+ * reads it. Every worker has its own subscribers, so worker 0 passes each
+ * batch to the others through datagram socket pairs made before the fork,
+ * prefixed with the sender's address.
+ */
+#define SNMP_BATCH 64
+#define SNMP_DATAGRAM_MAX (16 * 1024)
+/* batches per callback before sessions get their turn */
+#define SNMP_ROUNDS 16
+#define SNMP_RCVBUF (4 * 1024 * 1024)
+#define SNMP_RENDER_SIZE (1024 * 1024)
+
+/* BER tags used by SNMP */
+#define BER_INTEGER 0x02
+#define BER_OCTET_STRING 0x04
+#define BER_NULL 0x05
+#define BER_OID 0x06
+#define BER_SEQUENCE 0x30
+#define BER_IP_ADDRESS 0x40
+#define BER_COUNTER32 0x41
+#define BER_GAUGE32 0x42
+#define BER_TIMETICKS 0x43
+#define BER_OPAQUE 0x44
+#define BER_COUNTER64 0x46
+#define BER_NO_SUCH_OBJECT 0x80
+#define BER_NO_SUCH_INSTANCE 0x81
+#define BER_END_OF_MIB_VIEW 0x82
+#define BER_TRAP_V2 0xa7
+
+#define SNMP_VERSION_2C 1
+
+/* 1.3.6.1.2.1.1.3.0 and 1.3.6.1.6.3.1.1.4.1.0 */
+static const uint8_t oid_sys_uptime[] = { 0x2b, 0x06, 0x01, 0x02, 0x01, 0x01, 0x03, 0x00 };
+static const uint8_t oid_trap_oid[] = { 0x2b, 0x06, 0x01, 0x06, 0x03, 0x01, 0x01, 0x04, 0x01, 0x00 };
+
+struct ber
+{
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static void snmp_trap_cb(struct uloop_fd *fd, unsigned int events);
+
+static struct uloop_fd trap_fd = { .cb = snmp_trap_cb, .fd = -1 };
+/* [i][0] is read by worker i, [i][1] written by worker 0 */
+static int (*pairs)[2] = NULL;
+static int pair_count = 0;
+static int stream = -1;
+
+static uint8_t buffers[SNMP_BATCH][SNMP_DATAGRAM_MAX];
+static struct sockaddr_storage sources[SNMP_BATCH];
+static struct iovec iovs[SNMP_BATCH][2];
+static struct mmsghdr msgs[SNMP_BATCH];
+static char rendered[SNMP_RENDER_SIZE];
+
+/* next tag, content in v, single byte tags and definite lengths only */
+static int ber_next(struct ber *b, uint8_t *tag, struct ber *v)
+{
+	size_t len;
+	int n;
+
+	if (b->end - b->p < 2)
+		return -1;
+
+	*tag = *b->p++;
+	len = *b->p++;
+
+	if ((*tag & 0x1f) == 0x1f)
+		return -1;
+
+	if (len & 0x80)
+	{
+		n = len & 0x7f;
+
+		if (!n || n > 4 || b->end - b->p < n)
+			return -1;
+
+		for (len = 0; n--; )
+			len = len << 8 | *b->p++;
+	}
+
+	if (len > (size_t) (b->end - b->p))
+		return -1;
+
+	v->p = b->p;
+	v->end = b->p + len;
+	b->p += len;
+
+	return 0;
+}
+
+static int ber_expect(struct ber *b, uint8_t want, struct ber *v)
+{
+	uint8_t tag;
+
+	if (ber_next(b, &tag, v) || tag != want)
+		return -1;
+
+	return 0;
+}
+
+static int ber_int(const struct ber *v, int64_t *out)
+{
+	size_t len = v->end - v->p, i;
+	int64_t val;
+
+	if (!len || len > 8)
+		return -1;
+
+	val = (int8_t) v->p[0];
+
+	for (i = 1; i < len; i++)
+		val = (int64_t) ((uint64_t) val << 8 | v->p[i]);
+
+	*out = val;
+
+	return 0;
+}
+
+/* unsigned types carry a leading zero byte when their top bit is set */
+static int ber_uint(const struct ber *v, uint64_t *out)
+{
+	const uint8_t *p = v->p;
+	size_t len = v->end - v->p;
+	uint64_t val = 0;
+
+	if (!len || len > 9 || (len == 9 && p[0]))
+		return -1;
+
+	while (len--)
+		val = val << 8 | *p++;
+
+	*out = val;
+
+	return 0;
+}
+
+static bool ber_equal(const struct ber *v, const uint8_t *oid, size_t len)
+{
+	return (size_t) (v->end - v->p) == len && !memcmp(v->p, oid, len);
+}
+
+static struct snmp_slice ber_slice(const struct ber *v)
+{
+	return (struct snmp_slice) { v->p, v->end - v->p };
+}
+
+/*
+ * snmp_trap_decode() - parse SNMPv2c trap
+ *
+ * @const uint8_t*:	datagram
+ * @size_t:		its length
+ * @struct snmp_trap*:	filled with slices of the datagram
+ *
+ * Bindings beyond SNMP_VARBIND_MAX are left out. Returns 0 or -1 if the
+ * datagram is not a well formed v2c trap.
+ */
+int snmp_trap_decode(const uint8_t *data, size_t len, struct snmp_trap *t)
+{
+	struct ber b = { data, data + len }, msg, v, pdu, list, vb, oid, value;
+	int64_t version;
+	uint64_t uptime;
+	uint8_t type;
+	int n = 0;
+
+	if (ber_expect(&b, BER_SEQUENCE, &msg) ||
+	    ber_expect(&msg, BER_INTEGER, &v) || ber_int(&v, &version) || version != SNMP_VERSION_2C ||
+	    ber_expect(&msg, BER_OCTET_STRING, &v))
+		return -1;
+
+	t->community = ber_slice(&v);
+
+	/* request-id, error-status and error-index carry nothing for traps */
+	if (ber_expect(&msg, BER_TRAP_V2, &pdu) ||
+	    ber_expect(&pdu, BER_INTEGER, &v) ||
+	    ber_expect(&pdu, BER_INTEGER, &v) ||
+	    ber_expect(&pdu, BER_INTEGER, &v) ||
+	    ber_expect(&pdu, BER_SEQUENCE, &list))
+		return -1;
+
+	t->n_varbinds = 0;
+
+	while (list.p < list.end)
+	{
+		if (ber_expect(&list, BER_SEQUENCE, &vb) || ber_expect(&vb, BER_OID, &oid) || ber_next(&vb, &type, &value))
+			return -1;
+
+		/* RFC 3416 4.2.6: sysUpTime.0 and snmpTrapOID.0 come first */
+		if (n == 0)
+		{
+			if (!ber_equal(&oid, oid_sys_uptime, sizeof(oid_sys_uptime)) || type != BER_TIMETICKS ||
+			    ber_uint(&value, &uptime) || uptime > UINT32_MAX)
+				return -1;
+
+			t->uptime = uptime;
+		}
+		else if (n == 1)
+		{
+			if (!ber_equal(&oid, oid_trap_oid, sizeof(oid_trap_oid)) || type != BER_OID || value.p == value.end)
+				return -1;
+
+			t->trap_oid = ber_slice(&value);
+		}
+		else if (t->n_varbinds < SNMP_VARBIND_MAX)
+		{
+			t->varbinds[t->n_varbinds++] = (struct snmp_varbind) { ber_slice(&oid), type, ber_slice(&value) };
+		}
+
+		n++;
+	}
+
+	return n < 2 ? -1 : 0;
+}
+
+/* rendering into a fixed buffer, overflow is remembered and checked once */
+struct out
+{
+	char *p;
+	char *end;
+	bool overflow;
+};
+
+static void out_append(struct out *o, const char *s, size_t len)
+{
+	if (o->overflow || len > (size_t) (o->end - o->p))
+	{
+		o->overflow = true;
+		return;
+	}
+
+	memcpy(o->p, s, len);
+	o->p += len;
+}
+
+static void out_puts(struct out *o, const char *s)
+{
+	out_append(o, s, strlen(s));
+}
+
+static void out_printf(struct out *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(struct out *o, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	if (o->overflow)
+		return;
+
+	va_start(ap, fmt);
+	len = vsnprintf(o->p, o->end - o->p, fmt, ap);
+	va_end(ap);
+
+	if (len < 0 || len >= o->end - o->p)
+		o->overflow = true;
+	else
+		o->p += len;
+}
+
+static void out_oid(struct out *o, struct snmp_slice s)
+{
+	uint64_t sub = 0;
+	bool first = true;
+	size_t i;
+
+	for (i = 0; i < s.len; i++)
+	{
+		sub = sub << 7 | (s.p[i] & 0x7f);
+
+		if (s.p[i] & 0x80)
+			continue;
+
+		/* the first byte holds two arcs */
+		if (first)
+		{
+			out_printf(o, "%u.%llu", sub < 80 ? (unsigned int) (sub / 40) : 2,
+				   (unsigned long long) (sub < 80 ? sub % 40 : sub - 80));
+			first = false;
+		}
+		else
+			out_printf(o, ".%llu", (unsigned long long) sub);
+
+		sub = 0;
+	}
+}
+
+static void out_hex(struct out *o, struct snmp_slice s)
+{
+	size_t i;
+
+	for (i = 0; i < s.len; i++)
+		out_printf(o, i ? ":%02x" : "%02x", s.p[i]);
+}
+
+static bool snmp_printable(struct snmp_slice s)
+{
+	size_t i;
+
+	for (i = 0; i < s.len; i++)
+	{
+		if ((s.p[i] < 0x20 && s.p[i] != '\t' && s.p[i] != '\n' && s.p[i] != '\r') || s.p[i] >= 0x7f)
+			return false;
+	}
+
+	return true;
+}
+
+static void out_escape(struct out *o, struct snmp_slice s)
+{
+	size_t i, start = 0;
+	const char *rep;
+
+	for (i = 0; i < s.len; i++)
+	{
+		switch (s.p[i])
+		{
+			case '<': rep = "&lt;"; break;
+			case '>': rep = "&gt;"; break;
+			case '&': rep = "&amp;"; break;
+			case '"': rep = "&quot;"; break;
+			default: continue;
+		}
+
+		out_append(o, (const char *) s.p + start, i - start);
+		out_puts(o, rep);
+		start = i + 1;
+	}
+
+	out_append(o, (const char *) s.p + start, s.len - start);
+}
+
+static void out_value(struct out *o, uint8_t type, struct snmp_slice v)
+{
+	struct ber b = { v.p, v.p + v.len };
+	uint64_t u;
+	int64_t i;
+
+	switch (type)
+	{
+		case BER_INTEGER:
+			if (ber_int(&b, &i))
+				break;
+
+			out_printf(o, "<integer>%lld</integer>", (long long) i);
+			return;
+
+		case BER_OCTET_STRING:
+			if (!snmp_printable(v))
+			{
+				out_puts(o, "<hex-string>");
+				out_hex(o, v);
+				out_puts(o, "</hex-string>");
+				return;
+			}
+
+			out_puts(o, "<octet-string>");
+			out_escape(o, v);
+			out_puts(o, "</octet-string>");
+			return;
+
+		case BER_NULL:
+			out_puts(o, "<null/>");
+			return;
+
+		case BER_OID:
+			out_puts(o, "<object-id>");
+			out_oid(o, v);
+			out_puts(o, "</object-id>");
+			return;
+
+		case BER_IP_ADDRESS:
+			if (v.len != 4)
+				break;
+
+			out_printf(o, "<ip-address>%u.%u.%u.%u</ip-address>", v.p[0], v.p[1], v.p[2], v.p[3]);
+			return;
+
+		case BER_COUNTER32:
+		case BER_GAUGE32:
+		case BER_TIMETICKS:
+		case BER_COUNTER64:
+			if (ber_uint(&b, &u))
+				break;
+
+			out_printf(o, "<%s>%llu</%s>",
+				   type == BER_COUNTER32 ? "counter32" : type == BER_GAUGE32 ? "gauge32" :
+				   type == BER_TIMETICKS ? "timeticks" : "counter64",
+				   (unsigned long long) u,
+				   type == BER_COUNTER32 ? "counter32" : type == BER_GAUGE32 ? "gauge32" :
+				   type == BER_TIMETICKS ? "timeticks" : "counter64");
+			return;
+
+		case BER_NO_SUCH_OBJECT:
+			out_puts(o, "<no-such-object/>");
+			return;
+
+		case BER_NO_SUCH_INSTANCE:
+			out_puts(o, "<no-such-instance/>");
+			return;
+
+		case BER_END_OF_MIB_VIEW:
+			out_puts(o, "<end-of-mib-view/>");
+			return;
+	}
+
+	/* opaque, unknown types and values that do not fit their type */
+	out_printf(o, "<opaque type=\"%u\">", type);
+	out_hex(o, v);
+	out_puts(o, "</opaque>");
+}
+
+/*
+ * snmp_trap_render() - trap as notification message
+ *
+ * @const struct snmp_trap*:	decoded trap
+ * @const char*:		address of the sender
+ * @const char*:		eventTime value
+ * @char*:			output buffer
+ * @size_t:			its size
+ *
+ * Returns the message length or -1 if it does not fit.
+ */
+int snmp_trap_render(const struct snmp_trap *t, const char *source, const char *event_time, char *buf, size_t size)
+{
+	struct out o = { buf, buf + size, false };
+	int i;
+
+	out_puts(&o, "<notification xmlns=\"urn:ietf:params:xml:ns:netconf:notification:1.0\"><eventTime>");
+	out_puts(&o, event_time);
+	out_puts(&o, "</eventTime><snmp-trap xmlns=\"" SNMP_NS "\"><source>");
+	out_puts(&o, source);
+	out_printf(&o, "</source><uptime>%u</uptime><trap-oid>", t->uptime);
+	out_oid(&o, t->trap_oid);
+	out_puts(&o, "</trap-oid><varbinds>");
+
+	for (i = 0; i < t->n_varbinds; i++)
+	{
+		out_puts(&o, "<varbind><oid>");
+		out_oid(&o, t->varbinds[i].oid);
+		out_puts(&o, "</oid>");
+		out_value(&o, t->varbinds[i].type, t->varbinds[i].value);
+		out_puts(&o, "</varbind>");
+	}
+
+	out_puts(&o, "</varbinds></snmp-trap></notification>");
+
+	if (o.overflow)
+		return -1;
+
+	return o.p - buf;
+}
+
+static void snmp_source(const struct sockaddr_storage *ss, char *buf, size_t size)
+{
+	const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) ss;
+	const struct sockaddr_in *sin = (const struct sockaddr_in *) ss;
+
+	buf[0] = '\0';
+
+	if (ss->ss_family == AF_INET)
+		inet_ntop(AF_INET, &sin->sin_addr, buf, size);
+	else if (ss->ss_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr))
+		inet_ntop(AF_INET, &sin6->sin6_addr.s6_addr[12], buf, size);
+	else if (ss->ss_family == AF_INET6)
+		inet_ntop(AF_INET6, &sin6->sin6_addr, buf, size);
+}
+
+static bool snmp_community_ok(const struct snmp_trap *t)
+{
+	size_t len;
+
+	if (!config.snmp_community)
+		return true;
+
+	len = strlen(config.snmp_community);
+
+	return t->community.len == len && !memcmp(t->community.p, config.snmp_community, len);
+}
+
+/* decode and send n received traps, data at iov 1 and sender in sources */
+static void snmp_handle(int n)
+{
+	static struct snmp_trap trap;
+	char *out[NOTIFICATION_BATCH], event_time[32], source[INET6_ADDRSTRLEN];
+	size_t lens[NOTIFICATION_BATCH], used = 0;
+	int i, k = 0, len;
+
+	stats.snmp_traps += n;
+
+	if (!connection_subscribers(stream))
+		return;
+
+	notification_event_time(event_time, sizeof(event_time));
+
+	for (i = 0; i < n; i++)
+	{
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC || msgs[i].msg_len < sizeof(sources[i]))
+		{
+			stats.snmp_dropped++;
+			continue;
+		}
+
+		if (snmp_trap_decode(buffers[i], msgs[i].msg_len - sizeof(sources[i]), &trap))
+		{
+			stats.snmp_malformed++;
+			continue;
+		}
+
+		if (!snmp_community_ok(&trap))
+		{
+			stats.snmp_rejected++;
+			continue;
+		}
+
+		snmp_source(&sources[i], source, sizeof(source));
+
+		len = snmp_trap_render(&trap, source, event_time, rendered + used, sizeof(rendered) - used);
+
+		/* buffer full, send what is there and start over */
+		if (len < 0 && k)
+		{
+			connection_notify(stream, out, lens, k);
+			k = 0;
+			used = 0;
+			len = snmp_trap_render(&trap, source, event_time, rendered, sizeof(rendered));
+		}
+
+		if (len < 0)
+		{
+			stats.snmp_dropped++;
+			continue;
+		}
+
+		out[k] = rendered + used;
+		lens[k++] = len;
+		used += len;
+		stats.notifications++;
+
+		if (k == NOTIFICATION_BATCH)
+		{
+			connection_notify(stream, out, lens, k);
+			k = 0;
+			used = 0;
+		}
+	}
+
+	if (k)
+		connection_notify(stream, out, lens, k);
+}
+
+/* pass batch received by worker 0 on to the other workers */
+static void snmp_forward(int n)
+{
+	int i, sent;
+
+	for (i = 1; i < pair_count; i++)
+	{
+		sent = sendmmsg(pairs[i][1], msgs, n, MSG_DONTWAIT);
+
+		if (sent < n)
+			stats.snmp_dropped += n - (sent > 0 ? sent : 0);
+	}
+}
+
+/* received length includes the sender address, as it does when forwarded */
+static void snmp_batch_prepare(bool udp)
+{
+	int i;
+
+	for (i = 0; i < SNMP_BATCH; i++)
+	{
+		iovs[i][0] = (struct iovec) { &sources[i], sizeof(sources[i]) };
+		iovs[i][1] = (struct iovec) { buffers[i], sizeof(buffers[i]) };
+
+		msgs[i].msg_hdr = (struct msghdr)
+		{
+			.msg_name = udp ? &sources[i] : NULL,
+			.msg_namelen = udp ? sizeof(sources[i]) : 0,
+			.msg_iov = udp ? &iovs[i][1] : iovs[i],
+			.msg_iovlen = udp ? 1 : 2,
+		};
+	}
+}
+
+static void snmp_trap_cb(struct uloop_fd *fd, unsigned int events)
+{
+	bool udp = worker_id == 0;
+	int n, i, rounds = 0;
+
+	do
+	{
+		snmp_batch_prepare(udp);
+
+		if ((n = recvmmsg(fd->fd, msgs, SNMP_BATCH, MSG_DONTWAIT, NULL)) <= 0)
+			break;
+
+		if (udp)
+		{
+			/* same layout as forwarded batches: sender address, then datagram */
+			for (i = 0; i < n; i++)
+			{
+				msgs[i].msg_len += sizeof(sources[i]);
+				msgs[i].msg_hdr.msg_iov = iovs[i];
+				msgs[i].msg_hdr.msg_iovlen = 2;
+				iovs[i][1].iov_len = msgs[i].msg_len - sizeof(sources[i]);
+				msgs[i].msg_hdr.msg_name = NULL;
+				msgs[i].msg_hdr.msg_namelen = 0;
+			}
+
+			snmp_forward(n);
+		}
+
+		snmp_handle(n);
+	}
+	while (n == SNMP_BATCH && ++rounds < SNMP_ROUNDS);
+}
+
+/*
+ * snmp_init() - bind trap port before the workers are forked
+ *
+ * @int:	number of workers, each but the first gets a socket pair
+ *
+ * Does nothing unless snmp_trap_port is set.
+ */
+int snmp_init(int workers)
+{
+	int size = SNMP_RCVBUF, i;
+
+	if (!config.snmp_trap_port)
+		return 0;
+
+	trap_fd.fd = usock(USOCK_UDP | USOCK_SERVER | USOCK_NONBLOCK, config.snmp_trap_addr, config.snmp_trap_port);
+
+	if (trap_fd.fd < 0)
+	{
+		ERROR("unable to open snmp trap socket %s:%s\n", config.snmp_trap_addr ? config.snmp_trap_addr : "*", config.snmp_trap_port);
+		return -1;
+	}
+
+	/* storms are absorbed by the socket while a batch is handled */
+	if (setsockopt(trap_fd.fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+		setsockopt(trap_fd.fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	if (workers <= 1)
+		return 0;
+
+	if (!(pairs = calloc(workers, sizeof(*pairs))))
+		return -1;
+
+	pair_count = workers;
+
+	for (i = 0; i < workers; i++)
+	{
+		pairs[i][0] = pairs[i][1] = -1;
+
+		if (i && socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pairs[i]))
+		{
+			ERROR("unable to create snmp socket pair\n");
+			return -1;
+		}
+
+		if (i && setsockopt(pairs[i][0], SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+			setsockopt(pairs[i][0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+
+	return 0;
+}
+
+/* worker 0 reads the port, the others their end of a socket pair */
+int snmp_start(void)
+{
+	int i;
+
+	if (trap_fd.fd < 0)
+		return 0;
+
+	stream = connection_stream_id("snmp");
+
+	for (i = 1; i < pair_count; i++)
+	{
+		if (i != worker_id)
+		{
+			close(pairs[i][0]);
+			pairs[i][0] = -1;
+		}
+
+		if (worker_id)
+		{
+			close(pairs[i][1]);
+			pairs[i][1] = -1;
+		}
+	}
+
+	if (worker_id)
+	{
+		close(trap_fd.fd);
+		trap_fd.fd = pairs[worker_id][0];
+		pairs[worker_id][0] = -1;
+	}
+
+	if (uloop_fd_add(&trap_fd, ULOOP_READ))
+		return -1;
+
+	if (!worker_id)
+		LOG("receiving snmp traps on port %s\n", config.snmp_trap_port);
+
+	return 0;
+}
+
+void snmp_exit(void)
+{
+	int i;
+
+	if (trap_fd.fd >= 0)
+	{
+		if (trap_fd.registered)
+			uloop_fd_delete(&trap_fd);
+
+		close(trap_fd.fd);
+		trap_fd.fd = -1;
+	}
+
+	for (i = 0; i < pair_count; i++)
+	{
+		if (pairs[i][0] >= 0)
+			close(pairs[i][0]);
+
+		if (pairs[i][1] >= 0)
+			close(pairs[i][1]);
+	}
+
+	free(pairs);
+	pairs = NULL;
+	pair_count = 0;
+}
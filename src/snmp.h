@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_SNMP_H__
+#define __FREENETCONFD_SNMP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNMP_NS "urn:netconfd:snmp"
+
+/* variable bindings kept per trap, after sysUpTime.0 and snmpTrapOID.0 */
+#define SNMP_VARBIND_MAX 64
+
+/* part of the received datagram, nothing is copied */
+struct snmp_slice
+{
+	const uint8_t *p;
+	size_t len;
+};
+
+struct snmp_varbind
+{
+	struct snmp_slice oid;
+	uint8_t type;
+	struct snmp_slice value;
+};
+
+struct snmp_trap
+{
+	struct snmp_slice community;
+	uint32_t uptime;
+	struct snmp_slice trap_oid;
+	int n_varbinds;
+	struct snmp_varbind varbinds[SNMP_VARBIND_MAX];
+};
+
+int snmp_init(int workers);
+int snmp_start(void);
+void snmp_exit(void);
+
+int snmp_trap_decode(const uint8_t *data, size_t len, struct snmp_trap *t);
+int snmp_trap_render(const struct snmp_trap *t, const char *source, const char *event_time, char *buf, size_t size);
+
+#endif /* __FREENETCONFD_SNMP_H__ */
@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <libubox/uloop.h>
+#include <libssh/libssh.h>
+#include <libssh/server.h>
+
+#include "netconfd/netconfd.h"
+
+#include "config.h"
+#include "connection.h"
+#include "monitoring.h"
+#include "ssh.h"
+
+/*
+ * NETCONF over SSH, RFC 6242
+ *
+ * The listener accepts on the event loop, everything else happens on one
+ * thread per session: key exchange, public key authentication, opening the
+ * "netconf" subsystem and afterwards encryption of all traffic. Once the
+ * subsystem is up the thread hands the other end of a socket pair to the
+ * event loop, which runs the session like any tcp one, and shuffles data
+ * between the channel and the socket pair until either side closes.
+ */
+#define SSH_BRIDGE_BUFFER 16384
+#define SSH_SUBSYSTEM "netconf"
+
+struct ssh_conn
+{
+	ssh_session session;
+	ssh_channel channel;
+	/* thread end of the socket pair */
+	int fd;
+	/* until the subsystem is open */
+	struct handshake *handshake;
+};
+
+static void ssh_accept_cb(struct uloop_fd *fd, unsigned int events);
+
+static struct uloop_fd listener = { .cb = ssh_accept_cb, .fd = -1 };
+static ssh_bind sshbind = NULL;
+
+/* loaded once at startup, only read by session threads */
+static ssh_key *authorized_keys = NULL;
+static int authorized_count = 0;
+
+/*
+ * ssh_load_authorized_keys() - read OpenSSH authorized_keys file
+ *
+ * Only "type base64 [comment]" lines are understood, lines with options in
+ * front of the key are skipped.
+ */
+static int ssh_load_authorized_keys(const char *path)
+{
+	char line[8192], *type, *b64, *save;
+	ssh_key key, *keys;
+	FILE *f;
+
+	if (!(f = fopen(path, "r")))
+	{
+		ERROR("unable to open %s\n", path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f))
+	{
+		if (!(type = strtok_r(line, " \t\r\n", &save)) || *type == '#')
+			continue;
+
+		if (!(b64 = strtok_r(NULL, " \t\r\n", &save)))
+			continue;
+
+		if (ssh_pki_import_pubkey_base64(b64, ssh_key_type_from_name(type), &key) != SSH_OK)
+		{
+			LOG("skipping unsupported key in %s\n", path);
+			continue;
+		}
+
+		if (!(keys = realloc(authorized_keys, (authorized_count + 1) * sizeof(*keys))))
+		{
+			ssh_key_free(key);
+			break;
+		}
+
+		authorized_keys = keys;
+		authorized_keys[authorized_count++] = key;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static bool ssh_authorized(ssh_key key)
+{
+	int i;
+
+	if (!key)
+		return false;
+
+	for (i = 0; i < authorized_count; i++)
+	{
+		if (!ssh_key_cmp(key, authorized_keys[i], SSH_KEY_CMP_PUBLIC))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * ssh_session_setup() - authenticate client and open netconf subsystem
+ *
+ * Returns 0 once the subsystem is open and -1 if the client went away or
+ * the handshake timed out.
+ */
+static int ssh_session_setup(struct ssh_conn *sc)
+{
+	bool authenticated = false;
+	ssh_message msg;
+
+	while ((msg = ssh_message_get(sc->session)))
+	{
+		switch (ssh_message_type(msg))
+		{
+			case SSH_REQUEST_AUTH:
+				if (ssh_message_subtype(msg) != SSH_AUTH_METHOD_PUBLICKEY ||
+					!ssh_authorized(ssh_message_auth_pubkey(msg)))
+				{
+					ssh_message_auth_set_methods(msg, SSH_AUTH_METHOD_PUBLICKEY);
+					break;
+				}
+
+				/* a probe without signature is answered with pk_ok first */
+				switch (ssh_message_auth_publickey_state(msg))
+				{
+					case SSH_PUBLICKEY_STATE_NONE:
+						ssh_message_auth_reply_pk_ok_simple(msg);
+						ssh_message_free(msg);
+						continue;
+
+					case SSH_PUBLICKEY_STATE_VALID:
+						ssh_message_auth_reply_success(msg, 0);
+						ssh_message_free(msg);
+						authenticated = true;
+						continue;
+
+					default:
+						ssh_message_auth_set_methods(msg, SSH_AUTH_METHOD_PUBLICKEY);
+						break;
+				}
+
+				break;
+
+			case SSH_REQUEST_CHANNEL_OPEN:
+				if (!authenticated || sc->channel || ssh_message_subtype(msg) != SSH_CHANNEL_SESSION)
+					break;
+
+				sc->channel = ssh_message_channel_request_open_reply_accept(msg);
+				ssh_message_free(msg);
+				continue;
+
+			case SSH_REQUEST_CHANNEL:
+				if (!sc->channel || ssh_message_subtype(msg) != SSH_CHANNEL_REQUEST_SUBSYSTEM)
+					break;
+
+				if (strcmp(ssh_message_channel_request_subsystem(msg), SSH_SUBSYSTEM))
+					break;
+
+				ssh_message_channel_request_reply_success(msg);
+				ssh_message_free(msg);
+				return 0;
+		}
+
+		ssh_message_reply_default(msg);
+		ssh_message_free(msg);
+	}
+
+	return -1;
+}
+
+static int ssh_write_all(int fd, const char *buf, int len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return -1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* copy data between channel and socket pair until either side closes */
+static void ssh_bridge(struct ssh_conn *sc)
+{
+	struct pollfd pfd[2] =
+	{
+		{ .fd = ssh_get_fd(sc->session), .events = POLLIN },
+		{ .fd = sc->fd, .events = POLLIN },
+	};
+	char buf[SSH_BRIDGE_BUFFER];
+	int n;
+
+	while (1)
+	{
+		/* libssh may already hold decrypted data, drain it before polling */
+		while ((n = ssh_channel_read_nonblocking(sc->channel, buf, sizeof(buf), 0)) > 0)
+		{
+			if (ssh_write_all(sc->fd, buf, n))
+				return;
+		}
+
+		if (n == SSH_ERROR || ssh_channel_is_eof(sc->channel) || !ssh_channel_is_open(sc->channel))
+			return;
+
+		if (poll(pfd, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		if (!pfd[1].revents)
+			continue;
+
+		n = read(sc->fd, buf, sizeof(buf));
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		/* session closed by netconfd */
+		if (n <= 0)
+			return;
+
+		if (ssh_channel_write(sc->channel, buf, n) != n)
+			return;
+	}
+}
+
+static void *ssh_session_thread(void *arg)
+{
+	struct ssh_conn *sc = arg;
+	int sp[2], rc;
+
+	if (ssh_handle_key_exchange(sc->session) != SSH_OK)
+	{
+		LOG("ssh key exchange failed: %s\n", ssh_get_error(sc->session));
+		goto exit;
+	}
+
+	if (ssh_session_setup(sc))
+	{
+		LOG("ssh session setup failed: %s\n", ssh_get_error(sc->session));
+		goto exit;
+	}
+
+	rc = connection_handshake_done(sc->handshake);
+	sc->handshake = NULL;
+
+	if (rc)
+		goto exit;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sp))
+	{
+		ERROR("unable to create socket pair\n");
+		goto exit;
+	}
+
+	if (connection_handoff(sp[1], TRANSPORT_SSH, ssh_get_fd(sc->session)))
+	{
+		ERROR("unable to hand over ssh session\n");
+		close(sp[0]);
+		close(sp[1]);
+		goto exit;
+	}
+
+	sc->fd = sp[0];
+
+	LOG("ssh session established\n");
+
+	ssh_bridge(sc);
+
+exit:
+	/* before ssh_free() closes the socket */
+	if (sc->handshake)
+		connection_handshake_done(sc->handshake);
+
+	if (sc->fd >= 0)
+		close(sc->fd);
+
+	if (sc->channel)
+	{
+		ssh_channel_send_eof(sc->channel);
+		ssh_channel_close(sc->channel);
+		ssh_channel_free(sc->channel);
+	}
+
+	ssh_disconnect(sc->session);
+	ssh_free(sc->session);
+	free(sc);
+
+	return NULL;
+}
+
+static void ssh_accept_cb(struct uloop_fd *fd, unsigned int events)
+{
+	struct handshake *handshake;
+	struct ssh_conn *sc;
+	pthread_attr_t attr;
+	pthread_t thread;
+	long timeout = config.hello_timeout;
+	int sfd;
+
+	/* the session thread does blocking io on it */
+	sfd = accept4(fd->fd, NULL, NULL, SOCK_CLOEXEC);
+
+	if (sfd < 0)
+	{
+		ERROR("failed accepting ssh connection\n");
+		return;
+	}
+
+	LOG("received new ssh connection\n");
+
+	if (!(handshake = connection_handshake_start(sfd)))
+	{
+		close(sfd);
+		return;
+	}
+
+	if (!(sc = calloc(1, sizeof(*sc))) || !(sc->session = ssh_new()))
+	{
+		ERROR("not enough memory to accept ssh connection\n");
+		connection_handshake_done(handshake);
+		free(sc);
+		close(sfd);
+		return;
+	}
+
+	sc->fd = -1;
+	sc->handshake = handshake;
+
+	/* bounds each read, connection_handshake_start() the whole handshake */
+	if (timeout > 0)
+		ssh_options_set(sc->session, SSH_OPTIONS_TIMEOUT, &timeout);
+
+	if (ssh_bind_accept_fd(sshbind, sc->session, sfd) != SSH_OK)
+	{
+		ERROR("ssh accept failed: %s\n", ssh_get_error(sshbind));
+		connection_handshake_done(handshake);
+
+		/* the session owns the socket only if it got that far */
+		if (ssh_get_fd(sc->session) != sfd)
+			close(sfd);
+
+		ssh_free(sc->session);
+		free(sc);
+		return;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attr, ssh_session_thread, sc))
+	{
+		ERROR("fail to create ssh session thread\n");
+		connection_handshake_done(handshake);
+		ssh_disconnect(sc->session);
+		ssh_free(sc->session);
+		free(sc);
+	}
+
+	pthread_attr_destroy(&attr);
+}
+
+/*
+ * ssh_server_init() - start ssh listener
+ *
+ * Does nothing unless a host key is configured.
+ */
+int ssh_server_init(void)
+{
+	if (!config.ssh_hostkey)
+		return 0;
+
+	if (ssh_init() != SSH_OK)
+	{
+		ERROR("libssh init failed\n");
+		return -1;
+	}
+
+	if (ssh_load_authorized_keys(config.ssh_authorized_keys))
+		return -1;
+
+	if (!(sshbind = ssh_bind_new()))
+		return -1;
+
+	if (ssh_bind_options_set(sshbind, SSH_BIND_OPTIONS_HOSTKEY, config.ssh_hostkey) != SSH_OK)
+	{
+		ERROR("unable to load ssh host key %s\n", config.ssh_hostkey);
+		return -1;
+	}
+
+	listener.fd = connection_listen(config.addr, config.ssh_port);
+
+	if (listener.fd < 0)
+	{
+		ERROR("unable to open ssh socket %s:%s\n", config.addr, config.ssh_port);
+		return -1;
+	}
+
+	uloop_fd_add(&listener, ULOOP_READ);
+
+	LOG("accepting ssh connections on '%s:%s'\n", config.addr, config.ssh_port);
+
+	return 0;
+}
+
+void ssh_server_exit(void)
+{
+	int i;
+
+	if (listener.fd >= 0)
+	{
+		uloop_fd_delete(&listener);
+		close(listener.fd);
+		listener.fd = -1;
+	}
+
+	if (sshbind)
+	{
+		ssh_bind_free(sshbind);
+		ssh_finalize();
+	}
+
+	sshbind = NULL;
+
+	for (i = 0; i < authorized_count; i++)
+		ssh_key_free(authorized_keys[i]);
+
+	free(authorized_keys);
+	authorized_keys = NULL;
+	authorized_count = 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_SSH_H__
+#define __FREENETCONFD_SSH_H__
+
+#ifdef ENABLE_SSH
+int ssh_server_init(void);
+void ssh_server_exit(void);
+#else
+static inline int ssh_server_init(void) { return 0; }
+static inline void ssh_server_exit(void) { }
+#endif
+
+#endif /* __FREENETCONFD_SSH_H__ */
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libubox/blobmsg.h>
+
+#include "netconfd/arena.h"
+
+#include "stats.h"
+#include "timer.h"
+#include "worker.h"
+#include "log.h"
+#include "notification.h"
+
+struct stats stats;
+
+/* render counters as ubus reply */
+void stats_to_blob(struct blob_buf *b)
+{
+	void *t;
+
+	blobmsg_add_u32(b, "worker", worker_id);
+
+	t = blobmsg_open_table(b, "sessions");
+	blobmsg_add_u32(b, "active", stats.sessions);
+	blobmsg_add_u32(b, "subscribers", stats.subscribers);
+	blobmsg_add_u64(b, "accepted", stats.sessions_accepted);
+	blobmsg_add_u64(b, "rejected", stats.sessions_rejected);
+	blobmsg_add_u64(b, "handshakes_rejected", stats.handshakes_rejected);
+	blobmsg_add_u64(b, "handshakes_expired", stats.handshakes_expired);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "rpc");
+	blobmsg_add_u64(b, "requests", stats.rpcs);
+	blobmsg_add_u64(b, "errors", stats.rpc_errors);
+	blobmsg_add_u64(b, "bytes_in", stats.bytes_in);
+	blobmsg_add_u64(b, "bytes_out", stats.bytes_out);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "queues");
+	blobmsg_add_u32(b, "sched_queued", stats.sched_queued);
+	blobmsg_add_u64(b, "sched_rounds", stats.sched_rounds);
+	blobmsg_add_u32(b, "timers", timer_count());
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "notifications");
+	blobmsg_add_u64(b, "received", stats.notifications);
+	blobmsg_add_u64(b, "sent", stats.notifications_sent);
+	blobmsg_add_u64(b, "dropped", stats.notifications_dropped);
+	blobmsg_add_u64(b, "filtered", stats.notifications_filtered);
+	blobmsg_add_u32(b, "filter_groups", stats.filter_groups);
+	blobmsg_add_u32(b, "queued", notification_bus_queued());
+	blobmsg_add_u64(b, "queue_dropped", notification_bus_dropped());
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "providers");
+	blobmsg_add_u64(b, "calls", stats.provider_calls);
+	blobmsg_add_u64(b, "cache_hits", stats.provider_cache_hits);
+	blobmsg_add_u64(b, "errors", stats.provider_errors);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "datastore");
+	blobmsg_add_u64(b, "loads", stats.datastore_loads);
+	blobmsg_add_u64(b, "hits", stats.datastore_hits);
+	blobmsg_add_u64(b, "commits", stats.datastore_commits);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "snmp");
+	blobmsg_add_u64(b, "traps", stats.snmp_traps);
+	blobmsg_add_u64(b, "malformed", stats.snmp_malformed);
+	blobmsg_add_u64(b, "rejected", stats.snmp_rejected);
+	blobmsg_add_u64(b, "dropped", stats.snmp_dropped);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "push");
+	blobmsg_add_u32(b, "groups", stats.push_groups);
+	blobmsg_add_u64(b, "updates", stats.push_updates);
+	blobmsg_add_u64(b, "changes", stats.push_changes);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "reply_cache");
+	blobmsg_add_u64(b, "hits", stats.cache_hits);
+	blobmsg_add_u64(b, "misses", stats.cache_misses);
+	blobmsg_add_u64(b, "evictions", stats.cache_evictions);
+	blobmsg_add_u64(b, "invalidations", stats.cache_invalidations);
+	blobmsg_add_u32(b, "entries", stats.cache_entries);
+	blobmsg_add_u64(b, "bytes", stats.cache_bytes);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "change_log");
+	blobmsg_add_u64(b, "incremental", stats.changes_incremental);
+	blobmsg_add_u64(b, "full", stats.changes_full);
+	blobmsg_add_u32(b, "entries", stats.change_log_entries);
+	blobmsg_add_u64(b, "bytes", stats.change_log_bytes);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "compression");
+	blobmsg_add_u32(b, "sessions", stats.compress_sessions);
+	blobmsg_add_u64(b, "in_raw", stats.compress_in_raw);
+	blobmsg_add_u64(b, "in_wire", stats.compress_in_wire);
+	blobmsg_add_u64(b, "out_raw", stats.compress_out_raw);
+	blobmsg_add_u64(b, "out_wire", stats.compress_out_wire);
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "log");
+	blobmsg_add_u64(b, "dropped", log_dropped());
+	blobmsg_close_table(b, t);
+
+	t = blobmsg_open_table(b, "arena");
+	blobmsg_add_u64(b, "allocs", arena_stats.allocs);
+	blobmsg_add_u64(b, "bytes", arena_stats.bytes);
+	blobmsg_add_u64(b, "chunks", arena_stats.chunks);
+	blobmsg_add_u64(b, "resets", arena_stats.resets);
+	blobmsg_add_u64(b, "high_water", arena_stats.high_water);
+	blobmsg_close_table(b, t);
+}
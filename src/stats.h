@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_STATS_H__
+#define __FREENETCONFD_STATS_H__
+
+#include <stdint.h>
+
+/* per worker, only touched from the event loop */
+struct stats
+{
+	/* gauges */
+	uint32_t sessions;
+	uint32_t subscribers;
+	uint32_t filter_groups;
+	uint32_t push_groups;
+	uint32_t cache_entries;
+	uint64_t cache_bytes;
+	uint32_t change_log_entries;
+	uint64_t change_log_bytes;
+	uint32_t compress_sessions;
+	uint32_t sched_queued;
+
+	/* counters */
+	uint64_t sessions_accepted;
+	uint64_t sessions_rejected;
+	uint64_t handshakes_rejected;
+	uint64_t handshakes_expired;
+	uint64_t rpcs;
+	uint64_t rpc_errors;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t sched_rounds;
+	uint64_t notifications;
+	uint64_t notifications_sent;
+	uint64_t notifications_dropped;
+	uint64_t notifications_filtered;
+	uint64_t provider_calls;
+	uint64_t provider_cache_hits;
+	uint64_t provider_errors;
+	uint64_t datastore_loads;
+	uint64_t datastore_hits;
+	uint64_t datastore_commits;
+	uint64_t snmp_traps;
+	uint64_t snmp_malformed;
+	uint64_t snmp_rejected;
+	uint64_t snmp_dropped;
+	uint64_t push_updates;
+	uint64_t push_changes;
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t cache_evictions;
+	uint64_t cache_invalidations;
+	uint64_t changes_incremental;
+	uint64_t changes_full;
+	/* compressed sessions, xml and wire bytes each way */
+	uint64_t compress_in_raw;
+	uint64_t compress_in_wire;
+	uint64_t compress_out_raw;
+	uint64_t compress_out_wire;
+};
+
+extern struct stats stats;
+
+struct blob_buf;
+
+void stats_to_blob(struct blob_buf *b);
+
+#endif /* __FREENETCONFD_STATS_H__ */
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include <libubox/uloop.h>
+
+#include "netconfd/netconfd.h"
+
+#include "timer.h"
+
+/*
+ * Hierarchical timer wheel
+ *
+ * Session timers are armed and re-armed on every message, so instead of one
+ * uloop_timeout each (kept in a sorted list by uloop) they live in a wheel of
+ * TIMER_LEVELS levels with TIMER_SLOTS slots. Level 0 has tick resolution,
+ * each further level is TIMER_SLOTS times coarser. Arming and cancelling are
+ * O(1) list operations; timers in higher levels are cascaded down when the
+ * level below wraps. A single uloop_timeout drives the wheel; it sleeps until
+ * the next occupied slot or cascade and is stopped while nothing is pending.
+ */
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_MASK (TIMER_SLOTS - 1)
+#define TIMER_LEVELS 4
+#define TIMER_MAX_TICKS ((1ULL << (TIMER_BITS * TIMER_LEVELS)) - 1)
+
+static void timer_tick_cb(struct uloop_timeout *t);
+
+static struct list_head wheel[TIMER_LEVELS][TIMER_SLOTS];
+static struct uloop_timeout tick = { .cb = timer_tick_cb };
+static uint64_t current = 0;
+static uint64_t start_ms = 0;
+static unsigned int pending = 0;
+static bool initialized = false;
+static bool running = false;
+
+static uint64_t timer_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t timer_now_ticks(void)
+{
+	return (timer_now_ms() - start_ms) / TIMER_TICK_MS;
+}
+
+static void timer_wheel_init(void)
+{
+	int level, slot;
+
+	for (level = 0; level < TIMER_LEVELS; level++)
+		for (slot = 0; slot < TIMER_SLOTS; slot++)
+			INIT_LIST_HEAD(&wheel[level][slot]);
+
+	start_ms = timer_now_ms();
+	current = 0;
+	initialized = true;
+}
+
+static void timer_wheel_insert(struct timer *t)
+{
+	uint64_t delta = t->expires - current;
+	int level = 0;
+
+	if (t->expires < current)
+		delta = 0;
+
+	if (delta > TIMER_MAX_TICKS)
+	{
+		delta = TIMER_MAX_TICKS;
+		t->expires = current + delta;
+	}
+
+	while (level < TIMER_LEVELS - 1 && delta >= (1ULL << (TIMER_BITS * (level + 1))))
+		level++;
+
+	/* due timers go into the next slot so they never fire in the past */
+	if (!delta)
+		t->expires = current + 1;
+
+	list_add_tail(&t->list, &wheel[level][(t->expires >> (TIMER_BITS * level)) & TIMER_MASK]);
+}
+
+/* move timers of one higher level slot down to where they belong now */
+static void timer_cascade(int level)
+{
+	struct list_head *slot = &wheel[level][(current >> (TIMER_BITS * level)) & TIMER_MASK];
+	struct list_head list;
+	struct timer *t, *tmp;
+
+	INIT_LIST_HEAD(&list);
+	list_splice_init(slot, &list);
+
+	list_for_each_entry_safe(t, tmp, &list, list)
+	{
+		list_del(&t->list);
+		timer_wheel_insert(t);
+	}
+}
+
+static void timer_advance(void)
+{
+	struct list_head *slot;
+	struct timer *t;
+	int level;
+
+	current++;
+
+	for (level = 1; level < TIMER_LEVELS; level++)
+	{
+		if (current & ((1ULL << (TIMER_BITS * level)) - 1))
+			break;
+
+		timer_cascade(level);
+	}
+
+	slot = &wheel[0][current & TIMER_MASK];
+
+	/* callbacks may arm or cancel any timer, so always restart from the head */
+	while (!list_empty(slot))
+	{
+		t = list_first_entry(slot, struct timer, list);
+
+		list_del(&t->list);
+		t->pending = false;
+		pending--;
+
+		if (t->cb)
+			t->cb(t);
+	}
+}
+
+/* ticks until the next non-empty level 0 slot or the next cascade */
+static unsigned int timer_next_ticks(void)
+{
+	unsigned int i, wrap = TIMER_SLOTS - (current & TIMER_MASK);
+
+	for (i = 1; i < wrap; i++)
+	{
+		if (!list_empty(&wheel[0][(current + i) & TIMER_MASK]))
+			break;
+	}
+
+	return i;
+}
+
+static void timer_schedule(void)
+{
+	uint64_t now_ms = timer_now_ms() - start_ms;
+	uint64_t due_ms = (current + timer_next_ticks()) * TIMER_TICK_MS;
+	int msecs = due_ms > now_ms ? due_ms - now_ms : 0;
+
+	if (running)
+		return;
+
+	if (!tick.pending || uloop_timeout_remaining(&tick) > msecs)
+		uloop_timeout_set(&tick, msecs);
+}
+
+static void timer_tick_cb(struct uloop_timeout *t)
+{
+	uint64_t now = timer_now_ticks();
+
+	running = true;
+
+	while (current < now && pending)
+		timer_advance();
+
+	current = now;
+	running = false;
+
+	if (pending)
+		timer_schedule();
+}
+
+/*
+ * timer_set() - arm or re-arm timer
+ *
+ * @struct timer*:	timer with cb set
+ * @unsigned int:	milliseconds from now, rounded up to TIMER_TICK_MS
+ */
+void timer_set(struct timer *t, unsigned int msecs)
+{
+	uint64_t now_ms;
+
+	if (!initialized)
+		timer_wheel_init();
+
+	if (t->pending)
+		list_del(&t->list);
+	else
+		pending++;
+
+	now_ms = timer_now_ms() - start_ms;
+
+	/* an idle wheel does not tick, catch up before inserting */
+	if (!tick.pending && !running)
+		current = now_ms / TIMER_TICK_MS;
+
+	/* relative to the clock, current may lag while the wheel sleeps */
+	t->expires = (now_ms + msecs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	t->pending = true;
+
+	timer_wheel_insert(t);
+	timer_schedule();
+}
+
+void timer_cancel(struct timer *t)
+{
+	if (!t->pending)
+		return;
+
+	list_del(&t->list);
+	t->pending = false;
+	pending--;
+
+	if (!pending)
+		uloop_timeout_cancel(&tick);
+}
+
+unsigned int timer_count(void)
+{
+	return pending;
+}
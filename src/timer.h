@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_TIMER_H__
+#define __FREENETCONFD_TIMER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libubox/list.h>
+
+/* wheel resolution, timeouts are rounded up to it */
+#define TIMER_TICK_MS 100
+
+struct timer;
+
+typedef void (*timer_handler)(struct timer *t);
+
+struct timer
+{
+	struct list_head list;
+	uint64_t expires;
+	timer_handler cb;
+	bool pending;
+};
+
+void timer_set(struct timer *t, unsigned int msecs);
+void timer_cancel(struct timer *t);
+unsigned int timer_count(void);
+
+#endif /* __FREENETCONFD_TIMER_H__ */
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <libubox/uloop.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "netconfd/netconfd.h"
+
+#include "config.h"
+#include "connection.h"
+#include "monitoring.h"
+#include "tls.h"
+
+/*
+ * NETCONF over TLS, RFC 7589
+ *
+ * Both sides authenticate with certificates. The handshake runs on a thread
+ * per session. If the kernel took over the record layer in both directions
+ * (kTLS) the socket itself is handed to the event loop, which then reads and
+ * writes plain text on it and replies go out without being copied through
+ * OpenSSL. Otherwise the thread stays and relays between the TLS connection
+ * and a socket pair handed to the event loop, like the ssh transport does.
+ *
+ * The context is set up before workers are forked so they share the session
+ * ticket keys and a controller can resume its session on any of them.
+ */
+#define TLS_BRIDGE_BUFFER 16384
+#define TLS_SESSION_CACHE_SIZE 1024
+
+static void tls_accept_cb(struct uloop_fd *fd, unsigned int events);
+
+static struct uloop_fd listener = { .cb = tls_accept_cb, .fd = -1 };
+static SSL_CTX *ctx = NULL;
+
+static void tls_log_errors(const char *what)
+{
+	unsigned long e;
+	char buf[256];
+
+	while ((e = ERR_get_error()))
+	{
+		ERR_error_string_n(e, buf, sizeof(buf));
+		LOG("%s: %s\n", what, buf);
+	}
+}
+
+/* bounds blocking io of the handshake, 0 removes the limit again */
+static void tls_socket_timeout(int fd, int seconds)
+{
+	struct timeval tv = { .tv_sec = seconds };
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int tls_write_all(int fd, const char *buf, int len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return -1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* relay between tls connection and socket pair until either side closes */
+static void tls_bridge(SSL *ssl, int fd)
+{
+	struct pollfd pfd[2] =
+	{
+		{ .fd = SSL_get_fd(ssl), .events = POLLIN },
+		{ .fd = fd, .events = POLLIN },
+	};
+	char buf[TLS_BRIDGE_BUFFER];
+	int n;
+
+	while (1)
+	{
+		/* records already read and decrypted do not show up in poll */
+		while (SSL_has_pending(ssl))
+		{
+			if ((n = SSL_read(ssl, buf, sizeof(buf))) <= 0)
+				return;
+
+			if (tls_write_all(fd, buf, n))
+				return;
+		}
+
+		if (poll(pfd, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		if (pfd[0].revents)
+		{
+			if ((n = SSL_read(ssl, buf, sizeof(buf))) <= 0)
+				return;
+
+			if (tls_write_all(fd, buf, n))
+				return;
+		}
+
+		if (pfd[1].revents)
+		{
+			n = read(fd, buf, sizeof(buf));
+
+			if (n < 0 && errno == EINTR)
+				continue;
+
+			/* session closed by netconfd */
+			if (n <= 0)
+			{
+				SSL_shutdown(ssl);
+				return;
+			}
+
+			if (SSL_write(ssl, buf, n) != n)
+				return;
+		}
+	}
+}
+
+static void *tls_session_thread(void *arg)
+{
+	SSL *ssl = arg;
+	struct handshake *handshake = SSL_get_app_data(ssl);
+	int sfd = SSL_get_fd(ssl), sp[2], rc;
+
+	/* bounds each read, connection_handshake_start() the whole handshake */
+	tls_socket_timeout(sfd, config.hello_timeout > 0 ? config.hello_timeout : 0);
+
+	if (SSL_accept(ssl) != 1)
+	{
+		tls_log_errors("tls handshake failed");
+		goto exit;
+	}
+
+	rc = connection_handshake_done(handshake);
+	handshake = NULL;
+
+	if (rc)
+		goto exit;
+
+	tls_socket_timeout(sfd, 0);
+
+	LOG("tls session established%s\n", SSL_session_reused(ssl) ? " (resumed)" : "");
+
+	/*
+	 * The kernel does the record layer now. Nothing may be left buffered in
+	 * OpenSSL, otherwise it would be lost when the socket changes hands.
+	 */
+	if (BIO_get_ktls_send(SSL_get_wbio(ssl)) && BIO_get_ktls_recv(SSL_get_rbio(ssl)) && !SSL_has_pending(ssl))
+	{
+		DEBUG("using kernel tls\n");
+
+		/* the socket bio does not own the fd, SSL_free() leaves it open */
+		SSL_free(ssl);
+
+		if (connection_handoff(sfd, TRANSPORT_TLS, sfd))
+		{
+			ERROR("unable to hand over tls session\n");
+			close(sfd);
+		}
+
+		return NULL;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sp))
+	{
+		ERROR("unable to create socket pair\n");
+		goto exit;
+	}
+
+	if (connection_handoff(sp[1], TRANSPORT_TLS, sfd))
+	{
+		ERROR("unable to hand over tls session\n");
+		close(sp[0]);
+		close(sp[1]);
+		goto exit;
+	}
+
+	tls_bridge(ssl, sp[0]);
+	close(sp[0]);
+
+exit:
+	if (handshake)
+		connection_handshake_done(handshake);
+
+	SSL_free(ssl);
+	close(sfd);
+
+	return NULL;
+}
+
+static void tls_accept_cb(struct uloop_fd *fd, unsigned int events)
+{
+	struct handshake *handshake;
+	pthread_attr_t attr;
+	pthread_t thread;
+	SSL *ssl;
+	int sfd;
+
+	/* the session thread does blocking io on it */
+	sfd = accept4(fd->fd, NULL, NULL, SOCK_CLOEXEC);
+
+	if (sfd < 0)
+	{
+		ERROR("failed accepting tls connection\n");
+		return;
+	}
+
+	LOG("received new tls connection\n");
+
+	if (!(handshake = connection_handshake_start(sfd)))
+	{
+		close(sfd);
+		return;
+	}
+
+	if (!(ssl = SSL_new(ctx)) || !SSL_set_fd(ssl, sfd))
+	{
+		tls_log_errors("unable to set up tls connection");
+		connection_handshake_done(handshake);
+		SSL_free(ssl);
+		close(sfd);
+		return;
+	}
+
+	SSL_set_app_data(ssl, handshake);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attr, tls_session_thread, ssl))
+	{
+		ERROR("fail to create tls session thread\n");
+		connection_handshake_done(handshake);
+		SSL_free(ssl);
+		close(sfd);
+	}
+
+	pthread_attr_destroy(&attr);
+}
+
+/*
+ * tls_server_init() - set up tls context
+ *
+ * Called before workers are forked. Does nothing unless a certificate is
+ * configured.
+ */
+int tls_server_init(void)
+{
+	static const unsigned char sid_ctx[] = "netconfd";
+
+	if (!config.tls_cert)
+		return 0;
+
+	if (!config.tls_key || !config.tls_ca)
+	{
+		ERROR("tls needs tls_cert, tls_key and tls_ca\n");
+		return -1;
+	}
+
+	if (!(ctx = SSL_CTX_new(TLS_server_method())))
+		goto error;
+
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION);
+
+	if (SSL_CTX_use_certificate_chain_file(ctx, config.tls_cert) != 1 ||
+		SSL_CTX_use_PrivateKey_file(ctx, config.tls_key, SSL_FILETYPE_PEM) != 1 ||
+		SSL_CTX_check_private_key(ctx) != 1)
+		goto error;
+
+	/* clients must present a certificate issued by tls_ca */
+	if (SSL_CTX_load_verify_locations(ctx, config.tls_ca, NULL) != 1)
+		goto error;
+
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+
+	/* resumption through tickets and, within one worker, the session cache */
+	SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(ctx, TLS_SESSION_CACHE_SIZE);
+
+	return 0;
+
+error:
+	tls_log_errors("tls init failed");
+	SSL_CTX_free(ctx);
+	ctx = NULL;
+
+	return -1;
+}
+
+/* open tls listener, called in every worker */
+int tls_server_start(void)
+{
+	if (!ctx)
+		return 0;
+
+	listener.fd = connection_listen(config.addr, config.tls_port);
+
+	if (listener.fd < 0)
+	{
+		ERROR("unable to open tls socket %s:%s\n", config.addr, config.tls_port);
+		return -1;
+	}
+
+	uloop_fd_add(&listener, ULOOP_READ);
+
+	LOG("accepting tls connections on '%s:%s'\n", config.addr, config.tls_port);
+
+	return 0;
+}
+
+void tls_server_exit(void)
+{
+	if (listener.fd >= 0)
+	{
+		uloop_fd_delete(&listener);
+		close(listener.fd);
+		listener.fd = -1;
+	}
+
+	SSL_CTX_free(ctx);
+	ctx = NULL;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_TLS_H__
+#define __FREENETCONFD_TLS_H__
+
+#ifdef ENABLE_TLS
+int tls_server_init(void);
+int tls_server_start(void);
+void tls_server_exit(void);
+#else
+static inline int tls_server_init(void) { return 0; }
+static inline int tls_server_start(void) { return 0; }
+static inline void tls_server_exit(void) { }
+#endif
+
+#endif /* __FREENETCONFD_TLS_H__ */
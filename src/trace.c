@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "netconfd/netconfd.h"
+
+#include "config.h"
+#include "timer.h"
+#include "worker.h"
+#include "trace.h"
+
+/*
+ * Trace capture
+ *
+ * With trace_dir set every worker appends the messages it decodes to a
+ * file of its own in that directory, so real load can be replayed later
+ * by netconfd-replay. Records are collected in a buffer and written when
+ * it is full or a second after the first record in it, the event loop
+ * pays one write() per TRACE_BUFFER bytes. A reload can switch tracing on
+ * and off.
+ */
+#define TRACE_BUFFER (64 * 1024)
+#define TRACE_FLUSH_MS 1000
+#define TRACE_PATH_MAX 4096
+
+int trace_fd = -1;
+
+static char *dir = NULL;
+static char *buffer = NULL;
+static size_t used = 0;
+static uint64_t start_ns = 0;
+
+static void trace_flush_cb(struct timer *t);
+
+static struct timer flush_timer = { .cb = trace_flush_cb };
+
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int trace_write_all(const struct iovec *iov, int n)
+{
+	struct iovec v[2];
+	ssize_t len;
+	int i;
+
+	memcpy(v, iov, n * sizeof(*iov));
+
+	while (n)
+	{
+		len = writev(trace_fd, v, n);
+
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len < 0)
+			return -1;
+
+		for (i = 0; i < n && len >= v[i].iov_len; i++)
+			len -= v[i].iov_len;
+
+		memmove(v, v + i, (n - i) * sizeof(*v));
+		n -= i;
+
+		if (n)
+		{
+			v[0].iov_base = (char *) v[0].iov_base + len;
+			v[0].iov_len -= len;
+		}
+	}
+
+	return 0;
+}
+
+static void trace_close(void)
+{
+	timer_cancel(&flush_timer);
+
+	if (trace_fd >= 0)
+		close(trace_fd);
+
+	trace_fd = -1;
+	used = 0;
+
+	free(buffer);
+	buffer = NULL;
+}
+
+static void trace_flush(void)
+{
+	struct iovec iov = { buffer, used };
+
+	timer_cancel(&flush_timer);
+
+	if (!used)
+		return;
+
+	used = 0;
+
+	if (trace_write_all(&iov, 1))
+	{
+		ERROR("unable to write trace, tracing stopped: %s\n", strerror(errno));
+		trace_close();
+	}
+}
+
+static void trace_flush_cb(struct timer *t)
+{
+	trace_flush();
+}
+
+static int trace_open(const char *path)
+{
+	struct trace_file_header h = { .magic = TRACE_MAGIC, .version = TRACE_VERSION, .worker = worker_id };
+	struct iovec iov = { &h, sizeof(h) };
+
+	if (!(buffer = malloc(TRACE_BUFFER)))
+		return -1;
+
+	if ((trace_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600)) < 0)
+	{
+		trace_close();
+		return -1;
+	}
+
+	h.start_ns = start_ns = trace_now();
+
+	if (trace_write_all(&iov, 1))
+	{
+		trace_close();
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * trace_write() - append message to the trace
+ *
+ * @uint32_t:		session the message belongs to
+ * @int:		TRACE_HELLO, TRACE_RPC or TRACE_CLOSE
+ * @int:		framing of the session
+ * @const char*:	message as handed out by the decoder, NULL for TRACE_CLOSE
+ * @size_t:		its length
+ */
+void trace_write(uint32_t session, int type, int base, const char *msg, size_t len)
+{
+	struct trace_record r = { .ts = trace_now() - start_ns, .session = session, .len = len, .type = type, .base = base };
+	struct iovec iov[2] = { { &r, sizeof(r) }, { (char *) msg, len } };
+
+	if (used + sizeof(r) + len > TRACE_BUFFER)
+		trace_flush();
+
+	if (trace_fd < 0)
+		return;
+
+	/* too large to be buffered, goes out as it is */
+	if (sizeof(r) + len > TRACE_BUFFER)
+	{
+		if (trace_write_all(iov, 2))
+		{
+			ERROR("unable to write trace, tracing stopped: %s\n", strerror(errno));
+			trace_close();
+		}
+
+		return;
+	}
+
+	memcpy(buffer + used, &r, sizeof(r));
+
+	if (len)
+		memcpy(buffer + used + sizeof(r), msg, len);
+
+	used += sizeof(r) + len;
+
+	if (!flush_timer.pending)
+		timer_set(&flush_timer, TRACE_FLUSH_MS);
+}
+
+/*
+ * trace_reload() - follow trace_dir of the configuration
+ *
+ * Starts a new file when tracing is switched on or moved to another
+ * directory, closes the current one when it is switched off.
+ */
+int trace_reload(void)
+{
+	const char *want = config.trace_dir && *config.trace_dir ? config.trace_dir : NULL;
+	char path[TRACE_PATH_MAX];
+
+	if (!want && !dir)
+		return 0;
+
+	if (want && dir && !strcmp(want, dir))
+		return 0;
+
+	trace_exit();
+
+	if (!want)
+		return 0;
+
+	snprintf(path, sizeof(path), "%s/%s-%llu-%d.trace", want, PROJECT_NAME,
+			(unsigned long long) (trace_now() / 1000000000ULL), (int) getpid());
+
+	if (trace_open(path))
+	{
+		ERROR("unable to open trace file '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	dir = strdup(want);
+
+	LOG("tracing to '%s'\n", path);
+
+	return 0;
+}
+
+void trace_exit(void)
+{
+	trace_flush();
+	trace_close();
+
+	free(dir);
+	dir = NULL;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FREENETCONFD_TRACE_H__
+#define __FREENETCONFD_TRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Trace file format, also read by netconfd-replay
+ *
+ * A file header followed by records, each a record header and len bytes
+ * of message. Integers are in host byte order, times in nanoseconds since
+ * start_ns of the file, which is CLOCK_REALTIME so files of several
+ * workers can be merged.
+ */
+#define TRACE_MAGIC "NCTRACE1"
+#define TRACE_VERSION 1
+
+enum trace_type
+{
+	/* hello of the client */
+	TRACE_HELLO,
+	/* rpc as decoded from its framing */
+	TRACE_RPC,
+	/* session gone, no message */
+	TRACE_CLOSE,
+};
+
+struct trace_file_header
+{
+	char magic[8];
+	uint32_t version;
+	int32_t worker;
+	uint64_t start_ns;
+} __attribute__((packed));
+
+struct trace_record
+{
+	uint64_t ts;
+	uint32_t session;
+	uint32_t len;
+	uint8_t type;
+	/* framing of the session, 0 for base:1.0 and 1 for base:1.1 */
+	uint8_t base;
+	uint16_t reserved;
+} __attribute__((packed));
+
+extern int trace_fd;
+
+int trace_reload(void);
+void trace_exit(void);
+void trace_write(uint32_t session, int type, int base, const char *msg, size_t len);
+
+/* called for every message, costs a compare while tracing is off */
+static inline void trace_message(uint32_t session, int type, int base, const char *msg, size_t len)
+{
+	if (trace_fd >= 0)
+		trace_write(session, type, base, msg, len);
+}
+
+#endif /* __FREENETCONFD_TRACE_H__ */
@@ -21,11 +21,122 @@
 #include "netconfd/netconfd.h"
 
 #include "ubus.h"
+#include "worker.h"
+#include "reload.h"
+#include "stats.h"
+#include "notification.h"
+#include "metrics.h"
+#include "monitoring.h"
 
 static struct ubus_context *ubus = NULL;
 static struct ubus_object main_object;
+static char main_object_name[32];
+static struct blob_buf b;
 
-static const struct ubus_method fnd_methods[] = {};
+enum
+{
+	NOTIFY_STREAM,
+	NOTIFY_EVENTS,
+	__NOTIFY_MAX
+};
+
+static const struct blobmsg_policy notify_policy[__NOTIFY_MAX] =
+{
+	[NOTIFY_STREAM] = { .name = "stream", .type = BLOBMSG_TYPE_STRING },
+	[NOTIFY_EVENTS] = { .name = "events", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+static int
+fnd_notify(struct blob_attr *msg)
+{
+	struct blob_attr *tb[__NOTIFY_MAX];
+	const char *stream = NULL;
+
+	blobmsg_parse(notify_policy, __NOTIFY_MAX, tb, blob_data(msg), blob_len(msg));
+
+	if (!tb[NOTIFY_EVENTS])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	if (tb[NOTIFY_STREAM])
+		stream = blobmsg_get_string(tb[NOTIFY_STREAM]);
+
+	if (notification_publish(stream, tb[NOTIFY_EVENTS]) < 0)
+		return UBUS_STATUS_NOT_FOUND;
+
+	return UBUS_STATUS_OK;
+}
+
+/*
+ * fnd_handle_notify() - raise notifications
+ *
+ * { "stream": "netconf", "events": [ { "link-down": { "xmlns": "...", ... } } ] }
+ *
+ * Reaches the subscribers of this worker only, the "netconf.notify" event
+ * with the same message reaches all workers.
+ */
+static int
+fnd_handle_notify(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	return fnd_notify(msg);
+}
+
+static void
+fnd_notify_event_cb(struct ubus_context *ctx, struct ubus_event_handler *ev,
+	const char *type, struct blob_attr *msg)
+{
+	fnd_notify(msg);
+}
+
+static struct ubus_event_handler notify_event = { .cb = fnd_notify_event_cb };
+
+static int
+fnd_handle_stats(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	blob_buf_init(&b, 0);
+	stats_to_blob(&b);
+
+	return ubus_send_reply(ctx, req, b.head);
+}
+
+static int
+fnd_handle_metrics(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	blob_buf_init(&b, 0);
+	metrics_to_blob(&b);
+	monitoring_sessions_to_blob(&b);
+
+	return ubus_send_reply(ctx, req, b.head);
+}
+
+static int
+fnd_handle_metrics_reset(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	metrics_reset();
+
+	return UBUS_STATUS_OK;
+}
+
+static int
+fnd_handle_reload(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	if (reload_request())
+		return UBUS_STATUS_UNKNOWN_ERROR;
+
+	return UBUS_STATUS_OK;
+}
+
+static const struct ubus_method fnd_methods[] = {
+	UBUS_METHOD_NOARG("reload", fnd_handle_reload),
+	UBUS_METHOD("notify", fnd_handle_notify, notify_policy),
+	UBUS_METHOD_NOARG("stats", fnd_handle_stats),
+	UBUS_METHOD_NOARG("metrics", fnd_handle_metrics),
+	UBUS_METHOD_NOARG("metrics_reset", fnd_handle_metrics_reset),
+};
 
 static struct ubus_object_type main_object_type =
 	UBUS_OBJECT_TYPE("freenetconfd", fnd_methods);
@@ -47,13 +158,31 @@ ubus_init(void)
 
 	ubus_add_uloop(ubus);
 
+	/* ubus object names are unique, only the first worker owns "netconf" */
+	if (worker_id > 0)
+	{
+		snprintf(main_object_name, sizeof(main_object_name), "%s.%d", main_object.name, worker_id);
+		main_object.name = main_object_name;
+	}
+
 	if (ubus_add_object(ubus, &main_object)) return -1;
-		
+
+	if (ubus_register_event_handler(ubus, &notify_event, "netconf.notify")) return -1;
+
 	return 0;
 }
 
+/* connection shared with code calling other objects, NULL if not connected */
+struct ubus_context *
+ubus_ctx_get(void)
+{
+	return ubus;
+}
+
 void
 ubus_exit(void)
 {
 	if (ubus) ubus_free(ubus);
+
+	blob_buf_free(&b);
 }
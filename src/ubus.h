@@ -17,7 +17,10 @@
 #ifndef __FREENETCONFD_UBUS_H__
 #define __FREENETCONFD_UBUS_H__
 
+struct ubus_context;
+
 int ubus_init(void);
 void ubus_exit(void);
+struct ubus_context *ubus_ctx_get(void);
 
 #endif /* __FREENETCONFD_UBUS_H__ */
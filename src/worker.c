@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "netconfd/netconfd.h"
+
+#include "worker.h"
+
+int worker_id = 0;
+int worker_count = 1;
+
+static pid_t *workers = NULL;
+static volatile sig_atomic_t worker_stop = 0;
+static volatile sig_atomic_t worker_reload = 0;
+
+static void worker_signal_cb(int sig)
+{
+	if (sig == SIGHUP)
+		worker_reload = 1;
+	else
+		worker_stop = 1;
+}
+
+/* without SA_RESTART, so the signal interrupts waitpid() */
+static void worker_signal(int sig, void (*handler)(int))
+{
+	struct sigaction sa = { .sa_handler = handler };
+
+	sigemptyset(&sa.sa_mask);
+	sigaction(sig, &sa, NULL);
+}
+
+/*
+ * worker_number() - number of workers that will run
+ *
+ * @int:	configured number, 0 for one per allowed cpu
+ */
+int worker_number(int count)
+{
+	cpu_set_t allowed;
+
+	if (count > 0)
+		return count;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return 1;
+
+	return CPU_COUNT(&allowed);
+}
+
+/*
+ * worker_pin() - pin current process to one of the allowed cpus
+ *
+ * @int:	worker index, cpus are assigned round-robin
+ */
+static void worker_pin(int id)
+{
+	cpu_set_t allowed, set;
+	int ncpu, cpu, n = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return;
+
+	ncpu = CPU_COUNT(&allowed);
+
+	if (ncpu <= 0)
+		return;
+
+	id %= ncpu;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+
+		if (n++ == id)
+			break;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	if (sched_setaffinity(0, sizeof(set), &set))
+		ERROR("unable to pin worker %d to cpu %d\n", id, cpu);
+	else
+		DEBUG("worker %d pinned to cpu %d\n", worker_id, cpu);
+}
+
+/*
+ * worker_spawn() - fork event loop process
+ *
+ * @int:	worker index
+ *
+ * Returns 0 in the new worker, pid in the supervisor and -1 on error.
+ */
+static pid_t worker_spawn(int id)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+	{
+		ERROR("unable to fork worker %d\n", id);
+		return -1;
+	}
+
+	if (pid == 0)
+	{
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		/* until the worker installs its reload handler */
+		signal(SIGHUP, SIG_IGN);
+
+		free(workers);
+		workers = NULL;
+
+		worker_id = id;
+		worker_pin(id);
+
+		return 0;
+	}
+
+	workers[id] = pid;
+
+	return pid;
+}
+
+static void worker_signal_all(int sig)
+{
+	int i;
+
+	for (i = 0; i < worker_count; i++)
+	{
+		if (workers[i] > 0)
+			kill(workers[i], sig);
+	}
+}
+
+static void worker_kill_all(void)
+{
+	worker_signal_all(SIGTERM);
+
+	while (waitpid(-1, NULL, 0) > 0 || errno == EINTR);
+}
+
+/*
+ * worker_init() - start multi-reactor mode
+ *
+ * @int:	number of event loops, 0 for one per available cpu
+ *
+ * With a single worker nothing is forked and the caller just runs the event
+ * loop. Otherwise the calling process becomes a supervisor: it forks one
+ * process per worker, each pinned to its own cpu and running its own uloop
+ * with a SO_REUSEPORT listener, restarts workers that crash and passes
+ * SIGHUP on to all of them.
+ *
+ * Returns 0 in the event loop processes, 1 in the supervisor once all
+ * workers have stopped and -1 on error.
+ */
+int worker_init(int count)
+{
+	int i, status, rc = 1;
+	pid_t pid;
+
+	worker_count = worker_number(count);
+
+	if (worker_count <= 1)
+		return 0;
+
+	workers = calloc(worker_count, sizeof(*workers));
+
+	if (!workers)
+		return -1;
+
+	worker_signal(SIGINT, worker_signal_cb);
+	worker_signal(SIGTERM, worker_signal_cb);
+	worker_signal(SIGHUP, worker_signal_cb);
+
+	for (i = 0; i < worker_count; i++)
+	{
+		pid = worker_spawn(i);
+
+		if (pid == 0)
+			return 0;
+
+		if (pid < 0)
+		{
+			rc = -1;
+			goto exit;
+		}
+	}
+
+	LOG("started %d workers\n", worker_count);
+
+	while (!worker_stop)
+	{
+		if (worker_reload)
+		{
+			worker_reload = 0;
+			worker_signal_all(SIGHUP);
+		}
+
+		pid = waitpid(-1, &status, 0);
+
+		if (pid < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		for (i = 0; i < worker_count; i++)
+		{
+			if (workers[i] == pid)
+				break;
+		}
+
+		if (i == worker_count)
+			continue;
+
+		workers[i] = 0;
+
+		/* clean exit or startup failure, respawning would not help */
+		if (WIFEXITED(status))
+		{
+			ERROR("worker %d exited with status %d\n", i, WEXITSTATUS(status));
+			break;
+		}
+
+		ERROR("worker %d terminated by signal %d, restarting\n", i, WTERMSIG(status));
+
+		if (worker_spawn(i) == 0)
+			return 0;
+	}
+
+exit:
+	worker_kill_all();
+
+	free(workers);
+	workers = NULL;
+
+	return rc;
+}
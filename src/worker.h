@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_WORKER_H__
+#define __FREENETCONFD_WORKER_H__
+
+/* index of this event loop process and total number of them */
+extern int worker_id;
+extern int worker_count;
+
+int worker_number(int count);
+int worker_init(int count);
+
+#endif /* __FREENETCONFD_WORKER_H__ */
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <libubox/blobmsg.h>
+
+#include "xml.h"
+
+void xml_buf_append(struct xml_buf *b, const char *s, size_t len)
+{
+	size_t size;
+	char *data;
+
+	if (b->error)
+		return;
+
+	if (b->len + len + 1 > b->size)
+	{
+		size = b->size ? b->size * 2 : 512;
+
+		while (size < b->len + len + 1)
+			size *= 2;
+
+		if (!(data = realloc(b->data, size)))
+		{
+			b->error = true;
+			return;
+		}
+
+		b->data = data;
+		b->size = size;
+	}
+
+	memcpy(b->data + b->len, s, len);
+	b->len += len;
+	b->data[b->len] = '\0';
+}
+
+void xml_buf_puts(struct xml_buf *b, const char *s)
+{
+	xml_buf_append(b, s, strlen(s));
+}
+
+/* text and attribute values, runs without special characters are copied as is */
+void xml_buf_escape(struct xml_buf *b, const char *s)
+{
+	const char *run = s, *rep;
+
+	for (; *s; s++)
+	{
+		switch (*s)
+		{
+			case '<': rep = "&lt;"; break;
+			case '>': rep = "&gt;"; break;
+			case '&': rep = "&amp;"; break;
+			case '"': rep = "&quot;"; break;
+			default: continue;
+		}
+
+		xml_buf_append(b, run, s - run);
+		xml_buf_puts(b, rep);
+		run = s + 1;
+	}
+
+	xml_buf_append(b, run, s - run);
+}
+
+static void xml_buf_table(struct xml_buf *b, struct blob_attr *attr, const char *name)
+{
+	struct blob_attr *cur;
+	int rem;
+
+	xml_buf_puts(b, "<");
+	xml_buf_puts(b, name);
+
+	/* "xmlns" members become the element's namespace */
+	blobmsg_for_each_attr(cur, attr, rem)
+	{
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING || strcmp(blobmsg_name(cur), "xmlns"))
+			continue;
+
+		xml_buf_puts(b, " xmlns=\"");
+		xml_buf_escape(b, blobmsg_get_string(cur));
+		xml_buf_puts(b, "\"");
+	}
+
+	xml_buf_puts(b, ">");
+
+	blobmsg_for_each_attr(cur, attr, rem)
+	{
+		if (!strcmp(blobmsg_name(cur), "xmlns"))
+			continue;
+
+		xml_buf_blob(b, cur, blobmsg_name(cur));
+	}
+
+	xml_buf_puts(b, "</");
+	xml_buf_puts(b, name);
+	xml_buf_puts(b, ">");
+}
+
+/*
+ * xml_buf_blob() - render blobmsg value as element
+ *
+ * Tables become elements with children, arrays repeat the element once per
+ * item and scalars become text content.
+ */
+void xml_buf_blob(struct xml_buf *b, struct blob_attr *attr, const char *name)
+{
+	struct blob_attr *cur;
+	char num[32];
+	int rem;
+
+	if (!name || !*name)
+		return;
+
+	switch (blobmsg_type(attr))
+	{
+		case BLOBMSG_TYPE_TABLE:
+			xml_buf_table(b, attr, name);
+			return;
+
+		case BLOBMSG_TYPE_ARRAY:
+			blobmsg_for_each_attr(cur, attr, rem)
+				xml_buf_blob(b, cur, name);
+			return;
+
+		case BLOBMSG_TYPE_STRING:
+			xml_buf_puts(b, "<");
+			xml_buf_puts(b, name);
+			xml_buf_puts(b, ">");
+			xml_buf_escape(b, blobmsg_get_string(attr));
+			xml_buf_puts(b, "</");
+			xml_buf_puts(b, name);
+			xml_buf_puts(b, ">");
+			return;
+
+		case BLOBMSG_TYPE_INT64:
+			snprintf(num, sizeof(num), "%" PRId64, (int64_t) blobmsg_get_u64(attr));
+			break;
+
+		case BLOBMSG_TYPE_INT32:
+			snprintf(num, sizeof(num), "%" PRId32, (int32_t) blobmsg_get_u32(attr));
+			break;
+
+		case BLOBMSG_TYPE_INT16:
+			snprintf(num, sizeof(num), "%d", (int16_t) blobmsg_get_u16(attr));
+			break;
+
+		case BLOBMSG_TYPE_INT8:
+			snprintf(num, sizeof(num), "%s", blobmsg_get_bool(attr) ? "true" : "false");
+			break;
+
+		case BLOBMSG_TYPE_DOUBLE:
+			snprintf(num, sizeof(num), "%.17g", blobmsg_get_double(attr));
+			break;
+
+		default:
+			return;
+	}
+
+	xml_buf_puts(b, "<");
+	xml_buf_puts(b, name);
+	xml_buf_puts(b, ">");
+	xml_buf_puts(b, num);
+	xml_buf_puts(b, "</");
+	xml_buf_puts(b, name);
+	xml_buf_puts(b, ">");
+}
+
+/* every member of a table as one element, in order */
+void xml_buf_members(struct xml_buf *b, struct blob_attr *table)
+{
+	struct blob_attr *cur;
+	int rem;
+
+	blobmsg_for_each_attr(cur, table, rem)
+		xml_buf_blob(b, cur, blobmsg_name(cur));
+}
+
+void xml_buf_free(struct xml_buf *b)
+{
+	free(b->data);
+	memset(b, 0, sizeof(*b));
+}
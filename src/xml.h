@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2014 Cisco Systems, Inc.
+ *
+ * Author: Luka Perkov <luka.perkov@sartura.hr>
+ * Author: Petar Koretic <petar.koretic@sartura.hr>
+ *
+ * freenetconfd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freenetconfd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FREENETCONFD_XML_H__
+#define __FREENETCONFD_XML_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct blob_attr;
+
+/* growing string buffer, error is set once an allocation failed */
+struct xml_buf
+{
+	char *data;
+	size_t len;
+	size_t size;
+	bool error;
+};
+
+void xml_buf_append(struct xml_buf *b, const char *s, size_t len);
+void xml_buf_puts(struct xml_buf *b, const char *s);
+void xml_buf_escape(struct xml_buf *b, const char *s);
+void xml_buf_blob(struct xml_buf *b, struct blob_attr *attr, const char *name);
+void xml_buf_members(struct xml_buf *b, struct blob_attr *table);
+void xml_buf_free(struct xml_buf *b);
+
+#endif /* __FREENETCONFD_XML_H__ */